@@ -7,6 +7,7 @@ Computes higher order entropy for Von Neumann neighborhoods (r=10) around each c
 import csv
 import brotli
 import math
+import struct
 from pathlib import Path
 import glob
 from collections import defaultdict
@@ -119,6 +120,46 @@ def read_token_csv(csv_path):
     return epoch, width, height, grid_programs
 
 
+def read_token_snapshot(snapshot_path):
+    """
+    Read a binary token snapshot (.bffs) written with snapshot_format: binary.
+
+    Returns the same (epoch, width, height, grid_programs) as read_token_csv.
+    """
+    with open(snapshot_path, 'rb') as f:
+        data = f.read()
+
+    if data[:4] != b'BFFS':
+        raise ValueError(f"Not a snapshot file: {snapshot_path}")
+
+    kind, num_blocks, epoch, width, height, program_size = struct.unpack_from('<IIqIII', data, 8)
+    if kind != 2:
+        raise ValueError(f"Not a token snapshot: {snapshot_path}")
+
+    # Blocks: type, codec, raw size, stored size, then the payload padded to 8 bytes
+    offset = 64
+    tokens = None
+    for _ in range(num_blocks):
+        block_type, codec, raw_size, stored_size = struct.unpack_from('<IIQQ', data, offset)
+        offset += 32
+        payload = data[offset:offset + stored_size]
+        if block_type == 2:
+            tokens = brotli.decompress(payload) if codec == 1 else payload
+        offset += (stored_size + 7) & ~7
+
+    if tokens is None:
+        raise ValueError(f"Snapshot has no token block: {snapshot_path}")
+
+    # Bits 0-7 of each little-endian token hold the character
+    chars = tokens[::8]
+    grid_programs = {}
+    for idx in range(width * height):
+        start = idx * program_size
+        grid_programs[(idx % width, idx // width)] = list(chars[start:start + program_size])
+
+    return epoch, width, height, grid_programs
+
+
 def analyze_epoch(csv_path, radius=10):
     """
     Analyze one epoch's token data.
@@ -132,8 +173,11 @@ def analyze_epoch(csv_path, radius=10):
     """
     print(f"Analyzing {csv_path}...")
 
-    # Read CSV
-    epoch, width, height, grid_programs = read_token_csv(csv_path)
+    # Read CSV or binary snapshot
+    if csv_path.endswith('.bffs'):
+        epoch, width, height, grid_programs = read_token_snapshot(csv_path)
+    else:
+        epoch, width, height, grid_programs = read_token_csv(csv_path)
 
     print(f"  Grid size: {width}x{height}, Epoch: {epoch}")
 
@@ -193,12 +237,16 @@ def save_results(all_results, output_path):
 
 def main():
     """Main analysis function."""
-    # Find all token CSV files
+    # Find all token files; a binary snapshot wins over a CSV of the same epoch
     token_dir = Path("data/tokens")
-    csv_files = sorted(glob.glob(str(token_dir / "tokens_epoch_*.csv")))
+    files_by_epoch = {}
+    for pattern in ("tokens_epoch_*.csv", "tokens_epoch_*.bffs"):
+        for path in glob.glob(str(token_dir / pattern)):
+            files_by_epoch[Path(path).stem] = path
+    csv_files = [files_by_epoch[stem] for stem in sorted(files_by_epoch)]
 
     if not csv_files:
-        print("No token CSV files found in data/tokens/")
+        print("No token files found in data/tokens/")
         return
 
     print(f"Found {len(csv_files)} token files")
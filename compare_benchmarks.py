@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+"""
+Compare two bffpp_bench JSON results.
+Prints the change in time per operation for every benchmark in both files and
+exits with status 1 if any got slower than the threshold.
+"""
+
+import json
+import sys
+
+
+def load_results(path):
+    """Read a bffpp_bench --format json file into name -> result."""
+    with open(path) as f:
+        data = json.load(f)
+    return data, {b['name']: b for b in data['benchmarks']}
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("Usage: compare_benchmarks.py BASELINE.json CURRENT.json [THRESHOLD_PERCENT]")
+        return 2
+
+    threshold = float(sys.argv[3]) if len(sys.argv) > 3 else 10.0
+    base_data, baseline = load_results(sys.argv[1])
+    current_data, current = load_results(sys.argv[2])
+
+    print(f"Baseline: {base_data.get('timestamp', '?')}  Current: {current_data.get('timestamp', '?')}")
+    print(f"{'benchmark':<48}{'baseline ns':>16}{'current ns':>16}{'change':>10}")
+
+    regressions = []
+    for name, result in current.items():
+        if name not in baseline:
+            continue
+        before = baseline[name]['ns_per_op']
+        after = result['ns_per_op']
+        change = (after - before) / before * 100.0 if before > 0 else 0.0
+        flag = "  SLOWER" if change > threshold else ""
+        print(f"{name:<48}{before:>16.1f}{after:>16.1f}{change:>+9.1f}%{flag}")
+        if change > threshold:
+            regressions.append(name)
+
+    for name in sorted(set(baseline) - set(current)):
+        print(f"{name:<48}  (missing from current run)")
+
+    if regressions:
+        print(f"\n{len(regressions)} benchmark(s) more than {threshold:.0f}% slower")
+        return 1
+    print(f"\nNo benchmark more than {threshold:.0f}% slower")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,59 @@
+#ifndef BACKGROUND_WRITER_H
+#define BACKGROUND_WRITER_H
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+// Bounded queue of write jobs run by background threads
+//
+// What SnapshotWriter, CheckpointWriter and OutputPipeline share: a job
+// is a function that writes one file from data it owns, so the caller only
+// pays for copying that data out. At most capacity jobs wait in the queue;
+// submit() blocks while it is full and try_submit() gives up instead. An
+// exception thrown by a job is reported on std::cerr as "Failed to write
+// <what>: ..." and counted. With one thread, jobs run in submission order.
+// flush() waits for the queue to drain and the destructor finishes every
+// queued job before joining.
+class BackgroundWriter {
+public:
+    BackgroundWriter(unsigned int threads, size_t capacity, const std::string& what);
+    ~BackgroundWriter();
+
+    BackgroundWriter(const BackgroundWriter&) = delete;
+    BackgroundWriter& operator=(const BackgroundWriter&) = delete;
+
+    void submit(std::function<void()> job);
+
+    // Queue the job unless the queue is full; returns whether it was queued
+    bool try_submit(std::function<void()> job);
+
+    // Wait until every job submitted so far has run
+    void flush();
+
+    // Number of jobs that failed so far
+    size_t failures() const;
+
+private:
+    bool enqueue(std::function<void()>& job, bool may_give_up);
+    void run();
+
+    size_t capacity;
+    std::string what;
+
+    std::deque<std::function<void()>> queue;
+    size_t running;
+    bool stopping;
+    size_t failed;
+
+    mutable std::mutex mutex;
+    std::condition_variable queue_changed;
+    std::vector<std::thread> workers;
+};
+
+#endif // BACKGROUND_WRITER_H
@@ -0,0 +1,68 @@
+#ifndef BRACKET_INDEX_H
+#define BRACKET_INDEX_H
+
+#include <vector>
+#include <cstdint>
+
+// Bracket-jump index shared by emulate() and emulate_w_tracer()
+//
+// Holds, for every '[' and ']' on the tape, the position of its matching
+// partner, so a jump is a single table lookup instead of a linear scan.
+// Matching follows exactly the same rules as the scanning emulator: a '['
+// pairs with the first ']' that balances it going forwards, a ']' with the
+// first '[' that balances it going backwards, and brackets with no such
+// partner are reported as unmatched.
+//
+// The table only depends on where brackets sit on the tape, so writes that
+// neither remove nor create a bracket leave it valid. Writes that do are
+// reported with note_write(), which marks the table stale; it is rebuilt
+// lazily on the next jump.
+class BracketIndex {
+public:
+    static constexpr int UNMATCHED = -1;
+
+    static bool is_bracket(uint8_t ch) { return ch == '[' || ch == ']'; }
+
+    // Build the table from a tape whose i-th instruction byte is char_at(i)
+    template <typename CharAt>
+    void rebuild(int tape_size, CharAt char_at) {
+        match.assign(tape_size, UNMATCHED);
+        open_stack.clear();
+
+        for (int i = 0; i < tape_size; i++) {
+            uint8_t ch = char_at(i);
+            if (ch == '[') {
+                open_stack.push_back(i);
+            } else if (ch == ']' && !open_stack.empty()) {
+                int open_pos = open_stack.back();
+                open_stack.pop_back();
+                match[open_pos] = i;
+                match[i] = open_pos;
+            }
+        }
+
+        stale = false;
+    }
+
+    // Record a write of new_ch over old_ch; only bracket changes invalidate
+    void note_write(uint8_t old_ch, uint8_t new_ch) {
+        if (is_bracket(old_ch) || is_bracket(new_ch)) {
+            stale = true;
+        }
+    }
+
+    // Force a rebuild before the next lookup (e.g. when reused for a new tape)
+    void invalidate() { stale = true; }
+
+    bool is_stale() const { return stale; }
+
+    // Position of the bracket matching the one at pos, or UNMATCHED
+    int partner(int pos) const { return match[pos]; }
+
+private:
+    std::vector<int> match;
+    std::vector<int> open_stack;
+    bool stale = true;
+};
+
+#endif // BRACKET_INDEX_H
@@ -0,0 +1,66 @@
+#ifndef BYTE_ORDER_H
+#define BYTE_ORDER_H
+
+#include <cstdint>
+#include <cstring>
+
+// Little-endian fields of the binary formats (snapshots, checkpoints,
+// replicator caches, live grid frames, lineage archives)
+//
+// Headers use these to be byte-order independent. Bulk payloads are
+// copied as host integers instead; the simulation tools only run on
+// little-endian machines, and the readers check host_is_little_endian()
+// to reject anything else.
+namespace byte_order {
+
+inline void put_u32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+inline void put_u64(uint8_t* out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+inline uint32_t get_u32(const uint8_t* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= static_cast<uint32_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+inline uint64_t get_u64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+inline void put_f64(uint8_t* out, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_u64(out, bits);
+}
+
+inline double get_f64(const uint8_t* in) {
+    uint64_t bits = get_u64(in);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline bool host_is_little_endian() {
+    const uint32_t probe = 1;
+    uint8_t first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+} // namespace byte_order
+
+#endif // BYTE_ORDER_H
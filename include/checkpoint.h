@@ -0,0 +1,97 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <random>
+#include "snapshot.h"
+#include "background_writer.h"
+
+// Resumable run state (.bffc)
+//
+// A checkpoint holds everything a driver needs to carry on after a given
+// epoch as if it had never stopped: the programs (or tracer tokens) of each
+// soup/grid, the state of every std::mt19937 it draws from, and the
+// histories it has recorded so far. With counter_rng the engines are not
+// used, but they are stored all the same.
+//
+// On disk: a 64-byte header, then sections, each a 16-byte section header
+// and its payload padded to 8 bytes. Integers are little-endian.
+//
+//   header:   "BFFC" | version | num_sections | epoch | base_epoch | driver (32 bytes)
+//   section:  type | index | size | payload
+//
+// A full checkpoint (base_epoch -1) stores every program. An incremental
+// one stores, for each grid, only the programs that differ from the last
+// full checkpoint (or all of them, when that would be no larger), and the
+// file name of that checkpoint, which must sit in the same directory;
+// read_checkpoint() loads both.
+
+constexpr char CHECKPOINT_MAGIC[4] = {'B', 'F', 'F', 'C'};
+constexpr uint32_t CHECKPOINT_VERSION = 1;
+
+struct Checkpoint {
+    std::string driver;           // Executable that wrote it (at most 32 characters)
+    int64_t epoch = 0;            // Epochs completed; the run resumes with this one
+    std::vector<Snapshot> grids;  // Programs or tokens of each grid, in the driver's order
+    std::vector<std::string> rng_states;        // See rng_state()
+    std::vector<std::vector<double>> histories;  // Recorded series, in the driver's order
+};
+
+// An engine's state in the standard text form, and back
+std::string rng_state(const std::mt19937& rng);
+void restore_rng_state(std::mt19937& rng, const std::string& state);
+
+// directory/<driver>_epoch_NNNNNN.bffc
+std::string checkpoint_path(const std::string& directory, const std::string& driver, int64_t epoch);
+
+// Write a full checkpoint, or an incremental one against base (written to
+// base_path earlier); the file is written under a temporary name and
+// renamed, so a reader never sees a part-written checkpoint
+void write_checkpoint(const std::string& filepath, const Checkpoint& checkpoint,
+                      const Checkpoint* base = nullptr, const std::string& base_path = "");
+
+// Read a checkpoint, following an incremental one to its full base
+Checkpoint read_checkpoint(const std::string& filepath);
+
+// Throws std::runtime_error unless checkpoint was written by driver and
+// holds grids grids of width x height programs of program_size cells
+void check_checkpoint(const Checkpoint& checkpoint, const std::string& driver, size_t grids,
+                      int width, int height, int program_size);
+
+// Writes checkpoints on a background thread
+//
+// Works like SnapshotWriter, on a BackgroundWriter of its own: submit()
+// queues a filled checkpoint and only blocks while max_pending are waiting. Every full_interval-th checkpoint
+// is full (the first one always is, and so is one whose grids changed
+// shape); the ones in between are incremental against the last full one,
+// which the writer keeps a copy of. Write errors are reported on std::cerr;
+// a failed full checkpoint makes the next one full again.
+class CheckpointWriter {
+public:
+    explicit CheckpointWriter(int full_interval = 10, size_t max_pending = 2);
+
+    void submit(const std::string& filepath, Checkpoint checkpoint);
+    void flush() { writer.flush(); }
+
+    // Number of checkpoints that failed to write so far
+    size_t failures() const { return writer.failures(); }
+
+private:
+    // Write one checkpoint, full or against the base (on the writer thread)
+    void write(const std::string& filepath, Checkpoint& checkpoint);
+
+    int full_interval;
+
+    // Writer thread only
+    int written;
+    Checkpoint base;
+    std::string base_path;
+
+    // Last, so its thread is joined before the base goes away
+    BackgroundWriter writer;
+};
+
+#endif // CHECKPOINT_H
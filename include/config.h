@@ -19,6 +19,35 @@ struct Config {
     int grid_height;
     bool use_grid;
     int visualization_interval;
+
+    // Performance parameters
+    int num_threads;  // Worker threads incl. the main thread (0 = all cores)
+    bool counter_rng; // Counter-based RNG streams (thread-count independent)
+    bool fused_mutation; // Mutate inside the emulation task (needs counter_rng)
+    std::string emulator_backend; // "scalar", "predecoded" or "batch" (lockstep pairs)
+    bool cycle_detection; // Skip the repeats of loops that write nothing (same results)
+    int pair_cache_size;  // Remember this many pair emulations for identical pairs (0 = off)
+    std::string pairing; // "sequential" or "tiled" (parallel grid pairing, needs counter_rng)
+    bool numa_tiles;     // Pinned worker group and band of rows per NUMA node (needs counter_rng)
+    std::string soup_file; // Keep the soup in this memory-mapped file ("" = in memory)
+    int stream_shard_pairs; // Pairs per shard of an epoch over a mapped soup
+
+    // Metrics parameters
+    int brotli_quality;  // Brotli quality for the complexity estimate (0-11)
+    int brotli_window;   // Brotli window bits (10-24)
+    int hoe_shards;      // Compress the soup in this many parallel shards
+
+    // Output parameters
+    std::string snapshot_format;      // "csv" or "binary" (.bffs) epoch dumps
+    std::string snapshot_compression; // "none" or "brotli", per snapshot block
+    int checkpoint_interval;          // Write a resumable checkpoint every N epochs (0 = never)
+    int checkpoint_full_interval;     // Every Nth checkpoint is full, the others incremental
+    std::string live_frames;          // "json" or "binary" (grid_frame.h) WebSocket updates
+    bool token_lineage;               // Per-cell lineage statistics and archive (tracer only)
+    int output_threads;               // Background writers for output files (0 = write inline)
+    int output_queue;                 // Output jobs that may wait for a writer
+    std::string output_backpressure;  // "block" or "drop_frames" when the output queue is full
+    int profile_interval;             // Report phase times and counters every N epochs (0 = never)
 };
 
 Config load_config(const std::string& filename);
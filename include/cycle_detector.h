@@ -0,0 +1,73 @@
+#ifndef CYCLE_DETECTOR_H
+#define CYCLE_DETECTOR_H
+
+// Loop detection shared by the emulators (Brent's algorithm)
+//
+// Every step depends only on the program counter, the two heads and the
+// tape. A run that comes back to the same pc and heads without writing to
+// the tape in between (e.g. "[]" on a non-zero cell) therefore repeats that
+// stretch until max_iter, changing nothing. The detector keeps one saved
+// state and compares it after each step; the saved state moves up to the
+// current one whenever the number of steps since it was saved reaches the
+// next power of two, so a loop of L steps is found within about 2L steps of
+// entering it. A write (note_write()) starts the search over.
+//
+// When check() reports a repeat, skip_repeats() advances the counters past
+// every whole repetition that still fits in max_iter. The emulator then
+// runs the last partial repetition normally, so the final tape, heads and
+// counters are exactly those of the full run.
+class CycleDetector {
+public:
+    enum class Check { None, Saved, Repeated };
+
+    // Record a write to the tape
+    void note_write() { written = true; }
+
+    // State after a step, with the counters so far
+    Check check(int pc_pos, int head0_pos, int head1_pos, int iteration, int skipped) {
+        if (!written) {
+            steps++;
+            if (pc_pos == pc && head0_pos == head0 && head1_pos == head1) {
+                return Check::Repeated;
+            }
+            if (steps < power) {
+                return Check::None;
+            }
+            power *= 2;
+        } else {
+            power = 1;
+            written = false;
+        }
+        pc = pc_pos;
+        head0 = head0_pos;
+        head1 = head1_pos;
+        saved_iteration = iteration;
+        saved_skipped = skipped;
+        steps = 0;
+        return Check::Saved;
+    }
+
+    // After Check::Repeated: add every whole repetition of the loop that
+    // fits in max_iter to the counters, and return how many that was
+    int skip_repeats(int& iteration, int& skipped, int max_iter) {
+        int loop_iterations = iteration - saved_iteration;
+        int loop_skipped = skipped - saved_skipped;
+        int repeats = (max_iter - iteration) / loop_iterations;
+        iteration += repeats * loop_iterations;
+        skipped += repeats * loop_skipped;
+        written = true;  // Search again from here
+        return repeats;
+    }
+
+private:
+    bool written = true;  // Nothing saved yet
+    int pc = -1;
+    int head0 = 0;
+    int head1 = 0;
+    int saved_iteration = 0;
+    int saved_skipped = 0;
+    int power = 1;
+    int steps = 0;
+};
+
+#endif // CYCLE_DETECTOR_H
@@ -5,6 +5,28 @@
 #include <cstdint>
 #include <string>
 
+// Outcome of a run, as an enum so result loops don't compare strings
+enum class EmulatorStatus {
+    Finished,        // Program counter ran off the end of the tape
+    Terminated,      // max_iter reached
+    UnmatchedOpen,   // Jump from a '[' with no matching ']'
+    UnmatchedClose   // Jump from a ']' with no matching '['
+};
+
+// Interpreter behind the in-place entry points. Every backend produces
+// exactly the same tapes and counters.
+enum class EmulatorBackend {
+    Scalar,      // One byte at a time through an if/else chain
+    Predecoded   // Opcode stream with folded runs and jump-table dispatch
+};
+
+// Counters reported by the in-place emulator
+struct EmulatorStats {
+    EmulatorStatus status;
+    int iteration;
+    int skipped;
+};
+
 struct EmulatorResult {
     std::vector<uint8_t> tape;
     std::string state;
@@ -12,13 +34,105 @@ struct EmulatorResult {
     int skipped;
 };
 
+// With detect_cycles, a run that returns to the same program counter and
+// head positions without writing in between skips the repeats of that loop
+// (cycle_detector.h). Tape and counters are exactly those of the full run;
+// every entry point below takes the same flag.
 EmulatorResult emulate(
     std::vector<uint8_t> tape,
     int head0_pos = 0,
     int head1_pos = 0,
     int pc_pos = 0,
     int max_iter = 8192,
-    int verbose = 0
+    int verbose = 0,
+    bool detect_cycles = false
+);
+
+// Legacy string form of a status ("Finished", "Terminated", "Error, Unmatched [", ...)
+const char* emulator_status_name(EmulatorStatus status);
+
+// Zero-allocation entry point: runs directly on a caller-owned tape of
+// tape_size bytes, leaving the final tape in place
+EmulatorStats emulate_in_place(
+    uint8_t* tape,
+    int tape_size,
+    int head0_pos = 0,
+    int head1_pos = 0,
+    int pc_pos = 0,
+    int max_iter = 8192,
+    int verbose = 0,
+    bool detect_cycles = false
+);
+
+// emulate_in_place() for a tape of exactly TapeSize bytes, compiled for
+// that size: heads wrap with a mask and the tape is copied into a local
+// array. Instantiated for 32, 64, 128 and 256; emulate_pair_in_place()
+// picks these automatically for the scalar backend.
+template <int TapeSize>
+EmulatorStats emulate_fixed_in_place(
+    uint8_t* tape,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos,
+    int max_iter,
+    bool detect_cycles = false
+);
+
+// emulate_in_place() on the pre-decoded backend: the tape is decoded once
+// into opcodes and run lengths, so runs of no-ops and of repeated
+// '+', '-', '<', '>', '{', '}' take a single dispatch each. Self-modifying
+// writes re-decode the bytes they change.
+EmulatorStats emulate_predecoded_in_place(
+    uint8_t* tape,
+    int tape_size,
+    int head0_pos = 0,
+    int head1_pos = 0,
+    int pc_pos = 0,
+    int max_iter = 8192,
+    bool detect_cycles = false
+);
+
+// Same, for a tape made of two separately stored programs of program_size
+// bytes each (tape = programA + programB); both are updated in place
+EmulatorStats emulate_pair_in_place(
+    uint8_t* programA,
+    uint8_t* programB,
+    int program_size,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos = 0,
+    int max_iter = 8192,
+    EmulatorBackend backend = EmulatorBackend::Scalar,
+    bool detect_cycles = false
+);
+
+// One pair for emulate_batch(): the tape is programA + programB, both
+// updated in place, and the run's counters are stored in *stats
+struct EmulatorJob {
+    uint8_t* programA;
+    uint8_t* programB;
+    EmulatorStats* stats;
+};
+
+// Lanes emulate_batch() runs in lockstep
+constexpr int EMULATOR_BATCH_LANES = 32;
+
+// Runs every job exactly like emulate_pair_in_place() with the same
+// arguments. On CPUs with AVX-512, EMULATOR_BATCH_LANES pairs run in
+// lockstep, one instruction per lane per step; a lane whose pair stops is
+// refilled with the next job, and the last few stragglers are finished on
+// the scalar emulator. Elsewhere the jobs simply run one after another.
+// All pairs share program_size and the starting positions. detect_cycles
+// applies to the scalar runs only; the vector lanes run every step.
+void emulate_batch(
+    const EmulatorJob* jobs,
+    size_t count,
+    int program_size,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos = 0,
+    int max_iter = 8192,
+    bool detect_cycles = false
 );
 
 #endif // EMULATOR_H
@@ -43,14 +43,16 @@ struct EmulatorResultWithTracer {
     std::string state;            // Final state: "Finished", "Terminated", or "Running"
 };
 
-// Emulator with tracer - tracks character lineage through tokens
+// Emulator with tracer - tracks character lineage through tokens.
+// detect_cycles works as for emulate() (emulator.h)
 EmulatorResultWithTracer emulate_w_tracer(
     std::vector<Token> tape,
     int head0_pos = 0,
     int head1_pos = 0,
     int pc_pos = 0,
     int max_iter = 8192,
-    int verbose = 0
+    int verbose = 0,
+    bool detect_cycles = false
 );
 
 // Helper function: Initialize tokens for a tape (epoch 0)
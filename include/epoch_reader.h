@@ -0,0 +1,74 @@
+#ifndef EPOCH_READER_H
+#define EPOCH_READER_H
+
+#include "span.h"
+#include "mapped_file.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <future>
+
+// One epoch of a pairing or token dump, laid out on the grid
+//
+// Cell (x, y) lives at index y * width + x. All programs share one flat
+// buffer with a stride of program_size (the longest program in the file);
+// lengths says how much of each slot is used, and -1 marks cells the file
+// did not mention. Pairing dumps also fill partners with the flat index of
+// the cell each program was paired with (-1 = mutation only).
+struct EpochGrid {
+    int epoch = -1;
+    int width = 0;
+    int height = 0;
+    int program_size = 0;
+
+    std::vector<uint8_t> programs;
+    std::vector<int32_t> lengths;
+    std::vector<int32_t> partners;
+
+    bool has(int x, int y) const {
+        return x >= 0 && x < width && y >= 0 && y < height && lengths[y * width + x] >= 0;
+    }
+
+    // Program bytes at (x, y); has(x, y) must be true
+    Span<const uint8_t> program(int x, int y) const {
+        int idx = y * width + x;
+        return Span<const uint8_t>(programs.data() + static_cast<size_t>(idx) * program_size, lengths[idx]);
+    }
+
+    std::string program_string(int x, int y) const {
+        Span<const uint8_t> bytes = program(x, y);
+        return std::string(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+};
+
+// Pairing dump (pairings_epoch_*.csv or .bffs). Programs are returned as
+// written (quotes removed from CSV fields, raw bytes from snapshots).
+EpochGrid read_pairing_epoch(const std::string& filepath);
+
+// Token dump (tokens_epoch_*.csv or .bffs); programs hold the token characters
+EpochGrid read_token_epoch(const std::string& filepath);
+
+// Reads epoch files one step ahead on a background thread
+//
+// read(path, next_path) returns the epoch at path, from the background
+// read if it was the one prefetched and synchronously otherwise, then
+// starts reading next_path (pass "" at the end of the range). Read errors
+// are thrown from the read() call for that path, as if read directly.
+class EpochPrefetcher {
+public:
+    using Reader = std::function<EpochGrid(const std::string&)>;
+
+    explicit EpochPrefetcher(Reader reader);
+    ~EpochPrefetcher();
+
+    EpochGrid read(const std::string& filepath, const std::string& next_filepath = "");
+
+private:
+    Reader reader;
+    std::string pending_path;
+    std::future<EpochGrid> pending;
+};
+
+#endif // EPOCH_READER_H
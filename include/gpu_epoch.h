@@ -0,0 +1,373 @@
+#ifndef GPU_EPOCH_H
+#define GPU_EPOCH_H
+
+// Per-cell steps of a grid epoch, written once for the host and the device
+//
+// Every function here works on one cell, as a kernel thread of a device
+// backend would; this tree has no device driver yet. They compile as
+// ordinary C++, which is how the MPI strips (strip_grid.cpp) use them and
+// how test_gpu_epoch checks them against the CPU code (CounterRng,
+// Grid::create_spatial_pairs, emulate_in_place, mutate_in_place and
+// Grid::program_to_color).
+
+#include "emulator.h"
+#include "rng.h"
+#include <cstdint>
+#include <cmath>
+
+#if defined(__CUDACC__) || defined(__HIPCC__)
+#define BFFPP_HD __host__ __device__
+#else
+#define BFFPP_HD
+#endif
+
+#if defined(__CUDA_ARCH__) || defined(__HIP_DEVICE_COMPILE__)
+#define BFFPP_DEVICE_PASS 1
+#endif
+
+namespace gpu_epoch {
+
+// Von Neumann radius of the grid pairing (as in bffpp_grid)
+constexpr int PAIRING_RADIUS = 2;
+
+// partner[] values besides a partner's index
+constexpr int32_t UNRESOLVED = -2;  // Not paired yet this epoch
+constexpr int32_t SOLO = -1;        // Mutation-only, as in pairing_index()
+
+// Tapes live in per-thread local memory, so programs have a size limit
+constexpr int MAX_PROGRAM_SIZE = 128;
+
+constexpr int MAX_ITER = 8192;
+
+// CounterRng on the device: the same keys and the same numbers
+class Stream {
+public:
+    BFFPP_HD Stream(uint64_t seed, RngDomain domain, uint64_t epoch, uint64_t cell)
+        : key(stream_key(seed, domain, epoch, cell)), counter(0) {}
+
+    BFFPP_HD uint64_t next_u64() {
+        counter++;
+        return mix(key + counter * GOLDEN_GAMMA);
+    }
+
+    BFFPP_HD uint8_t next_byte() { return static_cast<uint8_t>(next_u64() >> 56); }
+
+    BFFPP_HD uint32_t next_below(uint32_t n) {
+        uint64_t m = static_cast<uint64_t>(static_cast<uint32_t>(next_u64() >> 32)) * n;
+        uint32_t low = static_cast<uint32_t>(m);
+        if (low < n) {
+            uint32_t threshold = static_cast<uint32_t>(-n) % n;
+            while (low < threshold) {
+                m = static_cast<uint64_t>(static_cast<uint32_t>(next_u64() >> 32)) * n;
+                low = static_cast<uint32_t>(m);
+            }
+        }
+        return static_cast<uint32_t>(m >> 32);
+    }
+
+    BFFPP_HD uint64_t next_geometric(double log_q) {
+        double u = static_cast<double>((next_u64() >> 11) + 1) * 0x1.0p-53;
+        double skip = floor(log(u) / log_q);
+        if (skip >= 9.0e18) {
+            return ~0ULL;
+        }
+        return static_cast<uint64_t>(skip);
+    }
+
+    static BFFPP_HD uint64_t hash(uint64_t seed, RngDomain domain, uint64_t epoch, uint64_t cell) {
+        return mix(stream_key(seed, domain, epoch, cell) + GOLDEN_GAMMA);
+    }
+
+    static BFFPP_HD uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+private:
+    static constexpr uint64_t GOLDEN_GAMMA = 0x9E3779B97F4A7C15ULL;
+
+    static BFFPP_HD uint64_t stream_key(uint64_t seed, RngDomain domain, uint64_t epoch, uint64_t cell) {
+        uint64_t k = mix(seed + GOLDEN_GAMMA * static_cast<uint64_t>(domain));
+        k = mix(k ^ (epoch * 0xD1B54A32D192ED03ULL));
+        k = mix(k ^ (cell * 0xAEF17502108EF2D9ULL));
+        return k;
+    }
+
+    uint64_t key;
+    uint64_t counter;
+};
+
+// Pairing
+//
+// Grid::create_spatial_pairs(radius, seed, epoch) visits the cells one by
+// one in order of their PairingOrder key, and each untaken cell takes a
+// random untaken neighbour. Here that greedy pass runs in rounds: a cell is
+// ready once no untaken cell that comes before it lies within twice the
+// radius, since only those could still take it or one of its neighbours.
+// Two ready cells are then more than twice the radius apart, so their
+// neighbourhoods are disjoint and they can resolve at the same time, and
+// every cell sees exactly the neighbours it would have seen in the
+// sequential pass. The pairs come out the same; the first cell of a pair
+// is the one with the smaller key.
+//
+// partner and keys hold the cells from first_cell on; a device keeps
+// the whole grid (first_cell 0), a strip of the MPI backend (strip_grid.h)
+// only its own rows and a margin of 2 * radius rows on either side.
+
+// Whether cell a comes before cell b in the visiting order
+BFFPP_HD inline bool visited_before(const uint64_t* keys, int a, int b) {
+    return keys[a] < keys[b] || (keys[a] == keys[b] && a < b);
+}
+
+BFFPP_HD inline bool pairing_ready(int cell, const int32_t* partner, const uint64_t* keys, int width, int height,
+                                   int first_cell = 0) {
+    if (partner[cell - first_cell] != UNRESOLVED) {
+        return false;
+    }
+
+    const int reach = 2 * PAIRING_RADIUS;
+    int x = cell % width;
+    int y = cell / width;
+    for (int dy = -reach; dy <= reach; dy++) {
+        for (int dx = -reach; dx <= reach; dx++) {
+            int manhattan_dist = (dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy);
+            int nx = x + dx;
+            int ny = y + dy;
+            if (manhattan_dist == 0 || manhattan_dist > reach ||
+                nx < 0 || nx >= width || ny < 0 || ny >= height) {
+                continue;
+            }
+
+            int other = ny * width + nx - first_cell;
+            if (partner[other] == UNRESOLVED && visited_before(keys, other, cell - first_cell)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Pair a ready cell with a random untaken neighbour, in the same neighbour
+// order as Grid::get_von_neumann_neighbors()
+BFFPP_HD inline void pairing_resolve(int cell, int32_t* partner, int width, int height, uint64_t seed, uint64_t epoch,
+                                     int first_cell = 0) {
+    int available[4 * PAIRING_RADIUS * (PAIRING_RADIUS + 1) / 2];
+    int count = 0;
+
+    int x = cell % width;
+    int y = cell / width;
+    for (int dy = -PAIRING_RADIUS; dy <= PAIRING_RADIUS; dy++) {
+        for (int dx = -PAIRING_RADIUS; dx <= PAIRING_RADIUS; dx++) {
+            int manhattan_dist = (dx < 0 ? -dx : dx) + (dy < 0 ? -dy : dy);
+            int nx = x + dx;
+            int ny = y + dy;
+            if (manhattan_dist == 0 || manhattan_dist > PAIRING_RADIUS ||
+                nx < 0 || nx >= width || ny < 0 || ny >= height) {
+                continue;
+            }
+
+            int neighbor = ny * width + nx;
+            if (partner[neighbor - first_cell] == UNRESOLVED) {
+                available[count++] = neighbor;
+            }
+        }
+    }
+
+    if (count == 0) {
+        partner[cell - first_cell] = SOLO;
+        return;
+    }
+
+    Stream choice(seed, RngDomain::PairingChoice, epoch, cell);
+    int chosen = available[choice.next_below(count)];
+    partner[cell - first_cell] = chosen;
+    partner[chosen - first_cell] = cell;
+}
+
+// Emulation: emulate_in_place() with jump targets scanned for, which keeps
+// a thread's state down to the tape and a few registers
+BFFPP_HD inline EmulatorStats emulate_tape(uint8_t* tape, int tape_size, int head0_pos, int head1_pos,
+                                          int pc_pos, int max_iter) {
+    const uint8_t zero = '0';
+
+    int iteration = 0;
+    int skipped = 0;
+    EmulatorStatus status = EmulatorStatus::Terminated;
+
+    while (iteration < max_iter) {
+        uint8_t instr = tape[pc_pos];
+
+        if (instr == '<') {
+            head0_pos = (head0_pos - 1 + tape_size) % tape_size;
+        }
+        else if (instr == '>') {
+            head0_pos = (head0_pos + 1) % tape_size;
+        }
+        else if (instr == '{') {
+            head1_pos = (head1_pos - 1 + tape_size) % tape_size;
+        }
+        else if (instr == '}') {
+            head1_pos = (head1_pos + 1) % tape_size;
+        }
+        else if (instr == '-') {
+            tape[head0_pos]--;
+        }
+        else if (instr == '+') {
+            tape[head0_pos]++;
+        }
+        else if (instr == '.') {
+            tape[head1_pos] = tape[head0_pos];
+        }
+        else if (instr == ',') {
+            tape[head0_pos] = tape[head1_pos];
+        }
+        else if (instr == '[') {
+            if (tape[head0_pos] == zero) {
+                int depth = 1;
+                int pos = pc_pos + 1;
+                for (; pos < tape_size; pos++) {
+                    if (tape[pos] == '[') {
+                        depth++;
+                    } else if (tape[pos] == ']' && --depth == 0) {
+                        break;
+                    }
+                }
+                if (pos >= tape_size) {
+                    status = EmulatorStatus::UnmatchedOpen;
+                    break;
+                }
+                pc_pos = pos;
+            }
+        }
+        else if (instr == ']') {
+            if (tape[head0_pos] != zero) {
+                int depth = 1;
+                int pos = pc_pos - 1;
+                for (; pos >= 0; pos--) {
+                    if (tape[pos] == ']') {
+                        depth++;
+                    } else if (tape[pos] == '[' && --depth == 0) {
+                        break;
+                    }
+                }
+                if (pos < 0) {
+                    status = EmulatorStatus::UnmatchedClose;
+                    break;
+                }
+                pc_pos = pos;
+            }
+        }
+        else {
+            skipped++;
+        }
+
+        iteration++;
+        pc_pos = pc_pos + 1;
+        if (pc_pos >= tape_size) {
+            status = EmulatorStatus::Finished;
+            break;
+        }
+    }
+
+    return EmulatorStats{status, iteration, skipped};
+}
+
+// Mutation: mutate_in_place() with a counter-based stream, given
+// log_q = log1p(-mutation_rate) for 0 < mutation_rate < 1
+BFFPP_HD inline void mutate_program(uint8_t* program, int length, double mutation_rate, double log_q,
+                                    uint64_t seed, uint64_t epoch, uint64_t cell) {
+    if (mutation_rate <= 0.0) {
+        return;
+    }
+
+    Stream rng(seed, RngDomain::Mutation, epoch, cell);
+    if (mutation_rate >= 1.0) {
+        for (int i = 0; i < length; i++) {
+            program[i] = rng.next_byte();
+        }
+        return;
+    }
+
+    uint64_t pos = rng.next_geometric(log_q);
+    while (pos < static_cast<uint64_t>(length)) {
+        program[pos] = rng.next_byte();
+        uint64_t skip = rng.next_geometric(log_q);
+        if (skip >= static_cast<uint64_t>(length)) {
+            break;
+        }
+        pos += skip + 1;
+    }
+}
+
+// Colors: Grid::program_to_color(), with the float operations spelled out
+// so the device compiler cannot contract them into FMAs
+BFFPP_HD inline float mul_rn(float a, float b) {
+#ifdef BFFPP_DEVICE_PASS
+    return __fmul_rn(a, b);
+#else
+    return a * b;
+#endif
+}
+
+BFFPP_HD inline float add_rn(float a, float b) {
+#ifdef BFFPP_DEVICE_PASS
+    return __fadd_rn(a, b);
+#else
+    return a + b;
+#endif
+}
+
+BFFPP_HD inline float div_rn(float a, float b) {
+#ifdef BFFPP_DEVICE_PASS
+    return __fdiv_rn(a, b);
+#else
+    return a / b;
+#endif
+}
+
+BFFPP_HD inline void program_color(const uint8_t* program, int length, uint8_t* rgb) {
+    int loop_ops = 0;
+    int arith_ops = 0;
+    int head_ops = 0;
+    for (int i = 0; i < length; i++) {
+        uint8_t ch = program[i];
+        if (ch == '[' || ch == ']') {
+            loop_ops++;
+        } else if (ch == '+' || ch == '-' || ch == '.' || ch == ',') {
+            arith_ops++;
+        } else if (ch == '<' || ch == '>' || ch == '{' || ch == '}') {
+            head_ops++;
+        }
+    }
+
+    int total_instructions = loop_ops + arith_ops + head_ops;
+    if (length == 0) {
+        rgb[0] = 0;
+        rgb[1] = 0;
+        rgb[2] = 0;
+        return;
+    }
+    if (total_instructions == 0) {
+        rgb[0] = 255;
+        rgb[1] = 0;
+        rgb[2] = 0;
+        return;
+    }
+
+    float total = static_cast<float>(total_instructions);
+    float loop_ratio = div_rn(static_cast<float>(loop_ops), total);
+    float arith_ratio = div_rn(static_cast<float>(arith_ops), total);
+    float head_ratio = div_rn(static_cast<float>(head_ops), total);
+
+    rgb[0] = static_cast<uint8_t>(add_rn(add_rn(mul_rn(loop_ratio, 0.0f), mul_rn(arith_ratio, 200.0f)),
+                                         mul_rn(head_ratio, 200.0f)));
+    rgb[1] = static_cast<uint8_t>(add_rn(add_rn(mul_rn(loop_ratio, 192.0f), mul_rn(arith_ratio, 0.0f)),
+                                         mul_rn(head_ratio, 128.0f)));
+    rgb[2] = static_cast<uint8_t>(add_rn(add_rn(mul_rn(loop_ratio, 0.0f), mul_rn(arith_ratio, 200.0f)),
+                                         mul_rn(head_ratio, 220.0f)));
+}
+
+} // namespace gpu_epoch
+
+#endif // GPU_EPOCH_H
@@ -5,6 +5,12 @@
 #include <cstdint>
 #include <string>
 #include <random>
+#include <algorithm>
+#include "span.h"
+#include "program_arena.h"
+#include "rng.h"
+#include "snapshot.h"
+#include "pairing_engine.h"
 
 struct RGB {
     uint8_t r;
@@ -20,12 +26,26 @@ public:
     void initialize_random();
     void initialize_random(std::mt19937& rng);
 
-    // Get program at position
-    std::vector<uint8_t>& get_program(int x, int y);
-    const std::vector<uint8_t>& get_program(int x, int y) const;
+    // Reallocate the programs so that each band of cells (row_bands(), one
+    // per group of the pinned pool) lies on its group's NUMA node, written
+    // first by that group's threads. Programs are reset; initialize after.
+    void place_bands(ThreadPool& pool, const std::vector<size_t>& bands);
+
+    // Fill one program from a counter-based stream (thread-safe per index)
+    void initialize_program(int index, CounterRng& rng);
+
+    // Get program at position (a view into the grid's contiguous storage).
+    // Outside an epoch, the non-const views mark the cell's color for
+    // recomputation; writes through them must come before the next colors().
+    Span<uint8_t> get_program(int x, int y);
+    Span<const uint8_t> get_program(int x, int y) const;
+
+    // Get program by flat index (y * width + x)
+    Span<uint8_t> program_at(int index) { mark_dirty(index); return programs.program(index); }
+    Span<const uint8_t> program_at(int index) const { return programs.program(index); }
 
     // Set program at position
-    void set_program(int x, int y, const std::vector<uint8_t>& program);
+    void set_program(int x, int y, Span<const uint8_t> program);
 
     // Get all programs as a flat vector (for fully-connected topology)
     std::vector<std::vector<uint8_t>> get_all_programs() const;
@@ -33,17 +53,64 @@ public:
     // Set all programs from flat vector
     void set_all_programs(const std::vector<std::vector<uint8_t>>& programs);
 
+    // All programs back to back, in flat index order
+    Span<const uint8_t> all_bytes() const { return programs.all(); }
+
+    // Double-buffered epochs: begin_epoch() readies the back buffer, workers
+    // fill next_program(index) for every cell, and commit_epoch() swaps it in
+    // (and, once colors have been cached, marks the cells that changed)
+    void begin_epoch() { programs.enable_back_buffer(); in_epoch = true; }
+    Span<uint8_t> next_program(int index) { return programs.back_program(index); }
+    void commit_epoch();
+
+    // After commit_epoch(): the programs of the epoch before, in flat index order
+    Span<const uint8_t> previous_bytes() const { return programs.back_all(); }
+
     // Convert program to RGB color for visualization
-    RGB program_to_color(const std::vector<uint8_t>& program) const;
+    RGB program_to_color(Span<const uint8_t> program) const;
+
+    // Color of every program, in flat index order. Colors are cached per
+    // cell and only recomputed for cells whose program changed; the reference
+    // stays valid until the grid changes. Not safe to call concurrently.
+    const std::vector<RGB>& colors() const;
 
-    // Save grid as PPM image
+    // Save grid as a binary (P6) PPM image, scale x scale pixels per cell
     void save_ppm(const std::string& filename, int scale = 4) const;
 
+    // Cell colors (flat index order) scaled up to RGB24 pixels, row by row
+    static std::vector<uint8_t> render_colors(int width, int height, const std::vector<RGB>& colors, int scale);
+
+    // Same image as save_ppm() from precomputed colors
+    static void save_colors_ppm(const std::string& filename, int width, int height, const std::vector<RGB>& colors,
+                                int scale = 4);
+
     // Generate HTML visualization
     void save_html(const std::string& filename) const;
 
+    // Same page from precomputed colors (one per cell, flat index order),
+    // for grids whose programs are not held on the host
+    static void save_colors_html(const std::string& filename, int width, int height, int program_size,
+                                 const std::vector<RGB>& colors);
+
+    // Save programs and partners (from pairing_index()) as a pairing CSV;
+    // non-instruction bytes are written as spaces
+    void save_pairing_csv(const std::string& filepath, int epoch, const std::vector<int32_t>& partners) const;
+
+    // The same file from a snapshot with partners (to_snapshot(epoch, partners)),
+    // for writers that no longer have the grid
+    static void save_pairing_csv(const std::string& filepath, const Snapshot& snapshot);
+
+    // Copy the programs (and optionally the partners) into a binary snapshot
+    Snapshot to_snapshot(int epoch, std::vector<int32_t> partners = {}) const;
+
+    // Replace the programs with a snapshot's; throws std::runtime_error if
+    // it holds no programs of this grid's size
+    void load_snapshot(const Snapshot& snapshot);
+
     // Serialize grid to JSON for WebSocket
     std::string to_json(int epoch, double entropy, double avg_iters, double finished_ratio) const;
+    static std::string colors_to_json(int epoch, int width, int height, double entropy, double avg_iters,
+                                      double finished_ratio, const std::vector<RGB>& colors);
 
     // Spatial pairing methods
     struct Cell {
@@ -61,6 +128,14 @@ public:
     std::vector<std::pair<int, int>> create_spatial_pairs(int neighborhood_radius = 2);
     std::vector<std::pair<int, int>> create_spatial_pairs(int neighborhood_radius, std::mt19937& rng);
 
+    // Counter-based pairing: the result is a pure function of (seed, epoch)
+    std::vector<std::pair<int, int>> create_spatial_pairs(int neighborhood_radius, uint64_t seed, uint64_t epoch);
+
+    // Parallel tiled matcher (see PairingEngine::pair_tiled), also a pure
+    // function of (seed, epoch) but not the same pairs as the sequential pass
+    std::vector<std::pair<int, int>> create_tiled_pairs(int neighborhood_radius, uint64_t seed, uint64_t epoch,
+                                                        ThreadPool* pool = nullptr);
+
     // Getters
     int get_width() const { return width; }
     int get_height() const { return height; }
@@ -71,9 +146,28 @@ private:
     int width;
     int height;
     int program_size;
-    std::vector<std::vector<uint8_t>> grid_data; // Flattened 2D array
+    ProgramArena<uint8_t> programs; // width * height programs, row-major
+    PairingEngine pairing;
+
+    // Color cache: one flag per cell whose color must be recomputed
+    mutable std::vector<RGB> color_cache;
+    mutable std::vector<uint8_t> color_dirty;
+    mutable bool colors_cached = false;
+    bool in_epoch = false;
 
     int index(int x, int y) const { return y * width + x; }
+
+    // During an epoch the current programs are only read, and commit_epoch()
+    // finds the cells that changed
+    void mark_dirty(int index) {
+        if (!in_epoch) {
+            color_dirty[index] = 1;
+        }
+    }
+    void mark_all_dirty() { std::fill(color_dirty.begin(), color_dirty.end(), static_cast<uint8_t>(1)); }
+
+    // The pairing engine for this radius (rebuilt if the radius changed)
+    PairingEngine& pairing_engine(int radius);
 };
 
 #endif // GRID_H
@@ -0,0 +1,75 @@
+#ifndef GRID_EXPERIMENT_H
+#define GRID_EXPERIMENT_H
+
+#include "config.h"
+#include "grid_simulation.h"
+#include "output_pipeline.h"
+#include "snapshot.h"
+#include <string>
+#include <random>
+#include <sstream>
+
+class ThreadPool;
+
+// One bffpp_grid run that advances an epoch at a time, so that a driver can
+// interleave many of them on one worker pool (see main_batch.cpp)
+//
+// step() runs exactly one epoch of bffpp_grid's loop, through the same
+// GridSimulation: pairing, emulation, mutation, statistics and the periodic
+// output files. Instead of the shared random engine of utils.h, every
+// experiment draws from its own mt19937 seeded with random_seed, which gives
+// the very same draws as a bffpp_grid run of the config on its own, so
+// several experiments can step at the same time. The lines bffpp_grid would
+// print go to log() instead, for the driver to print in a fixed order.
+class GridExperiment {
+public:
+    // Output files go under output_dir ("" = no files); snapshot_writer, if
+    // given, writes binary pairing snapshots and may be shared
+    GridExperiment(const std::string& name, const Config& config, const std::string& output_dir,
+                   ThreadPool& pool, SnapshotWriter* snapshot_writer = nullptr);
+
+    const std::string& name() const { return experiment_name; }
+    const Config& config() const { return settings; }
+    const Grid& grid() const { return simulation.grid(); }
+
+    int epoch() const { return current_epoch; }
+    bool finished() const { return current_epoch >= settings.epochs; }
+
+    // Run the next epoch; live_clients asks for the entropy that bffpp_grid
+    // only computes while someone is watching
+    void step(bool live_clients = false);
+
+    // Statistics of the last epoch, as bffpp_grid broadcasts them
+    double entropy() const { return last_entropy; }
+    double avg_iterations() const { return last_avg_iterations; }
+    double finished_ratio() const { return last_finished_ratio; }
+
+    // Live update of the last epoch, tagged with the experiment's name
+    std::string to_json() const;
+
+    // Write the final visualization and wait for the output files (once finished)
+    void finish();
+
+    // Output printed since the last call
+    std::string take_log();
+
+    const PairCache* pair_cache() const { return simulation.pair_cache(); }
+
+private:
+    std::string experiment_name;
+    Config settings;
+    std::string output_dir;
+    SnapshotWriter* snapshot_writer;
+
+    std::mt19937 rng;
+    GridSimulation simulation;
+    OutputPipeline output;
+
+    int current_epoch = 0;
+    double last_entropy = 0.0;
+    double last_avg_iterations = 0.0;
+    double last_finished_ratio = 0.0;
+    std::ostringstream log_stream;
+};
+
+#endif // GRID_EXPERIMENT_H
@@ -0,0 +1,66 @@
+#ifndef GRID_FRAME_H
+#define GRID_FRAME_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "grid.h"
+
+// Binary live-view frames
+//
+// A compact alternative to Grid::to_json for WebSocket clients, sent as
+// binary messages: a 48-byte header with the epoch statistics, then the
+// cell colours in one of three encodings. Integers and doubles are
+// little-endian.
+//
+//   header:   "BFGF" | type | epoch | width | height | count | entropy | avg_iters | finished_ratio
+//   Rgb:      width * height RGB triples, row by row
+//   Palette:  count (<= 256) RGB triples, then one palette index per cell
+//   Delta:    count cell indices (uint32), then their new RGB triples
+//
+// Rgb and Palette frames are keyframes; a Delta frame only makes sense to a
+// client that has applied every frame since the last keyframe.
+
+constexpr char GRID_FRAME_MAGIC[4] = {'B', 'F', 'G', 'F'};
+constexpr size_t GRID_FRAME_HEADER_SIZE = 48;
+
+enum class GridFrameType : uint32_t {
+    Rgb = 0,
+    Palette = 1,
+    Delta = 2
+};
+
+struct GridFrameStats {
+    int epoch = 0;
+    double entropy = 0.0;
+    double avg_iters = 0.0;
+    double finished_ratio = 0.0;
+};
+
+// Encodes successive colour grids as keyframes and deltas
+class GridFrameEncoder {
+public:
+    // Encode one grid state. The delta is taken against the previous call and
+    // kept only when it is smaller than a keyframe; the keyframe is built when
+    // with_keyframe is set, on the first call, or when there is no delta.
+    void encode(const GridFrameStats& stats, int width, int height, const std::vector<RGB>& colors,
+                bool with_keyframe);
+
+    // The frames of the last encode(); either may be empty (see above)
+    const std::vector<uint8_t>& keyframe() const { return key; }
+    const std::vector<uint8_t>& delta() const { return changes; }
+
+private:
+    std::vector<uint8_t> key;
+    std::vector<uint8_t> changes;
+    std::vector<RGB> previous;
+    int previous_width = 0;
+    int previous_height = 0;
+};
+
+// Apply a frame to colors (resized on keyframes) and read its header;
+// throws std::runtime_error on a malformed frame or a delta that does not fit
+void apply_grid_frame(const uint8_t* data, size_t size, GridFrameType& type, GridFrameStats& stats,
+                      int& width, int& height, std::vector<RGB>& colors);
+
+#endif // GRID_FRAME_H
@@ -0,0 +1,95 @@
+#ifndef GRID_SIMULATION_H
+#define GRID_SIMULATION_H
+
+#include "config.h"
+#include "grid.h"
+#include "pair_cache.h"
+#include "metrics_engine.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <random>
+#include <ostream>
+
+class ThreadPool;
+class EpochProfiler;
+class SnapshotWriter;
+class OutputPipeline;
+
+// Averages over the pairs an epoch executed, as bffpp_grid reports them
+struct GridEpochStats {
+    double avg_iterations = 0.0;
+    double avg_skipped = 0.0;
+    double finished_ratio = 0.0;
+    double terminated_ratio = 0.0;
+};
+
+// bffpp_grid's simulation of one grid, an epoch at a time
+//
+// bffpp_grid and every experiment of bffpp_batch (GridExperiment) run their
+// epochs through here, so both honour the same settings: pairing, emulator
+// backend, pair cache, counter-based streams, fused mutation, numa_tiles
+// (a band of rows per thread group of the pool) and the output pipeline.
+// Draws that are not counter-based come from rng: the shared engine of
+// utils.h for bffpp_grid, one engine per experiment in a batch. Lines for
+// the console go to the given stream.
+class GridSimulation {
+public:
+    GridSimulation(const Config& config, ThreadPool& pool, std::mt19937& rng);
+
+    Grid& grid() { return soup; }
+    const Grid& grid() const { return soup; }
+
+    // Initial programs: counter-based streams on the pool, or draws from rng
+    void initialize();
+
+    // Start the running metrics over from the grid as it is now (after
+    // initialize() or after loading a snapshot)
+    void reset_metrics();
+
+    // Phases and counters of the following calls go here (nullptr = none)
+    void set_profiler(EpochProfiler* epoch_profiler) { profiler = epoch_profiler; }
+
+    // One epoch (counting from 0): pair, emulate, mutate, commit the next
+    // programs and update the running metrics
+    GridEpochStats run_epoch(int epoch);
+
+    // Pairs of the last epoch
+    const std::vector<std::pair<int, int>>& pairs() const { return program_pairs; }
+
+    double higher_order_entropy();
+
+    // The pairing dump of the last epoch, from epoch 16324 on, in
+    // pairings_dir (made on first use): a binary snapshot through
+    // snapshot_writer if given, otherwise a CSV through output
+    void save_pairings(int epoch, const std::string& pairings_dir, SnapshotWriter* snapshot_writer,
+                       OutputPipeline& output, std::ostream& log);
+
+    // The visualization every visualization_interval epochs, as a frame of output
+    void save_visualization(int epoch, const std::string& visualizations_dir, OutputPipeline& output,
+                            std::ostream& log);
+
+    PairCache* pair_cache() { return cache.get(); }
+    const PairCache* pair_cache() const { return cache.get(); }
+
+private:
+    Config settings;
+    ThreadPool& pool;
+    std::mt19937& rng;
+    uint64_t seed;
+
+    Grid soup;
+    std::vector<size_t> bands;
+    MetricsEngine metrics;
+    std::unique_ptr<PairCache> cache;
+    EpochProfiler* profiler = nullptr;
+
+    std::vector<std::pair<int, int>> program_pairs;
+    bool pairings_dir_made = false;
+};
+
+// The statistics of an eval epoch as bffpp_grid prints them; the last line
+// is left open for a driver's own fields
+void print_epoch_stats(std::ostream& out, int epoch, double hoe, const GridEpochStats& stats);
+
+#endif // GRID_SIMULATION_H
@@ -2,6 +2,11 @@
 #define GRID_W_TRACER_H
 
 #include "emulator_w_tracer.h"
+#include "span.h"
+#include "program_arena.h"
+#include "rng.h"
+#include "snapshot.h"
+#include "pairing_engine.h"
 #include <vector>
 #include <cstdint>
 #include <string>
@@ -23,12 +28,27 @@ public:
     void initialize_random();
     void initialize_random(std::mt19937& rng);
 
-    // Get program tokens at position
-    std::vector<Token>& get_program(int x, int y);
-    const std::vector<Token>& get_program(int x, int y) const;
+    // Reallocate the tokens so that each band of cells (row_bands(), one
+    // per group of the pinned pool) lies on its group's NUMA node, written
+    // first by that group's threads. Tokens are reset; initialize after.
+    void place_bands(ThreadPool& pool, const std::vector<size_t>& bands);
+
+    // Fill one program (epoch-0 tokens) from a counter-based stream
+    void initialize_program(int index, CounterRng& rng);
+
+    // Get program tokens at position (a view into the grid's contiguous storage)
+    Span<Token> get_program(int x, int y);
+    Span<const Token> get_program(int x, int y) const;
+
+    // Get program tokens by flat index (y * width + x)
+    Span<Token> program_at(int index) { return programs.program(index); }
+    Span<const Token> program_at(int index) const { return programs.program(index); }
+
+    // Every token of the grid, program after program
+    Span<const Token> tokens() const { return programs.all(); }
 
     // Set program tokens at position
-    void set_program(int x, int y, const std::vector<Token>& program);
+    void set_program(int x, int y, Span<const Token> program);
 
     // Get all programs as a flat vector
     std::vector<std::vector<Token>> get_all_programs() const;
@@ -36,15 +56,34 @@ public:
     // Set all programs from flat vector
     void set_all_programs(const std::vector<std::vector<Token>>& programs);
 
+    // Double-buffered epochs, as in Grid
+    void begin_epoch() { programs.enable_back_buffer(); }
+    Span<Token> next_program(int index) { return programs.back_program(index); }
+    void commit_epoch() { programs.swap_buffers(); }
+
     // Get program as bytes (for compatibility)
     std::vector<uint8_t> get_program_bytes(int x, int y) const;
 
     // Convert program to RGB color for visualization
-    RGB program_to_color(const std::vector<uint8_t>& program) const;
+    RGB program_to_color(Span<const uint8_t> program) const;
+
+    // Color of every program, in flat index order
+    std::vector<RGB> colors() const;
 
     // Save all tokens to CSV file
     void save_tokens_to_csv(const std::string& filepath, int epoch_num) const;
 
+    // The same file from a token snapshot (to_snapshot()), for writers that
+    // no longer have the grid
+    static void save_tokens_to_csv(const std::string& filepath, const Snapshot& snapshot);
+
+    // Copy all tokens into a binary snapshot (same content, a fraction of the size)
+    Snapshot to_snapshot(int epoch_num) const;
+
+    // Replace the tokens with a token snapshot's; throws std::runtime_error
+    // if it holds no tokens of this grid's size
+    void load_snapshot(const Snapshot& snapshot);
+
     // Generate JSON for visualization
     std::string to_json(int epoch, double entropy, double finished_ratio) const;
 
@@ -54,10 +93,25 @@ public:
     // Create spatial pairs for pairing programs
     std::vector<std::pair<int, int>> create_spatial_pairs(int neighborhood_radius, std::mt19937& rng);
 
+    // Counter-based pairing: the result is a pure function of (seed, epoch)
+    std::vector<std::pair<int, int>> create_spatial_pairs(int neighborhood_radius, uint64_t seed, uint64_t epoch);
+
+    // Parallel tiled matcher, as Grid::create_tiled_pairs()
+    std::vector<std::pair<int, int>> create_tiled_pairs(int neighborhood_radius, uint64_t seed, uint64_t epoch,
+                                                        ThreadPool* pool = nullptr);
+
     // Mutate a program (creates new token with given epoch)
     std::vector<Token> mutate(const std::vector<Token>& program, double mutation_rate,
                               uint64_t epoch, std::mt19937& rng);
 
+    // In-place variant: same random draws as mutate(), without the copy
+    void mutate_in_place(Span<Token> program, double mutation_rate,
+                         uint64_t epoch, std::mt19937& rng);
+
+    // Counter-based variant, mutation sites picked by geometric skips
+    void mutate_in_place(Span<Token> program, double mutation_rate,
+                         uint64_t epoch, CounterRng& rng);
+
     // Getters
     int get_width() const { return width; }
     int get_height() const { return height; }
@@ -68,9 +122,13 @@ private:
     int width;
     int height;
     int program_size;
-    std::vector<std::vector<Token>> grid_data; // Flattened 2D array
+    ProgramArena<Token> programs; // width * height programs, row-major
+    PairingEngine pairing;
 
     int index(int x, int y) const { return y * width + x; }
+
+    // The pairing engine for this radius (rebuilt if the radius changed)
+    PairingEngine& pairing_engine(int radius);
 };
 
 #endif // GRID_W_TRACER_H
@@ -0,0 +1,42 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// A file mapped into memory, read-only or read-write
+//
+// MappedFile(path) maps an existing file read-only, for parsing it front
+// to back once; its bytes must not be written through data().
+//
+// MappedFile(path, size) creates (or truncates) the file at the given size
+// and maps it shared, so pages are read in as they are touched and written
+// back by the kernel; only the pages in use have to be resident. The file
+// stays on disk after the mapping is gone.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    MappedFile(const std::string& path, size_t size);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    uint8_t* data() { return bytes; }
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+    const std::string& path() const { return file_path; }
+    bool writable() const { return fd >= 0; }
+
+    // Write dirty pages back to the file now (nothing to do when read-only)
+    void flush() const;
+
+private:
+    std::string file_path;
+    size_t length;
+    int fd;  // Kept open for writable mappings only
+    uint8_t* bytes;
+};
+
+#endif // MAPPED_FILE_H
@@ -4,6 +4,7 @@
 #include <vector>
 #include <cstdint>
 #include <string>
+#include <cstddef>
 
 double shannon_entropy(const std::vector<uint8_t>& byte_string);
 
@@ -11,8 +12,42 @@ double kolmogorov_complexity_estimate(const std::vector<uint8_t>& byte_string);
 
 double compressed_size(const std::vector<uint8_t>& byte_string);
 
+// Levenshtein distance, computed with Myers' bit-vector algorithm: one
+// machine word per 64 characters of the shorter string
+size_t edit_distance(const std::string& s1, const std::string& s2);
+
+// edit_distance() / max(len(s1), len(s2))
 double normalized_edit_distance(const std::string& s1, const std::string& s2);
 
 double higher_order_entropy(const std::vector<uint8_t>& byte_string);
 
+// Pointer-based variants, so contiguous soups can be measured without a copy.
+// quality and window are Brotli parameters; the defaults (11, 22) match
+// BROTLI_DEFAULT_QUALITY and BROTLI_DEFAULT_WINDOW used above.
+double shannon_entropy(const uint8_t* data, size_t size);
+
+double kolmogorov_complexity_estimate(const uint8_t* data, size_t size, int quality = 11, int window = 22);
+
+double compressed_size(const uint8_t* data, size_t size, int quality = 11, int window = 22);
+
+double higher_order_entropy(const uint8_t* data, size_t size);
+
+// compressed_size() through Brotli's streaming encoder: the input is fed in
+// chunks of chunk_size bytes and the output is counted, not kept, so no
+// buffer of the compressed size is needed. With the input size passed as a
+// hint, the encoder makes the same choices as the one-shot call.
+double streamed_compressed_size(const uint8_t* data, size_t size, int quality = 11, int window = 22,
+                                size_t chunk_size = 1 << 20);
+
+// (C(xy) - min(C(x), C(y))) / max(C(x), C(y)), with C the compressed size;
+// the first form takes the three sizes, so callers can reuse C(x) and C(y)
+double normalized_compression_distance(double cx, double cy, double cxy);
+
+double normalized_compression_distance(const std::string& x, const std::string& y, int quality = 11,
+                                       int window = 22);
+
+// Number of positions where a and b hold the same byte, compared 64 bytes
+// at a time on CPUs with AVX-512BW
+size_t matching_bytes(const uint8_t* a, const uint8_t* b, size_t size);
+
 #endif // METRICS_H
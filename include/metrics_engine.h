@@ -0,0 +1,91 @@
+#ifndef METRICS_ENGINE_H
+#define METRICS_ENGINE_H
+
+#include <array>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+class ThreadPool;
+
+// Brotli settings and sharding used for the complexity estimate
+struct MetricsOptions {
+    int brotli_quality = 11;  // BROTLI_DEFAULT_QUALITY
+    int brotli_window = 22;   // BROTLI_DEFAULT_WINDOW
+    int shards = 1;           // >1 compresses that many slices independently
+    bool streaming = false;   // Brotli's streaming encoder, without an output buffer
+};
+
+// Distance measures between two programs for distance_matrix()
+enum class ProgramDistance {
+    Edit,         // normalized_edit_distance()
+    Compression   // normalized_compression_distance() with the engine's Brotli settings
+};
+
+// Byte histogram that can be kept up to date from the bytes that changed
+struct ByteHistogram {
+    std::array<int64_t, 256> counts = {};
+    int64_t total = 0;
+
+    void clear();
+    void add(const uint8_t* data, size_t size);
+    void merge(const ByteHistogram& other);
+
+    // Same value as shannon_entropy() over the counted bytes
+    double shannon_entropy() const;
+};
+
+// Higher-order entropy for a soup that changes a little every epoch
+//
+// The Shannon part comes from a running histogram: reset() counts the soup
+// once, and update() then only applies the bytes that differ between the
+// previous and the current soup. The Kolmogorov part still compresses the
+// soup, but with configurable Brotli quality/window and optionally split
+// into shards that are compressed in parallel on the pool (each shard on
+// its own, so more shards trade some accuracy for speed). With streaming,
+// the compressor reads the soup in chunks and only counts its output
+// (streamed_compressed_size()), so huge soups need no second buffer; the
+// estimate stays the same.
+//
+// With the default options, higher_order_entropy() gives exactly the same
+// value as the free higher_order_entropy() function.
+class MetricsEngine {
+public:
+    explicit MetricsEngine(const MetricsOptions& options = MetricsOptions(), ThreadPool* pool = nullptr);
+
+    // Count a soup from scratch
+    void reset(const uint8_t* data, size_t size);
+
+    // Apply the changes from previous to current (both size bytes)
+    void update(const uint8_t* previous, const uint8_t* current, size_t size);
+
+    const ByteHistogram& histogram() const { return running; }
+    double shannon_entropy() const { return running.shannon_entropy(); }
+
+    // Histogram-based HOE; data must be the soup the histogram describes
+    double higher_order_entropy(const uint8_t* data, size_t size) const;
+    double higher_order_entropy(const ByteHistogram& histogram, const uint8_t* data, size_t size) const;
+
+    // Stateless HOE of an arbitrary byte string with this engine's options
+    double higher_order_entropy_of(const uint8_t* data, size_t size) const;
+
+    double kolmogorov_complexity_estimate(const uint8_t* data, size_t size) const;
+
+    // Distance from every row program to every column program, row-major
+    // (rows.size() x columns.size()), computed on the pool. Passing the
+    // same list twice gives the all-pairs matrix. With Compression, each
+    // program is compressed on its own only once, however many pairs it
+    // is part of.
+    std::vector<double> distance_matrix(const std::vector<std::string>& rows,
+                                        const std::vector<std::string>& columns,
+                                        ProgramDistance kind = ProgramDistance::Edit) const;
+
+private:
+    MetricsOptions options;
+    ThreadPool* pool;
+    ByteHistogram running;
+    bool initialized;
+};
+
+#endif // METRICS_ENGINE_H
@@ -0,0 +1,64 @@
+#ifndef OUTPUT_PIPELINE_H
+#define OUTPUT_PIPELINE_H
+
+#include "background_writer.h"
+#include <functional>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <cstddef>
+
+// What submit_frame() does when the queue is full
+enum class OutputBackpressure {
+    Block,       // Wait for a free slot, like every data file
+    DropFrames,  // Skip the frame; the simulation never waits for one
+};
+
+// "block" or "drop_frames"; throws std::runtime_error otherwise
+OutputBackpressure parse_output_backpressure(const std::string& name);
+
+// Background stage for a driver's output files
+//
+// The simulation thread copies what a file needs out of the grid (a
+// Snapshot, the cell colors of a frame), the grid's buffers being rewritten
+// by the next epoch, hands the copy over as a job and goes on with the next
+// epoch while background workers serialise, compress and write. At most
+// capacity jobs wait in the queue, so a slow disk cannot pile up copies
+// without bound: a data file (pairings, tokens) then waits for a free slot,
+// and a frame (visualizations, PPM video frames) waits or is dropped.
+//
+// The queue and its workers are a BackgroundWriter. With no worker threads,
+// every job runs inline in submit(), which is how the drivers wrote their
+// files before. Jobs may finish in any order;
+// flush() waits for all of them. Exceptions thrown by a queued job are
+// reported on stderr and counted; those of an inline job reach the caller.
+class OutputPipeline {
+public:
+    OutputPipeline(unsigned int threads = 0, size_t capacity = 8,
+                   OutputBackpressure backpressure = OutputBackpressure::Block);
+
+    OutputPipeline(const OutputPipeline&) = delete;
+    OutputPipeline& operator=(const OutputPipeline&) = delete;
+
+    // Queue a data file; blocks while the queue is full
+    void submit(std::function<void()> job);
+
+    // Queue a frame; returns false if it was dropped (queue full under DropFrames)
+    bool submit_frame(std::function<void()> job);
+
+    // Wait until every job submitted so far has run
+    void flush();
+
+    bool inline_jobs() const { return writer == nullptr; }
+
+    // Frames dropped and jobs that failed so far
+    size_t dropped() const { return dropped_frames; }
+    size_t failures() const { return writer ? writer->failures() : 0; }
+
+private:
+    OutputBackpressure backpressure;
+    std::atomic<size_t> dropped_frames;
+    std::unique_ptr<BackgroundWriter> writer;  // nullptr: inline
+};
+
+#endif // OUTPUT_PIPELINE_H
@@ -0,0 +1,85 @@
+#ifndef PAIR_CACHE_H
+#define PAIR_CACHE_H
+
+#include "emulator.h"
+#include <array>
+#include <list>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+
+// Bounded, concurrent cache of pair emulations
+//
+// Once a replicator has taken over, most pairs are byte-identical to pairs
+// run before, in the same epoch or an earlier one. The cache maps the two
+// programs of a pair to the tapes and stats their emulation left, so such a
+// pair is copied instead of run again. Every entry keeps its input programs
+// and a lookup compares them, so a hash collision is only a miss.
+//
+// Each result is that of the drivers' layout: head 0 at 0, head 1 at
+// program_size, the program counter at 0 and the cache's max_iter. All
+// backends and cycle detection give the same result, so one cache serves
+// them all. As in ReplicatorCache, entries are spread over SHARDS shards by
+// their hash, each with its own lock; each shard evicts its least recently
+// used entry once it holds capacity / SHARDS of them.
+class PairCache {
+public:
+    static constexpr size_t SHARDS = 64;
+
+    explicit PairCache(size_t capacity, int max_iter = 8192);
+
+    static uint64_t hash_pair(const uint8_t* programA, const uint8_t* programB, int program_size);
+
+    // True if the pair has been run before: both programs are replaced by
+    // the tapes that run left and stats is set
+    bool lookup(uint8_t* programA, uint8_t* programB, int program_size, EmulatorStats& stats);
+
+    // Record that the pair inputA, inputB left outputA, outputB and stats
+    void add(const uint8_t* inputA, const uint8_t* inputB, const uint8_t* outputA, const uint8_t* outputB,
+             int program_size, const EmulatorStats& stats);
+
+    size_t size() const;
+    size_t capacity() const { return shard_capacity * SHARDS; }
+    int max_iter() const { return max_iterations; }
+
+    // Lookups so far and how many of them were hits
+    uint64_t lookups() const;
+    uint64_t hits() const;
+
+private:
+    struct Entry {
+        uint64_t key;
+        int program_size;
+        EmulatorStats stats;
+        std::vector<uint8_t> tapes;  // Input A, input B, output A, output B
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> entries;  // Most recently used first
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+        uint64_t lookups = 0;
+        uint64_t hits = 0;
+    };
+
+    Shard& shard_for(uint64_t key) { return shards[key >> 58]; }
+
+    size_t shard_capacity;
+    int max_iterations;
+    std::array<Shard, SHARDS> shards;
+};
+
+// emulate_pair_in_place() in the cache's layout, answered from the cache
+// when the pair has been run before and recorded in it otherwise
+EmulatorStats emulate_pair_cached(
+    PairCache& cache,
+    uint8_t* programA,
+    uint8_t* programB,
+    int program_size,
+    EmulatorBackend backend = EmulatorBackend::Scalar,
+    bool detect_cycles = false
+);
+
+#endif // PAIR_CACHE_H
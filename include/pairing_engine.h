@@ -0,0 +1,112 @@
+#ifndef PAIRING_ENGINE_H
+#define PAIRING_ENGINE_H
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <random>
+
+class ThreadPool;
+
+// Spatial pairing of grid cells within a Von Neumann radius
+//
+// Shared by Grid and GridWithTracer. The neighbour offsets are computed
+// once, and the working buffers are kept from one epoch to the next, so a
+// pass allocates nothing per cell.
+//
+// Two matchers produce the (cell, partner) list, with (-1, cell) for cells
+// left without a free neighbour (mutation-only):
+//
+//   pair()        The sequential greedy pass: cells in random order, each
+//                 untaken cell takes a random untaken neighbour. Gives the
+//                 same pairs as the original Grid::create_spatial_pairs for
+//                 the same generator or (seed, epoch), so it is the
+//                 deterministic mode for regression runs.
+//
+//   pair_tiled()  The same greedy rule, run in parallel. The grid is cut
+//                 into TILE_SIZE squares coloured in a 2x2 pattern; tiles
+//                 of one colour are at least 2 * radius apart, so they
+//                 never read or take each other's cells and run on the
+//                 pool at the same time, one colour after the other.
+//                 Within a tile, cells go in the order of their
+//                 PairingOrder keys. Finishing a whole tile before its
+//                 neighbours would pair up noticeably more cells than the
+//                 sequential pass, so the keys are cut into KEY_SLICES
+//                 ranges and the four colours run once per range. The
+//                 tiling origin and the colour orders are drawn per epoch,
+//                 so no tile seam stays in place. The result is a pure
+//                 function of (seed, epoch), whatever the thread count, and
+//                 a statistically equivalent matching, but not the same
+//                 pairs as pair().
+class PairingEngine {
+public:
+    static constexpr int TILE_SIZE = 16;
+    static constexpr int KEY_SLICES = 8;
+
+    PairingEngine(int width, int height, int radius = 2);
+
+    int get_radius() const { return radius; }
+
+    // Sequential pass over a std::shuffle'd order (draws from rng exactly
+    // as the original implementation did)
+    std::vector<std::pair<int, int>> pair(std::mt19937& rng);
+
+    // Sequential pass in PairingOrder key order, picks from PairingChoice
+    std::vector<std::pair<int, int>> pair(uint64_t seed, uint64_t epoch);
+
+    // Tiled parallel matcher; pool may be null (same result, one thread)
+    std::vector<std::pair<int, int>> pair_tiled(uint64_t seed, uint64_t epoch, ThreadPool* pool = nullptr);
+
+    // Writes the in-bounds neighbours of cell to out (at least
+    // max_neighbors() entries), in Grid::get_von_neumann_neighbors() order
+    int neighbors(int cell, int* out) const;
+
+    int max_neighbors() const { return static_cast<int>(offsets.size()); }
+
+private:
+    struct Offset {
+        int dx;
+        int dy;
+        int delta;  // dy * width + dx
+    };
+
+    // Untaken neighbours of cell into out; returns how many
+    int available_neighbors(int cell, const uint8_t* taken, int* out) const;
+
+    // One tile of the tiled matcher
+    struct Tile {
+        int x0, y0, x1, y1;
+        std::vector<std::pair<uint64_t, int>> order;  // Cells by PairingOrder key
+        size_t next = 0;                              // First cell not visited yet
+        std::vector<std::pair<int, int>> pairs;
+    };
+
+    void order_tile(Tile& tile, uint64_t seed, uint64_t epoch);
+
+    // Visit the tile's cells up to and including last_key
+    void pair_tile(Tile& tile, uint64_t last_key, uint64_t seed, uint64_t epoch);
+
+    int width;
+    int height;
+    int radius;
+    std::vector<Offset> offsets;
+
+    // Reused between calls
+    std::vector<uint8_t> taken;
+    std::vector<int> cell_order;
+    std::vector<std::pair<uint64_t, int>> keyed_order;
+    std::vector<Tile> tiles;
+};
+
+// NUMA tiles of a grid: its rows cut into `bands` runs of whole rows, as
+// even as possible, as the bands + 1 flat cell indices where they start
+// (and the last one ends)
+std::vector<size_t> row_bands(int width, int height, int bands);
+
+// Reorder pairs, stably, by band: first the pairs within band 0, then those
+// within band 1 and so on, then the pairs whose cells lie in two bands. A
+// mutation-only pair goes with its cell. Returns the bounds of these runs
+// of pairs, in the form ThreadPool::parallel_for_groups() takes.
+std::vector<size_t> group_pairs_by_band(std::vector<std::pair<int, int>>& pairs, const std::vector<size_t>& bands);
+
+#endif // PAIRING_ENGINE_H
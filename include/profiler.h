@@ -0,0 +1,280 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Per-epoch phase timing and hot-path counters
+//
+// Profiling is off until set_profiling(true). Counters are kept per thread:
+// each thread adds to its own block without locking, and profile_totals()
+// sums every block, so workers never contend. The emulators count opcodes,
+// bracket jumps and bracket-table rebuilds on the stack of each run (an
+// EmulatorTally) and add them to their thread's block once at the end; with
+// profiling off they run an uninstrumented copy of their loop. The drivers
+// time their phases with ScopedPhase and an EpochProfiler (profiler.cpp).
+
+enum class ProfilePhase : int {
+    Pairing,
+    Emulation,
+    Mutation,
+    Metrics,    // Entropy and Brotli complexity
+    Output,     // CSV, snapshot, checkpoint and image files
+    Broadcast,  // WebSocket frames, built and queued
+    Count
+};
+
+enum class ProfileCounter : int {
+    Pairs,              // Pairs emulated
+    PairCacheHits,      // Pairs answered from the pair cache (pair_cache.h)
+    MutationOnly,       // Programs carried over without a partner
+    Instructions,       // Emulator steps, no-ops included
+    Skipped,            // Emulator steps on no-op bytes
+    CycleExits,         // Runs that skipped the repeats of a read-only loop
+    Jumps,              // Bracket jumps taken
+    JumpDistance,       // Bytes those jumps crossed (what a scan would walk)
+    BracketRebuilds,    // Bracket tables rebuilt after a bracket was written
+    BracketScanBytes,   // Bytes scanned by those rebuilds
+    BytesWritten,       // Bytes of output files
+    WebSocketBytes,     // Bytes sent to WebSocket clients
+    Count
+};
+
+constexpr int PROFILE_PHASES = static_cast<int>(ProfilePhase::Count);
+constexpr int PROFILE_COUNTERS = static_cast<int>(ProfileCounter::Count);
+
+// Opcode slots: no-op bytes, then < > { } - + . , [ ]. They count every
+// step dispatched, so they add up to EmulatorStats::iteration, plus one for
+// the bracket of a run that stops on an unmatched bracket.
+constexpr int PROFILE_OPCODES = 11;
+
+const char* profile_phase_name(ProfilePhase phase);
+const char* profile_counter_name(ProfileCounter counter);
+const char* profile_opcode_name(int slot);  // "noop", "<", ">", ...
+
+// Every thread's counters, one value per counter and per opcode slot
+struct ProfileBlock {
+    std::atomic<uint64_t> counters[PROFILE_COUNTERS] = {};
+    std::atomic<uint64_t> opcodes[PROFILE_OPCODES] = {};
+};
+
+namespace profiler_detail {
+
+inline std::atomic<bool> enabled{false};
+inline std::mutex blocks_mutex;
+inline std::vector<std::shared_ptr<ProfileBlock>> blocks;  // Outlive their threads
+
+inline ProfileBlock& local_block() {
+    thread_local std::shared_ptr<ProfileBlock> block = [] {
+        auto created = std::make_shared<ProfileBlock>();
+        std::lock_guard<std::mutex> lock(blocks_mutex);
+        blocks.push_back(created);
+        return created;
+    }();
+    return *block;
+}
+
+// Only the owning thread writes a block, so a plain load and store will do
+inline void bump(std::atomic<uint64_t>& value, uint64_t amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+struct OpcodeSlots {
+    uint8_t slots[256];
+
+    OpcodeSlots() : slots() {
+        const char* ops = "<>{}-+.,[]";
+        for (int i = 0; ops[i]; i++) {
+            slots[static_cast<uint8_t>(ops[i])] = static_cast<uint8_t>(i + 1);
+        }
+    }
+};
+
+inline const OpcodeSlots opcode_slots;
+
+} // namespace profiler_detail
+
+inline bool profiling_enabled() {
+    return profiler_detail::enabled.load(std::memory_order_relaxed);
+}
+
+inline void set_profiling(bool enabled) {
+    profiler_detail::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+// Add to this thread's counter; does nothing while profiling is off
+inline void profile_count(ProfileCounter counter, uint64_t amount = 1) {
+    if (profiling_enabled()) {
+        profiler_detail::bump(profiler_detail::local_block().counters[static_cast<int>(counter)], amount);
+    }
+}
+
+// Opcode slot of a tape byte
+inline int profile_opcode_slot(uint8_t instr) {
+    return profiler_detail::opcode_slots.slots[instr];
+}
+
+// Counts of one emulator run, added to the thread's block when it goes out
+// of scope (so every return path is covered)
+struct EmulatorTally {
+    uint64_t opcodes[PROFILE_OPCODES] = {};
+    uint64_t jumps = 0;
+    uint64_t jump_distance = 0;
+    uint64_t rebuilds = 0;
+    uint64_t rebuild_bytes = 0;
+    uint64_t cycle_exits = 0;
+    uint64_t marked_opcodes[PROFILE_OPCODES] = {};  // Counts at the last mark()
+    uint64_t marked_jumps = 0;
+    uint64_t marked_jump_distance = 0;
+
+    EmulatorTally() = default;
+    EmulatorTally(const EmulatorTally&) = delete;
+    EmulatorTally& operator=(const EmulatorTally&) = delete;
+
+    void op(uint8_t instr) { opcodes[profile_opcode_slot(instr)]++; }
+    void ops(int slot, int count) { opcodes[slot] += static_cast<uint64_t>(count); }
+    void jump(int from, int to) {
+        jumps++;
+        jump_distance += static_cast<uint64_t>(std::abs(to - from));
+    }
+    void rebuild(int tape_size) {
+        rebuilds++;
+        rebuild_bytes += static_cast<uint64_t>(tape_size);
+    }
+
+    // Where a CycleDetector saved its state
+    void mark() {
+        std::copy(opcodes, opcodes + PROFILE_OPCODES, marked_opcodes);
+        marked_jumps = jumps;
+        marked_jump_distance = jump_distance;
+    }
+
+    // The steps since mark() were skipped this many more times. A loop
+    // without writes never finds its bracket table stale, so rebuilds are
+    // not repeated.
+    void repeat(int times) {
+        if (times <= 0) {
+            return;
+        }
+        uint64_t n = static_cast<uint64_t>(times);
+        for (int i = 0; i < PROFILE_OPCODES; i++) {
+            opcodes[i] += n * (opcodes[i] - marked_opcodes[i]);
+        }
+        jumps += n * (jumps - marked_jumps);
+        jump_distance += n * (jump_distance - marked_jump_distance);
+        cycle_exits++;
+    }
+
+    ~EmulatorTally() {
+        ProfileBlock& block = profiler_detail::local_block();
+        for (int i = 0; i < PROFILE_OPCODES; i++) {
+            if (opcodes[i]) {
+                profiler_detail::bump(block.opcodes[i], opcodes[i]);
+            }
+        }
+        profiler_detail::bump(block.counters[static_cast<int>(ProfileCounter::CycleExits)], cycle_exits);
+        profiler_detail::bump(block.counters[static_cast<int>(ProfileCounter::Jumps)], jumps);
+        profiler_detail::bump(block.counters[static_cast<int>(ProfileCounter::JumpDistance)], jump_distance);
+        profiler_detail::bump(block.counters[static_cast<int>(ProfileCounter::BracketRebuilds)], rebuilds);
+        profiler_detail::bump(block.counters[static_cast<int>(ProfileCounter::BracketScanBytes)], rebuild_bytes);
+    }
+};
+
+// ------------------------------------------------------------------ drivers
+
+// Counter totals over every thread at one point in time
+struct ProfileSample {
+    uint64_t counters[PROFILE_COUNTERS] = {};
+    uint64_t opcodes[PROFILE_OPCODES] = {};
+
+    uint64_t get(ProfileCounter counter) const { return counters[static_cast<int>(counter)]; }
+    ProfileSample operator-(const ProfileSample& earlier) const;
+};
+
+ProfileSample profile_totals();
+
+// Times and counts over the epochs of one reporting interval
+struct EpochProfile {
+    int64_t epoch = 0;            // Last epoch of the interval
+    int64_t epochs = 0;           // Epochs in the interval
+    double wall_seconds = 0.0;
+    double phase_seconds[PROFILE_PHASES] = {};
+    ProfileSample counts;
+
+    // "Profile epoch 100 (10 epochs): 12.3 ms/epoch | pairing 0.4 ms ..."
+    std::string stats_line() const;
+
+    // {"type":"profile", ...}, as sent on the WebSocket profile channel
+    std::string to_json() const;
+
+    static std::string csv_header();
+    std::string csv_row() const;
+};
+
+// Collects the phase times of each epoch and the counters they moved
+class EpochProfiler {
+public:
+    EpochProfiler();
+
+    // Start timing an epoch
+    void begin_epoch();
+
+    void add_time(ProfilePhase phase, double seconds);
+
+    // Finish the epoch started last
+    void end_epoch(int64_t epoch);
+
+    // Everything since the last call (or since construction), then start over
+    EpochProfile take_interval();
+
+    // Totals since construction in the Prometheus text format
+    std::string prometheus() const;
+
+private:
+    std::chrono::steady_clock::time_point epoch_start;
+    bool in_epoch;
+    ProfileSample interval_start;
+    EpochProfile interval;
+    int64_t total_epochs;
+    int64_t last_epoch;
+    double total_wall_seconds;
+    double total_phase_seconds[PROFILE_PHASES];
+};
+
+// Adds the time until stop() or the end of its scope to a phase; a null
+// profiler makes it a no-op
+class ScopedPhase {
+public:
+    ScopedPhase(EpochProfiler* profiler, ProfilePhase phase)
+        : profiler(profiler), phase(phase) {
+        if (profiler) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedPhase() { stop(); }
+
+    void stop() {
+        if (profiler) {
+            profiler->add_time(phase, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            profiler = nullptr;
+        }
+    }
+
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+private:
+    EpochProfiler* profiler;
+    ProfilePhase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // PROFILER_H
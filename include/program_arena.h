@@ -0,0 +1,154 @@
+#ifndef PROGRAM_ARENA_H
+#define PROGRAM_ARENA_H
+
+#include "span.h"
+#include "mapped_file.h"
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstddef>
+#include <utility>
+#include <new>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+
+// Contiguous storage for a soup of fixed-size programs
+//
+// All programs live back to back in one buffer of num_programs * program_size
+// elements, so program i starts at element i * program_size. Programs are
+// handed out as spans into that buffer.
+//
+// An optional back buffer of the same shape lets an epoch be built next to
+// the current one: workers write next-epoch programs into back_program(),
+// and swap_buffers() then makes them current by swapping the two buffers
+// (no copy). The back buffer is only allocated once enable_back_buffer() is
+// called, so single-buffered users pay nothing for it.
+//
+// The current buffer can instead live in a memory-mapped file (mapped_file.h),
+// for soups larger than the memory one wants to spend on them. Such an arena
+// has no back buffer, and copies of it share the file.
+//
+// Or both buffers can be allocated without being written, so that threads on
+// the NUMA node meant to own a range of programs write it first: Linux
+// places each page on the node of the thread that first touches it.
+
+// Allocator whose resize() leaves trivially copyable elements unwritten:
+// they are raw bytes until someone writes them
+template <typename T>
+struct UntouchedAllocator : std::allocator<T> {
+    template <typename U>
+    struct rebind {
+        using other = UntouchedAllocator<U>;
+    };
+
+    UntouchedAllocator() = default;
+    template <typename U>
+    UntouchedAllocator(const UntouchedAllocator<U>&) {}
+
+    template <typename U>
+    void construct(U* p) {
+        if constexpr (!std::is_trivially_copyable<U>::value) {
+            ::new (static_cast<void*>(p)) U;
+        }
+    }
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) { ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+};
+
+template <typename T>
+class ProgramArena {
+public:
+    ProgramArena() : num_programs_(0), program_size_(0) {}
+
+    ProgramArena(int num_programs, int program_size, const T& fill = T())
+        : num_programs_(num_programs),
+          program_size_(program_size),
+          front(static_cast<size_t>(num_programs) * program_size, fill) {}
+
+    // Current buffer in the file at backing_path, created at the right size
+    ProgramArena(int num_programs, int program_size, const std::string& backing_path, const T& fill = T())
+        : num_programs_(num_programs),
+          program_size_(program_size),
+          mapping(std::make_shared<MappedFile>(backing_path,
+                                               static_cast<size_t>(num_programs) * program_size * sizeof(T))) {
+        static_assert(std::is_trivially_copyable<T>::value, "a mapped arena holds its programs as raw bytes");
+        std::fill(data(), data() + size(), fill);
+    }
+
+    bool is_mapped() const { return mapping != nullptr; }
+
+    // Replace both buffers with fresh ones that are not written yet; every
+    // program must then be written through touch() before it is read
+    void allocate_untouched() {
+        static_assert(std::is_trivially_copyable<T>::value, "only raw bytes can be left unwritten");
+        if (mapping) {
+            throw std::runtime_error("A mapped program arena cannot be reallocated");
+        }
+        size_t elements = offset(num_programs_);
+        Buffer().swap(front);
+        Buffer().swap(back);
+        front.resize(elements);
+        back.resize(elements);
+    }
+
+    // Fill programs [begin, end) of both buffers, from the thread that
+    // should own their pages
+    void touch(int begin, int end, const T& fill = T()) {
+        std::fill(front.data() + offset(begin), front.data() + offset(end), fill);
+        if (!back.empty()) {
+            std::fill(back.data() + offset(begin), back.data() + offset(end), fill);
+        }
+    }
+
+    int num_programs() const { return num_programs_; }
+    int program_size() const { return program_size_; }
+
+    // Current programs
+    Span<T> program(int i) {
+        return Span<T>(data() + offset(i), program_size_);
+    }
+    Span<const T> program(int i) const {
+        return Span<const T>(data() + offset(i), program_size_);
+    }
+
+    // Whole current buffer, program after program
+    T* data() { return mapping ? reinterpret_cast<T*>(mapping->data()) : front.data(); }
+    const T* data() const { return mapping ? reinterpret_cast<const T*>(mapping->data()) : front.data(); }
+    size_t size() const { return mapping ? offset(num_programs_) : front.size(); }
+    Span<const T> all() const { return Span<const T>(data(), size()); }
+
+    // Allocate the back buffer (no-op if already allocated)
+    void enable_back_buffer() {
+        if (mapping) {
+            throw std::runtime_error("A mapped program arena has no back buffer");
+        }
+        if (back.size() != front.size()) {
+            back.assign(front.size(), T());
+        }
+    }
+
+    // Slot for program i in the epoch being built; needs enable_back_buffer()
+    Span<T> back_program(int i) {
+        return Span<T>(back.data() + offset(i), program_size_);
+    }
+
+    // Whole back buffer; right after swap_buffers() this is the previous epoch
+    Span<const T> back_all() const { return Span<const T>(back.data(), back.size()); }
+
+    // Make the back buffer current; the old programs become the new back buffer
+    void swap_buffers() { front.swap(back); }
+
+private:
+    using Buffer = std::vector<T, UntouchedAllocator<T>>;
+
+    size_t offset(int i) const { return static_cast<size_t>(i) * program_size_; }
+
+    int num_programs_;
+    int program_size_;
+    Buffer front;
+    Buffer back;
+    std::shared_ptr<MappedFile> mapping;
+};
+
+#endif // PROGRAM_ARENA_H
@@ -0,0 +1,52 @@
+#ifndef REPLICATOR_CACHE_H
+#define REPLICATOR_CACHE_H
+
+#include <array>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <shared_mutex>
+
+// Concurrent cache of self-replication checks, keyed by a 64-bit program hash
+//
+// Entries are spread over SHARDS independent shards by the hash, each with
+// its own reader/writer lock, so threads only contend when they touch the
+// same shard, and lookups (the common case) share it. The cache can be saved
+// to and loaded from a small binary file; a tag stored with it (e.g. the
+// emulator's max_iter) keeps results from incompatible checks apart.
+class ReplicatorCache {
+public:
+    static constexpr size_t SHARDS = 64;
+
+    static uint64_t hash_program(const std::string& program);
+
+    // True and sets is_replicator if the program has been checked before
+    bool lookup(const std::string& program, bool& is_replicator) const;
+    bool lookup(uint64_t key, bool& is_replicator) const;
+
+    void add(const std::string& program, bool is_replicator);
+    void add(uint64_t key, bool is_replicator);
+
+    size_t size() const;
+
+    // Merge entries from a saved cache; returns how many were loaded (0 if
+    // the file is missing, damaged or was saved with a different tag)
+    size_t load(const std::string& filepath, uint32_t tag);
+
+    // Write all entries (via a temporary file, so a crash keeps the old one)
+    void save(const std::string& filepath, uint32_t tag) const;
+
+private:
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<uint64_t, bool> entries;
+    };
+
+    Shard& shard_for(uint64_t key) { return shards[key >> 58]; }
+    const Shard& shard_for(uint64_t key) const { return shards[key >> 58]; }
+
+    std::array<Shard, SHARDS> shards;
+};
+
+#endif // REPLICATOR_CACHE_H
@@ -0,0 +1,105 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+// What a counter-based stream is used for; part of the stream key so the
+// same (seed, epoch, cell) gives unrelated numbers for different purposes
+enum class RngDomain : uint64_t {
+    Initialization = 1,
+    Mutation = 2,
+    PairingOrder = 3,
+    PairingChoice = 4,
+    PairingTiles = 5
+};
+
+// Counter-based random number generator (SplitMix64 style)
+//
+// Every stream is identified by (seed, domain, epoch, cell) and the n-th
+// number of a stream is a pure function of that key and n. Nothing is
+// shared between streams, so any thread can produce the numbers for any
+// cell and the result does not depend on how the work was split up or in
+// which order it ran. This is what lets initialization, mutation and
+// pairing run on the thread pool and still reproduce the same soup for the
+// same seed.
+//
+// Satisfies UniformRandomBitGenerator, so it also works with <random>
+// distributions and <algorithm>.
+class CounterRng {
+public:
+    using result_type = uint64_t;
+
+    CounterRng(uint64_t seed, RngDomain domain, uint64_t epoch, uint64_t cell)
+        : key(stream_key(seed, domain, epoch, cell)), counter(0) {}
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<uint64_t>::max(); }
+
+    result_type operator()() { return next_u64(); }
+
+    uint64_t next_u64() {
+        counter++;
+        return mix(key + counter * GOLDEN_GAMMA);
+    }
+
+    // Uniform byte (top bits have the best quality)
+    uint8_t next_byte() { return static_cast<uint8_t>(next_u64() >> 56); }
+
+    // Uniform double in [0, 1)
+    double next_double() { return static_cast<double>(next_u64() >> 11) * 0x1.0p-53; }
+
+    // Uniform integer in [0, n), n > 0 (Lemire's multiply-shift, unbiased)
+    uint32_t next_below(uint32_t n) {
+        uint64_t m = static_cast<uint64_t>(static_cast<uint32_t>(next_u64() >> 32)) * n;
+        uint32_t low = static_cast<uint32_t>(m);
+        if (low < n) {
+            uint32_t threshold = static_cast<uint32_t>(-n) % n;
+            while (low < threshold) {
+                m = static_cast<uint64_t>(static_cast<uint32_t>(next_u64() >> 32)) * n;
+                low = static_cast<uint32_t>(m);
+            }
+        }
+        return static_cast<uint32_t>(m >> 32);
+    }
+
+    // Number of failed Bernoulli trials before the next success, where
+    // log_q = log(1 - p) for success probability p in (0, 1)
+    uint64_t next_geometric(double log_q) {
+        // u in (0, 1] so log(u) is finite
+        double u = static_cast<double>((next_u64() >> 11) + 1) * 0x1.0p-53;
+        double skip = std::floor(std::log(u) / log_q);
+        if (skip >= 9.0e18) {
+            return std::numeric_limits<uint64_t>::max();
+        }
+        return static_cast<uint64_t>(skip);
+    }
+
+    // One-off hash of a key, e.g. for sort keys that need no full stream
+    static uint64_t hash(uint64_t seed, RngDomain domain, uint64_t epoch, uint64_t cell) {
+        return mix(stream_key(seed, domain, epoch, cell) + GOLDEN_GAMMA);
+    }
+
+    // SplitMix64 finalizer
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+private:
+    static constexpr uint64_t GOLDEN_GAMMA = 0x9E3779B97F4A7C15ULL;
+
+    static uint64_t stream_key(uint64_t seed, RngDomain domain, uint64_t epoch, uint64_t cell) {
+        uint64_t k = mix(seed + GOLDEN_GAMMA * static_cast<uint64_t>(domain));
+        k = mix(k ^ (epoch * 0xD1B54A32D192ED03ULL));
+        k = mix(k ^ (cell * 0xAEF17502108EF2D9ULL));
+        return k;
+    }
+
+    uint64_t key;
+    uint64_t counter;
+};
+
+#endif // RNG_H
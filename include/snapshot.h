@@ -0,0 +1,101 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include "background_writer.h"
+
+// Binary per-epoch snapshot (.bffs)
+//
+// A snapshot holds one epoch of a grid: either the raw program bytes or the
+// packed 64-bit Token values, plus an optional pairing index. On disk it is
+// a fixed 64-byte header followed by blocks; each block has a 32-byte block
+// header and its payload, padded to 8 bytes so uncompressed blocks can be
+// used in place from a memory map. Blocks are stored raw or Brotli-compressed
+// on their own. All integers are little-endian.
+//
+//   header:  "BFFS" | version | kind | num_blocks | epoch | width | height | program_size
+//   block:   type | codec | raw_size | stored_size | payload
+
+constexpr char SNAPSHOT_MAGIC[4] = {'B', 'F', 'F', 'S'};
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+constexpr size_t SNAPSHOT_HEADER_SIZE = 64;
+constexpr size_t SNAPSHOT_BLOCK_HEADER_SIZE = 32;
+
+// What the programs block holds
+enum class SnapshotKind : uint32_t {
+    Programs = 1,  // one byte per program cell
+    Tokens = 2     // one packed Token (uint64) per program cell
+};
+
+enum class SnapshotBlockType : uint32_t {
+    Programs = 1,
+    Tokens = 2,
+    Pairing = 3    // int32 partner index per program, -1 = mutation only
+};
+
+enum class SnapshotCodec : uint32_t {
+    Raw = 0,
+    Brotli = 1
+};
+
+struct Snapshot {
+    SnapshotKind kind = SnapshotKind::Programs;
+    int64_t epoch = 0;
+    int width = 0;
+    int height = 0;
+    int program_size = 0;
+
+    std::vector<uint8_t> bytes;     // Programs: width * height * program_size
+    std::vector<uint64_t> tokens;   // Tokens: width * height * program_size
+    std::vector<int32_t> partners;  // Empty when the epoch has no pairing data
+
+    int total_programs() const { return width * height; }
+};
+
+// Partner of every program for a list of (a, b) pairs; a == -1 marks b as
+// mutation-only, and so do programs that appear in no pair
+std::vector<int32_t> pairing_index(const std::vector<std::pair<int, int>>& pairs, int total_programs);
+
+// Write a snapshot; blocks are Brotli-compressed when codec says so
+void write_snapshot(const std::string& filepath, const Snapshot& snapshot,
+                    SnapshotCodec codec = SnapshotCodec::Raw);
+
+// Read and decompress a whole snapshot
+Snapshot read_snapshot(const std::string& filepath);
+
+// Decode a snapshot that is already in memory; name is used in errors
+Snapshot parse_snapshot(const uint8_t* data, size_t size, const std::string& name);
+
+// True if the file starts with the snapshot magic
+bool is_snapshot_file(const std::string& filepath);
+
+// Parse "raw"/"none" or "brotli"
+SnapshotCodec parse_snapshot_codec(const std::string& name);
+
+// Writes snapshots on a background thread (a BackgroundWriter)
+//
+// submit() takes ownership of a filled snapshot and returns once it is
+// queued, so the simulation only pays for copying the grid out. At most
+// max_pending snapshots wait in the queue; submit() blocks while it is full.
+// Write errors are reported on std::cerr, like the CSV writers do. flush()
+// waits for the queue to drain and the destructor flushes before joining.
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(SnapshotCodec codec = SnapshotCodec::Raw, size_t max_pending = 4);
+
+    void submit(const std::string& filepath, Snapshot snapshot);
+    void flush() { writer.flush(); }
+
+    // Number of snapshots that failed to write so far
+    size_t failures() const { return writer.failures(); }
+
+private:
+    SnapshotCodec codec;
+    BackgroundWriter writer;
+};
+
+#endif // SNAPSHOT_H
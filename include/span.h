@@ -0,0 +1,52 @@
+#ifndef SPAN_H
+#define SPAN_H
+
+#include <vector>
+#include <cstddef>
+#include <type_traits>
+
+// Non-owning view of a contiguous run of elements (C++17 stand-in for std::span)
+//
+// Used to hand out programs stored in a ProgramArena without copying them.
+// A Span<const T> can be built from a Span<T> or from any std::vector<T>, so
+// functions that only read a program accept both arena slots and vectors.
+template <typename T>
+class Span {
+public:
+    using element_type = T;
+    using value_type = typename std::remove_cv<T>::type;
+    using iterator = T*;
+
+    Span() : ptr(nullptr), len(0) {}
+    Span(T* data, size_t size) : ptr(data), len(size) {}
+
+    // From a mutable vector
+    Span(std::vector<value_type>& vec) : ptr(vec.data()), len(vec.size()) {}
+
+    // From a const vector (only for Span<const T>)
+    template <typename U = T, typename = typename std::enable_if<std::is_const<U>::value>::type>
+    Span(const std::vector<value_type>& vec) : ptr(vec.data()), len(vec.size()) {}
+
+    // Span<T> -> Span<const T>
+    template <typename U, typename = typename std::enable_if<
+        std::is_same<const U, T>::value && !std::is_same<U, T>::value>::type>
+    Span(const Span<U>& other) : ptr(other.data()), len(other.size()) {}
+
+    T* data() const { return ptr; }
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+
+    T& operator[](size_t i) const { return ptr[i]; }
+
+    iterator begin() const { return ptr; }
+    iterator end() const { return ptr + len; }
+
+    // Copy the viewed elements out into an owning vector
+    std::vector<value_type> to_vector() const { return std::vector<value_type>(ptr, ptr + len); }
+
+private:
+    T* ptr;
+    size_t len;
+};
+
+#endif // SPAN_H
@@ -0,0 +1,34 @@
+#ifndef STRIP_EXCHANGE_MPI_H
+#define STRIP_EXCHANGE_MPI_H
+
+#include <mpi.h>
+#include "strip_grid.h"
+
+// StripExchange over MPI: one strip per rank of comm, rank 0 on top
+//
+// Margins go to the ranks above and below with MPI_Sendrecv (MPI_PROC_NULL
+// past the first and last strip), sums are MPI_Allreduce and gathers
+// MPI_Gatherv to rank 0. MPI must be initialized for as long as the
+// exchange is in use.
+class MpiStripExchange : public StripExchange {
+public:
+    explicit MpiStripExchange(MPI_Comm comm = MPI_COMM_WORLD);
+
+    int rank() const override { return comm_rank; }
+    int size() const override { return comm_size; }
+
+    void exchange_rows(const uint8_t* to_up, uint8_t* from_up, size_t up_bytes,
+                       const uint8_t* to_down, uint8_t* from_down, size_t down_bytes) override;
+
+    void sum(int64_t* values, int count) override;
+    void sum(double* values, int count) override;
+
+    void gather(const uint8_t* data, size_t size, std::vector<uint8_t>& out) override;
+
+private:
+    MPI_Comm comm;
+    int comm_rank;
+    int comm_size;
+};
+
+#endif // STRIP_EXCHANGE_MPI_H
@@ -0,0 +1,151 @@
+#ifndef STRIP_GRID_H
+#define STRIP_GRID_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "emulator.h"
+#include "grid.h"
+#include "span.h"
+
+class ThreadPool;
+class MetricsEngine;
+
+// Communication between the strips of one grid
+//
+// Strip r holds rows above strip r + 1. The MPI backend (strip_exchange_mpi.h)
+// puts one strip on each rank; test_strip_grid runs them on threads. Every
+// call is collective: all strips make it, in the same order.
+class StripExchange {
+public:
+    virtual ~StripExchange() = default;
+
+    virtual int rank() const = 0;
+    virtual int size() const = 0;
+
+    // Send to_up to the strip above and to_down to the strip below, and
+    // receive what they sent this way into from_up and from_down. Each side
+    // moves up_bytes or down_bytes in both directions; a side without a
+    // neighbour moves nothing.
+    virtual void exchange_rows(const uint8_t* to_up, uint8_t* from_up, size_t up_bytes,
+                               const uint8_t* to_down, uint8_t* from_down, size_t down_bytes) = 0;
+
+    // Element-wise sum over all strips, in place
+    virtual void sum(int64_t* values, int count) = 0;
+    virtual void sum(double* values, int count) = 0;
+
+    // Every strip's bytes back to back in rank order, on rank 0 only
+    virtual void gather(const uint8_t* data, size_t size, std::vector<uint8_t>& out) = 0;
+};
+
+// Statistics of one epoch over the whole grid, summed over executed pairs
+struct StripEpochStats {
+    int64_t executed_pairs = 0;
+    int64_t iterations = 0;
+    int64_t skipped = 0;
+    int64_t finished = 0;
+    int64_t terminated = 0;
+};
+
+// One horizontal strip of a grid split across several processes
+//
+// Runs the epochs of bffpp_grid with counter_rng: true, so the whole grid
+// evolves exactly as it would in one process, whatever the strip count.
+// Each strip keeps its own rows plus copies of the neighbouring rows:
+//
+//   pairing    the ready/resolve rounds of gpu_epoch.h over the strip's
+//              cells. The PairingOrder keys of nearby foreign cells are
+//              computed locally; the pairing state of the 2 * radius rows
+//              next to each boundary is exchanged before every round, and
+//              partners a strip took from its neighbour's rows are sent
+//              back after it. The round count is agreed on with a sum.
+//   emulation  the first cell of a pair runs it, so a pair across a
+//              boundary runs on one strip with the other program from a
+//              copy of the radius rows next to the boundary; the program
+//              it wrote for the neighbour's cell goes back afterwards.
+//
+// Strips are at least 2 * radius rows high, so only direct neighbours ever
+// talk. Statistics and the entropy are reduced over all strips; the
+// Kolmogorov part compresses each strip on its own, like hoe_shards.
+class StripGrid {
+public:
+    // Splits height rows evenly over exchange.size() strips; throws
+    // std::runtime_error if a strip would be thinner than 2 * radius rows
+    StripGrid(int width, int height, int program_size, uint64_t seed, StripExchange& exchange);
+
+    // Fill the strip's programs from their Initialization streams (epoch 0)
+    void initialize();
+
+    // One epoch; epoch is the stream epoch, i.e. 1 for the first one
+    StripEpochStats run_epoch(uint64_t epoch, double mutation_rate, EmulatorBackend backend,
+                              ThreadPool* pool = nullptr);
+
+    // The strip's programs, in flat index order from first_cell()
+    Span<const uint8_t> bytes() const;
+    Span<const uint8_t> previous_bytes() const;
+
+    // Whole-grid HOE; metrics holds the running histogram of this strip
+    double higher_order_entropy(const MetricsEngine& metrics);
+
+    // Color of every program of the grid, on rank 0 only (empty elsewhere)
+    std::vector<RGB> gather_colors();
+
+    // Pairing rounds the last epoch needed
+    int pairing_rounds() const { return last_rounds; }
+
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+    int get_program_size() const { return program_size; }
+    int get_total_programs() const { return width * height; }
+
+    int row_begin() const { return first_row; }
+    int row_end() const { return last_row; }
+    int first_cell() const { return first_row * width; }
+
+private:
+    // Rows copied from each neighbour for pairing and for the programs
+    int pairing_margin_above() const;
+    int pairing_margin_below() const;
+    int program_margin_above() const;
+    int program_margin_below() const;
+
+    void pair(uint64_t epoch, ThreadPool* pool);
+
+    // Send the margins of a buffer to its neighbours (refresh), or send
+    // what was written into them back to their owners (merge)
+    void refresh_partners();
+    void merge_partners();
+    void refresh_programs();
+    void merge_programs();
+
+    // Whether a cell lies in this strip's own rows
+    bool own_cell(int cell) const { return cell >= first_row * width && cell < last_row * width; }
+
+    int width;
+    int height;
+    int program_size;
+    uint64_t seed;
+    StripExchange& exchange;
+
+    int first_row;
+    int last_row;
+
+    // Pairing window: own rows plus the pairing margins
+    int pairing_first_cell;
+    std::vector<uint64_t> keys;
+    std::vector<int32_t> partner;
+    std::vector<int> unresolved;    // Own cells still to pair
+    std::vector<uint8_t> ready;
+
+    // Program window: own rows plus the program margins, current and next
+    int program_first_cell;
+    std::vector<uint8_t> programs[2];
+    int current = 0;
+
+    // Margins sent back by the neighbours
+    std::vector<uint8_t> receive_up, receive_down;
+
+    int last_rounds = 0;
+};
+
+#endif // STRIP_GRID_H
@@ -0,0 +1,121 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <cstddef>
+
+// Persistent work-stealing thread pool shared by the simulation drivers
+//
+// The pool is created once and reused for every epoch. parallel_for() splits
+// an index range into chunks and spreads them over per-worker queues; idle
+// workers steal chunks from the back of other queues, so one slow pair never
+// holds up the rest. The calling thread takes part in the work and only
+// returns once every chunk has run, which also makes nested parallel_for()
+// calls from inside a task safe.
+//
+// A pool can also be split into groups of threads pinned to given CPUs,
+// normally one group per NUMA node (numa_cpu_groups()). parallel_for_groups()
+// then keeps each group's share of the indices on that group's threads:
+// idle threads only steal within their group, or work that may run anywhere.
+class ThreadPool {
+public:
+    // num_threads counts the calling thread; 0 means hardware_concurrency()
+    explicit ThreadPool(unsigned int num_threads = 0);
+
+    // Pinned pool: threads are split into cpu_groups.size() groups of
+    // consecutive threads, as even as possible, and each is pinned to one CPU
+    // of its group in turn. The calling thread belongs to group 0 and is
+    // pinned to all of that group's CPUs. No groups give the unpinned pool.
+    // Throws std::runtime_error if there are more groups than threads, a
+    // group has no CPUs or a thread cannot be pinned.
+    ThreadPool(unsigned int num_threads, const std::vector<std::vector<int>>& cpu_groups);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Run fn(begin, end) over [0, count) in chunks of at most chunk_size
+    // indices (0 picks a chunk size from count and the thread count).
+    // Blocks until all chunks are done; rethrows the first exception thrown.
+    void parallel_for(
+        size_t count,
+        size_t chunk_size,
+        const std::function<void(size_t, size_t)>& fn
+    );
+
+    // parallel_for() in which indices [bounds[g], bounds[g + 1]) only run on
+    // the threads of group g, for every group; if bounds has groups() + 2
+    // entries, the indices of the last range may run on any thread.
+    // bounds starts at 0 and never decreases.
+    void parallel_for_groups(
+        const std::vector<size_t>& bounds,
+        size_t chunk_size,
+        const std::function<void(size_t, size_t)>& fn
+    );
+
+    // Total number of threads doing work, including the caller
+    unsigned int size() const { return num_threads; }
+
+    // Number of thread groups (1 unless pinned)
+    unsigned int groups() const { return static_cast<unsigned int>(group_queued.size()); }
+
+    // Resolve a configured thread count (0 = auto) to an actual count
+    static unsigned int resolve_thread_count(int requested);
+
+    // CPUs this process may run on, one group per NUMA node that has any
+    // (from /sys/devices/system/node); a single group when that is unknown,
+    // and off Linux, where threads are never pinned
+    static std::vector<std::vector<int>> numa_cpu_groups();
+
+private:
+    struct Job {
+        const std::function<void(size_t, size_t)>* fn;
+        size_t remaining;  // chunks not yet finished, guarded by done_mutex
+        std::mutex done_mutex;
+        std::condition_variable done_cv;
+        std::exception_ptr error;
+        std::mutex error_mutex;
+    };
+
+    struct Task {
+        Job* job;
+        size_t begin;
+        size_t end;
+        int group;  // group whose threads may run it, -1 = any
+    };
+
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void start_workers();
+    void stop_workers();
+    void push_task(unsigned int queue_index, const Task& task);
+    void run_job(Job& job, unsigned int home);
+    void worker_loop(unsigned int queue_index);
+    bool try_pop_task(unsigned int queue_index, Task& task);
+    bool runnable_tasks(unsigned int queue_index) const;
+    void run_task(const Task& task);
+
+    unsigned int num_threads;
+    std::vector<std::unique_ptr<WorkQueue>> queues;  // one per thread (caller's is queue 0)
+    std::vector<std::thread> workers;
+    std::vector<unsigned int> thread_group;  // group of each thread
+    std::vector<unsigned int> group_first;   // first thread of each group, then num_threads
+    std::atomic<size_t> queued_tasks;        // tasks any thread may run
+    std::vector<std::unique_ptr<std::atomic<size_t>>> group_queued;  // tasks of each group
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    std::atomic<bool> stopping;
+};
+
+#endif // THREAD_POOL_H
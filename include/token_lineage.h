@@ -0,0 +1,144 @@
+#ifndef TOKEN_LINEAGE_H
+#define TOKEN_LINEAGE_H
+
+#include "emulator_w_tracer.h"
+#include "span.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <memory>
+
+class ThreadPool;
+class GridWithTracer;
+
+// Columnar token lineage for the tracer
+//
+// The tracer's packed 64-bit tokens are split into planes: the characters,
+// the epoch each token was made in and its position at the time. A token is
+// known by all three; copies made by the emulator keep them, so equal values
+// across the grid are copies of one token (tokens made at the same epoch and
+// position with the same character cannot be told apart). Per-cell statistics
+// are computed from the planes on the worker pool and written straight out,
+// and each capture can be appended to a lineage archive (.bffl) that stores
+// only the tokens that changed since the previous one.
+
+// One epoch of tokens, one entry per program cell in flat order
+struct TokenColumns {
+    int64_t epoch = 0;
+    std::vector<uint8_t> chars;
+    std::vector<uint32_t> epochs;     // epoch the token was made in
+    std::vector<uint16_t> positions;  // its position in the program then
+
+    size_t size() const { return chars.size(); }
+    void resize(size_t count);
+
+    // The packed Token value of entry i
+    uint64_t token(size_t i) const {
+        return (static_cast<uint64_t>(epochs[i]) << 24) | (static_cast<uint64_t>(positions[i]) << 8) | chars[i];
+    }
+
+    // Split tokens into planes; throws std::runtime_error if a token epoch
+    // does not fit the 32-bit epoch plane
+    static TokenColumns from_tokens(Span<const Token> tokens, int64_t epoch, ThreadPool* pool = nullptr);
+};
+
+// Lineage statistics of one cell
+struct CellLineage {
+    double mean_age = 0.0;            // epochs since the cell's tokens were made
+    double median_age = 0.0;
+    uint32_t max_age = 0;
+    double primordial_fraction = 0.0; // share of tokens left from initialization (epoch 0)
+    uint32_t distinct_origins = 0;    // distinct tokens in the cell
+    double origin_entropy = 0.0;      // Shannon entropy of the cell's tokens, in bits
+    double mean_copies = 0.0;         // copies across the grid of the cell's tokens, on average
+    uint32_t max_copies = 0;          // copies of the cell's most widely copied token
+    double churn = 0.0;               // share of tokens changed since the previous capture
+};
+
+// Appends captures to a lineage archive
+//
+//   header:  "BFFL" | version | width | height | program_size | reserved
+//   record:  epoch | full | changed | [changed bitmap] | chars | epochs | positions
+//
+// The first record holds every token; later ones a bitmap of the tokens that
+// changed and the planes of those tokens only. Integers are little-endian.
+class LineageArchiveWriter {
+public:
+    // Throws std::runtime_error if the file cannot be created
+    LineageArchiveWriter(const std::string& filepath, int width, int height, int program_size);
+
+    // Append one capture; previous is the one appended last (nullptr for the first)
+    void append(const TokenColumns& columns, const TokenColumns* previous);
+
+    size_t records_written() const { return records; }
+
+private:
+    std::string filepath;
+    std::ofstream file;
+    size_t cells;
+    size_t records;
+};
+
+// Reads a lineage archive record by record
+class LineageArchiveReader {
+public:
+    // Throws std::runtime_error if the file is missing or not an archive
+    explicit LineageArchiveReader(const std::string& filepath);
+
+    // Apply the next record; false at the end of the archive
+    bool next(TokenColumns& columns);
+
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+    int get_program_size() const { return program_size; }
+
+private:
+    std::string filepath;
+    std::ifstream file;
+    int width;
+    int height;
+    int program_size;
+    bool started;
+};
+
+// Lineage engine: captures the grid's tokens into planes, computes the
+// statistics of every cell and optionally archives the captures
+class TokenLineage {
+public:
+    TokenLineage(int width, int height, int program_size, ThreadPool* pool = nullptr);
+
+    // Capture the grid's tokens at this epoch and compute every cell's statistics
+    void capture(const GridWithTracer& grid, int64_t epoch);
+    void capture(Span<const Token> tokens, int64_t epoch);
+
+    // Append every later capture to this archive (the current one first, if any)
+    void open_archive(const std::string& filepath);
+
+    const TokenColumns& columns() const { return current; }
+    const std::vector<CellLineage>& cells() const { return stats; }
+
+    // Tokens that differ from the previous capture (all of them on the first)
+    size_t changed_tokens() const { return changed; }
+
+    // Per-cell statistics of the last capture, one row per cell
+    void save_csv(const std::string& filepath) const;
+
+private:
+    int width;
+    int height;
+    int program_size;
+    ThreadPool* pool;
+    TokenColumns current;
+    TokenColumns previous;
+    bool has_previous;
+    size_t changed;
+    std::vector<CellLineage> stats;
+    std::vector<uint8_t> changed_flags;  // 1 per token that differs from the previous capture
+    std::unique_ptr<LineageArchiveWriter> archive;
+
+    void compute_stats();
+};
+
+#endif // TOKEN_LINEAGE_H
@@ -5,6 +5,7 @@
 #include <cstdint>
 #include <string>
 #include <random>
+#include "rng.h"
 
 namespace bcolors {
     const std::string RED = "\033[0;30;41m";
@@ -38,8 +39,23 @@ std::vector<uint8_t> mutate(
     std::mt19937& rng
 );
 
+// In-place variants: same random draws as mutate(), without the copy
+void mutate_in_place(uint8_t* program, int length, double mutation_rate);
+
+void mutate_in_place(uint8_t* program, int length, double mutation_rate, std::mt19937& rng);
+
 std::vector<uint8_t> generate_random_program(int length);
 
 std::vector<uint8_t> generate_random_program(int length, std::mt19937& rng);
 
+// Counter-based variants (see rng.h): safe to call from any thread, the
+// result only depends on the stream, not on call order
+void generate_random_program(uint8_t* program, int length, CounterRng& rng);
+
+// Picks mutation sites by geometric skips instead of one draw per byte
+void mutate_in_place(uint8_t* program, int length, double mutation_rate, CounterRng& rng);
+
+// Single-quote text for the shell, e.g. a path given to system()
+std::string shell_quote(const std::string& text);
+
 #endif // UTILS_H
@@ -0,0 +1,45 @@
+#ifndef VIDEO_PIPE_H
+#define VIDEO_PIPE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+
+// Video frames piped to an encoder
+//
+// Starts an encoder process (normally ffmpeg) that reads raw RGB24 frames of
+// a fixed size on its standard input, so frames never touch the disk as
+// images. write() returns false once the encoder has stopped taking frames
+// (it failed to start, or exited); the caller can fall back to image files.
+class VideoPipe {
+public:
+    // Throws std::runtime_error if the command cannot be started at all
+    VideoPipe(const std::string& command, int width, int height);
+    ~VideoPipe();
+
+    VideoPipe(const VideoPipe&) = delete;
+    VideoPipe& operator=(const VideoPipe&) = delete;
+
+    // Send one frame of width * height RGB24 pixels, row by row
+    bool write(const std::vector<uint8_t>& pixels);
+
+    // Close the pipe and wait for the encoder; true if it exited cleanly
+    bool close();
+
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+    int frames_written() const { return frames; }
+
+    // An ffmpeg command encoding the frames to an H.264 file at fps frames per second
+    static std::string ffmpeg_command(const std::string& output, int width, int height, int fps);
+
+private:
+    FILE* pipe;
+    int width;
+    int height;
+    int frames;
+    bool failed;
+};
+
+#endif // VIDEO_PIPE_H
@@ -3,54 +3,148 @@
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <map>
+#include <memory>
 #include <thread>
 #include <mutex>
 #include <atomic>
 #include <cstdint>
 #include <functional>
 
+// Live-view server
+//
+// One event-loop thread (epoll on Linux, kqueue on macOS and the BSDs, poll
+// elsewhere) accepts clients, completes their handshakes, reads their
+// commands and writes their frames, all on non-blocking sockets. Broadcasts
+// only queue messages and wake the loop, so neither a slow client nor many
+// of them hold up an epoch. Each client queues at most MAX_QUEUED_FRAMES
+// messages; further ones are dropped for that client until it catches up.
+//
+// Clients that offer permessage-deflate get compressed messages. Neither side
+// keeps its compression context between messages, so each message is
+// compressed once, on the event loop, for every client that takes it.
+//
+// A plain HTTP GET /metrics on the same port is answered with the text set by
+// set_metrics() (Prometheus exposition format) and then closed.
 class WebSocketServer {
 public:
     WebSocketServer(int port);
     ~WebSocketServer();
 
-    // Start the server in a background thread
+    // Listen on the port and start the event loop in a background thread
     void start();
 
-    // Stop the server
+    // Stop the server, giving queued messages up to a second to go out
     void stop();
 
-    // Broadcast a message to all connected clients
+    // Broadcast a text message to all connected clients
     void broadcast(const std::string& message);
 
+    // Broadcast a binary grid frame (grid_frame.h). Clients that applied
+    // every frame since their last keyframe get delta; new clients, clients
+    // that had a frame dropped and all clients when delta is empty get
+    // keyframe instead (or nothing, if it is empty too).
+    void broadcast_frame(const std::vector<uint8_t>& keyframe, const std::vector<uint8_t>& delta);
+
+    // Broadcast a text message to the clients that sent the "profile" command
+    void broadcast_profile(const std::string& message);
+
+    // Text served on GET /metrics
+    void set_metrics(const std::string& text);
+
+    // Bytes written to client sockets so far
+    uint64_t bytes_sent() const;
+
+    // Whether the next broadcast_frame() needs a keyframe for some client
+    bool wants_keyframe() const;
+
     // Check if any clients are connected
     bool has_clients() const;
 
     // Get number of connected clients
     int get_client_count() const;
 
-    // Set callback for incoming commands
+    // Set callback for incoming commands; it runs on the event loop
     void set_command_callback(std::function<void(const std::string&)> callback);
 
     // Check if paused (thread-safe)
     bool is_paused() const;
 
+    static constexpr size_t MAX_QUEUED_FRAMES = 4;
+    // Largest message accepted from a client, after decompression
+    static constexpr size_t MAX_CLIENT_MESSAGE = 64 * 1024;
+
 private:
-    void server_thread();
-    void handle_client(int client_socket);
-    std::string create_handshake_response(const std::string& key);
-    std::vector<uint8_t> create_websocket_frame(const std::string& message);
-    std::string parse_websocket_frame(const std::vector<uint8_t>& frame);
+    struct Poller;
+    struct Codec;
+
+    // A queued message, shared by every client queue it is in. Its frames are
+    // built on the event loop when first needed.
+    struct Message {
+        std::vector<uint8_t> payload;
+        uint8_t opcode = 0x1;
+        bool compressible = false;
+        std::vector<uint8_t> plain;
+        std::vector<uint8_t> deflated;  // Left empty when it would not be smaller
+        bool deflate_tried = false;
+    };
+    using MessagePtr = std::shared_ptr<Message>;
+
+    struct Client {
+        std::deque<MessagePtr> queue;
+        size_t sent = 0;              // Bytes of queue.front() already written
+        bool needs_keyframe = true;
+        bool deflate = false;         // permessage-deflate was negotiated
+        bool writing = false;         // Waiting for the socket to take more
+        bool closing = false;         // Close once the queue is written
+        bool profile = false;         // Subscribed to broadcast_profile()
+        std::vector<uint8_t> input;   // Received bytes not yet parsed
+        std::vector<uint8_t> message; // Fragments of a message in progress
+        bool message_compressed = false;
+        bool in_message = false;
+    };
+
+    void event_loop();
+    void accept_clients();
+    // Read a handshake in progress; true once the socket is dealt with
+    bool read_handshake(int sock, std::string& request);
+    // Answer a plain HTTP request and close the socket
+    void serve_http(int sock, const std::string& request);
+    // Read and parse what a client sent; false if it should be closed
+    bool read_client(Client& client, int sock, std::vector<std::string>& commands);
+    // Write as much of the queue as the socket takes; false on error
+    bool write_client(Client& client, int sock);
+    void handle_message(Client& client, uint8_t opcode, std::vector<uint8_t>& payload, bool compressed,
+                        std::vector<std::string>& commands);
+    void close_socket(int sock);
+    void wake();
+    // Queue a message for one client; false if its queue is full
+    bool enqueue(Client& client, const MessagePtr& message);
+    static MessagePtr make_message(const uint8_t* payload, size_t size, uint8_t opcode, bool compressible);
+    const std::vector<uint8_t>& wire_frame(Message& message, bool deflate);
+    std::string create_handshake_response(const std::string& key, bool deflate);
+    static std::vector<uint8_t> create_websocket_frame(const uint8_t* payload, size_t size, uint8_t opcode,
+                                                       bool compressed);
 
     int port;
     int server_socket;
+    int wake_read;
+    int wake_write;
     std::atomic<bool> running;
     std::atomic<bool> paused;
-    std::thread server_thread_handle;
-    std::vector<int> client_sockets;
-    std::mutex clients_mutex;
+    std::atomic<bool> wake_pending;
+    std::atomic<uint64_t> total_bytes_sent;
+    std::thread loop_thread_handle;
+    std::unique_ptr<Poller> poller;
+    std::unique_ptr<Codec> codec;
+    std::map<int, std::string> handshakes;  // Requests read so far, by socket; event loop only
+    std::map<int, Client> clients;          // By socket
+    mutable std::mutex clients_mutex;
     std::function<void(const std::string&)> command_callback;
     std::mutex callback_mutex;
+    std::string metrics;
+    std::mutex metrics_mutex;
 };
 
 #endif // WEBSOCKET_SERVER_H
@@ -1,7 +1,7 @@
 #include "metrics.h"
+#include "epoch_reader.h"
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <vector>
 #include <string>
 #include <map>
@@ -13,23 +13,6 @@
 
 namespace fs = std::filesystem;
 
-struct TokenData {
-    int epoch;
-    int grid_x;
-    int grid_y;
-    int pos_in_program;
-    uint64_t token_epoch;
-    uint16_t token_orig_pos;
-    uint8_t character;
-};
-
-struct GridData {
-    int epoch;
-    int width;
-    int height;
-    std::map<std::pair<int, int>, std::vector<uint8_t>> programs;
-};
-
 struct HOEResult {
     int epoch;
     int grid_x;
@@ -64,67 +47,8 @@ std::vector<std::pair<int, int>> get_von_neumann_neighbors(int x, int y, int wid
     return neighbors;
 }
 
-GridData read_token_csv(const std::string& csv_path) {
-    std::cout << "Reading " << csv_path << "..." << std::endl;
-
-    std::ifstream file(csv_path);
-    if (!file.is_open()) {
-        throw std::runtime_error("Could not open file: " + csv_path);
-    }
-
-    GridData data;
-    data.epoch = -1;
-    data.width = 0;
-    data.height = 0;
-
-    std::string line;
-    // Skip header
-    std::getline(file, line);
-
-    while (std::getline(file, line)) {
-        std::stringstream ss(line);
-        std::string field;
-        std::vector<std::string> fields;
-
-        // Parse CSV line
-        while (std::getline(ss, field, ',')) {
-            // Remove quotes if present
-            if (!field.empty() && field.front() == '"') {
-                field = field.substr(1, field.size() - 2);
-            }
-            fields.push_back(field);
-        }
-
-        if (fields.size() < 7) continue;
-
-        TokenData token;
-        token.epoch = std::stoi(fields[0]);
-        token.grid_x = std::stoi(fields[1]);
-        token.grid_y = std::stoi(fields[2]);
-        token.pos_in_program = std::stoi(fields[3]);
-        token.character = static_cast<uint8_t>(std::stoi(fields[6]));
-
-        if (data.epoch == -1) {
-            data.epoch = token.epoch;
-        }
-
-        data.width = std::max(data.width, token.grid_x + 1);
-        data.height = std::max(data.height, token.grid_y + 1);
-
-        auto key = std::make_pair(token.grid_x, token.grid_y);
-        if (data.programs[key].size() <= static_cast<size_t>(token.pos_in_program)) {
-            data.programs[key].resize(token.pos_in_program + 1);
-        }
-        data.programs[key][token.pos_in_program] = token.character;
-    }
-
-    std::cout << "  Grid size: " << data.width << "x" << data.height << ", Epoch: " << data.epoch << std::endl;
-
-    return data;
-}
-
 void analyze_cell_range(
-    const GridData& grid_data,
+    const EpochGrid& grid_data,
     int start_idx,
     int end_idx,
     int radius,
@@ -141,17 +65,15 @@ void analyze_cell_range(
         std::vector<uint8_t> neighborhood_bytes;
 
         // Add cell itself
-        auto cell_key = std::make_pair(x, y);
-        if (grid_data.programs.count(cell_key)) {
-            const auto& program = grid_data.programs.at(cell_key);
+        if (grid_data.has(x, y)) {
+            Span<const uint8_t> program = grid_data.program(x, y);
             neighborhood_bytes.insert(neighborhood_bytes.end(), program.begin(), program.end());
         }
 
         // Add neighbors
         for (const auto& [nx, ny] : neighbors) {
-            auto neighbor_key = std::make_pair(nx, ny);
-            if (grid_data.programs.count(neighbor_key)) {
-                const auto& program = grid_data.programs.at(neighbor_key);
+            if (grid_data.has(nx, ny)) {
+                Span<const uint8_t> program = grid_data.program(nx, ny);
                 neighborhood_bytes.insert(neighborhood_bytes.end(), program.begin(), program.end());
             }
         }
@@ -173,7 +95,7 @@ void analyze_cell_range(
     }
 }
 
-std::vector<HOEResult> analyze_epoch(const GridData& grid_data, int radius, unsigned int num_threads) {
+std::vector<HOEResult> analyze_epoch(const EpochGrid& grid_data, int radius, unsigned int num_threads) {
     int total_cells = grid_data.width * grid_data.height;
 
     std::cout << "  Analyzing " << total_cells << " cells with " << num_threads << " threads..." << std::endl;
@@ -267,30 +189,45 @@ int main(int argc, char* argv[]) {
     std::cout << "Tokens directory: " << tokens_dir << std::endl;
     std::cout << std::endl;
 
-    // Find all CSV files
-    std::vector<std::string> csv_files;
+    // Find all token files; a binary snapshot wins over a CSV of the same epoch
+    std::map<std::string, std::string> files_by_epoch;
     for (const auto& entry : fs::directory_iterator(tokens_dir)) {
-        if (entry.path().extension() == ".csv" &&
+        std::string extension = entry.path().extension().string();
+        if ((extension == ".csv" || extension == ".bffs") &&
             entry.path().filename().string().find("tokens_epoch_") == 0) {
-            csv_files.push_back(entry.path().string());
+            std::string stem = entry.path().stem().string();
+            if (extension == ".bffs" || files_by_epoch.count(stem) == 0) {
+                files_by_epoch[stem] = entry.path().string();
+            }
         }
     }
 
-    std::sort(csv_files.begin(), csv_files.end());
+    std::vector<std::string> token_files;
+    for (const auto& [stem, path] : files_by_epoch) {
+        token_files.push_back(path);
+    }
 
-    if (csv_files.empty()) {
-        std::cerr << "No token CSV files found in " << tokens_dir << std::endl;
+    if (token_files.empty()) {
+        std::cerr << "No token files found in " << tokens_dir << std::endl;
         return 1;
     }
 
-    std::cout << "Found " << csv_files.size() << " token files" << std::endl;
+    std::cout << "Found " << token_files.size() << " token files" << std::endl;
     std::cout << std::endl;
 
     // Analyze each epoch
     std::vector<HOEResult> all_results;
 
-    for (const auto& csv_file : csv_files) {
-        GridData grid_data = read_token_csv(csv_file);
+    // The next epoch file is read in the background while one is analysed
+    EpochPrefetcher prefetcher(read_token_epoch);
+
+    for (size_t i = 0; i < token_files.size(); i++) {
+        std::cout << "Reading " << token_files[i] << "..." << std::endl;
+        std::string next_file = (i + 1 < token_files.size()) ? token_files[i + 1] : "";
+        EpochGrid grid_data = prefetcher.read(token_files[i], next_file);
+        std::cout << "  Grid size: " << grid_data.width << "x" << grid_data.height
+                  << ", Epoch: " << grid_data.epoch << std::endl;
+
         auto results = analyze_epoch(grid_data, radius, num_threads);
         all_results.insert(all_results.end(), results.begin(), results.end());
         std::cout << std::endl;
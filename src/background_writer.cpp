@@ -0,0 +1,84 @@
+#include "background_writer.h"
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+BackgroundWriter::BackgroundWriter(unsigned int threads, size_t capacity, const std::string& what)
+    : capacity(capacity < 1 ? 1 : capacity), what(what), running(0), stopping(false), failed(0) {
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.emplace_back(&BackgroundWriter::run, this);
+    }
+}
+
+BackgroundWriter::~BackgroundWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queue_changed.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void BackgroundWriter::submit(std::function<void()> job) {
+    enqueue(job, false);
+}
+
+bool BackgroundWriter::try_submit(std::function<void()> job) {
+    return enqueue(job, true);
+}
+
+bool BackgroundWriter::enqueue(std::function<void()>& job, bool may_give_up) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (may_give_up && queue.size() >= capacity) {
+        return false;
+    }
+    queue_changed.wait(lock, [this] { return queue.size() < capacity; });
+    queue.push_back(std::move(job));
+    lock.unlock();
+    queue_changed.notify_all();
+    return true;
+}
+
+void BackgroundWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    queue_changed.wait(lock, [this] { return queue.empty() && running == 0; });
+}
+
+size_t BackgroundWriter::failures() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed;
+}
+
+void BackgroundWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        // Drain the queue before honouring a stop request
+        queue_changed.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+            return;
+        }
+
+        std::function<void()> job = std::move(queue.front());
+        queue.pop_front();
+        running++;
+        lock.unlock();
+        queue_changed.notify_all();
+
+        bool ok = true;
+        try {
+            job();
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to write " << what << ": " << e.what() << std::endl;
+            ok = false;
+        }
+
+        lock.lock();
+        running--;
+        if (!ok) {
+            failed++;
+        }
+        queue_changed.notify_all();
+    }
+}
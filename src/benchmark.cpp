@@ -0,0 +1,505 @@
+// Benchmark suite: the hot paths on their own and full grid epochs
+//
+// Each benchmark runs its body in rounds that grow until a round takes at
+// least --min-time seconds, then times --repetitions such
+// rounds and reports the median (and fastest) time per operation. Results
+// go to stdout as a table, or as CSV or JSON for tracking across releases.
+//
+//   bffpp_bench [--filter SUBSTRING] [--min-time SECONDS] [--repetitions N]
+//               [--threads 1,2,4] [--grid-sizes 64,128] [--format text|csv|json]
+//               [--output FILE]
+
+#include "emulator.h"
+#include "emulator_w_tracer.h"
+#include "pair_cache.h"
+#include "utils.h"
+#include "metrics.h"
+#include "grid.h"
+#include "grid_w_tracer.h"
+#include "thread_pool.h"
+#include "snapshot.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <filesystem>
+#include <utility>
+#include <ctime>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// The replicator from test_emulator: copies itself onto the other program
+const std::string REPLICATOR = "[[{.>]-]                ]-]>.{[[";
+
+// Programs (and tapes) in every emulator benchmark
+constexpr int TAPES = 256;
+constexpr int BENCH_PROGRAM_SIZE = 64;
+
+// Results are folded in here so the compiler cannot drop the work
+volatile uint64_t sink = 0;
+
+struct BenchOptions {
+    std::string filter;
+    double min_time = 0.5;
+    int repetitions = 3;
+    std::vector<int> threads;
+    std::vector<int> grid_sizes = {64, 128};
+    std::string format = "text";
+    std::string output;
+};
+
+struct BenchResult {
+    std::string name;
+    uint64_t iterations;   // operations per timed round
+    double ns_per_op;      // median over the repetitions
+    double ns_per_op_min;  // fastest repetition
+    double items_per_op;
+    std::string unit;      // what an item is (tapes, bytes, cells, ...)
+
+    double items_per_second() const { return ns_per_op > 0 ? items_per_op * 1e9 / ns_per_op : 0.0; }
+};
+
+class BenchRunner {
+public:
+    explicit BenchRunner(const BenchOptions& options) : options(options) {}
+
+    // Time fn() per call; one call handles items_per_op items of unit
+    void run(const std::string& name, double items_per_op, const std::string& unit,
+             const std::function<void()>& fn) {
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos) {
+            return;
+        }
+
+        // Warm up, then grow the round until it is long enough to time
+        fn();
+        uint64_t iterations = 1;
+        while (true) {
+            double seconds = time_round(fn, iterations);
+            if (seconds >= options.min_time || iterations >= (1ULL << 40)) {
+                break;
+            }
+            double scale = seconds > 0 ? options.min_time / seconds * 1.2 : 10.0;
+            iterations = std::max(iterations + 1, static_cast<uint64_t>(iterations * std::min(scale, 10.0)));
+        }
+
+        std::vector<double> samples;
+        for (int r = 0; r < options.repetitions; r++) {
+            samples.push_back(time_round(fn, iterations) * 1e9 / iterations);
+        }
+        std::sort(samples.begin(), samples.end());
+
+        BenchResult result{name, iterations, samples[samples.size() / 2], samples.front(), items_per_op, unit};
+        results.push_back(result);
+        // Progress goes to stderr when stdout carries CSV or JSON
+        if (options.format == "text") {
+            print_row(std::cout, result);
+        } else if (!options.output.empty()) {
+            print_row(std::cerr, result);
+        }
+    }
+
+    const std::vector<BenchResult>& get_results() const { return results; }
+
+private:
+    const BenchOptions& options;
+    std::vector<BenchResult> results;
+
+    static double time_round(const std::function<void()>& fn, uint64_t iterations) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            fn();
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static void print_row(std::ostream& out, const BenchResult& r) {
+        out << std::left << std::setw(44) << r.name << std::right
+            << std::setw(14) << std::fixed << std::setprecision(1) << r.ns_per_op << " ns/op"
+            << std::setw(14) << std::setprecision(3) << r.items_per_second() / 1e6 << " M" << r.unit << "/s"
+            << std::endl;
+    }
+};
+
+// ---------------------------------------------------------------- inputs
+
+std::vector<uint8_t> random_bytes(size_t size, std::mt19937& rng) {
+    std::uniform_int_distribution<int> dist(0, 255);
+    std::vector<uint8_t> bytes(size);
+    for (uint8_t& byte : bytes) {
+        byte = static_cast<uint8_t>(dist(rng));
+    }
+    return bytes;
+}
+
+// Pair tapes (programA + programB); replicator tapes start with the
+// replicator in A and padding after it, as a soup taken over by one
+std::vector<std::vector<uint8_t>> make_tapes(bool replicator, std::mt19937& rng) {
+    std::vector<std::vector<uint8_t>> tapes;
+    for (int t = 0; t < TAPES; t++) {
+        std::vector<uint8_t> tape = random_bytes(2 * BENCH_PROGRAM_SIZE, rng);
+        if (replicator) {
+            for (int copy = 0; copy < BENCH_PROGRAM_SIZE / static_cast<int>(REPLICATOR.size()); copy++) {
+                std::copy(REPLICATOR.begin(), REPLICATOR.end(), tape.begin() + copy * REPLICATOR.size());
+            }
+        }
+        tapes.push_back(std::move(tape));
+    }
+    return tapes;
+}
+
+std::string thread_suffix(int threads) {
+    return "/threads:" + std::to_string(threads);
+}
+
+std::string grid_suffix(int width, int height) {
+    return "/" + std::to_string(width) + "x" + std::to_string(height);
+}
+
+// ---------------------------------------------------------------- benchmarks
+
+void bench_emulators(BenchRunner& runner) {
+    std::mt19937 rng(1);
+    for (bool replicator : {false, true}) {
+        std::string kind = replicator ? "replicator" : "random";
+        std::vector<std::vector<uint8_t>> tapes = make_tapes(replicator, rng);
+
+        runner.run("emulate/" + kind, TAPES, "tapes", [&]() {
+            for (const std::vector<uint8_t>& tape : tapes) {
+                sink = sink + emulate(tape, 0, BENCH_PROGRAM_SIZE).iteration;
+            }
+        });
+
+        std::vector<std::vector<Token>> token_tapes;
+        for (const std::vector<uint8_t>& tape : tapes) {
+            token_tapes.push_back(initialize_tokens(tape));
+        }
+        runner.run("emulate_w_tracer/" + kind, TAPES, "tapes", [&]() {
+            for (const std::vector<Token>& tape : token_tapes) {
+                sink = sink + emulate_w_tracer(tape, 0, BENCH_PROGRAM_SIZE).iteration;
+            }
+        });
+
+        // The in-place backends the drivers use, on a reused copy of each
+        // tape, with and without cycle detection
+        std::vector<uint8_t> work(2 * BENCH_PROGRAM_SIZE);
+        for (auto backend : {std::make_pair(EmulatorBackend::Scalar, "scalar"),
+                             std::make_pair(EmulatorBackend::Predecoded, "predecoded")}) {
+            for (bool cycles : {false, true}) {
+                std::string name = std::string("emulate_pair_in_place/") + backend.second +
+                                   (cycles ? "/cycles/" : "/") + kind;
+                runner.run(name, TAPES, "tapes", [&]() {
+                    for (const std::vector<uint8_t>& tape : tapes) {
+                        std::copy(tape.begin(), tape.end(), work.begin());
+                        sink = sink + emulate_pair_in_place(work.data(), work.data() + BENCH_PROGRAM_SIZE,
+                                                            BENCH_PROGRAM_SIZE, 0, BENCH_PROGRAM_SIZE, 0, 8192,
+                                                            backend.first, cycles).iteration;
+                    }
+                });
+            }
+        }
+
+        // Every tape again once the pair cache holds it: the cost of a hit
+        PairCache cache(TAPES);
+        runner.run("emulate_pair_cached/" + kind, TAPES, "tapes", [&]() {
+            for (const std::vector<uint8_t>& tape : tapes) {
+                std::copy(tape.begin(), tape.end(), work.begin());
+                sink = sink + emulate_pair_cached(cache, work.data(), work.data() + BENCH_PROGRAM_SIZE,
+                                                  BENCH_PROGRAM_SIZE).iteration;
+            }
+        });
+
+        std::vector<std::vector<uint8_t>> batch_tapes = tapes;
+        std::vector<EmulatorStats> stats(TAPES);
+        std::vector<EmulatorJob> jobs;
+        for (int t = 0; t < TAPES; t++) {
+            jobs.push_back(EmulatorJob{batch_tapes[t].data(), batch_tapes[t].data() + BENCH_PROGRAM_SIZE, &stats[t]});
+        }
+        runner.run("emulate_batch/" + kind, TAPES, "tapes", [&]() {
+            for (int t = 0; t < TAPES; t++) {
+                std::copy(tapes[t].begin(), tapes[t].end(), batch_tapes[t].begin());
+            }
+            emulate_batch(jobs.data(), jobs.size(), BENCH_PROGRAM_SIZE, 0, BENCH_PROGRAM_SIZE);
+            sink = sink + stats[0].iteration;
+        });
+    }
+}
+
+void bench_mutation(BenchRunner& runner) {
+    std::mt19937 rng(2);
+    std::vector<uint8_t> program = random_bytes(BENCH_PROGRAM_SIZE, rng);
+
+    runner.run("mutate/copy", BENCH_PROGRAM_SIZE, "bytes", [&]() {
+        sink = sink + mutate(program, 0.001, rng)[0];
+    });
+    runner.run("mutate_in_place/mt19937", BENCH_PROGRAM_SIZE, "bytes", [&]() {
+        mutate_in_place(program.data(), BENCH_PROGRAM_SIZE, 0.001, rng);
+        sink = sink + program[0];
+    });
+    uint64_t cell = 0;
+    runner.run("mutate_in_place/counter", BENCH_PROGRAM_SIZE, "bytes", [&]() {
+        CounterRng cell_rng(3, RngDomain::Mutation, 1, cell++);
+        mutate_in_place(program.data(), BENCH_PROGRAM_SIZE, 0.001, cell_rng);
+        sink = sink + program[0];
+    });
+}
+
+void bench_pairing(BenchRunner& runner, const BenchOptions& options) {
+    for (int size : options.grid_sizes) {
+        Grid grid(size, size, BENCH_PROGRAM_SIZE);
+        std::mt19937 rng(4);
+        double cells = static_cast<double>(size) * size;
+
+        runner.run("create_spatial_pairs/mt19937" + grid_suffix(size, size), cells, "cells", [&]() {
+            sink = sink + grid.create_spatial_pairs(2, rng).size();
+        });
+        uint64_t epoch = 1;
+        runner.run("create_spatial_pairs/counter" + grid_suffix(size, size), cells, "cells", [&]() {
+            sink = sink + grid.create_spatial_pairs(2, 5, epoch++).size();
+        });
+        for (int threads : options.threads) {
+            ThreadPool pool(threads);
+            runner.run("create_tiled_pairs" + grid_suffix(size, size) + thread_suffix(threads), cells, "cells",
+                       [&]() { sink = sink + grid.create_tiled_pairs(2, 5, epoch++, &pool).size(); });
+        }
+    }
+}
+
+void bench_metrics(BenchRunner& runner) {
+    std::mt19937 rng(6);
+    for (size_t size : {size_t(1) << 16, size_t(1) << 18}) {
+        // A soup halfway between noise and a copied program
+        std::vector<uint8_t> soup = random_bytes(size, rng);
+        for (size_t i = 0; i < size / 2; i++) {
+            soup[i] = static_cast<uint8_t>(REPLICATOR[i % REPLICATOR.size()]);
+        }
+        std::string label = std::to_string(size / 1024) + "KiB";
+        runner.run("shannon_entropy/" + label, static_cast<double>(size), "bytes", [&]() {
+            sink = sink + static_cast<uint64_t>(shannon_entropy(soup.data(), soup.size()) * 1000);
+        });
+        runner.run("higher_order_entropy/" + label, static_cast<double>(size), "bytes", [&]() {
+            sink = sink + static_cast<uint64_t>(higher_order_entropy(soup.data(), soup.size()) * 1000);
+        });
+    }
+}
+
+void bench_output(BenchRunner& runner, const BenchOptions& options) {
+    std::string csv_path = (fs::temp_directory_path() / "bffpp_bench_output.csv").string();
+    for (int size : options.grid_sizes) {
+        std::mt19937 rng(7);
+        Grid grid(size, size, BENCH_PROGRAM_SIZE);
+        grid.initialize_random(rng);
+        double cells = static_cast<double>(size) * size;
+
+        runner.run("Grid::to_json" + grid_suffix(size, size), cells, "cells", [&]() {
+            sink = sink + grid.to_json(1, 0.5, 100.0, 0.25).size();
+        });
+
+        // Every cell freshly written, so the colors are computed again
+        runner.run("Grid::to_json/uncached" + grid_suffix(size, size), cells, "cells", [&]() {
+            for (int i = 0; i < grid.get_total_programs(); i++) {
+                grid.program_at(i);
+            }
+            sink = sink + grid.to_json(1, 0.5, 100.0, 0.25).size();
+        });
+
+        std::vector<int32_t> partners = pairing_index(grid.create_spatial_pairs(2, rng), grid.get_total_programs());
+        runner.run("Grid::save_pairing_csv" + grid_suffix(size, size), cells, "cells", [&]() {
+            grid.save_pairing_csv(csv_path, 1, partners);
+        });
+
+        GridWithTracer tracer(size, size, BENCH_PROGRAM_SIZE);
+        tracer.initialize_random(rng);
+        runner.run("GridWithTracer::save_tokens_to_csv" + grid_suffix(size, size), cells, "cells", [&]() {
+            tracer.save_tokens_to_csv(csv_path, 1);
+        });
+    }
+    fs::remove(csv_path);
+}
+
+// One bffpp_grid epoch with counter-based streams: pairing, the pairs on the
+// pool in their next-epoch slots, mutation on the pool, then the swap
+void run_grid_epoch(Grid& grid, ThreadPool& pool, uint64_t seed, uint64_t epoch) {
+    const Grid& current = grid;
+    int program_size = grid.get_program_size();
+    grid.begin_epoch();
+    std::vector<std::pair<int, int>> pairs = grid.create_spatial_pairs(2, seed, epoch);
+
+    pool.parallel_for(pairs.size(), 0, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            int idx_a = pairs[i].first;
+            int idx_b = pairs[i].second;
+            if (idx_a != -1) {
+                std::copy(current.program_at(idx_a).begin(), current.program_at(idx_a).end(),
+                          grid.next_program(idx_a).begin());
+            }
+            std::copy(current.program_at(idx_b).begin(), current.program_at(idx_b).end(),
+                      grid.next_program(idx_b).begin());
+            if (idx_a != -1) {
+                emulate_pair_in_place(grid.next_program(idx_a).data(), grid.next_program(idx_b).data(),
+                                      program_size, 0, program_size);
+            }
+            for (int idx : {idx_a, idx_b}) {
+                if (idx != -1) {
+                    CounterRng cell_rng(seed, RngDomain::Mutation, epoch, idx);
+                    mutate_in_place(grid.next_program(idx).data(), program_size, 0.001, cell_rng);
+                }
+            }
+        }
+    });
+    grid.commit_epoch();
+}
+
+void bench_epochs(BenchRunner& runner, const BenchOptions& options) {
+    for (int size : options.grid_sizes) {
+        for (int threads : options.threads) {
+            ThreadPool pool(threads);
+            Grid grid(size, size, BENCH_PROGRAM_SIZE);
+            pool.parallel_for(grid.get_total_programs(), 0, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    CounterRng cell_rng(8, RngDomain::Initialization, 0, i);
+                    grid.initialize_program(static_cast<int>(i), cell_rng);
+                }
+            });
+            uint64_t epoch = 1;
+            runner.run("epoch/grid" + grid_suffix(size, size) + thread_suffix(threads),
+                       static_cast<double>(size) * size, "cells", [&]() { run_grid_epoch(grid, pool, 8, epoch++); });
+        }
+    }
+}
+
+// ---------------------------------------------------------------- output
+
+std::string json_escape(const std::string& text) {
+    std::string escaped;
+    for (char ch : text) {
+        if (ch == '"' || ch == '\\') {
+            escaped += '\\';
+        }
+        escaped += ch;
+    }
+    return escaped;
+}
+
+void write_results(std::ostream& out, const BenchOptions& options, const std::vector<BenchResult>& results) {
+    if (options.format == "csv") {
+        out << "name,iterations,ns_per_op,ns_per_op_min,items_per_second,unit\n";
+        for (const BenchResult& r : results) {
+            out << r.name << "," << r.iterations << "," << std::fixed << std::setprecision(2) << r.ns_per_op << ","
+                << r.ns_per_op_min << "," << std::setprecision(1) << r.items_per_second() << "," << r.unit << "\n";
+        }
+    } else if (options.format == "json") {
+        std::time_t now = std::time(nullptr);
+        char timestamp[32];
+        std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+        out << "{\n  \"version\": 1,\n"
+            << "  \"timestamp\": \"" << timestamp << "\",\n"
+#ifdef __VERSION__
+            << "  \"compiler\": \"" << json_escape(__VERSION__) << "\",\n"
+#endif
+            << "  \"hardware_threads\": " << ThreadPool::resolve_thread_count(0) << ",\n"
+            << "  \"min_time\": " << options.min_time << ",\n"
+            << "  \"repetitions\": " << options.repetitions << ",\n"
+            << "  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchResult& r = results[i];
+            out << (i ? "," : "") << "\n    {\"name\": \"" << json_escape(r.name) << "\", \"iterations\": "
+                << r.iterations << std::fixed << std::setprecision(2) << ", \"ns_per_op\": " << r.ns_per_op
+                << ", \"ns_per_op_min\": " << r.ns_per_op_min << std::setprecision(1)
+                << ", \"items_per_second\": " << r.items_per_second() << ", \"unit\": \"" << r.unit << "\"}";
+        }
+        out << "\n  ]\n}\n";
+    }
+}
+
+std::vector<int> parse_list(const std::string& text) {
+    std::vector<int> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        values.push_back(std::stoi(item));
+        if (values.back() <= 0) {
+            throw std::runtime_error("List values must be positive: " + text);
+        }
+    }
+    return values;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value for " + arg);
+            }
+            std::string value = argv[++i];
+            if (arg == "--filter") {
+                options.filter = value;
+            } else if (arg == "--min-time") {
+                options.min_time = std::stod(value);
+            } else if (arg == "--repetitions") {
+                options.repetitions = std::max(1, std::stoi(value));
+            } else if (arg == "--threads") {
+                options.threads = parse_list(value);
+            } else if (arg == "--grid-sizes") {
+                options.grid_sizes = parse_list(value);
+            } else if (arg == "--format") {
+                options.format = value;
+            } else if (arg == "--output") {
+                options.output = value;
+            } else {
+                throw std::runtime_error("Unknown option: " + arg);
+            }
+        }
+        if (options.format != "text" && options.format != "csv" && options.format != "json") {
+            throw std::runtime_error("--format must be text, csv or json");
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Thread counts default to 1, 2, 4, ... up to the machine's
+    if (options.threads.empty()) {
+        unsigned int hardware = ThreadPool::resolve_thread_count(0);
+        for (unsigned int threads = 1; threads < hardware; threads *= 2) {
+            options.threads.push_back(static_cast<int>(threads));
+        }
+        options.threads.push_back(static_cast<int>(hardware));
+    }
+
+    BenchRunner runner(options);
+    bench_emulators(runner);
+    bench_mutation(runner);
+    bench_pairing(runner, options);
+    bench_metrics(runner);
+    bench_output(runner, options);
+    bench_epochs(runner, options);
+
+    if (options.format != "text") {
+        if (options.output.empty()) {
+            write_results(std::cout, options, runner.get_results());
+        } else {
+            std::ofstream file(options.output);
+            if (!file.is_open()) {
+                std::cerr << "Error: could not open " << options.output << std::endl;
+                return 1;
+            }
+            write_results(file, options, runner.get_results());
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,449 @@
+#include "checkpoint.h"
+#include "byte_order.h"
+#include "profiler.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <iterator>
+#include <iomanip>
+
+namespace {
+
+using namespace byte_order;
+
+constexpr size_t HEADER_SIZE = 64;
+constexpr size_t SECTION_HEADER_SIZE = 16;
+constexpr size_t DRIVER_NAME_SIZE = 32;
+
+enum class SectionType : uint32_t {
+    Grid = 1,       // kind | width | height | program_size | all programs
+    GridDelta = 2,  // kind | width | height | program_size | count | indices | changed programs
+    Rng = 3,        // engine state text
+    History = 4,    // doubles
+    Base = 5        // file name of the full checkpoint a delta applies to
+};
+
+constexpr size_t GRID_HEADER_SIZE = 16;
+
+size_t padded(size_t size) {
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+// Bytes of one program of a grid, and where the programs start
+size_t program_bytes(const Snapshot& grid) {
+    size_t cell = (grid.kind == SnapshotKind::Tokens) ? sizeof(uint64_t) : 1;
+    return cell * grid.program_size;
+}
+
+const uint8_t* grid_data(const Snapshot& grid) {
+    return (grid.kind == SnapshotKind::Tokens) ? reinterpret_cast<const uint8_t*>(grid.tokens.data())
+                                               : grid.bytes.data();
+}
+
+uint8_t* grid_data(Snapshot& grid) {
+    return (grid.kind == SnapshotKind::Tokens) ? reinterpret_cast<uint8_t*>(grid.tokens.data())
+                                               : grid.bytes.data();
+}
+
+size_t grid_size(const Snapshot& grid) {
+    return static_cast<size_t>(grid.total_programs()) * program_bytes(grid);
+}
+
+class SectionWriter {
+public:
+    std::vector<uint8_t> buffer;
+    uint32_t sections = 0;
+
+    // Reserve a section; returns the offset of its payload
+    size_t begin(SectionType type, uint32_t index, size_t size) {
+        size_t offset = buffer.size();
+        buffer.resize(offset + SECTION_HEADER_SIZE + padded(size), 0);
+        put_u32(buffer.data() + offset, static_cast<uint32_t>(type));
+        put_u32(buffer.data() + offset + 4, index);
+        put_u64(buffer.data() + offset + 8, size);
+        sections++;
+        return offset + SECTION_HEADER_SIZE;
+    }
+
+    void add(SectionType type, uint32_t index, const void* data, size_t size) {
+        size_t offset = begin(type, index, size);
+        if (size > 0) {
+            std::memcpy(buffer.data() + offset, data, size);
+        }
+    }
+};
+
+void put_grid_header(uint8_t* out, const Snapshot& grid) {
+    put_u32(out, static_cast<uint32_t>(grid.kind));
+    put_u32(out + 4, static_cast<uint32_t>(grid.width));
+    put_u32(out + 8, static_cast<uint32_t>(grid.height));
+    put_u32(out + 12, static_cast<uint32_t>(grid.program_size));
+}
+
+Snapshot get_grid_header(const uint8_t* in, const std::string& name) {
+    Snapshot grid;
+    grid.kind = static_cast<SnapshotKind>(get_u32(in));
+    grid.width = static_cast<int>(get_u32(in + 4));
+    grid.height = static_cast<int>(get_u32(in + 8));
+    grid.program_size = static_cast<int>(get_u32(in + 12));
+    if (grid.kind != SnapshotKind::Programs && grid.kind != SnapshotKind::Tokens) {
+        throw std::runtime_error("Unknown grid kind in checkpoint " + name);
+    }
+
+    size_t cells = static_cast<size_t>(grid.total_programs()) * grid.program_size;
+    if (grid.kind == SnapshotKind::Tokens) {
+        grid.tokens.resize(cells);
+    } else {
+        grid.bytes.resize(cells);
+    }
+    return grid;
+}
+
+std::string directory_of(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return (slash == std::string::npos) ? std::string() : path.substr(0, slash + 1);
+}
+
+std::string file_name_of(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return (slash == std::string::npos) ? path : path.substr(slash + 1);
+}
+
+// One file, without following its base
+Checkpoint parse_checkpoint(const std::vector<uint8_t>& contents, const std::string& name,
+                            int64_t& base_epoch, std::string& base_file,
+                            std::vector<std::vector<int32_t>>& changed, std::vector<bool>& delta) {
+    const uint8_t* data = contents.data();
+    size_t size = contents.size();
+
+    if (!host_is_little_endian()) {
+        throw std::runtime_error("Checkpoints can only be read on little-endian hosts: " + name);
+    }
+    if (size < HEADER_SIZE || std::memcmp(data, CHECKPOINT_MAGIC, 4) != 0) {
+        throw std::runtime_error("Not a checkpoint file: " + name);
+    }
+    if (get_u32(data + 4) != CHECKPOINT_VERSION) {
+        throw std::runtime_error("Unsupported checkpoint version in " + name);
+    }
+
+    Checkpoint checkpoint;
+    uint32_t num_sections = get_u32(data + 8);
+    checkpoint.epoch = static_cast<int64_t>(get_u64(data + 16));
+    base_epoch = static_cast<int64_t>(get_u64(data + 24));
+    const char* driver = reinterpret_cast<const char*>(data + 32);
+    checkpoint.driver.assign(driver, strnlen(driver, DRIVER_NAME_SIZE));
+
+    size_t offset = HEADER_SIZE;
+    for (uint32_t s = 0; s < num_sections; s++) {
+        if (offset + SECTION_HEADER_SIZE > size) {
+            throw std::runtime_error("Truncated checkpoint file: " + name);
+        }
+        SectionType type = static_cast<SectionType>(get_u32(data + offset));
+        uint32_t index = get_u32(data + offset + 4);
+        size_t section_size = get_u64(data + offset + 8);
+        offset += SECTION_HEADER_SIZE;
+        if (section_size > size - offset) {
+            throw std::runtime_error("Truncated checkpoint file: " + name);
+        }
+        const uint8_t* payload = data + offset;
+
+        if (type == SectionType::Grid || type == SectionType::GridDelta) {
+            if (section_size < GRID_HEADER_SIZE || index != checkpoint.grids.size()) {
+                throw std::runtime_error("Corrupt grid section in checkpoint " + name);
+            }
+            Snapshot grid = get_grid_header(payload, name);
+            std::vector<int32_t> indices;
+
+            if (type == SectionType::Grid) {
+                if (section_size != GRID_HEADER_SIZE + grid_size(grid)) {
+                    throw std::runtime_error("Checkpoint grid does not match its size in " + name);
+                }
+                std::memcpy(grid_data(grid), payload + GRID_HEADER_SIZE, grid_size(grid));
+            } else {
+                // The changed programs stay in the section until the base is loaded
+                if (section_size < GRID_HEADER_SIZE + 8) {
+                    throw std::runtime_error("Corrupt grid section in checkpoint " + name);
+                }
+                uint64_t count = get_u64(payload + GRID_HEADER_SIZE);
+                size_t indices_offset = GRID_HEADER_SIZE + 8;
+                size_t programs_offset = indices_offset + padded(count * sizeof(int32_t));
+                if (count > static_cast<uint64_t>(grid.total_programs()) ||
+                    section_size != programs_offset + count * program_bytes(grid)) {
+                    throw std::runtime_error("Checkpoint changes do not match the grid size in " + name);
+                }
+                indices.resize(count);
+                std::memcpy(indices.data(), payload + indices_offset, count * sizeof(int32_t));
+                for (size_t i = 0; i < count; i++) {
+                    if (indices[i] < 0 || indices[i] >= grid.total_programs()) {
+                        throw std::runtime_error("Checkpoint change outside the grid in " + name);
+                    }
+                    std::memcpy(grid_data(grid) + static_cast<size_t>(indices[i]) * program_bytes(grid),
+                                payload + programs_offset + i * program_bytes(grid), program_bytes(grid));
+                }
+            }
+            checkpoint.grids.push_back(std::move(grid));
+            changed.push_back(std::move(indices));
+            delta.push_back(type == SectionType::GridDelta);
+        } else if (type == SectionType::Rng) {
+            checkpoint.rng_states.emplace_back(reinterpret_cast<const char*>(payload), section_size);
+        } else if (type == SectionType::History) {
+            if (section_size % sizeof(double) != 0) {
+                throw std::runtime_error("Corrupt history section in checkpoint " + name);
+            }
+            std::vector<double> history(section_size / sizeof(double));
+            if (!history.empty()) {
+                std::memcpy(history.data(), payload, section_size);
+            }
+            checkpoint.histories.push_back(std::move(history));
+        } else if (type == SectionType::Base) {
+            base_file.assign(reinterpret_cast<const char*>(payload), section_size);
+        }
+        // Unknown section types are skipped, so newer writers stay readable
+
+        offset += padded(section_size);
+    }
+
+    return checkpoint;
+}
+
+// Whether an incremental checkpoint can be taken against base
+bool same_layout(const Checkpoint& checkpoint, const Checkpoint& base) {
+    if (checkpoint.grids.size() != base.grids.size()) {
+        return false;
+    }
+    for (size_t g = 0; g < checkpoint.grids.size(); g++) {
+        const Snapshot& grid = checkpoint.grids[g];
+        const Snapshot& base_grid = base.grids[g];
+        if (grid.kind != base_grid.kind || grid.width != base_grid.width || grid.height != base_grid.height ||
+            grid.program_size != base_grid.program_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<uint8_t> read_file(const std::string& filepath) {
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: " + filepath);
+    }
+    return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+std::string rng_state(const std::mt19937& rng) {
+    std::ostringstream out;
+    out << rng;
+    return out.str();
+}
+
+void restore_rng_state(std::mt19937& rng, const std::string& state) {
+    std::istringstream in(state);
+    in >> rng;
+    if (in.fail()) {
+        throw std::runtime_error("Invalid random engine state in checkpoint");
+    }
+}
+
+std::string checkpoint_path(const std::string& directory, const std::string& driver, int64_t epoch) {
+    std::ostringstream path;
+    path << directory << "/" << driver << "_epoch_" << std::setfill('0') << std::setw(6) << epoch << ".bffc";
+    return path.str();
+}
+
+void write_checkpoint(const std::string& filepath, const Checkpoint& checkpoint,
+                      const Checkpoint* base, const std::string& base_path) {
+    if (checkpoint.driver.size() > DRIVER_NAME_SIZE) {
+        throw std::runtime_error("Checkpoint driver name is too long: " + checkpoint.driver);
+    }
+    if (base && base->grids.size() != checkpoint.grids.size()) {
+        throw std::runtime_error("Incremental checkpoint does not match its base: " + filepath);
+    }
+
+    SectionWriter sections;
+    for (size_t g = 0; g < checkpoint.grids.size(); g++) {
+        const Snapshot& grid = checkpoint.grids[g];
+        size_t cells = static_cast<size_t>(grid.total_programs()) * grid.program_size;
+        bool tokens = grid.kind == SnapshotKind::Tokens;
+        if ((tokens ? grid.tokens.size() : grid.bytes.size()) != cells) {
+            throw std::runtime_error("Checkpoint programs do not match the grid size: " + filepath);
+        }
+
+        const Snapshot* base_grid = base ? &base->grids[g] : nullptr;
+        if (base_grid && (base_grid->kind != grid.kind || grid_size(*base_grid) != grid_size(grid))) {
+            throw std::runtime_error("Incremental checkpoint does not match its base: " + filepath);
+        }
+
+        // Only the programs that differ from the base, unless that is no smaller
+        size_t stride = program_bytes(grid);
+        std::vector<int32_t> indices;
+        if (base_grid) {
+            for (int i = 0; i < grid.total_programs(); i++) {
+                if (std::memcmp(grid_data(grid) + i * stride, grid_data(*base_grid) + i * stride, stride) != 0) {
+                    indices.push_back(i);
+                }
+            }
+        }
+        size_t indices_offset = GRID_HEADER_SIZE + 8;
+        size_t programs_offset = indices_offset + padded(indices.size() * sizeof(int32_t));
+
+        if (!base_grid || programs_offset + indices.size() * stride >= GRID_HEADER_SIZE + grid_size(grid)) {
+            size_t offset = sections.begin(SectionType::Grid, static_cast<uint32_t>(g),
+                                           GRID_HEADER_SIZE + grid_size(grid));
+            put_grid_header(sections.buffer.data() + offset, grid);
+            std::memcpy(sections.buffer.data() + offset + GRID_HEADER_SIZE, grid_data(grid), grid_size(grid));
+            continue;
+        }
+
+        size_t offset = sections.begin(SectionType::GridDelta, static_cast<uint32_t>(g),
+                                       programs_offset + indices.size() * stride);
+        uint8_t* out = sections.buffer.data() + offset;
+        put_grid_header(out, grid);
+        put_u64(out + GRID_HEADER_SIZE, indices.size());
+        if (!indices.empty()) {
+            std::memcpy(out + indices_offset, indices.data(), indices.size() * sizeof(int32_t));
+        }
+        for (size_t i = 0; i < indices.size(); i++) {
+            std::memcpy(out + programs_offset + i * stride, grid_data(grid) + indices[i] * stride, stride);
+        }
+    }
+
+    for (const std::string& state : checkpoint.rng_states) {
+        sections.add(SectionType::Rng, 0, state.data(), state.size());
+    }
+    for (const std::vector<double>& history : checkpoint.histories) {
+        sections.add(SectionType::History, 0, history.data(), history.size() * sizeof(double));
+    }
+    if (base) {
+        std::string base_file = file_name_of(base_path);
+        sections.add(SectionType::Base, 0, base_file.data(), base_file.size());
+    }
+
+    uint8_t header[HEADER_SIZE] = {};
+    std::memcpy(header, CHECKPOINT_MAGIC, 4);
+    put_u32(header + 4, CHECKPOINT_VERSION);
+    put_u32(header + 8, sections.sections);
+    put_u64(header + 16, static_cast<uint64_t>(checkpoint.epoch));
+    put_u64(header + 24, static_cast<uint64_t>(base ? base->epoch : -1));
+    std::memcpy(header + 32, checkpoint.driver.data(), checkpoint.driver.size());
+
+    std::string temporary = filepath + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Could not open checkpoint file: " + temporary);
+        }
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(sections.buffer.data()), sections.buffer.size());
+        if (!file) {
+            throw std::runtime_error("Failed to write checkpoint file: " + temporary);
+        }
+        profile_count(ProfileCounter::BytesWritten, static_cast<uint64_t>(file.tellp()));
+    }
+    if (std::rename(temporary.c_str(), filepath.c_str()) != 0) {
+        throw std::runtime_error("Could not rename checkpoint file to " + filepath);
+    }
+}
+
+Checkpoint read_checkpoint(const std::string& filepath) {
+    int64_t base_epoch = -1;
+    std::string base_file;
+    std::vector<std::vector<int32_t>> changed;
+    std::vector<bool> delta;
+    Checkpoint checkpoint = parse_checkpoint(read_file(filepath), filepath, base_epoch, base_file, changed, delta);
+    if (base_epoch < 0) {
+        return checkpoint;
+    }
+
+    if (base_file.empty()) {
+        throw std::runtime_error("Incremental checkpoint names no base: " + filepath);
+    }
+    std::string base_path = directory_of(filepath) + base_file;
+    int64_t base_base_epoch = -1;
+    std::string unused_file;
+    std::vector<std::vector<int32_t>> unused_changes;
+    std::vector<bool> unused_delta;
+    Checkpoint base = parse_checkpoint(read_file(base_path), base_path, base_base_epoch, unused_file,
+                                       unused_changes, unused_delta);
+    if (base_base_epoch >= 0 || base.epoch != base_epoch || base.driver != checkpoint.driver ||
+        base.grids.size() != checkpoint.grids.size()) {
+        throw std::runtime_error("Checkpoint " + filepath + " does not match its base " + base_path);
+    }
+
+    // Unchanged programs come from the base
+    for (size_t g = 0; g < checkpoint.grids.size(); g++) {
+        if (!delta[g]) {
+            continue;
+        }
+        Snapshot& grid = checkpoint.grids[g];
+        const Snapshot& base_grid = base.grids[g];
+        if (base_grid.kind != grid.kind || grid_size(base_grid) != grid_size(grid)) {
+            throw std::runtime_error("Checkpoint " + filepath + " does not match its base " + base_path);
+        }
+
+        size_t stride = program_bytes(grid);
+        std::vector<uint8_t> is_changed(grid.total_programs(), 0);
+        for (int32_t index : changed[g]) {
+            is_changed[index] = 1;
+        }
+        for (int i = 0; i < grid.total_programs(); i++) {
+            if (!is_changed[i]) {
+                std::memcpy(grid_data(grid) + i * stride, grid_data(base_grid) + i * stride, stride);
+            }
+        }
+    }
+
+    return checkpoint;
+}
+
+void check_checkpoint(const Checkpoint& checkpoint, const std::string& driver, size_t grids,
+                      int width, int height, int program_size) {
+    if (checkpoint.driver != driver) {
+        throw std::runtime_error("Checkpoint was written by " + checkpoint.driver + ", not " + driver);
+    }
+    if (checkpoint.grids.size() != grids) {
+        throw std::runtime_error("Checkpoint holds " + std::to_string(checkpoint.grids.size()) +
+                                 " grids, expected " + std::to_string(grids));
+    }
+    for (const Snapshot& grid : checkpoint.grids) {
+        if (grid.width != width || grid.height != height || grid.program_size != program_size) {
+            throw std::runtime_error("Checkpoint grid is " + std::to_string(grid.width) + "x" +
+                                     std::to_string(grid.height) + " with programs of " +
+                                     std::to_string(grid.program_size) + ", which does not match the config");
+        }
+    }
+}
+
+CheckpointWriter::CheckpointWriter(int full_interval, size_t max_pending)
+    : full_interval(full_interval < 1 ? 1 : full_interval), written(0), writer(1, max_pending, "checkpoint") {}
+
+void CheckpointWriter::submit(const std::string& filepath, Checkpoint checkpoint) {
+    writer.submit([this, filepath, checkpoint = std::move(checkpoint)]() mutable { write(filepath, checkpoint); });
+}
+
+void CheckpointWriter::write(const std::string& filepath, Checkpoint& checkpoint) {
+    bool full = base_path.empty() || written % full_interval == 0 || !same_layout(checkpoint, base);
+    try {
+        write_checkpoint(filepath, checkpoint, full ? nullptr : &base, base_path);
+    } catch (const std::exception&) {
+        // A failed full checkpoint leaves nothing to take increments against
+        if (full) {
+            base_path.clear();
+            base = Checkpoint();
+            written = 0;
+        }
+        throw;
+    }
+
+    // Later increments are taken against a full one
+    if (full) {
+        base_path = filepath;
+        base = std::move(checkpoint);
+        written = 1;
+    } else {
+        written++;
+    }
+}
@@ -12,6 +12,29 @@ Config load_config(const std::string& filename) {
     config.grid_width = 0;
     config.grid_height = 0;
     config.visualization_interval = 100;
+    config.num_threads = 0;
+    config.counter_rng = false;
+    config.fused_mutation = false;
+    config.emulator_backend = "scalar";
+    config.cycle_detection = false;
+    config.pair_cache_size = 0;
+    config.pairing = "sequential";
+    config.numa_tiles = false;
+    config.soup_file = "";
+    config.stream_shard_pairs = 4096;
+    config.brotli_quality = 11;
+    config.brotli_window = 22;
+    config.hoe_shards = 1;
+    config.snapshot_format = "csv";
+    config.snapshot_compression = "none";
+    config.checkpoint_interval = 0;
+    config.checkpoint_full_interval = 10;
+    config.live_frames = "json";
+    config.token_lineage = false;
+    config.output_threads = 0;
+    config.output_queue = 8;
+    config.output_backpressure = "block";
+    config.profile_interval = 0;
 
     std::ifstream file(filename);
 
@@ -70,6 +93,52 @@ Config load_config(const std::string& filename) {
             config.use_grid = (value == "true" || value == "1" || value == "yes");
         } else if (key == "visualization_interval") {
             config.visualization_interval = std::stoi(value);
+        } else if (key == "num_threads") {
+            config.num_threads = std::stoi(value);
+        } else if (key == "counter_rng") {
+            config.counter_rng = (value == "true" || value == "1" || value == "yes");
+        } else if (key == "fused_mutation") {
+            config.fused_mutation = (value == "true" || value == "1" || value == "yes");
+        } else if (key == "emulator_backend") {
+            config.emulator_backend = value;
+        } else if (key == "cycle_detection") {
+            config.cycle_detection = (value == "true" || value == "1" || value == "yes");
+        } else if (key == "pair_cache_size") {
+            config.pair_cache_size = std::stoi(value);
+        } else if (key == "pairing") {
+            config.pairing = value;
+        } else if (key == "numa_tiles") {
+            config.numa_tiles = (value == "true" || value == "1" || value == "yes");
+        } else if (key == "soup_file") {
+            config.soup_file = value;
+        } else if (key == "stream_shard_pairs") {
+            config.stream_shard_pairs = std::stoi(value);
+        } else if (key == "brotli_quality") {
+            config.brotli_quality = std::stoi(value);
+        } else if (key == "brotli_window") {
+            config.brotli_window = std::stoi(value);
+        } else if (key == "hoe_shards") {
+            config.hoe_shards = std::stoi(value);
+        } else if (key == "snapshot_format") {
+            config.snapshot_format = value;
+        } else if (key == "snapshot_compression") {
+            config.snapshot_compression = value;
+        } else if (key == "checkpoint_interval") {
+            config.checkpoint_interval = std::stoi(value);
+        } else if (key == "checkpoint_full_interval") {
+            config.checkpoint_full_interval = std::stoi(value);
+        } else if (key == "live_frames") {
+            config.live_frames = value;
+        } else if (key == "token_lineage") {
+            config.token_lineage = (value == "true" || value == "1" || value == "yes");
+        } else if (key == "output_threads") {
+            config.output_threads = std::stoi(value);
+        } else if (key == "output_queue") {
+            config.output_queue = std::stoi(value);
+        } else if (key == "output_backpressure") {
+            config.output_backpressure = value;
+        } else if (key == "profile_interval") {
+            config.profile_interval = std::stoi(value);
         }
     }
 
@@ -78,6 +147,70 @@ Config load_config(const std::string& filename) {
         config.soup_size = config.grid_width * config.grid_height;
     }
 
+    // Workers mutate in whatever order they finish, which only the
+    // counter-based streams can reproduce
+    if (config.fused_mutation && !config.counter_rng) {
+        throw std::runtime_error("fused_mutation requires counter_rng: true in " + filename);
+    }
+
+    if (config.brotli_quality < 0 || config.brotli_quality > 11) {
+        throw std::runtime_error("brotli_quality must be between 0 and 11 in " + filename);
+    }
+    if (config.brotli_window < 10 || config.brotli_window > 24) {
+        throw std::runtime_error("brotli_window must be between 10 and 24 in " + filename);
+    }
+    if (config.hoe_shards < 1) {
+        throw std::runtime_error("hoe_shards must be >= 1 in " + filename);
+    }
+
+    if (config.emulator_backend != "scalar" && config.emulator_backend != "predecoded" &&
+        config.emulator_backend != "batch") {
+        throw std::runtime_error("emulator_backend must be scalar, predecoded or batch in " + filename);
+    }
+    if (config.pair_cache_size < 0) {
+        throw std::runtime_error("pair_cache_size must be >= 0 in " + filename);
+    }
+    if (config.stream_shard_pairs < 1) {
+        throw std::runtime_error("stream_shard_pairs must be >= 1 in " + filename);
+    }
+
+    if (config.pairing != "sequential" && config.pairing != "tiled") {
+        throw std::runtime_error("pairing must be sequential or tiled in " + filename);
+    }
+    if (config.pairing == "tiled" && !config.counter_rng) {
+        throw std::runtime_error("pairing: tiled requires counter_rng: true in " + filename);
+    }
+    if (config.numa_tiles && !config.counter_rng) {
+        throw std::runtime_error("numa_tiles requires counter_rng: true in " + filename);
+    }
+
+    if (config.snapshot_format != "csv" && config.snapshot_format != "binary") {
+        throw std::runtime_error("snapshot_format must be csv or binary in " + filename);
+    }
+    if (config.snapshot_compression != "none" && config.snapshot_compression != "brotli") {
+        throw std::runtime_error("snapshot_compression must be none or brotli in " + filename);
+    }
+
+    if (config.checkpoint_interval < 0 || config.checkpoint_full_interval < 1) {
+        throw std::runtime_error("checkpoint_interval must be >= 0 and checkpoint_full_interval >= 1 in " +
+                                 filename);
+    }
+
+    if (config.live_frames != "json" && config.live_frames != "binary") {
+        throw std::runtime_error("live_frames must be json or binary in " + filename);
+    }
+
+    if (config.output_threads < 0 || config.output_queue < 1) {
+        throw std::runtime_error("output_threads must be >= 0 and output_queue >= 1 in " + filename);
+    }
+    if (config.output_backpressure != "block" && config.output_backpressure != "drop_frames") {
+        throw std::runtime_error("output_backpressure must be block or drop_frames in " + filename);
+    }
+
+    if (config.profile_interval < 0) {
+        throw std::runtime_error("profile_interval must be >= 0 in " + filename);
+    }
+
     file.close();
     return config;
 }
@@ -20,114 +20,324 @@
  */
 
 #include "emulator.h"
+#include "bracket_index.h"
+#include "cycle_detector.h"
 #include "utils.h"
+#include "profiler.h"
 #include <iostream>
+#include <cstring>
+#include <array>
+#include <type_traits>
 
-EmulatorResult emulate(
-    std::vector<uint8_t> tape,
-    int head0_pos,
-    int head1_pos,
-    int pc_pos,
-    int max_iter,
-    int verbose
-) {
-    const std::string instructions = "<>{}-+.,[]";
+const char* emulator_status_name(EmulatorStatus status) {
+    switch (status) {
+        case EmulatorStatus::Finished: return "Finished";
+        case EmulatorStatus::Terminated: return "Terminated";
+        case EmulatorStatus::UnmatchedOpen: return "Error, Unmatched [";
+        case EmulatorStatus::UnmatchedClose: return "Error, Unmatched ]";
+    }
+    return "Terminated";
+}
+
+namespace {
+
+// Tape of a size known only at run time: heads wrap with a modulo, and
+// verbose runs print the tape after every step
+struct RuntimeTape {
+    uint8_t* data;
+    int length;
+    int verbose;
+
+    int size() const { return length; }
+    uint8_t& operator[](int i) { return data[i]; }
+    int prev(int pos) const { return (pos - 1 + length) % length; }
+    int next(int pos) const { return (pos + 1) % length; }
+
+    void trace(int iteration, int head0_pos, int head1_pos, int pc_pos) const {
+        if (verbose > 0) {
+            std::cout << "Iteration: " << iteration << "\t\t";
+            print_tape(std::vector<uint8_t>(data, data + length), head0_pos, head1_pos, pc_pos, false);
+        }
+    }
+};
+
+// Tape of exactly TapeSize bytes: head moves wrap with a mask instead of
+// a modulo, and the tape is a local array the compiler can keep in
+// registers or on the stack
+template <int TapeSize>
+struct FixedTape {
+    static_assert(TapeSize > 0 && (TapeSize & (TapeSize - 1)) == 0, "mask wraparound needs a power-of-two tape");
+    static constexpr int MASK = TapeSize - 1;
+
+    std::array<uint8_t, TapeSize>& data;
+
+    static constexpr int size() { return TapeSize; }
+    uint8_t& operator[](int i) { return data[i]; }
+    static int prev(int pos) { return (pos - 1) & MASK; }
+    static int next(int pos) { return (pos + 1) & MASK; }
+
+    void trace(int, int, int, int) const {}
+};
+
+// The interpreter loop over either tape; Profile adds opcode and jump
+// counts for profiler.h, DetectCycles skips the repeats of loops that
+// write nothing
+template <typename Tape, bool Profile, bool DetectCycles>
+EmulatorStats run(Tape tape, int head0_pos, int head1_pos, int pc_pos, int max_iter) {
     const uint8_t zero = '0';
-    const uint8_t open_bracket = '[';
-    const uint8_t close_bracket = ']';
+    const int tape_size = tape.size();
 
-    int tape_size = tape.size();
     int iteration = 0;
     int skipped = 0;
-    std::string state = "Terminated";
+    EmulatorStatus status = EmulatorStatus::Terminated;
+
+    // Jump targets are looked up instead of scanned for. The index is kept
+    // per thread so its storage is reused from one pair to the next.
+    thread_local BracketIndex brackets;
+    brackets.invalidate();
+    auto char_at = [&tape](int i) { return tape[i]; };
+    [[maybe_unused]] std::conditional_t<Profile, EmulatorTally, char> tally{};
+    [[maybe_unused]] std::conditional_t<DetectCycles, CycleDetector, char> cycles{};
 
     while (iteration < max_iter) {
         uint8_t instr = tape[pc_pos];
+        if constexpr (Profile) {
+            tally.op(instr);
+        }
 
         if (instr == '<') {
-            head0_pos = (head0_pos - 1 + tape_size) % tape_size;
+            head0_pos = tape.prev(head0_pos);
         }
         else if (instr == '>') {
-            head0_pos = (head0_pos + 1) % tape_size;
+            head0_pos = tape.next(head0_pos);
         }
         else if (instr == '{') {
-            head1_pos = (head1_pos - 1 + tape_size) % tape_size;
+            head1_pos = tape.prev(head1_pos);
         }
         else if (instr == '}') {
-            head1_pos = (head1_pos + 1) % tape_size;
+            head1_pos = tape.next(head1_pos);
         }
         else if (instr == '-') {
-            tape[head0_pos] = (tape[head0_pos] - 1) % 256;
+            uint8_t old_value = tape[head0_pos];
+            tape[head0_pos] = old_value - 1;
+            brackets.note_write(old_value, tape[head0_pos]);
         }
         else if (instr == '+') {
-            tape[head0_pos] = (tape[head0_pos] + 1) % 256;
+            uint8_t old_value = tape[head0_pos];
+            tape[head0_pos] = old_value + 1;
+            brackets.note_write(old_value, tape[head0_pos]);
         }
         else if (instr == '.') {
+            brackets.note_write(tape[head1_pos], tape[head0_pos]);
             tape[head1_pos] = tape[head0_pos];
         }
         else if (instr == ',') {
+            brackets.note_write(tape[head0_pos], tape[head1_pos]);
             tape[head0_pos] = tape[head1_pos];
         }
         else if (instr == '[') {
             if (tape[head0_pos] == zero) {
-                int diff = 1;
-                for (int i = pc_pos + 1; i < tape_size; i++) {
-                    if (tape[i] == open_bracket) {
-                        diff++;
-                    } else if (tape[i] == close_bracket) {
-                        diff--;
-                    }
-
-                    if (diff == 0) {
-                        pc_pos = i;
-                        break;
+                if (brackets.is_stale()) {
+                    brackets.rebuild(tape_size, char_at);
+                    if constexpr (Profile) {
+                        tally.rebuild(tape_size);
                     }
                 }
 
-                if (diff != 0) {
-                    state = "Error, Unmatched [";
+                int target = brackets.partner(pc_pos);
+                if (target == BracketIndex::UNMATCHED) {
+                    status = EmulatorStatus::UnmatchedOpen;
                     break;
                 }
+                if constexpr (Profile) {
+                    tally.jump(pc_pos, target);
+                }
+                pc_pos = target;
             }
         }
         else if (instr == ']') {
             if (tape[head0_pos] != zero) {
-                int diff = 1;
-                for (int i = pc_pos - 1; i >= 0; i--) {
-                    if (tape[i] == close_bracket) {
-                        diff++;
-                    } else if (tape[i] == open_bracket) {
-                        diff--;
-                    }
-
-                    if (diff == 0) {
-                        pc_pos = i;
-                        break;
+                if (brackets.is_stale()) {
+                    brackets.rebuild(tape_size, char_at);
+                    if constexpr (Profile) {
+                        tally.rebuild(tape_size);
                     }
                 }
 
-                if (diff != 0) {
-                    state = "Error, Unmatched ]";
+                int target = brackets.partner(pc_pos);
+                if (target == BracketIndex::UNMATCHED) {
+                    status = EmulatorStatus::UnmatchedClose;
                     break;
                 }
+                if constexpr (Profile) {
+                    tally.jump(pc_pos, target);
+                }
+                pc_pos = target;
             }
         }
         else {
             skipped++;
         }
 
-        if (verbose > 0) {
-            std::cout << "Iteration: " << iteration << "\t\t";
-            print_tape(tape, head0_pos, head1_pos, pc_pos, false);
-        }
+        tape.trace(iteration, head0_pos, head1_pos, pc_pos);
 
         iteration++;
         pc_pos = pc_pos + 1;
         if (pc_pos >= tape_size) {
-            state = "Finished";
+            status = EmulatorStatus::Finished;
             break;
         }
+
+        if constexpr (DetectCycles) {
+            if (instr == '-' || instr == '+' || instr == '.' || instr == ',') {
+                cycles.note_write();
+            }
+            CycleDetector::Check seen = cycles.check(pc_pos, head0_pos, head1_pos, iteration, skipped);
+            if (seen == CycleDetector::Check::Repeated) {
+                int repeats = cycles.skip_repeats(iteration, skipped, max_iter);
+                if constexpr (Profile) {
+                    tally.repeat(repeats);
+                }
+            } else if (seen == CycleDetector::Check::Saved) {
+                if constexpr (Profile) {
+                    tally.mark();
+                }
+            }
+        }
+    }
+
+    return EmulatorStats{status, iteration, skipped};
+}
+
+// run() instantiated for the profiling and cycle-detection settings
+template <typename Tape>
+EmulatorStats run_for(Tape tape, int head0_pos, int head1_pos, int pc_pos, int max_iter, bool detect_cycles) {
+    bool profile = profiling_enabled();
+    if (detect_cycles) {
+        return profile ? run<Tape, true, true>(tape, head0_pos, head1_pos, pc_pos, max_iter)
+                       : run<Tape, false, true>(tape, head0_pos, head1_pos, pc_pos, max_iter);
+    }
+    return profile ? run<Tape, true, false>(tape, head0_pos, head1_pos, pc_pos, max_iter)
+                   : run<Tape, false, false>(tape, head0_pos, head1_pos, pc_pos, max_iter);
+}
+
+} // namespace
+
+EmulatorStats emulate_in_place(
+    uint8_t* tape,
+    int tape_size,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos,
+    int max_iter,
+    int verbose,
+    bool detect_cycles
+) {
+    return run_for(RuntimeTape{tape, tape_size, verbose}, head0_pos, head1_pos, pc_pos, max_iter, detect_cycles);
+}
+
+namespace {
+
+// Pair entry point for one fixed size: the halves are copied straight
+// into the local tape and back
+template <int TapeSize>
+EmulatorStats emulate_fixed_pair(
+    uint8_t* programA,
+    uint8_t* programB,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos,
+    int max_iter,
+    bool detect_cycles
+) {
+    constexpr int HALF = TapeSize / 2;
+    std::array<uint8_t, TapeSize> tape;
+    std::memcpy(tape.data(), programA, HALF);
+    std::memcpy(tape.data() + HALF, programB, HALF);
+
+    EmulatorStats stats = run_for(FixedTape<TapeSize>{tape}, head0_pos, head1_pos, pc_pos, max_iter, detect_cycles);
+
+    std::memcpy(programA, tape.data(), HALF);
+    std::memcpy(programB, tape.data() + HALF, HALF);
+    return stats;
+}
+
+} // namespace
+
+template <int TapeSize>
+EmulatorStats emulate_fixed_in_place(uint8_t* tape, int head0_pos, int head1_pos, int pc_pos, int max_iter,
+                                     bool detect_cycles) {
+    std::array<uint8_t, TapeSize> local;
+    std::memcpy(local.data(), tape, TapeSize);
+    EmulatorStats stats = run_for(FixedTape<TapeSize>{local}, head0_pos, head1_pos, pc_pos, max_iter, detect_cycles);
+    std::memcpy(tape, local.data(), TapeSize);
+    return stats;
+}
+
+template EmulatorStats emulate_fixed_in_place<32>(uint8_t*, int, int, int, int, bool);
+template EmulatorStats emulate_fixed_in_place<64>(uint8_t*, int, int, int, int, bool);
+template EmulatorStats emulate_fixed_in_place<128>(uint8_t*, int, int, int, int, bool);
+template EmulatorStats emulate_fixed_in_place<256>(uint8_t*, int, int, int, int, bool);
+
+EmulatorStats emulate_pair_in_place(
+    uint8_t* programA,
+    uint8_t* programB,
+    int program_size,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos,
+    int max_iter,
+    EmulatorBackend backend,
+    bool detect_cycles
+) {
+    // Common power-of-two tapes have their own instantiation
+    if (backend == EmulatorBackend::Scalar) {
+        switch (2 * program_size) {
+            case 32: return emulate_fixed_pair<32>(programA, programB, head0_pos, head1_pos, pc_pos, max_iter,
+                                                  detect_cycles);
+            case 64: return emulate_fixed_pair<64>(programA, programB, head0_pos, head1_pos, pc_pos, max_iter,
+                                                  detect_cycles);
+            case 128: return emulate_fixed_pair<128>(programA, programB, head0_pos, head1_pos, pc_pos, max_iter,
+                                                  detect_cycles);
+            case 256: return emulate_fixed_pair<256>(programA, programB, head0_pos, head1_pos, pc_pos, max_iter,
+                                                  detect_cycles);
+            default: break;
+        }
     }
 
-    return EmulatorResult{tape, state, iteration, skipped};
+    // The two programs live in separate buffers, so run them on a per-thread
+    // scratch tape and copy the halves back; no allocation after warm-up
+    thread_local std::vector<uint8_t> scratch;
+    scratch.resize(2 * program_size);
+
+    std::memcpy(scratch.data(), programA, program_size);
+    std::memcpy(scratch.data() + program_size, programB, program_size);
+
+    EmulatorStats stats = (backend == EmulatorBackend::Predecoded)
+        ? emulate_predecoded_in_place(scratch.data(), 2 * program_size, head0_pos, head1_pos, pc_pos, max_iter,
+                                      detect_cycles)
+        : emulate_in_place(scratch.data(), 2 * program_size, head0_pos, head1_pos, pc_pos, max_iter, 0,
+                           detect_cycles);
+
+    std::memcpy(programA, scratch.data(), program_size);
+    std::memcpy(programB, scratch.data() + program_size, program_size);
+
+    return stats;
+}
+
+EmulatorResult emulate(
+    std::vector<uint8_t> tape,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos,
+    int max_iter,
+    int verbose,
+    bool detect_cycles
+) {
+    EmulatorStats stats = emulate_in_place(
+        tape.data(), static_cast<int>(tape.size()),
+        head0_pos, head1_pos, pc_pos, max_iter, verbose, detect_cycles
+    );
+
+    return EmulatorResult{tape, emulator_status_name(stats.status), stats.iteration, stats.skipped};
 }
@@ -0,0 +1,379 @@
+/*
+ * Lockstep batch emulator
+ *
+ * Runs EMULATOR_BATCH_LANES pairs at once in the lanes of AVX-512
+ * registers: every lane keeps its own pc and heads, and one pass of the
+ * loop executes one instruction on every running lane. Instructions are
+ * decoded with vector compares instead of a branch chain, tape reads are
+ * gathers and tape writes are masked scatters. Each lane's tape is held as
+ * 32-bit cells so that gathers and scatters hit exactly one byte of the
+ * program.
+ *
+ * Bracket jumps use a per-lane partner table built with the same rules as
+ * BracketIndex, rebuilt only when a lane overwrites or creates a bracket.
+ *
+ * CPUs without AVX-512 (and non-x86 builds) run the jobs one at a time
+ * through emulate_pair_in_place(), so results never depend on the CPU.
+ */
+
+#include "emulator.h"
+#include "bracket_index.h"
+#include <vector>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BFFPP_BATCH_AVX512 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+void emulate_batch_scalar(
+    const EmulatorJob* jobs,
+    size_t count,
+    int program_size,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos,
+    int max_iter,
+    bool detect_cycles
+) {
+    for (size_t i = 0; i < count; i++) {
+        *jobs[i].stats = emulate_pair_in_place(
+            jobs[i].programA, jobs[i].programB, program_size, head0_pos, head1_pos, pc_pos, max_iter,
+            EmulatorBackend::Scalar, detect_cycles
+        );
+    }
+}
+
+#ifdef BFFPP_BATCH_AVX512
+
+// One lane per 32-bit element of a 512-bit register. The lanes are split
+// into groups that step in the same loop pass: a group's step is one long
+// chain of dependent gathers, and independent groups let the CPU overlap
+// those chains instead of waiting on each one.
+constexpr int GROUP_LANES = 16;
+constexpr int GROUPS = EMULATOR_BATCH_LANES / GROUP_LANES;
+static_assert(EMULATOR_BATCH_LANES % GROUP_LANES == 0, "lanes come in whole registers");
+
+// Once this few lanes are left and no jobs are waiting, a vector step
+// costs more than finishing the stragglers one by one
+constexpr int DRAIN_LANES = 8;
+
+struct LaneGroup {
+    __m512i base;        // Offset of each lane's tape in the cell buffer
+    __m512i pc;
+    __m512i head0;
+    __m512i head1;
+    __m512i iteration;
+    __m512i skipped;
+    __mmask16 active;
+    uint32_t stale;      // Lanes whose partner table needs a rebuild
+    const EmulatorJob* job[GROUP_LANES];
+};
+
+struct BatchContext {
+    const EmulatorJob* jobs;
+    size_t count;
+    size_t next_job;
+    int program_size;
+    int tape_size;
+    int head0_pos;
+    int head1_pos;
+    int pc_pos;
+    int max_iter;
+    bool detect_cycles;
+    int32_t* cells;      // Lane tapes as 32-bit cells, back to back
+    int32_t* partners;   // Matching bracket of every cell, per lane
+};
+
+int32_t* lane_cells(const BatchContext& ctx, int group, int lane) {
+    return ctx.cells + static_cast<size_t>(group * GROUP_LANES + lane) * ctx.tape_size;
+}
+
+void load_lane(BatchContext& ctx, LaneGroup& g, int group, int lane) {
+    const EmulatorJob* job = &ctx.jobs[ctx.next_job++];
+    g.job[lane] = job;
+    int32_t* tape = lane_cells(ctx, group, lane);
+    for (int i = 0; i < ctx.program_size; i++) {
+        tape[i] = job->programA[i];
+        tape[ctx.program_size + i] = job->programB[i];
+    }
+    g.stale |= 1u << lane;
+}
+
+void store_lane(const BatchContext& ctx, const LaneGroup& g, int group, int lane) {
+    const int32_t* tape = lane_cells(ctx, group, lane);
+    for (int i = 0; i < ctx.program_size; i++) {
+        g.job[lane]->programA[i] = static_cast<uint8_t>(tape[i]);
+        g.job[lane]->programB[i] = static_cast<uint8_t>(tape[ctx.program_size + i]);
+    }
+}
+
+void rebuild_lane(const BatchContext& ctx, int group, int lane) {
+    thread_local BracketIndex brackets;
+    const int32_t* tape = lane_cells(ctx, group, lane);
+    int32_t* partner = ctx.partners + (tape - ctx.cells);
+    brackets.rebuild(ctx.tape_size, [tape](int i) { return static_cast<uint8_t>(tape[i]); });
+    for (int i = 0; i < ctx.tape_size; i++) {
+        partner[i] = brackets.partner(i);
+    }
+}
+
+__attribute__((target("avx512f")))
+inline __mmask16 lanes_equal(__m512i values, char c) {
+    return _mm512_cmpeq_epi32_mask(values, _mm512_set1_epi32(c));
+}
+
+// One instruction on every running lane of the group
+__attribute__((target("avx512f")))
+inline void step_group(BatchContext& ctx, LaneGroup& g, int group) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i tape_size = _mm512_set1_epi32(ctx.tape_size);
+    const __mmask16 active = g.active;
+
+    __m512i pc_cell = _mm512_add_epi32(g.base, g.pc);
+    __m512i instr = _mm512_mask_i32gather_epi32(zero, active, pc_cell, ctx.cells, 4);
+
+    // Matching bracket, fetched before we know whether a jump happens so
+    // that it is not on the critical path. Unused for stale lanes.
+    __m512i target = _mm512_mask_i32gather_epi32(zero, active, pc_cell, ctx.partners, 4);
+
+    // Decode by comparing against each instruction character
+    __mmask16 left0 = lanes_equal(instr, '<');
+    __mmask16 right0 = lanes_equal(instr, '>');
+    __mmask16 left1 = lanes_equal(instr, '{');
+    __mmask16 right1 = lanes_equal(instr, '}');
+    __mmask16 minus = lanes_equal(instr, '-');
+    __mmask16 plus = lanes_equal(instr, '+');
+    __mmask16 copy_to = lanes_equal(instr, '.');
+    __mmask16 copy_from = lanes_equal(instr, ',');
+    __mmask16 open = lanes_equal(instr, '[');
+    __mmask16 close = lanes_equal(instr, ']');
+    __mmask16 writes = active & (minus | plus | copy_to | copy_from);
+    __mmask16 skip = active & ~(left0 | right0 | left1 | right1 | minus | plus | copy_to | copy_from | open | close);
+
+    // Head moves, wrapping around the tape
+    __m512i head0 = _mm512_mask_add_epi32(g.head0, right0, g.head0, one);
+    head0 = _mm512_mask_sub_epi32(head0, left0, head0, one);
+    head0 = _mm512_mask_add_epi32(head0, _mm512_cmplt_epi32_mask(head0, zero), head0, tape_size);
+    head0 = _mm512_mask_sub_epi32(head0, _mm512_cmpge_epi32_mask(head0, tape_size), head0, tape_size);
+    __m512i head1 = _mm512_mask_add_epi32(g.head1, right1, g.head1, one);
+    head1 = _mm512_mask_sub_epi32(head1, left1, head1, one);
+    head1 = _mm512_mask_add_epi32(head1, _mm512_cmplt_epi32_mask(head1, zero), head1, tape_size);
+    head1 = _mm512_mask_sub_epi32(head1, _mm512_cmpge_epi32_mask(head1, tape_size), head1, tape_size);
+    g.head0 = head0;
+    g.head1 = head1;
+
+    // value is what tape[head0] holds after this instruction, whether or
+    // not the instruction writes: '.' stores tape[head0] at head1, the
+    // others store at head0
+    __m512i src = _mm512_add_epi32(g.base, _mm512_mask_mov_epi32(head0, copy_from, head1));
+    __m512i value = _mm512_mask_i32gather_epi32(zero, active, src, ctx.cells, 4);
+    value = _mm512_mask_add_epi32(value, plus, value, one);
+    value = _mm512_mask_sub_epi32(value, minus, value, one);
+    value = _mm512_and_si512(value, _mm512_set1_epi32(0xFF));
+
+    if (writes) {
+        __m512i dst = _mm512_add_epi32(g.base, _mm512_mask_mov_epi32(head0, copy_to, head1));
+        __m512i old_value = _mm512_mask_i32gather_epi32(zero, writes, dst, ctx.cells, 4);
+        _mm512_mask_i32scatter_epi32(ctx.cells, writes, dst, value, 4);
+
+        const __m512i char_open = _mm512_set1_epi32('[');
+        const __m512i char_close = _mm512_set1_epi32(']');
+        g.stale |= writes & (_mm512_cmpeq_epi32_mask(old_value, char_open) |
+                             _mm512_cmpeq_epi32_mask(old_value, char_close) |
+                             _mm512_cmpeq_epi32_mask(value, char_open) |
+                             _mm512_cmpeq_epi32_mask(value, char_close));
+    }
+
+    // Bracket jumps
+    __mmask16 is_zero = _mm512_cmpeq_epi32_mask(value, _mm512_set1_epi32('0'));
+    __mmask16 jump = active & ((open & is_zero) | (close & ~is_zero));
+    __mmask16 unmatched = 0;
+    __m512i pc = g.pc;
+    if (jump) {
+        uint32_t rebuild = jump & g.stale;
+        if (rebuild) {
+            for (uint32_t bits = rebuild; bits; bits &= bits - 1) {
+                rebuild_lane(ctx, group, __builtin_ctz(bits));
+            }
+            g.stale &= ~rebuild;
+            target = _mm512_mask_i32gather_epi32(target, static_cast<__mmask16>(rebuild), pc_cell, ctx.partners, 4);
+        }
+        unmatched = jump & _mm512_cmpeq_epi32_mask(target, _mm512_set1_epi32(BracketIndex::UNMATCHED));
+        pc = _mm512_mask_mov_epi32(pc, jump & ~unmatched, target);
+    }
+
+    // Advance
+    __mmask16 running = active & ~unmatched;
+    g.iteration = _mm512_mask_add_epi32(g.iteration, running, g.iteration, one);
+    g.skipped = _mm512_mask_add_epi32(g.skipped, skip, g.skipped, one);
+    pc = _mm512_mask_add_epi32(pc, running, pc, one);
+    g.pc = pc;
+
+    __mmask16 finished = running & _mm512_cmpge_epi32_mask(pc, tape_size);
+    __mmask16 terminated = running & ~finished &
+                           _mm512_cmpge_epi32_mask(g.iteration, _mm512_set1_epi32(ctx.max_iter));
+    __mmask16 stopped = unmatched | finished | terminated;
+    if (stopped == 0) {
+        return;
+    }
+
+    // Hand results back and refill the lanes from the remaining jobs
+    alignas(64) int32_t iteration[GROUP_LANES];
+    alignas(64) int32_t skipped[GROUP_LANES];
+    _mm512_store_si512(iteration, g.iteration);
+    _mm512_store_si512(skipped, g.skipped);
+
+    __mmask16 refilled = 0;
+    for (uint32_t bits = stopped; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        uint32_t bit = 1u << lane;
+        EmulatorStatus status = (finished & bit) ? EmulatorStatus::Finished
+                              : (terminated & bit) ? EmulatorStatus::Terminated
+                              : (open & bit) ? EmulatorStatus::UnmatchedOpen
+                              : EmulatorStatus::UnmatchedClose;
+        store_lane(ctx, g, group, lane);
+        *g.job[lane]->stats = EmulatorStats{status, iteration[lane], skipped[lane]};
+
+        if (ctx.next_job < ctx.count) {
+            load_lane(ctx, g, group, lane);
+            refilled |= static_cast<__mmask16>(bit);
+        } else {
+            g.active &= static_cast<__mmask16>(~bit);
+        }
+    }
+
+    g.pc = _mm512_mask_mov_epi32(g.pc, refilled, _mm512_set1_epi32(ctx.pc_pos));
+    g.head0 = _mm512_mask_mov_epi32(g.head0, refilled, _mm512_set1_epi32(ctx.head0_pos));
+    g.head1 = _mm512_mask_mov_epi32(g.head1, refilled, _mm512_set1_epi32(ctx.head1_pos));
+    g.iteration = _mm512_mask_mov_epi32(g.iteration, refilled, zero);
+    g.skipped = _mm512_mask_mov_epi32(g.skipped, refilled, zero);
+}
+
+// Finish a group's running lanes on the scalar emulator, which picks up
+// from the lane registers exactly where the vector loop stopped
+__attribute__((target("avx512f")))
+void drain_group(BatchContext& ctx, LaneGroup& g, int group) {
+    alignas(64) int32_t pc[GROUP_LANES];
+    alignas(64) int32_t head0[GROUP_LANES];
+    alignas(64) int32_t head1[GROUP_LANES];
+    alignas(64) int32_t iteration[GROUP_LANES];
+    alignas(64) int32_t skipped[GROUP_LANES];
+    _mm512_store_si512(pc, g.pc);
+    _mm512_store_si512(head0, g.head0);
+    _mm512_store_si512(head1, g.head1);
+    _mm512_store_si512(iteration, g.iteration);
+    _mm512_store_si512(skipped, g.skipped);
+
+    thread_local std::vector<uint8_t> scratch;
+    scratch.resize(ctx.tape_size);
+
+    for (uint32_t bits = g.active; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        const int32_t* tape = lane_cells(ctx, group, lane);
+        for (int i = 0; i < ctx.tape_size; i++) {
+            scratch[i] = static_cast<uint8_t>(tape[i]);
+        }
+
+        EmulatorStats rest = emulate_in_place(
+            scratch.data(), ctx.tape_size, head0[lane], head1[lane], pc[lane], ctx.max_iter - iteration[lane], 0,
+            ctx.detect_cycles
+        );
+
+        const EmulatorJob* job = g.job[lane];
+        std::memcpy(job->programA, scratch.data(), ctx.program_size);
+        std::memcpy(job->programB, scratch.data() + ctx.program_size, ctx.program_size);
+        *job->stats = EmulatorStats{rest.status, iteration[lane] + rest.iteration, skipped[lane] + rest.skipped};
+    }
+    g.active = 0;
+}
+
+__attribute__((target("avx512f")))
+void emulate_batch_avx512(
+    const EmulatorJob* jobs,
+    size_t count,
+    int program_size,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos,
+    int max_iter,
+    bool detect_cycles
+) {
+    const int tape_size = 2 * program_size;
+
+    thread_local std::vector<int32_t> cells;
+    thread_local std::vector<int32_t> partners;
+    cells.resize(static_cast<size_t>(EMULATOR_BATCH_LANES) * tape_size);
+    partners.resize(static_cast<size_t>(EMULATOR_BATCH_LANES) * tape_size);
+
+    BatchContext ctx{jobs, count, 0, program_size, tape_size, head0_pos, head1_pos, pc_pos, max_iter,
+                     detect_cycles, cells.data(), partners.data()};
+
+    const __m512i lane_index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    LaneGroup groups[GROUPS];
+    for (int group = 0; group < GROUPS; group++) {
+        LaneGroup& g = groups[group];
+        g.base = _mm512_mullo_epi32(_mm512_add_epi32(lane_index, _mm512_set1_epi32(group * GROUP_LANES)),
+                                    _mm512_set1_epi32(tape_size));
+        g.pc = _mm512_set1_epi32(pc_pos);
+        g.head0 = _mm512_set1_epi32(head0_pos);
+        g.head1 = _mm512_set1_epi32(head1_pos);
+        g.iteration = _mm512_setzero_si512();
+        g.skipped = _mm512_setzero_si512();
+        g.active = 0;
+        g.stale = 0;
+        for (int lane = 0; lane < GROUP_LANES && ctx.next_job < count; lane++) {
+            load_lane(ctx, g, group, lane);
+            g.active |= static_cast<__mmask16>(1u << lane);
+        }
+    }
+
+    while (true) {
+        int running = 0;
+        for (int group = 0; group < GROUPS; group++) {
+            if (groups[group].active) {
+                step_group(ctx, groups[group], group);
+            }
+            running += __builtin_popcount(groups[group].active);
+        }
+
+        if (ctx.next_job >= count && running <= DRAIN_LANES) {
+            for (int group = 0; group < GROUPS; group++) {
+                drain_group(ctx, groups[group], group);
+            }
+            break;
+        }
+    }
+}
+
+bool cpu_has_avx512() {
+    static const bool supported = __builtin_cpu_supports("avx512f");
+    return supported;
+}
+
+#endif // BFFPP_BATCH_AVX512
+
+} // namespace
+
+void emulate_batch(
+    const EmulatorJob* jobs,
+    size_t count,
+    int program_size,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos,
+    int max_iter,
+    bool detect_cycles
+) {
+#ifdef BFFPP_BATCH_AVX512
+    // Small batches would spend most steps with idle lanes
+    if (max_iter > 0 && count >= static_cast<size_t>(EMULATOR_BATCH_LANES) && cpu_has_avx512()) {
+        emulate_batch_avx512(jobs, count, program_size, head0_pos, head1_pos, pc_pos, max_iter, detect_cycles);
+        return;
+    }
+#endif
+    emulate_batch_scalar(jobs, count, program_size, head0_pos, head1_pos, pc_pos, max_iter, detect_cycles);
+}
@@ -0,0 +1,295 @@
+/*
+ * Pre-decoded emulator
+ *
+ * Same semantics as emulate_in_place(), but the tape is first decoded into
+ * an opcode stream and dispatched through a switch over the opcodes, which
+ * the compiler lowers to a jump table. Along with its opcode every
+ * position stores the length of the run of identical opcodes starting
+ * there, so a run of no-op bytes is skipped in one step and a run of
+ * '+', '-', '<', '>', '{' or '}' is applied as a single counted operation.
+ *
+ * Writes that change a byte's opcode re-decode that position and fix up
+ * the run lengths in front of it, so the stream always matches the tape.
+ */
+
+#include "emulator.h"
+#include "bracket_index.h"
+#include "cycle_detector.h"
+#include "profiler.h"
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+namespace {
+
+// In the order of profiler.h's opcode slots, so a tally can take them as is
+enum Opcode : uint8_t {
+    OP_SKIP,         // Any byte that is not an instruction
+    OP_HEAD0_LEFT,   // <
+    OP_HEAD0_RIGHT,  // >
+    OP_HEAD1_LEFT,   // {
+    OP_HEAD1_RIGHT,  // }
+    OP_DECREMENT,    // -
+    OP_INCREMENT,    // +
+    OP_COPY_TO_HEAD1,    // .
+    OP_COPY_FROM_HEAD1,  // ,
+    OP_OPEN,         // [
+    OP_CLOSE         // ]
+};
+
+// Opcodes whose runs can be executed as one counted step
+bool foldable(uint8_t op) {
+    return op <= OP_INCREMENT;
+}
+
+struct OpcodeTable {
+    uint8_t ops[256];
+
+    OpcodeTable() {
+        std::fill(ops, ops + 256, OP_SKIP);
+        ops[static_cast<uint8_t>('<')] = OP_HEAD0_LEFT;
+        ops[static_cast<uint8_t>('>')] = OP_HEAD0_RIGHT;
+        ops[static_cast<uint8_t>('{')] = OP_HEAD1_LEFT;
+        ops[static_cast<uint8_t>('}')] = OP_HEAD1_RIGHT;
+        ops[static_cast<uint8_t>('-')] = OP_DECREMENT;
+        ops[static_cast<uint8_t>('+')] = OP_INCREMENT;
+        ops[static_cast<uint8_t>('.')] = OP_COPY_TO_HEAD1;
+        ops[static_cast<uint8_t>(',')] = OP_COPY_FROM_HEAD1;
+        ops[static_cast<uint8_t>('[')] = OP_OPEN;
+        ops[static_cast<uint8_t>(']')] = OP_CLOSE;
+    }
+};
+
+const OpcodeTable OPCODES;
+
+// Opcode stream of a tape: op[i] for tape[i], and run[i] = how many
+// positions from i on carry the same foldable opcode (1 otherwise)
+class DecodedTape {
+public:
+    void decode(const uint8_t* tape, int tape_size) {
+        size = tape_size;
+        op.resize(size);
+        run.resize(size);
+        for (int i = size - 1; i >= 0; i--) {
+            op[i] = OPCODES.ops[tape[i]];
+            run[i] = continues(i) ? run[i + 1] + 1 : 1;
+        }
+    }
+
+    // Bring position pos up to date after tape[pos] became value
+    void update(int pos, uint8_t value) {
+        uint8_t new_op = OPCODES.ops[value];
+        if (new_op == op[pos]) {
+            return;
+        }
+
+        op[pos] = new_op;
+        run[pos] = continues(pos) ? run[pos + 1] + 1 : 1;
+
+        // Runs ending in pos got longer or shorter; stop at the first
+        // position whose run length comes out the same
+        for (int q = pos - 1; q >= 0; q--) {
+            int length = continues(q) ? run[q + 1] + 1 : 1;
+            if (length == run[q]) {
+                break;
+            }
+            run[q] = length;
+        }
+    }
+
+    std::vector<uint8_t> op;
+    std::vector<int> run;
+
+private:
+    bool continues(int i) const {
+        return foldable(op[i]) && i + 1 < size && op[i + 1] == op[i];
+    }
+
+    int size = 0;
+};
+
+// The dispatch loop; Profile adds opcode and jump counts for profiler.h,
+// DetectCycles skips the repeats of loops that write nothing
+template <bool Profile, bool DetectCycles>
+EmulatorStats run_predecoded(
+    uint8_t* tape,
+    int tape_size,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos,
+    int max_iter
+) {
+    const uint8_t zero = '0';
+
+    int iteration = 0;
+    int skipped = 0;
+    EmulatorStatus status = EmulatorStatus::Terminated;
+
+    // Both tables are kept per thread and reused from one pair to the next
+    thread_local DecodedTape decoded;
+    thread_local BracketIndex brackets;
+    decoded.decode(tape, tape_size);
+    brackets.invalidate();
+    auto char_at = [tape](int i) { return tape[i]; };
+
+    // Store value at pos, keeping the opcode stream and bracket index valid
+    auto write = [&](int pos, uint8_t value) {
+        brackets.note_write(tape[pos], value);
+        tape[pos] = value;
+        decoded.update(pos, value);
+    };
+
+    [[maybe_unused]] std::conditional_t<Profile, EmulatorTally, char> tally{};
+    [[maybe_unused]] std::conditional_t<DetectCycles, CycleDetector, char> cycles{};
+
+    while (iteration < max_iter) {
+        // Instructions executed by this step
+        int steps = 1;
+        uint8_t op = decoded.op[pc_pos];
+
+        switch (op) {
+            case OP_SKIP:
+                steps = std::min(decoded.run[pc_pos], max_iter - iteration);
+                skipped += steps;
+                break;
+
+            case OP_HEAD0_LEFT:
+                steps = std::min(decoded.run[pc_pos], max_iter - iteration);
+                head0_pos = ((head0_pos - steps) % tape_size + tape_size) % tape_size;
+                break;
+
+            case OP_HEAD0_RIGHT:
+                steps = std::min(decoded.run[pc_pos], max_iter - iteration);
+                head0_pos = (head0_pos + steps) % tape_size;
+                break;
+
+            case OP_HEAD1_LEFT:
+                steps = std::min(decoded.run[pc_pos], max_iter - iteration);
+                head1_pos = ((head1_pos - steps) % tape_size + tape_size) % tape_size;
+                break;
+
+            case OP_HEAD1_RIGHT:
+                steps = std::min(decoded.run[pc_pos], max_iter - iteration);
+                head1_pos = (head1_pos + steps) % tape_size;
+                break;
+
+            case OP_DECREMENT:
+            case OP_INCREMENT: {
+                steps = std::min(decoded.run[pc_pos], max_iter - iteration);
+                // A write into the rest of the run changes what runs next,
+                // so only fold up to the instruction it lands on
+                if (head0_pos > pc_pos && head0_pos < pc_pos + steps) {
+                    steps = head0_pos - pc_pos;
+                }
+                int delta = (op == OP_INCREMENT) ? steps : -steps;
+                write(head0_pos, static_cast<uint8_t>(tape[head0_pos] + delta));
+                break;
+            }
+
+            case OP_COPY_TO_HEAD1:
+                write(head1_pos, tape[head0_pos]);
+                break;
+
+            case OP_COPY_FROM_HEAD1:
+                write(head0_pos, tape[head1_pos]);
+                break;
+
+            case OP_OPEN:
+                if (tape[head0_pos] == zero) {
+                    if (brackets.is_stale()) {
+                        brackets.rebuild(tape_size, char_at);
+                        if constexpr (Profile) {
+                            tally.rebuild(tape_size);
+                        }
+                    }
+
+                    int target = brackets.partner(pc_pos);
+                    if (target == BracketIndex::UNMATCHED) {
+                        if constexpr (Profile) {
+                            tally.ops(op, 1);  // Dispatched, as in the other emulators
+                        }
+                        status = EmulatorStatus::UnmatchedOpen;
+                        return EmulatorStats{status, iteration, skipped};
+                    }
+                    if constexpr (Profile) {
+                        tally.jump(pc_pos, target);
+                    }
+                    pc_pos = target;
+                }
+                break;
+
+            case OP_CLOSE:
+                if (tape[head0_pos] != zero) {
+                    if (brackets.is_stale()) {
+                        brackets.rebuild(tape_size, char_at);
+                        if constexpr (Profile) {
+                            tally.rebuild(tape_size);
+                        }
+                    }
+
+                    int target = brackets.partner(pc_pos);
+                    if (target == BracketIndex::UNMATCHED) {
+                        if constexpr (Profile) {
+                            tally.ops(op, 1);  // Dispatched, as in the other emulators
+                        }
+                        status = EmulatorStatus::UnmatchedClose;
+                        return EmulatorStats{status, iteration, skipped};
+                    }
+                    if constexpr (Profile) {
+                        tally.jump(pc_pos, target);
+                    }
+                    pc_pos = target;
+                }
+                break;
+        }
+
+        if constexpr (Profile) {
+            tally.ops(op, steps);
+        }
+        iteration += steps;
+        pc_pos += steps;
+        if (pc_pos >= tape_size) {
+            status = EmulatorStatus::Finished;
+            break;
+        }
+
+        if constexpr (DetectCycles) {
+            if (op >= OP_DECREMENT && op <= OP_COPY_FROM_HEAD1) {
+                cycles.note_write();
+            }
+            CycleDetector::Check seen = cycles.check(pc_pos, head0_pos, head1_pos, iteration, skipped);
+            if (seen == CycleDetector::Check::Repeated) {
+                int repeats = cycles.skip_repeats(iteration, skipped, max_iter);
+                if constexpr (Profile) {
+                    tally.repeat(repeats);
+                }
+            } else if (seen == CycleDetector::Check::Saved) {
+                if constexpr (Profile) {
+                    tally.mark();
+                }
+            }
+        }
+    }
+
+    return EmulatorStats{status, iteration, skipped};
+}
+
+} // namespace
+
+EmulatorStats emulate_predecoded_in_place(
+    uint8_t* tape,
+    int tape_size,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos,
+    int max_iter,
+    bool detect_cycles
+) {
+    bool profile = profiling_enabled();
+    if (detect_cycles) {
+        return profile ? run_predecoded<true, true>(tape, tape_size, head0_pos, head1_pos, pc_pos, max_iter)
+                       : run_predecoded<false, true>(tape, tape_size, head0_pos, head1_pos, pc_pos, max_iter);
+    }
+    return profile ? run_predecoded<true, false>(tape, tape_size, head0_pos, head1_pos, pc_pos, max_iter)
+                   : run_predecoded<false, false>(tape, tape_size, head0_pos, head1_pos, pc_pos, max_iter);
+}
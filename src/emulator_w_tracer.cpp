@@ -1,6 +1,11 @@
 #include "emulator_w_tracer.h"
+#include "bracket_index.h"
+#include "cycle_detector.h"
+#include "profiler.h"
 #include <iostream>
 #include <algorithm>
+#include <type_traits>
+#include <utility>
 
 // Token constructor
 Token::Token(uint64_t epoch, uint16_t position, uint8_t character) {
@@ -37,8 +42,12 @@ Token create_mutation_token(uint64_t epoch, uint16_t position, uint8_t new_char)
     return Token(epoch, position, new_char);
 }
 
-// Emulator with tracer implementation
-EmulatorResultWithTracer emulate_w_tracer(
+namespace {
+
+// The emulator loop; Profile adds opcode and jump counts for profiler.h,
+// DetectCycles skips the repeats of loops that write nothing
+template <bool Profile, bool DetectCycles>
+EmulatorResultWithTracer run_w_tracer(
     std::vector<Token> tape,
     int head0_pos,
     int head1_pos,
@@ -60,11 +69,21 @@ EmulatorResultWithTracer emulate_w_tracer(
     const std::string instructions = "<>{}-+.,[]";
     const uint8_t zero = '0';  // ASCII 48
 
+    // Jump targets are looked up instead of scanned for
+    BracketIndex brackets;
+    auto char_at = [&tape](int i) { return tape[i].get_char(); };
+
+    [[maybe_unused]] std::conditional_t<Profile, EmulatorTally, char> tally{};
+    [[maybe_unused]] std::conditional_t<DetectCycles, CycleDetector, char> cycles{};
+
     while (iteration < max_iter) {
         iteration++;
 
         // Get current instruction (char part of token)
         char instruction = static_cast<char>(tape[pc_pos].get_char());
+        if constexpr (Profile) {
+            tally.op(tape[pc_pos].get_char());
+        }
 
         // Skip non-instruction characters
         if (instructions.find(instruction) == std::string::npos) {
@@ -104,23 +123,27 @@ EmulatorResultWithTracer emulate_w_tracer(
             case '+': {  // Increment value at head 0 (only char part)
                 uint8_t current = tape[head0_pos].get_char();
                 tape[head0_pos].set_char(current + 1);
+                brackets.note_write(current, tape[head0_pos].get_char());
                 break;
             }
 
             case '-': {  // Decrement value at head 0 (only char part)
                 uint8_t current = tape[head0_pos].get_char();
                 tape[head0_pos].set_char(current - 1);
+                brackets.note_write(current, tape[head0_pos].get_char());
                 break;
             }
 
             case '.': {  // Copy from head 0 to head 1 (copy entire token)
                 Token source_token = tape[head0_pos];
+                brackets.note_write(tape[head1_pos].get_char(), source_token.get_char());
                 tape[head1_pos] = source_token;
                 break;
             }
 
             case ',': {  // Copy from head 1 to head 0 (copy entire token)
                 Token source_token = tape[head1_pos];
+                brackets.note_write(tape[head0_pos].get_char(), source_token.get_char());
                 tape[head0_pos] = source_token;
                 break;
             }
@@ -128,24 +151,24 @@ EmulatorResultWithTracer emulate_w_tracer(
             case '[': {  // Jump forward if head 0 is '0' (ASCII 48)
                 uint8_t value = tape[head0_pos].get_char();
                 if (value == zero) {
-                    int depth = 1;
-                    for (int i = pc_pos + 1; i < tape_size; i++) {
-                        char c = static_cast<char>(tape[i].get_char());
-                        if (c == '[') depth++;
-                        else if (c == ']') depth--;
-
-                        if (depth == 0) {
-                            pc_pos = i;
-                            break;
+                    if (brackets.is_stale()) {
+                        brackets.rebuild(tape_size, char_at);
+                        if constexpr (Profile) {
+                            tally.rebuild(tape_size);
                         }
                     }
 
-                    if (depth != 0) {
+                    int target = brackets.partner(pc_pos);
+                    if (target == BracketIndex::UNMATCHED) {
                         state = "Error, Unmatched [";
                         return EmulatorResultWithTracer{
                             tape, head0_pos, head1_pos, pc_pos, iteration, skipped, state
                         };
                     }
+                    if constexpr (Profile) {
+                        tally.jump(pc_pos, target);
+                    }
+                    pc_pos = target;
                 }
                 break;
             }
@@ -153,24 +176,24 @@ EmulatorResultWithTracer emulate_w_tracer(
             case ']': {  // Jump backward if head 0 is not '0' (ASCII 48)
                 uint8_t value = tape[head0_pos].get_char();
                 if (value != zero) {
-                    int depth = 1;
-                    for (int i = pc_pos - 1; i >= 0; i--) {
-                        char c = static_cast<char>(tape[i].get_char());
-                        if (c == ']') depth++;
-                        else if (c == '[') depth--;
-
-                        if (depth == 0) {
-                            pc_pos = i;
-                            break;
+                    if (brackets.is_stale()) {
+                        brackets.rebuild(tape_size, char_at);
+                        if constexpr (Profile) {
+                            tally.rebuild(tape_size);
                         }
                     }
 
-                    if (depth != 0) {
+                    int target = brackets.partner(pc_pos);
+                    if (target == BracketIndex::UNMATCHED) {
                         state = "Error, Unmatched ]";
                         return EmulatorResultWithTracer{
                             tape, head0_pos, head1_pos, pc_pos, iteration, skipped, state
                         };
                     }
+                    if constexpr (Profile) {
+                        tally.jump(pc_pos, target);
+                    }
+                    pc_pos = target;
                 }
                 break;
             }
@@ -188,6 +211,24 @@ EmulatorResultWithTracer emulate_w_tracer(
             state = "Finished";
             break;
         }
+
+        // Only a jump goes back, so checking after instructions is enough
+        if constexpr (DetectCycles) {
+            if (instruction == '-' || instruction == '+' || instruction == '.' || instruction == ',') {
+                cycles.note_write();
+            }
+            CycleDetector::Check seen = cycles.check(pc_pos, head0_pos, head1_pos, iteration, skipped);
+            if (seen == CycleDetector::Check::Repeated) {
+                int repeats = cycles.skip_repeats(iteration, skipped, max_iter);
+                if constexpr (Profile) {
+                    tally.repeat(repeats);
+                }
+            } else if (seen == CycleDetector::Check::Saved) {
+                if constexpr (Profile) {
+                    tally.mark();
+                }
+            }
+        }
     }
 
     if (iteration >= max_iter && state == "Running") {
@@ -204,3 +245,24 @@ EmulatorResultWithTracer emulate_w_tracer(
         state
     };
 }
+
+} // namespace
+
+// Emulator with tracer implementation
+EmulatorResultWithTracer emulate_w_tracer(
+    std::vector<Token> tape,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos,
+    int max_iter,
+    int verbose,
+    bool detect_cycles
+) {
+    bool profile = profiling_enabled();
+    if (detect_cycles) {
+        return profile ? run_w_tracer<true, true>(std::move(tape), head0_pos, head1_pos, pc_pos, max_iter, verbose)
+                       : run_w_tracer<false, true>(std::move(tape), head0_pos, head1_pos, pc_pos, max_iter, verbose);
+    }
+    return profile ? run_w_tracer<true, false>(std::move(tape), head0_pos, head1_pos, pc_pos, max_iter, verbose)
+                   : run_w_tracer<false, false>(std::move(tape), head0_pos, head1_pos, pc_pos, max_iter, verbose);
+}
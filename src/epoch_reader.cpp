@@ -0,0 +1,266 @@
+#include "epoch_reader.h"
+#include "snapshot.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Integer at the start of a field, like std::stoi on the field with its
+// quotes removed: leading blanks, an optional sign, then digits
+int parse_int(const char* begin, const char* end, const std::string& filepath) {
+    const char* p = begin;
+    while (p < end && (*p == '"' || *p == ' ' || *p == '\t')) p++;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    long value = 0;
+    bool digits = false;
+    for (; p < end; p++) {
+        if (*p == '"') continue;
+        if (*p < '0' || *p > '9') break;
+        value = value * 10 + (*p - '0');
+        digits = true;
+    }
+
+    if (!digits) {
+        throw std::runtime_error("Invalid number in " + filepath);
+    }
+    return static_cast<int>(negative ? -value : value);
+}
+
+// Calls fn(begin, end) for every line after the header, like getline
+template <typename Fn>
+void for_each_data_line(const MappedFile& file, Fn fn) {
+    const char* p = reinterpret_cast<const char*>(file.data());
+    const char* end = p + file.size();
+
+    bool header = true;
+    while (p < end) {
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        const char* line_end = newline ? newline : end;
+        if (!header) {
+            fn(p, line_end);
+        }
+        header = false;
+        p = newline ? newline + 1 : end;
+    }
+}
+
+bool is_snapshot(const MappedFile& file) {
+    return file.size() >= 4 && std::memcmp(file.data(), SNAPSHOT_MAGIC, 4) == 0;
+}
+
+void allocate(EpochGrid& grid) {
+    size_t cells = static_cast<size_t>(grid.width) * grid.height;
+    grid.programs.assign(cells * grid.program_size, 0);
+    grid.lengths.assign(cells, -1);
+}
+
+EpochGrid from_snapshot(const MappedFile& file, const std::string& filepath, SnapshotKind kind) {
+    Snapshot snapshot = parse_snapshot(file.data(), file.size(), filepath);
+    if (snapshot.kind != kind) {
+        throw std::runtime_error(std::string("Not a ") + (kind == SnapshotKind::Tokens ? "token" : "pairing") +
+                                 " snapshot: " + filepath);
+    }
+
+    EpochGrid grid;
+    grid.epoch = static_cast<int>(snapshot.epoch);
+    grid.width = snapshot.width;
+    grid.height = snapshot.height;
+    grid.program_size = snapshot.program_size;
+    grid.lengths.assign(snapshot.total_programs(), snapshot.program_size);
+
+    if (kind == SnapshotKind::Tokens) {
+        // Bits 0-7 of a packed token hold the character
+        grid.programs.resize(snapshot.tokens.size());
+        for (size_t i = 0; i < snapshot.tokens.size(); i++) {
+            grid.programs[i] = static_cast<uint8_t>(snapshot.tokens[i] & 0xFF);
+        }
+    } else {
+        grid.programs = std::move(snapshot.bytes);
+        grid.partners = std::move(snapshot.partners);
+        if (grid.partners.empty()) {
+            grid.partners.assign(snapshot.total_programs(), -1);
+        }
+    }
+
+    return grid;
+}
+
+} // namespace
+
+EpochGrid read_pairing_epoch(const std::string& filepath) {
+    MappedFile file(filepath);
+    if (is_snapshot(file)) {
+        return from_snapshot(file, filepath, SnapshotKind::Programs);
+    }
+
+    // epoch,position_x,position_y,"program",combined_x,combined_y
+    struct Row {
+        int epoch, x, y, combined_x, combined_y;
+        const char* program_begin;
+        const char* program_end;
+        int program_length;
+    };
+    std::vector<Row> rows;
+
+    for_each_data_line(file, [&](const char* begin, const char* end) {
+        // Split on commas outside quotes, keeping the first six fields
+        const char* field_begin[6];
+        const char* field_end[6];
+        int fields = 0;
+        bool in_quotes = false;
+        const char* start = begin;
+        for (const char* p = begin; p <= end; p++) {
+            if (p < end && *p == '"') {
+                in_quotes = !in_quotes;
+            } else if (p == end || (*p == ',' && !in_quotes)) {
+                if (fields < 6) {
+                    field_begin[fields] = start;
+                    field_end[fields] = p;
+                }
+                fields++;
+                start = p + 1;
+            }
+        }
+        if (fields < 6) return;
+
+        Row row;
+        row.epoch = parse_int(field_begin[0], field_end[0], filepath);
+        row.x = parse_int(field_begin[1], field_end[1], filepath);
+        row.y = parse_int(field_begin[2], field_end[2], filepath);
+        row.combined_x = parse_int(field_begin[4], field_end[4], filepath);
+        row.combined_y = parse_int(field_begin[5], field_end[5], filepath);
+        row.program_begin = field_begin[3];
+        row.program_end = field_end[3];
+        row.program_length = static_cast<int>((row.program_end - row.program_begin) -
+                                              std::count(row.program_begin, row.program_end, '"'));
+
+        if (row.x >= 0 && row.y >= 0) {
+            rows.push_back(row);
+        }
+    });
+
+    EpochGrid grid;
+    for (const Row& row : rows) {
+        if (grid.epoch == -1) grid.epoch = row.epoch;
+        grid.width = std::max(grid.width, row.x + 1);
+        grid.height = std::max(grid.height, row.y + 1);
+        grid.program_size = std::max(grid.program_size, row.program_length);
+    }
+    allocate(grid);
+    grid.partners.assign(grid.lengths.size(), -1);
+
+    // Later rows for the same cell win, as with a map insert
+    for (const Row& row : rows) {
+        int idx = row.y * grid.width + row.x;
+        uint8_t* out = grid.programs.data() + static_cast<size_t>(idx) * grid.program_size;
+        for (const char* p = row.program_begin; p < row.program_end; p++) {
+            if (*p != '"') *out++ = static_cast<uint8_t>(*p);
+        }
+        grid.lengths[idx] = row.program_length;
+        grid.partners[idx] = (row.combined_x >= 0 && row.combined_y >= 0)
+                                 ? row.combined_y * grid.width + row.combined_x : -1;
+    }
+
+    return grid;
+}
+
+EpochGrid read_token_epoch(const std::string& filepath) {
+    MappedFile file(filepath);
+    if (is_snapshot(file)) {
+        return from_snapshot(file, filepath, SnapshotKind::Tokens);
+    }
+
+    // epoch_snapshot,grid_x,grid_y,pos_in_program,token_epoch,token_orig_pos,char,char_ascii
+    struct Row {
+        int x, y, pos;
+        uint8_t character;
+    };
+    std::vector<Row> rows;
+    int epoch = -1;
+
+    for_each_data_line(file, [&](const char* begin, const char* end) {
+        // Plain comma split; only the leading numeric fields are needed
+        const char* field_begin[7];
+        const char* field_end[7];
+        int fields = 0;
+        const char* start = begin;
+        for (const char* p = begin; p < end && fields < 7; p++) {
+            if (*p == ',') {
+                field_begin[fields] = start;
+                field_end[fields] = p;
+                fields++;
+                start = p + 1;
+            }
+        }
+        if (fields < 7 && start < end) {
+            field_begin[fields] = start;
+            field_end[fields] = end;
+            fields++;
+        }
+        if (fields < 7) return;
+
+        int row_epoch = parse_int(field_begin[0], field_end[0], filepath);
+        Row row;
+        row.x = parse_int(field_begin[1], field_end[1], filepath);
+        row.y = parse_int(field_begin[2], field_end[2], filepath);
+        row.pos = parse_int(field_begin[3], field_end[3], filepath);
+        row.character = static_cast<uint8_t>(parse_int(field_begin[6], field_end[6], filepath));
+
+        if (epoch == -1) epoch = row_epoch;
+        if (row.x >= 0 && row.y >= 0 && row.pos >= 0) {
+            rows.push_back(row);
+        }
+    });
+
+    EpochGrid grid;
+    grid.epoch = epoch;
+    for (const Row& row : rows) {
+        grid.width = std::max(grid.width, row.x + 1);
+        grid.height = std::max(grid.height, row.y + 1);
+        grid.program_size = std::max(grid.program_size, row.pos + 1);
+    }
+    allocate(grid);
+
+    for (const Row& row : rows) {
+        int idx = row.y * grid.width + row.x;
+        grid.programs[static_cast<size_t>(idx) * grid.program_size + row.pos] = row.character;
+        grid.lengths[idx] = std::max(grid.lengths[idx], row.pos + 1);
+    }
+
+    return grid;
+}
+
+EpochPrefetcher::EpochPrefetcher(Reader reader) : reader(std::move(reader)) {}
+
+EpochPrefetcher::~EpochPrefetcher() {
+    if (pending.valid()) {
+        pending.wait();
+    }
+}
+
+EpochGrid EpochPrefetcher::read(const std::string& filepath, const std::string& next_filepath) {
+    EpochGrid grid;
+    if (pending.valid() && pending_path == filepath) {
+        grid = pending.get();
+    } else {
+        if (pending.valid()) {
+            pending.wait();
+            pending = std::future<EpochGrid>();
+        }
+        grid = reader(filepath);
+    }
+
+    if (!next_filepath.empty()) {
+        pending_path = next_filepath;
+        pending = std::async(std::launch::async, reader, next_filepath);
+    }
+
+    return grid;
+}
@@ -1,6 +1,10 @@
 #include "emulator.h"
 #include "utils.h"
 #include "metrics.h"
+#include "epoch_reader.h"
+#include "replicator_cache.h"
+#include "thread_pool.h"
+#include "metrics_engine.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -9,50 +13,10 @@
 #include <map>
 #include <set>
 #include <thread>
-#include <mutex>
-#include <future>
+#include <unordered_map>
 #include <algorithm>
 #include <iomanip>
 
-// Thread-safe cache for program execution results
-class ProgramCache {
-public:
-    bool has(const std::string& program) {
-        std::lock_guard<std::mutex> lock(cache_mutex);
-        return cache.count(program) > 0;
-    }
-
-    bool is_replicator(const std::string& program) {
-        std::lock_guard<std::mutex> lock(cache_mutex);
-        auto it = cache.find(program);
-        if (it != cache.end()) {
-            return it->second;
-        }
-        return false;
-    }
-
-    void add(const std::string& program, bool is_replicator) {
-        std::lock_guard<std::mutex> lock(cache_mutex);
-        cache[program] = is_replicator;
-    }
-
-    size_t size() const {
-        std::lock_guard<std::mutex> lock(cache_mutex);
-        return cache.size();
-    }
-
-private:
-    std::map<std::string, bool> cache;
-    mutable std::mutex cache_mutex;
-};
-
-// Cell data from CSV
-struct CellData {
-    std::string program;
-    int combined_x;
-    int combined_y;
-};
-
 // Represents a program at a specific position
 struct ProgramLocation {
     int epoch;
@@ -101,29 +65,6 @@ std::vector<std::pair<int, int>> get_neighboors(int grid_x, int grid_y) {
     return neighbors;
 }
 
-// Parse a CSV line with proper quote handling
-std::vector<std::string> parse_csv_line(const std::string& line) {
-    std::vector<std::string> fields;
-    std::string field;
-    bool in_quotes = false;
-
-    for (size_t i = 0; i < line.size(); i++) {
-        char c = line[i];
-
-        if (c == '"') {
-            in_quotes = !in_quotes;
-        } else if (c == ',' && !in_quotes) {
-            fields.push_back(field);
-            field.clear();
-        } else {
-            field += c;
-        }
-    }
-    fields.push_back(field);
-
-    return fields;
-}
-
 // Check if a character is a valid BF instruction
 bool is_valid_instruction(char ch) {
     const std::string instructions = ",.[]{}<>+-";
@@ -141,75 +82,42 @@ std::string clean_program(const std::string& program) {
     return cleaned;
 }
 
-// Read all cell data from a pairing CSV file
-std::map<std::pair<int, int>, CellData> read_pairing_csv(const std::string& csv_path) {
-    std::map<std::pair<int, int>, CellData> cells;
-    std::ifstream file(csv_path);
+// Pairing file for an epoch: the binary snapshot if there is one, else the CSV
+std::string pairing_file_path(const std::string& pairings_dir, int epoch) {
+    std::stringstream stem;
+    stem << pairings_dir << "/pairings_epoch_" << std::setfill('0') << std::setw(4) << epoch;
 
-    if (!file.is_open()) {
-        throw std::runtime_error("Could not open file: " + csv_path);
+    std::string snapshot_path = stem.str() + ".bffs";
+    if (std::ifstream(snapshot_path).good()) {
+        return snapshot_path;
     }
+    return stem.str() + ".csv";
+}
 
-    std::string line;
-    // Skip header
-    std::getline(file, line);
-
-    while (std::getline(file, line)) {
-        auto fields = parse_csv_line(line);
-
-        if (fields.size() < 6) continue;
-
-        int x = std::stoi(fields[1]);
-        int y = std::stoi(fields[2]);
-        std::string program = clean_program(fields[3]);  // Clean program
-        int combined_x = std::stoi(fields[4]);
-        int combined_y = std::stoi(fields[5]);
-
-        CellData cell_data;
-        cell_data.program = program;
-        cell_data.combined_x = combined_x;
-        cell_data.combined_y = combined_y;
+// Emulation budget of a replication check; also tags the on-disk cache so
+// results from a different budget are never reused
+const int REPLICATOR_MAX_ITER = 1024;
 
-        cells[{x, y}] = cell_data;
-    }
-
-    return cells;
+// Tape of a replication check: the program followed by as many '0' cells
+void replication_tape(const std::string& program, uint8_t* tape) {
+    std::copy(program.begin(), program.end(), tape);
+    std::fill(tape + program.size(), tape + 2 * program.size(), static_cast<uint8_t>('0'));
 }
 
-// Convert string program to vector<uint8_t>
-std::vector<uint8_t> string_to_program(const std::string& str) {
-    std::vector<uint8_t> program;
-    for (char c : str) {
-        program.push_back(static_cast<uint8_t>(c));
-    }
-    return program;
+// A replicator has copied itself over the '0' half once the run is over
+bool copied_itself(const uint8_t* tape, size_t size) {
+    return size > 0 && matching_bytes(tape, tape + size, size) == size;
 }
 
 // Check if a program is a self-replicator
-bool check_replicator(const std::string& program_str, int max_iter = 1024) {
+bool check_replicator(const std::string& program_str, int max_iter = REPLICATOR_MAX_ITER) {
     if (program_str.empty()) return false;
 
-    // Convert to vector
-    std::vector<uint8_t> program = string_to_program(program_str);
-
-    // Create tape: program1 + program2 (filled with '0')
-    std::vector<uint8_t> tape = program;
-    tape.insert(tape.end(), program.size(), '0');
-
-    // Run emulation
-    EmulatorResult result = emulate(tape, 0, static_cast<int>(program.size()), 0, max_iter, 0);
-
-    // Check if first half equals second half
-    if (result.tape.size() < program.size() * 2) return false;
-
-    size_t mid = result.tape.size() / 2;
-    for (size_t i = 0; i < mid; i++) {
-        if (result.tape[i] != result.tape[mid + i]) {
-            return false;
-        }
-    }
-
-    return true;
+    int size = static_cast<int>(program_str.size());
+    std::vector<uint8_t> tape(2 * program_str.size());
+    replication_tape(program_str, tape.data());
+    emulate_pair_in_place(tape.data(), tape.data() + size, size, 0, size, 0, max_iter);
+    return copied_itself(tape.data(), program_str.size());
 }
 
 // Calculate similarity between two programs
@@ -217,14 +125,42 @@ double calculate_similarity(const std::string& prog1, const std::string& prog2)
     if (prog1.size() != prog2.size()) return 0.0;
     if (prog1.empty()) return 0.0;
 
-    int matches = 0;
-    for (size_t i = 0; i < prog1.size(); i++) {
-        if (prog1[i] == prog2[i]) {
-            matches++;
-        }
+    size_t matches = matching_bytes(reinterpret_cast<const uint8_t*>(prog1.data()),
+                                    reinterpret_cast<const uint8_t*>(prog2.data()), prog1.size());
+    return static_cast<double>(matches) / prog1.size();
+}
+
+// Replication checks of programs of one size, run as one batch: each
+// chunk of the pool goes through emulate_batch() at once
+std::vector<bool> check_replicators(const std::vector<const std::string*>& programs, ThreadPool& pool) {
+    std::vector<bool> results(programs.size(), false);
+    if (programs.empty() || programs[0]->empty()) {
+        return results;
     }
 
-    return static_cast<double>(matches) / prog1.size();
+    int size = static_cast<int>(programs[0]->size());
+    std::vector<uint8_t> tapes(2 * programs.size() * size);
+    std::vector<EmulatorStats> stats(programs.size());
+    std::vector<EmulatorJob> jobs(programs.size());
+    std::vector<char> copied(programs.size(), 0);
+
+    size_t chunk_size = std::max<size_t>(4 * EMULATOR_BATCH_LANES, programs.size() / (pool.size() * 8));
+    pool.parallel_for(programs.size(), chunk_size, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint8_t* tape = tapes.data() + 2 * i * size;
+            replication_tape(*programs[i], tape);
+            jobs[i] = EmulatorJob{tape, tape + size, &stats[i]};
+        }
+        emulate_batch(jobs.data() + begin, end - begin, size, 0, size, 0, REPLICATOR_MAX_ITER);
+        for (size_t i = begin; i < end; i++) {
+            copied[i] = copied_itself(tapes.data() + 2 * i * size, size) ? 1 : 0;
+        }
+    });
+
+    for (size_t i = 0; i < programs.size(); i++) {
+        results[i] = copied[i] != 0;
+    }
+    return results;
 }
 
 // Find replicators using forward pass analysis with pairing data
@@ -236,41 +172,34 @@ std::map<int, std::set<ProgramLocation>> find_replicators(
     int last_epoch,
     int grid_width,
     int grid_height,
-    unsigned int num_threads = 0
+    ReplicatorCache& cache,
+    ThreadPool& pool
 ) {
-    if (num_threads == 0) {
-        num_threads = std::thread::hardware_concurrency();
-        if (num_threads == 0) num_threads = 4;
-    }
 
     std::cout << "Forward Pass Analysis (Pairing-based)" << std::endl;
     std::cout << "Start epoch: " << start_epoch << std::endl;
     std::cout << "Start position: (" << grid_x << ", " << grid_y << ")" << std::endl;
     std::cout << "Last epoch: " << last_epoch << std::endl;
     std::cout << "Grid size: " << grid_width << "x" << grid_height << std::endl;
-    std::cout << "Threads: " << num_threads << std::endl;
+    std::cout << "Threads: " << pool.size() << std::endl;
     std::cout << std::endl;
 
-    // Cache for program execution results
-    ProgramCache cache;
-
     // Result storage: epoch -> set of replicators (using set to avoid duplicates)
     std::map<int, std::set<ProgramLocation>> replicators_by_epoch;
 
-    // Get initial program from pairing CSV
-    std::stringstream csv_path;
-    csv_path << pairings_dir << "/pairings_epoch_"
-             << std::setfill('0') << std::setw(4) << start_epoch << ".csv";
+    // Reads the pairing file of the epoch after the one being processed
+    EpochPrefetcher prefetcher(read_pairing_epoch);
 
-    auto cells = read_pairing_csv(csv_path.str());
-    auto it = cells.find({grid_x, grid_y});
+    // Get initial program from the pairing data
+    std::string first_next = (start_epoch < last_epoch) ? pairing_file_path(pairings_dir, start_epoch + 1) : "";
+    EpochGrid cells = prefetcher.read(pairing_file_path(pairings_dir, start_epoch), first_next);
 
-    if (it == cells.end()) {
+    if (!cells.has(grid_x, grid_y)) {
         std::cerr << "Error: Could not find program at initial position" << std::endl;
         return replicators_by_epoch;
     }
 
-    std::string initial_program = it->second.program;
+    std::string initial_program = clean_program(cells.program_string(grid_x, grid_y));
 
     // Verify initial program is a replicator
     std::cout << "Verifying initial program is a replicator..." << std::endl;
@@ -306,15 +235,12 @@ std::map<int, std::set<ProgramLocation>> find_replicators(
             continue;
         }
 
-        // Get CSV data for next epoch
-        std::stringstream next_csv_path;
-        next_csv_path << pairings_dir << "/pairings_epoch_"
-                     << std::setfill('0') << std::setw(4) << (epoch + 1) << ".csv";
-
-        // Read next epoch cell data
-        std::map<std::pair<int, int>, CellData> next_cells;
+        // Read next epoch cell data (CSV or binary snapshot); the epoch
+        // after it is read in the background while this one is analysed
+        EpochGrid next_cells;
         try {
-            next_cells = read_pairing_csv(next_csv_path.str());
+            std::string following = (epoch + 2 <= last_epoch) ? pairing_file_path(pairings_dir, epoch + 2) : "";
+            next_cells = prefetcher.read(pairing_file_path(pairings_dir, epoch + 1), following);
         } catch (const std::exception& e) {
             std::cerr << "  Error reading next epoch: " << e.what() << std::endl;
             break;
@@ -322,7 +248,6 @@ std::map<int, std::set<ProgramLocation>> find_replicators(
 
         // Candidate programs to check
         std::vector<ProgramLocation> candidates;
-        std::mutex candidates_mutex;
 
         // For each replicator at time t
         for (const auto& replicator : current_replicators) {
@@ -341,17 +266,16 @@ std::map<int, std::set<ProgramLocation>> find_replicators(
                 }
 
                 // Get cell data at neighbor position in next epoch
-                auto cell_it = next_cells.find({neigh_x, neigh_y});
-                if (cell_it == next_cells.end()) continue;
+                if (!next_cells.has(neigh_x, neigh_y)) continue;
 
-                const CellData& neighbor_cell = cell_it->second;
-                int combined_x = neighbor_cell.combined_x;
-                int combined_y = neighbor_cell.combined_y;
+                int combined_idx = next_cells.partners[neigh_y * next_cells.width + neigh_x];
+                int combined_x = combined_idx >= 0 ? combined_idx % next_cells.width : -1;
+                int combined_y = combined_idx >= 0 ? combined_idx / next_cells.width : -1;
 
                 // Case 1: Neighbor paired with the replicator's position
                 if (combined_x == rep_x && combined_y == rep_y) {
                     // Check the neighbor position
-                    std::string next_program = neighbor_cell.program;
+                    std::string next_program = clean_program(next_cells.program_string(neigh_x, neigh_y));
                     double similarity = calculate_similarity(rep_program, next_program);
 
                     if (similarity > 0.9) {
@@ -361,14 +285,12 @@ std::map<int, std::set<ProgramLocation>> find_replicators(
                         candidate.grid_y = neigh_y;
                         candidate.program = next_program;
 
-                        std::lock_guard<std::mutex> lock(candidates_mutex);
                         candidates.push_back(candidate);
                     }
 
                     // Also check the replicator's own position (both get updated in pairing)
-                    auto rep_cell_it = next_cells.find({rep_x, rep_y});
-                    if (rep_cell_it != next_cells.end()) {
-                        std::string next_same = rep_cell_it->second.program;
+                    if (next_cells.has(rep_x, rep_y)) {
+                        std::string next_same = clean_program(next_cells.program_string(rep_x, rep_y));
                         double similarity_same = calculate_similarity(rep_program, next_same);
 
                         if (similarity_same > 0.9) {
@@ -378,7 +300,6 @@ std::map<int, std::set<ProgramLocation>> find_replicators(
                             candidate.grid_y = rep_y;
                             candidate.program = next_same;
 
-                            std::lock_guard<std::mutex> lock(candidates_mutex);
                             candidates.push_back(candidate);
                         }
                     }
@@ -387,7 +308,7 @@ std::map<int, std::set<ProgramLocation>> find_replicators(
                 // Case 2: Mutation-only (no pairing) at the replicator's position
                 if (combined_x == -1 && combined_y == -1 &&
                     neigh_x == rep_x && neigh_y == rep_y) {
-                    std::string next_program = neighbor_cell.program;
+                    std::string next_program = clean_program(next_cells.program_string(neigh_x, neigh_y));
                     double similarity = calculate_similarity(rep_program, next_program);
 
                     if (similarity > 0.9) {
@@ -397,7 +318,6 @@ std::map<int, std::set<ProgramLocation>> find_replicators(
                         candidate.grid_y = neigh_y;
                         candidate.program = next_program;
 
-                        std::lock_guard<std::mutex> lock(candidates_mutex);
                         candidates.push_back(candidate);
                     }
                 }
@@ -406,45 +326,42 @@ std::map<int, std::set<ProgramLocation>> find_replicators(
 
         std::cout << "  Candidates (>90% similar): " << candidates.size() << std::endl;
 
-        // Check candidates in parallel
-        std::vector<std::future<std::pair<ProgramLocation, bool>>> futures;
-        std::mutex results_mutex;
+        // Neighbouring replicators propose the same cells and copies of the
+        // same program; each distinct program is checked once
+        std::vector<uint64_t> keys(candidates.size());
+        std::unordered_map<uint64_t, size_t> distinct;  // Program hash -> first candidate
+        for (size_t i = 0; i < candidates.size(); i++) {
+            keys[i] = ReplicatorCache::hash_program(candidates[i].program);
+            distinct.emplace(keys[i], i);
+        }
 
-        for (const auto& candidate : candidates) {
-            // Skip if already in cache
-            if (cache.has(candidate.program)) {
-                if (cache.is_replicator(candidate.program)) {
-                    replicators_by_epoch[epoch + 1].insert(candidate);
-                }
-                continue;
+        // Programs the cache has not seen, grouped by size for the batches
+        std::map<size_t, std::vector<const std::string*>> unchecked;
+        std::map<size_t, std::vector<uint64_t>> unchecked_keys;
+        for (const auto& [key, first] : distinct) {
+            bool cached_result;
+            if (!cache.lookup(key, cached_result)) {
+                size_t size = candidates[first].program.size();
+                unchecked[size].push_back(&candidates[first].program);
+                unchecked_keys[size].push_back(key);
             }
+        }
 
-            // Wait if too many threads are running
-            if (futures.size() >= num_threads) {
-                // Wait for one to complete
-                auto result = futures.front().get();
-                futures.erase(futures.begin());
-
-                cache.add(result.first.program, result.second);
-                if (result.second) {
-                    std::lock_guard<std::mutex> lock(results_mutex);
-                    replicators_by_epoch[epoch + 1].insert(result.first);
-                }
+        size_t checked = 0;
+        for (const auto& [size, programs] : unchecked) {
+            std::vector<bool> results = check_replicators(programs, pool);
+            const std::vector<uint64_t>& program_keys = unchecked_keys[size];
+            for (size_t i = 0; i < programs.size(); i++) {
+                cache.add(program_keys[i], results[i]);
             }
-
-            // Submit to thread pool
-            futures.push_back(std::async(std::launch::async, [candidate]() {
-                bool is_rep = check_replicator(candidate.program);
-                return std::make_pair(candidate, is_rep);
-            }));
+            checked += programs.size();
         }
+        std::cout << "  Distinct programs: " << distinct.size() << ", emulated: " << checked << std::endl;
 
-        // Wait for remaining futures
-        for (auto& future : futures) {
-            auto result = future.get();
-            cache.add(result.first.program, result.second);
-            if (result.second) {
-                replicators_by_epoch[epoch + 1].insert(result.first);
+        for (size_t i = 0; i < candidates.size(); i++) {
+            bool is_replicator = false;
+            if (cache.lookup(keys[i], is_replicator) && is_replicator) {
+                replicators_by_epoch[epoch + 1].insert(candidates[i]);
             }
         }
 
@@ -457,11 +374,283 @@ std::map<int, std::set<ProgramLocation>> find_replicators(
     return replicators_by_epoch;
 }
 
+// Plot of each replicator's distance from the first one over the epochs,
+// with edges between neighbouring replicators of consecutive epochs
+void write_distance_tree(
+    const std::string& path,
+    const std::string& name,
+    const std::string& axis,
+    const std::string& formula,
+    const std::map<std::string, double>& distances,
+    const std::map<int, std::set<ProgramLocation>>& replicators,
+    int start_epoch,
+    const std::map<std::string, int>& program_to_label,
+    const std::map<std::string, ProgramLocation>& first_appearance,
+    double dot_radius,
+    double line_width
+) {
+    std::ofstream dist_viz_file(path);
+    if (dist_viz_file.is_open()) {
+        dist_viz_file << R"(<!DOCTYPE html>
+<html>
+<head>
+    <title>Replicator )" << name << R"( Tree</title>
+    <style>
+        body {
+            font-family: 'Courier New', monospace;
+            background: #1a1a1a;
+            color: #00ff00;
+            margin: 20px;
+        }
+        #canvas {
+            background: #000;
+            border: 2px solid #00ff00;
+            display: block;
+            margin: 20px auto;
+        }
+        .info {
+            max-width: 1200px;
+            margin: 0 auto;
+            padding: 20px;
+            background: #0a0a0a;
+            border: 1px solid #00ff00;
+        }
+        h1 {
+            color: #00ff00;
+            text-align: center;
+        }
+    </style>
+</head>
+<body>
+    <h1>Replicator )" << name << R"( Tree</h1>
+    <canvas id="canvas"></canvas>
+    <div class="info">
+        <h2>Legend</h2>
+        <p>X-axis: Epoch (time)</p>
+        <p>Y-axis: )" << axis << R"( from first replicator</p>
+        <p>Dots: Replicator present at that epoch</p>
+        <p>Lines: Evolutionary connections (parent → child)</p>
+        <p>Distance formula: )" << formula << R"(</p>
+    </div>
+    <script>
+        const canvas = document.getElementById('canvas');
+        const ctx = canvas.getContext('2d');
+
+        // Data
+        const data = {
+)";
+
+        // Output epoch data with edit distances
+        dist_viz_file << "            epochs: [\n";
+        bool first_epoch_dist = true;
+        for (const auto& [epoch, reps] : replicators) {
+            if (!first_epoch_dist) dist_viz_file << ",\n";
+            first_epoch_dist = false;
+
+            std::set<double> distances_at_epoch;
+            std::set<std::pair<double, double>> edges_with_distances;
+
+            // Collect distances for this epoch
+            for (const auto& rep : reps) {
+                double distance = distances.at(rep.program);
+                distances_at_epoch.insert(distance);
+            }
+
+            // Calculate edges using edit distances
+            if (epoch != start_epoch) {
+                const auto& prev_epoch_reps = replicators.at(epoch - 1);
+                for (const auto& rep : reps) {
+                    double child_distance = distances.at(rep.program);
+
+                    for (const auto& prev_rep : prev_epoch_reps) {
+                        int dx = std::abs(rep.grid_x - prev_rep.grid_x);
+                        int dy = std::abs(rep.grid_y - prev_rep.grid_y);
+                        int manhattan = dx + dy;
+                        bool is_neighbor = (manhattan <= 2) || (dx == 1 && dy == 1);
+
+                        if (is_neighbor || (rep.grid_x == prev_rep.grid_x && rep.grid_y == prev_rep.grid_y)) {
+                            double parent_distance = distances.at(prev_rep.program);
+                            edges_with_distances.insert({parent_distance, child_distance});
+                        }
+                    }
+                }
+            }
+
+            dist_viz_file << "                {\n";
+            dist_viz_file << "                    epoch: " << epoch << ",\n";
+            dist_viz_file << "                    distances: [";
+            bool first_dist = true;
+            for (double dist : distances_at_epoch) {
+                if (!first_dist) dist_viz_file << ", ";
+                first_dist = false;
+                dist_viz_file << std::fixed << std::setprecision(6) << dist;
+            }
+            dist_viz_file << "],\n";
+            dist_viz_file << "                    edges: [";
+            bool first_edge_dist = true;
+            for (const auto& [parent_dist, child_dist] : edges_with_distances) {
+                if (!first_edge_dist) dist_viz_file << ", ";
+                first_edge_dist = false;
+                dist_viz_file << "[" << std::fixed << std::setprecision(6) << parent_dist << ", " << child_dist << "]";
+            }
+            dist_viz_file << "]\n";
+            dist_viz_file << "                }";
+        }
+        dist_viz_file << "\n            ],\n";
+
+        // Output program info with distances
+        dist_viz_file << "            programs: {\n";
+        bool first_prog_dist = true;
+        for (const auto& [program, label] : program_to_label) {
+            if (!first_prog_dist) dist_viz_file << ",\n";
+            first_prog_dist = false;
+
+            const auto& first = first_appearance.at(program);
+            double distance = distances.at(program);
+            dist_viz_file << "                \"" << label << "\": {\n";
+            dist_viz_file << "                    program: \"" << program << "\",\n";
+            dist_viz_file << "                    distance: " << std::fixed << std::setprecision(6) << distance << ",\n";
+            dist_viz_file << "                    firstEpoch: " << first.epoch << ",\n";
+            dist_viz_file << "                    firstPos: [" << first.grid_x << ", " << first.grid_y << "]\n";
+            dist_viz_file << "                }";
+        }
+        dist_viz_file << "\n            }\n";
+        dist_viz_file << "        };\n\n";
+
+        // Output visualization parameters
+        dist_viz_file << "        const dotRadius = " << dot_radius << ";\n";
+        dist_viz_file << "        const lineWidth = " << line_width << ";\n\n";
+
+        dist_viz_file << R"(
+        // Drawing parameters
+        const width = 1200;
+        const height = 800;
+        canvas.width = width;
+        canvas.height = height;
+
+        const padding = 60;
+        const plotWidth = width - 2 * padding;
+        const plotHeight = height - 2 * padding;
+
+        // Find ranges
+        const minEpoch = Math.min(...data.epochs.map(e => e.epoch));
+        const maxEpoch = Math.max(...data.epochs.map(e => e.epoch));
+        const allDistances = new Set();
+        data.epochs.forEach(e => e.distances.forEach(d => allDistances.add(d)));
+        const maxDistance = Math.max(...allDistances);
+        const minDistance = Math.min(...allDistances);
+
+        console.log('Epochs:', minEpoch, 'to', maxEpoch);
+        console.log('Distances:', Array.from(allDistances));
+        console.log('Canvas size:', width, 'x', height);
+
+        // Scale functions
+        function scaleX(epoch) {
+            if (maxEpoch === minEpoch) return width / 2;
+            return padding + (epoch - minEpoch) / (maxEpoch - minEpoch) * plotWidth;
+        }
+
+        function scaleY(distance) {
+            const range = maxDistance - minDistance;
+            if (range === 0) return height / 2;
+            return padding + plotHeight - ((distance - minDistance) / range) * plotHeight;
+        }
+
+        // Draw axes
+        ctx.strokeStyle = '#00ff00';
+        ctx.lineWidth = 2;
+        ctx.beginPath();
+        ctx.moveTo(padding, padding);
+        ctx.lineTo(padding, height - padding);
+        ctx.lineTo(width - padding, height - padding);
+        ctx.stroke();
+
+        // Draw axis labels
+        ctx.fillStyle = '#00ff00';
+        ctx.font = '14px Courier New';
+        ctx.textAlign = 'center';
+        ctx.fillText('Epoch', width / 2, height - 20);
+        ctx.save();
+        ctx.translate(20, height / 2);
+        ctx.rotate(-Math.PI / 2);
+        ctx.fillText(')" << name << R"(', 0, 0);
+        ctx.restore();
+
+        // Draw epoch ticks (only min and max)
+        ctx.font = '12px Courier New';
+        const x_min = scaleX(minEpoch);
+        const x_max = scaleX(maxEpoch);
+        ctx.fillText(minEpoch.toString(), x_min, height - padding + 20);
+        ctx.fillText(maxEpoch.toString(), x_max, height - padding + 20);
+
+        // Draw distance ticks (min, mid, max)
+        ctx.textAlign = 'right';
+        const distancesToShow = [minDistance];
+        if (maxDistance !== minDistance) {
+            distancesToShow.push((minDistance + maxDistance) / 2);
+            distancesToShow.push(maxDistance);
+        }
+        for (let distance of distancesToShow) {
+            const y = scaleY(distance);
+            ctx.fillText(distance.toFixed(3), padding - 10, y + 5);
+        }
+
+        // Draw edges
+        ctx.strokeStyle = '#00aa00';
+        ctx.lineWidth = lineWidth;
+        for (let i = 1; i < data.epochs.length; i++) {
+            const epochData = data.epochs[i];
+            const prevEpochData = data.epochs[i - 1];
+
+            for (let [parentDist, childDist] of epochData.edges) {
+                const x1 = scaleX(prevEpochData.epoch);
+                const y1 = scaleY(parentDist);
+                const x2 = scaleX(epochData.epoch);
+                const y2 = scaleY(childDist);
+
+                ctx.beginPath();
+                ctx.moveTo(x1, y1);
+                ctx.lineTo(x2, y2);
+                ctx.stroke();
+            }
+        }
+
+        // Draw points
+        let pointsDrawn = 0;
+        for (let epochData of data.epochs) {
+            for (let distance of epochData.distances) {
+                const x = scaleX(epochData.epoch);
+                const y = scaleY(distance);
+
+                console.log('Drawing point at epoch', epochData.epoch, 'distance', distance, '-> (', x, ',', y, ')');
+
+                ctx.fillStyle = '#00ff00';
+                ctx.beginPath();
+                ctx.arc(x, y, dotRadius, 0, 2 * Math.PI);
+                ctx.fill();
+
+                ctx.strokeStyle = '#000';
+                ctx.lineWidth = 1;
+                ctx.stroke();
+                pointsDrawn++;
+            }
+        }
+
+        console.log(')" << name << R"( tree drawn successfully. Points:', pointsDrawn);
+    </script>
+</body>
+</html>
+)";
+        dist_viz_file.close();
+        std::cout << name << " tree saved to: " << path << std::endl;
+    }
+}
+
 int main(int argc, char* argv[]) {
     // Parse command line arguments
     if (argc < 8) {
         std::cerr << "Usage: " << argv[0]
-                  << " <pairings_dir> <start_epoch> <grid_x> <grid_y> <last_epoch> <grid_width> <grid_height> [num_threads] [dot_radius] [line_width]"
+                  << " <pairings_dir> <start_epoch> <grid_x> <grid_y> <last_epoch> <grid_width> <grid_height> [num_threads] [dot_radius] [line_width] [cache_file|none] [compression_tree]"
                   << std::endl;
         std::cerr << "Example: " << argv[0]
                   << " python/test_data 16324 14 27 16327 64 64 8 3 1"
@@ -481,6 +670,10 @@ int main(int argc, char* argv[]) {
     if (argc > 8) {
         num_threads = std::atoi(argv[8]);
     }
+    if (num_threads == 0) {
+        num_threads = std::thread::hardware_concurrency();
+        if (num_threads == 0) num_threads = 4;
+    }
 
     double dot_radius = 3.0;
     if (argc > 9) {
@@ -492,6 +685,24 @@ int main(int argc, char* argv[]) {
         line_width = std::atof(argv[10]);
     }
 
+    // Replication checks carry over between runs through this file
+    std::string cache_path = pairings_dir + "/replicator_cache.bin";
+    if (argc > 11) {
+        cache_path = argv[11];
+    }
+    bool persist_cache = cache_path != "none";
+
+    // Also plot the normalized compression distance from the first replicator
+    bool compression_tree = argc > 12 && std::atoi(argv[12]) != 0;
+
+    ThreadPool pool(num_threads);
+
+    ReplicatorCache cache;
+    if (persist_cache) {
+        size_t loaded = cache.load(cache_path, REPLICATOR_MAX_ITER);
+        std::cout << "Loaded " << loaded << " cached replicator checks from " << cache_path << std::endl;
+    }
+
     // Run forward pass analysis
     auto replicators = find_replicators(
         pairings_dir,
@@ -501,9 +712,19 @@ int main(int argc, char* argv[]) {
         last_epoch,
         grid_width,
         grid_height,
-        num_threads
+        cache,
+        pool
     );
 
+    if (persist_cache) {
+        try {
+            cache.save(cache_path, REPLICATOR_MAX_ITER);
+            std::cout << "Saved " << cache.size() << " replicator checks to " << cache_path << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: " << e.what() << std::endl;
+        }
+    }
+
     // Print summary
     std::cout << "=== Summary ===" << std::endl;
     int total_replicators = 0;
@@ -596,6 +817,7 @@ int main(int argc, char* argv[]) {
     // Calculate edit distances for each unique replicator
     std::cout << "\nCalculating edit distances..." << std::endl;
     std::map<std::string, double> edit_distances;
+    std::map<std::string, double> compression_distances;
 
     // Find the replicator with label 0 (the first discovered replicator)
     std::string reference_replicator;
@@ -607,15 +829,22 @@ int main(int argc, char* argv[]) {
     }
 
     if (!reference_replicator.empty()) {
-        // Reference replicator (label 0) has distance 0
-        edit_distances[reference_replicator] = 0.0;
-
-        // Calculate distance for all other unique replicators
-        for (const auto& program : unique_programs) {
-            if (program == reference_replicator) continue;
+        // Distance of every unique replicator from the reference (label 0),
+        // which has distance 0 from itself
+        MetricsEngine metrics(MetricsOptions(), &pool);
+        std::vector<std::string> programs(unique_programs.begin(), unique_programs.end());
+        std::vector<double> distances = metrics.distance_matrix({reference_replicator}, programs);
+        std::vector<double> compression;
+        if (compression_tree) {
+            compression = metrics.distance_matrix({reference_replicator}, programs, ProgramDistance::Compression);
+        }
 
-            // Calculate normalized edit distance
-            edit_distances[program] = normalized_edit_distance(reference_replicator, program);
+        for (size_t i = 0; i < programs.size(); i++) {
+            bool reference = programs[i] == reference_replicator;
+            edit_distances[programs[i]] = reference ? 0.0 : distances[i];
+            if (compression_tree) {
+                compression_distances[programs[i]] = reference ? 0.0 : compression[i];
+            }
         }
     }
 
@@ -863,261 +1092,16 @@ int main(int argc, char* argv[]) {
     // Generate edit distance plot
     std::cout << "Generating edit distance plot..." << std::endl;
 
-    std::string dist_viz_path = pairings_dir + "/edit_distance_tree.html";
-    std::ofstream dist_viz_file(dist_viz_path);
-    if (dist_viz_file.is_open()) {
-        dist_viz_file << R"(<!DOCTYPE html>
-<html>
-<head>
-    <title>Replicator Edit Distance Tree</title>
-    <style>
-        body {
-            font-family: 'Courier New', monospace;
-            background: #1a1a1a;
-            color: #00ff00;
-            margin: 20px;
-        }
-        #canvas {
-            background: #000;
-            border: 2px solid #00ff00;
-            display: block;
-            margin: 20px auto;
-        }
-        .info {
-            max-width: 1200px;
-            margin: 0 auto;
-            padding: 20px;
-            background: #0a0a0a;
-            border: 1px solid #00ff00;
-        }
-        h1 {
-            color: #00ff00;
-            text-align: center;
-        }
-    </style>
-</head>
-<body>
-    <h1>Replicator Edit Distance Tree</h1>
-    <canvas id="canvas"></canvas>
-    <div class="info">
-        <h2>Legend</h2>
-        <p>X-axis: Epoch (time)</p>
-        <p>Y-axis: Normalized Edit Distance from first replicator</p>
-        <p>Dots: Replicator present at that epoch</p>
-        <p>Lines: Evolutionary connections (parent → child)</p>
-        <p>Distance formula: Levenshtein distance / max(len(s1), len(s2))</p>
-    </div>
-    <script>
-        const canvas = document.getElementById('canvas');
-        const ctx = canvas.getContext('2d');
-
-        // Data
-        const data = {
-)";
-
-        // Output epoch data with edit distances
-        dist_viz_file << "            epochs: [\n";
-        bool first_epoch_dist = true;
-        for (const auto& [epoch, reps] : replicators) {
-            if (!first_epoch_dist) dist_viz_file << ",\n";
-            first_epoch_dist = false;
-
-            std::set<double> distances_at_epoch;
-            std::set<std::pair<double, double>> edges_with_distances;
-
-            // Collect distances for this epoch
-            for (const auto& rep : reps) {
-                double distance = edit_distances[rep.program];
-                distances_at_epoch.insert(distance);
-            }
-
-            // Calculate edges using edit distances
-            if (epoch != start_epoch) {
-                const auto& prev_epoch_reps = replicators.at(epoch - 1);
-                for (const auto& rep : reps) {
-                    double child_distance = edit_distances[rep.program];
-
-                    for (const auto& prev_rep : prev_epoch_reps) {
-                        int dx = std::abs(rep.grid_x - prev_rep.grid_x);
-                        int dy = std::abs(rep.grid_y - prev_rep.grid_y);
-                        int manhattan = dx + dy;
-                        bool is_neighbor = (manhattan <= 2) || (dx == 1 && dy == 1);
-
-                        if (is_neighbor || (rep.grid_x == prev_rep.grid_x && rep.grid_y == prev_rep.grid_y)) {
-                            double parent_distance = edit_distances[prev_rep.program];
-                            edges_with_distances.insert({parent_distance, child_distance});
-                        }
-                    }
-                }
-            }
-
-            dist_viz_file << "                {\n";
-            dist_viz_file << "                    epoch: " << epoch << ",\n";
-            dist_viz_file << "                    distances: [";
-            bool first_dist = true;
-            for (double dist : distances_at_epoch) {
-                if (!first_dist) dist_viz_file << ", ";
-                first_dist = false;
-                dist_viz_file << std::fixed << std::setprecision(6) << dist;
-            }
-            dist_viz_file << "],\n";
-            dist_viz_file << "                    edges: [";
-            bool first_edge_dist = true;
-            for (const auto& [parent_dist, child_dist] : edges_with_distances) {
-                if (!first_edge_dist) dist_viz_file << ", ";
-                first_edge_dist = false;
-                dist_viz_file << "[" << std::fixed << std::setprecision(6) << parent_dist << ", " << child_dist << "]";
-            }
-            dist_viz_file << "]\n";
-            dist_viz_file << "                }";
-        }
-        dist_viz_file << "\n            ],\n";
-
-        // Output program info with distances
-        dist_viz_file << "            programs: {\n";
-        bool first_prog_dist = true;
-        for (const auto& [program, label] : program_to_label) {
-            if (!first_prog_dist) dist_viz_file << ",\n";
-            first_prog_dist = false;
-
-            const auto& first = first_appearance[program];
-            double distance = edit_distances[program];
-            dist_viz_file << "                \"" << label << "\": {\n";
-            dist_viz_file << "                    program: \"" << program << "\",\n";
-            dist_viz_file << "                    distance: " << std::fixed << std::setprecision(6) << distance << ",\n";
-            dist_viz_file << "                    firstEpoch: " << first.epoch << ",\n";
-            dist_viz_file << "                    firstPos: [" << first.grid_x << ", " << first.grid_y << "]\n";
-            dist_viz_file << "                }";
-        }
-        dist_viz_file << "\n            }\n";
-        dist_viz_file << "        };\n\n";
-
-        // Output visualization parameters
-        dist_viz_file << "        const dotRadius = " << dot_radius << ";\n";
-        dist_viz_file << "        const lineWidth = " << line_width << ";\n\n";
-
-        dist_viz_file << R"(
-        // Drawing parameters
-        const width = 1200;
-        const height = 800;
-        canvas.width = width;
-        canvas.height = height;
-
-        const padding = 60;
-        const plotWidth = width - 2 * padding;
-        const plotHeight = height - 2 * padding;
-
-        // Find ranges
-        const minEpoch = Math.min(...data.epochs.map(e => e.epoch));
-        const maxEpoch = Math.max(...data.epochs.map(e => e.epoch));
-        const allDistances = new Set();
-        data.epochs.forEach(e => e.distances.forEach(d => allDistances.add(d)));
-        const maxDistance = Math.max(...allDistances);
-        const minDistance = Math.min(...allDistances);
-
-        console.log('Epochs:', minEpoch, 'to', maxEpoch);
-        console.log('Distances:', Array.from(allDistances));
-        console.log('Canvas size:', width, 'x', height);
-
-        // Scale functions
-        function scaleX(epoch) {
-            if (maxEpoch === minEpoch) return width / 2;
-            return padding + (epoch - minEpoch) / (maxEpoch - minEpoch) * plotWidth;
-        }
-
-        function scaleY(distance) {
-            const range = maxDistance - minDistance;
-            if (range === 0) return height / 2;
-            return padding + plotHeight - ((distance - minDistance) / range) * plotHeight;
-        }
-
-        // Draw axes
-        ctx.strokeStyle = '#00ff00';
-        ctx.lineWidth = 2;
-        ctx.beginPath();
-        ctx.moveTo(padding, padding);
-        ctx.lineTo(padding, height - padding);
-        ctx.lineTo(width - padding, height - padding);
-        ctx.stroke();
-
-        // Draw axis labels
-        ctx.fillStyle = '#00ff00';
-        ctx.font = '14px Courier New';
-        ctx.textAlign = 'center';
-        ctx.fillText('Epoch', width / 2, height - 20);
-        ctx.save();
-        ctx.translate(20, height / 2);
-        ctx.rotate(-Math.PI / 2);
-        ctx.fillText('Compression Distance', 0, 0);
-        ctx.restore();
-
-        // Draw epoch ticks (only min and max)
-        ctx.font = '12px Courier New';
-        const x_min = scaleX(minEpoch);
-        const x_max = scaleX(maxEpoch);
-        ctx.fillText(minEpoch.toString(), x_min, height - padding + 20);
-        ctx.fillText(maxEpoch.toString(), x_max, height - padding + 20);
-
-        // Draw distance ticks (min, mid, max)
-        ctx.textAlign = 'right';
-        const distancesToShow = [minDistance];
-        if (maxDistance !== minDistance) {
-            distancesToShow.push((minDistance + maxDistance) / 2);
-            distancesToShow.push(maxDistance);
-        }
-        for (let distance of distancesToShow) {
-            const y = scaleY(distance);
-            ctx.fillText(distance.toFixed(3), padding - 10, y + 5);
-        }
-
-        // Draw edges
-        ctx.strokeStyle = '#00aa00';
-        ctx.lineWidth = lineWidth;
-        for (let i = 1; i < data.epochs.length; i++) {
-            const epochData = data.epochs[i];
-            const prevEpochData = data.epochs[i - 1];
-
-            for (let [parentDist, childDist] of epochData.edges) {
-                const x1 = scaleX(prevEpochData.epoch);
-                const y1 = scaleY(parentDist);
-                const x2 = scaleX(epochData.epoch);
-                const y2 = scaleY(childDist);
-
-                ctx.beginPath();
-                ctx.moveTo(x1, y1);
-                ctx.lineTo(x2, y2);
-                ctx.stroke();
-            }
-        }
-
-        // Draw points
-        let pointsDrawn = 0;
-        for (let epochData of data.epochs) {
-            for (let distance of epochData.distances) {
-                const x = scaleX(epochData.epoch);
-                const y = scaleY(distance);
-
-                console.log('Drawing point at epoch', epochData.epoch, 'distance', distance, '-> (', x, ',', y, ')');
-
-                ctx.fillStyle = '#00ff00';
-                ctx.beginPath();
-                ctx.arc(x, y, dotRadius, 0, 2 * Math.PI);
-                ctx.fill();
-
-                ctx.strokeStyle = '#000';
-                ctx.lineWidth = 1;
-                ctx.stroke();
-                pointsDrawn++;
-            }
-        }
-
-        console.log('Compression distance tree drawn successfully. Points:', pointsDrawn);
-    </script>
-</body>
-</html>
-)";
-        dist_viz_file.close();
-        std::cout << "Edit distance tree saved to: " << dist_viz_path << std::endl;
+    write_distance_tree(pairings_dir + "/edit_distance_tree.html", "Edit Distance",
+                        "Normalized Edit Distance", "Levenshtein distance / max(len(s1), len(s2))",
+                        edit_distances, replicators, start_epoch, program_to_label, first_appearance,
+                        dot_radius, line_width);
+    if (compression_tree) {
+        std::cout << "Generating compression distance plot..." << std::endl;
+        write_distance_tree(pairings_dir + "/compression_distance_tree.html", "Compression Distance",
+                            "Compression Distance", "(C(xy) - min(C(x),C(y))) / max(C(x),C(y))",
+                            compression_distances, replicators, start_epoch, program_to_label,
+                            first_appearance, dot_radius, line_width);
     }
 
     // Save results to file
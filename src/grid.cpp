@@ -1,53 +1,118 @@
 #include "grid.h"
 #include "utils.h"
+#include "profiler.h"
+#include "thread_pool.h"
 #include <fstream>
 #include <sstream>
 #include <cmath>
 #include <iomanip>
 #include <random>
 #include <algorithm>
+#include <stdexcept>
+#include <cstring>
 
 Grid::Grid(int width, int height, int program_size)
-    : width(width), height(height), program_size(program_size) {
-    grid_data.resize(width * height);
-    for (auto& program : grid_data) {
-        program.resize(program_size);
-    }
+    : width(width), height(height), program_size(program_size),
+      programs(width * height, program_size), pairing(width, height),
+      color_cache(width * height), color_dirty(width * height, 1) {
+}
+
+void Grid::place_bands(ThreadPool& pool, const std::vector<size_t>& bands) {
+    programs.allocate_untouched();
+    pool.parallel_for_groups(bands, 0, [&](size_t begin, size_t end) {
+        programs.touch(static_cast<int>(begin), static_cast<int>(end));
+    });
+    mark_all_dirty();
 }
 
 void Grid::initialize_random() {
-    for (auto& program : grid_data) {
-        program = generate_random_program(program_size);
+    for (int i = 0; i < get_total_programs(); i++) {
+        std::vector<uint8_t> program = generate_random_program(program_size);
+        std::copy(program.begin(), program.end(), programs.program(i).begin());
     }
+    mark_all_dirty();
 }
 
 void Grid::initialize_random(std::mt19937& rng) {
-    for (auto& program : grid_data) {
-        program = generate_random_program(program_size, rng);
+    for (int i = 0; i < get_total_programs(); i++) {
+        std::vector<uint8_t> program = generate_random_program(program_size, rng);
+        std::copy(program.begin(), program.end(), programs.program(i).begin());
     }
+    mark_all_dirty();
+}
+
+void Grid::initialize_program(int index, CounterRng& counter_rng) {
+    generate_random_program(programs.program(index).data(), program_size, counter_rng);
+    mark_dirty(index);
+}
+
+Span<uint8_t> Grid::get_program(int x, int y) {
+    mark_dirty(index(x, y));
+    return programs.program(index(x, y));
 }
 
-std::vector<uint8_t>& Grid::get_program(int x, int y) {
-    return grid_data[index(x, y)];
+Span<const uint8_t> Grid::get_program(int x, int y) const {
+    return programs.program(index(x, y));
 }
 
-const std::vector<uint8_t>& Grid::get_program(int x, int y) const {
-    return grid_data[index(x, y)];
+void Grid::set_program(int x, int y, Span<const uint8_t> program) {
+    Span<uint8_t> slot = programs.program(index(x, y));
+    std::copy(program.begin(), program.begin() + std::min(program.size(), slot.size()), slot.begin());
+    mark_dirty(index(x, y));
 }
 
-void Grid::set_program(int x, int y, const std::vector<uint8_t>& program) {
-    grid_data[index(x, y)] = program;
+void Grid::commit_epoch() {
+    programs.swap_buffers();
+    in_epoch = false;
+
+    // Without a cache there is nothing to keep; otherwise only the cells
+    // whose program differs from the epoch before need a new color
+    if (colors_cached) {
+        const uint8_t* current = programs.all().data();
+        const uint8_t* previous = programs.back_all().data();
+        for (int i = 0; i < get_total_programs(); i++) {
+            size_t offset = static_cast<size_t>(i) * program_size;
+            if (std::memcmp(current + offset, previous + offset, program_size) != 0) {
+                color_dirty[i] = 1;
+            }
+        }
+    }
 }
 
 std::vector<std::vector<uint8_t>> Grid::get_all_programs() const {
-    return grid_data;
+    std::vector<std::vector<uint8_t>> soup;
+    soup.reserve(get_total_programs());
+    for (int i = 0; i < get_total_programs(); i++) {
+        soup.push_back(programs.program(i).to_vector());
+    }
+    return soup;
 }
 
-void Grid::set_all_programs(const std::vector<std::vector<uint8_t>>& programs) {
-    grid_data = programs;
+void Grid::set_all_programs(const std::vector<std::vector<uint8_t>>& soup) {
+    for (int i = 0; i < get_total_programs() && i < static_cast<int>(soup.size()); i++) {
+        set_program(i % width, i / width, soup[i]);
+    }
 }
 
-RGB Grid::program_to_color(const std::vector<uint8_t>& program) const {
+namespace {
+
+// Instruction class of every byte value, indexing program_to_color's counts
+struct ColorClasses {
+    uint8_t of[256];
+
+    ColorClasses() {
+        std::fill(of, of + 256, static_cast<uint8_t>(3));
+        for (char ch : std::string("[]")) of[static_cast<uint8_t>(ch)] = 0;
+        for (char ch : std::string("+-.,")) of[static_cast<uint8_t>(ch)] = 1;
+        for (char ch : std::string("<>{}")) of[static_cast<uint8_t>(ch)] = 2;
+    }
+};
+
+const ColorClasses COLOR_CLASSES;
+
+} // namespace
+
+RGB Grid::program_to_color(Span<const uint8_t> program) const {
     // Semantic color mapping based on CuBFF implementation
     // Colors programs based on instruction type frequencies
 
@@ -55,26 +120,15 @@ RGB Grid::program_to_color(const std::vector<uint8_t>& program) const {
         return RGB{0, 0, 0};
     }
 
-    // Count instruction types
-    int loop_ops = 0;      // [ ]
-    int arith_ops = 0;     // + - . ,
-    int head_ops = 0;      // < > { }
-    int null_ops = 0;      // non-instruction bytes
-
-    const std::string instructions = "<>{}-+.,[]";
-
+    // Count instruction types: [ ], then + - . ,, then < > { }, then
+    // non-instruction bytes
+    int counts[4] = {0, 0, 0, 0};
     for (uint8_t byte : program) {
-        char ch = static_cast<char>(byte);
-        if (ch == '[' || ch == ']') {
-            loop_ops++;
-        } else if (ch == '+' || ch == '-' || ch == '.' || ch == ',') {
-            arith_ops++;
-        } else if (ch == '<' || ch == '>' || ch == '{' || ch == '}') {
-            head_ops++;
-        } else {
-            null_ops++;
-        }
+        counts[COLOR_CLASSES.of[byte]]++;
     }
+    int loop_ops = counts[0];
+    int arith_ops = counts[1];
+    int head_ops = counts[2];
 
     // Calculate dominant instruction type
     int total_instructions = loop_ops + arith_ops + head_ops;
@@ -116,35 +170,70 @@ RGB Grid::program_to_color(const std::vector<uint8_t>& program) const {
 }
 
 void Grid::save_ppm(const std::string& filename, int scale) const {
-    std::ofstream file(filename);
+    save_colors_ppm(filename, width, height, colors(), scale);
+}
+
+std::vector<uint8_t> Grid::render_colors(int width, int height, const std::vector<RGB>& colors, int scale) {
+    size_t row_bytes = static_cast<size_t>(width) * scale * 3;
+    std::vector<uint8_t> pixels(row_bytes * height * scale);
+
+    // Each cell scaled to scale x scale pixels; the first pixel row of each
+    // cell row is built once and repeated
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = pixels.data() + static_cast<size_t>(y) * scale * row_bytes;
+        uint8_t* out = row;
+        for (int x = 0; x < width; x++) {
+            const RGB& color = colors[static_cast<size_t>(y) * width + x];
+            for (int sx = 0; sx < scale; sx++) {
+                *out++ = color.r;
+                *out++ = color.g;
+                *out++ = color.b;
+            }
+        }
+        for (int sy = 1; sy < scale; sy++) {
+            std::memcpy(row + sy * row_bytes, row, row_bytes);
+        }
+    }
+    return pixels;
+}
+
+void Grid::save_colors_ppm(const std::string& filename, int width, int height, const std::vector<RGB>& colors,
+                           int scale) {
+    std::ofstream file(filename, std::ios::binary);
     if (!file.is_open()) {
         throw std::runtime_error("Could not open file: " + filename);
     }
 
-    // PPM header
-    file << "P3\n";
+    // PPM header, then the pixels as raw bytes
+    file << "P6\n";
     file << (width * scale) << " " << (height * scale) << "\n";
     file << "255\n";
 
-    // Write pixel data, each cell scaled to scale x scale pixels
-    for (int y = 0; y < height; y++) {
-        for (int sy = 0; sy < scale; sy++) {
-            for (int x = 0; x < width; x++) {
-                RGB color = program_to_color(get_program(x, y));
-                for (int sx = 0; sx < scale; sx++) {
-                    file << static_cast<int>(color.r) << " "
-                         << static_cast<int>(color.g) << " "
-                         << static_cast<int>(color.b) << " ";
-                }
-            }
-            file << "\n";
-        }
+    std::vector<uint8_t> pixels = render_colors(width, height, colors, scale);
+    file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+    if (!file) {
+        throw std::runtime_error("Could not write file: " + filename);
     }
+    profile_count(ProfileCounter::BytesWritten, static_cast<uint64_t>(file.tellp()));
+}
 
-    file.close();
+const std::vector<RGB>& Grid::colors() const {
+    for (int i = 0; i < get_total_programs(); i++) {
+        if (color_dirty[i]) {
+            color_cache[i] = program_to_color(programs.program(i));
+            color_dirty[i] = 0;
+        }
+    }
+    colors_cached = true;
+    return color_cache;
 }
 
 void Grid::save_html(const std::string& filename) const {
+    save_colors_html(filename, width, height, program_size, colors());
+}
+
+void Grid::save_colors_html(const std::string& filename, int width, int height, int program_size,
+                            const std::vector<RGB>& colors) {
     std::ofstream file(filename);
     if (!file.is_open()) {
         throw std::runtime_error("Could not open file: " + filename);
@@ -180,7 +269,7 @@ void Grid::save_html(const std::string& filename) const {
 <body>
     <div class="info">
         <h2>BFF Grid Visualization</h2>
-        <p>Grid Size: )" << width << "x" << height << R"( ()" << get_total_programs() << R"( programs)</p>
+        <p>Grid Size: )" << width << "x" << height << R"( ()" << width * height << R"( programs)</p>
         <p>Program Size: )" << program_size << R"( bytes</p>
     </div>
     <canvas id="canvas" width=")" << canvas_width << R"(" height=")" << canvas_height << R"("></canvas>
@@ -199,7 +288,7 @@ void Grid::save_html(const std::string& filename) const {
     for (int y = 0; y < height; y++) {
         file << "            [";
         for (int x = 0; x < width; x++) {
-            RGB color = program_to_color(get_program(x, y));
+            const RGB& color = colors[y * width + x];
             file << "[" << static_cast<int>(color.r) << ","
                  << static_cast<int>(color.g) << ","
                  << static_cast<int>(color.b) << "]";
@@ -225,10 +314,92 @@ void Grid::save_html(const std::string& filename) const {
 </html>
 )";
 
+    profile_count(ProfileCounter::BytesWritten, static_cast<uint64_t>(file.tellp()));
     file.close();
 }
 
+// Pairing CSV of width * height programs stored back to back
+static void write_pairing_csv(const std::string& filepath, int epoch, int width, int height, int program_size,
+                              const uint8_t* programs, const std::vector<int32_t>& partners) {
+    std::ofstream file(filepath);
+    if (!file.is_open()) return;
+
+    static const std::string instructions = ",.[]{}<>+-";
+
+    // Rows are built in one buffer and written in a single call
+    std::string out = "epoch,position_x,position_y,program,combined_x,combined_y\n";
+    out.reserve(out.size() + static_cast<size_t>(width) * height * (program_size + 32));
+
+    std::string epoch_field = std::to_string(epoch) + ",";
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int idx = y * width + x;
+            int combined_idx = partners[idx];
+            int combined_x = combined_idx >= 0 ? combined_idx % width : -1;
+            int combined_y = combined_idx >= 0 ? combined_idx / width : -1;
+
+            out += epoch_field;
+            out += std::to_string(x);
+            out += ',';
+            out += std::to_string(y);
+            out += ",\"";
+            const uint8_t* program = programs + static_cast<size_t>(idx) * program_size;
+            for (int i = 0; i < program_size; i++) {
+                char c = static_cast<char>(program[i]);
+                out += instructions.find(c) != std::string::npos ? c : ' ';
+            }
+            out += "\",";
+            out += std::to_string(combined_x);
+            out += ',';
+            out += std::to_string(combined_y);
+            out += '\n';
+        }
+    }
+
+    file.write(out.data(), out.size());
+    profile_count(ProfileCounter::BytesWritten, static_cast<uint64_t>(file.tellp()));
+}
+
+void Grid::save_pairing_csv(const std::string& filepath, int epoch, const std::vector<int32_t>& partners) const {
+    write_pairing_csv(filepath, epoch, width, height, program_size, programs.data(), partners);
+}
+
+void Grid::save_pairing_csv(const std::string& filepath, const Snapshot& snapshot) {
+    if (snapshot.kind != SnapshotKind::Programs ||
+        snapshot.partners.size() != static_cast<size_t>(snapshot.total_programs())) {
+        throw std::runtime_error("Snapshot holds no programs and partners for " + filepath);
+    }
+    write_pairing_csv(filepath, static_cast<int>(snapshot.epoch), snapshot.width, snapshot.height, snapshot.program_size,
+                      snapshot.bytes.data(), snapshot.partners);
+}
+
+Snapshot Grid::to_snapshot(int epoch, std::vector<int32_t> partners) const {
+    Snapshot snapshot;
+    snapshot.kind = SnapshotKind::Programs;
+    snapshot.epoch = epoch;
+    snapshot.width = width;
+    snapshot.height = height;
+    snapshot.program_size = program_size;
+    snapshot.bytes = programs.all().to_vector();
+    snapshot.partners = std::move(partners);
+    return snapshot;
+}
+
+void Grid::load_snapshot(const Snapshot& snapshot) {
+    if (snapshot.kind != SnapshotKind::Programs || snapshot.width != width || snapshot.height != height ||
+        snapshot.program_size != program_size || snapshot.bytes.size() != programs.size()) {
+        throw std::runtime_error("Snapshot does not match the grid size");
+    }
+    std::copy(snapshot.bytes.begin(), snapshot.bytes.end(), programs.data());
+    mark_all_dirty();
+}
+
 std::string Grid::to_json(int epoch, double entropy, double avg_iters, double finished_ratio) const {
+    return colors_to_json(epoch, width, height, entropy, avg_iters, finished_ratio, colors());
+}
+
+std::string Grid::colors_to_json(int epoch, int width, int height, double entropy, double avg_iters,
+                                 double finished_ratio, const std::vector<RGB>& colors) {
     std::ostringstream json;
 
     json << "{";
@@ -244,7 +415,7 @@ std::string Grid::to_json(int epoch, double entropy, double avg_iters, double fi
     for (int y = 0; y < height; y++) {
         json << "[";
         for (int x = 0; x < width; x++) {
-            RGB color = program_to_color(get_program(x, y));
+            const RGB& color = colors[y * width + x];
             json << "[" << static_cast<int>(color.r) << ","
                  << static_cast<int>(color.g) << ","
                  << static_cast<int>(color.b) << "]";
@@ -286,115 +457,27 @@ std::vector<Grid::Cell> Grid::get_von_neumann_neighbors(int x, int y, int radius
     return neighbors;
 }
 
-std::vector<std::pair<int, int>> Grid::create_spatial_pairs(int neighborhood_radius) {
-    int total_cells = width * height;
-    std::vector<std::pair<int, int>> pairs;
-    std::vector<bool> taken(total_cells, false);
-
-    // Create a random order to visit cells
-    std::vector<int> cell_order(total_cells);
-    for (int i = 0; i < total_cells; i++) {
-        cell_order[i] = i;
+PairingEngine& Grid::pairing_engine(int radius) {
+    if (pairing.get_radius() != radius) {
+        pairing = PairingEngine(width, height, radius);
     }
+    return pairing;
+}
 
+std::vector<std::pair<int, int>> Grid::create_spatial_pairs(int neighborhood_radius) {
     // Get RNG from utils (use shared RNG for reproducibility)
-    std::mt19937& rng = get_rng();
-    std::shuffle(cell_order.begin(), cell_order.end(), rng);
-
-    // Process cells in random order
-    for (int cell_idx : cell_order) {
-        // Skip if already taken
-        if (taken[cell_idx]) {
-            continue;
-        }
-
-        // Convert flat index to x, y
-        int y = cell_idx / width;
-        int x = cell_idx % width;
-
-        // Get neighbors
-        std::vector<Cell> neighbors = get_von_neumann_neighbors(x, y, neighborhood_radius);
-
-        // Filter to only untaken neighbors
-        std::vector<int> available_neighbors;
-        for (const Cell& neighbor : neighbors) {
-            int neighbor_idx = index(neighbor.x, neighbor.y);
-            if (!taken[neighbor_idx]) {
-                available_neighbors.push_back(neighbor_idx);
-            }
-        }
-
-        // If there are available neighbors, pick one randomly
-        if (!available_neighbors.empty()) {
-            std::uniform_int_distribution<int> dist(0, available_neighbors.size() - 1);
-            int chosen_idx = available_neighbors[dist(rng)];
-
-            // Mark both as taken and add pair
-            taken[cell_idx] = true;
-            taken[chosen_idx] = true;
-            pairs.push_back({cell_idx, chosen_idx});
-        } else {
-            // No available neighbors - mark as mutation-only
-            taken[cell_idx] = true;
-            pairs.push_back({-1, cell_idx});
-        }
-    }
-
-    return pairs;
+    return pairing_engine(neighborhood_radius).pair(get_rng());
 }
 
 std::vector<std::pair<int, int>> Grid::create_spatial_pairs(int neighborhood_radius, std::mt19937& custom_rng) {
-    int total_cells = width * height;
-    std::vector<std::pair<int, int>> pairs;
-    std::vector<bool> taken(total_cells, false);
-
-    // Create a random order to visit cells
-    std::vector<int> cell_order(total_cells);
-    for (int i = 0; i < total_cells; i++) {
-        cell_order[i] = i;
-    }
-
-    // Use custom RNG instead of shared RNG
-    std::shuffle(cell_order.begin(), cell_order.end(), custom_rng);
-
-    // Process cells in random order
-    for (int cell_idx : cell_order) {
-        // Skip if already taken
-        if (taken[cell_idx]) {
-            continue;
-        }
-
-        // Convert flat index to x, y
-        int y = cell_idx / width;
-        int x = cell_idx % width;
-
-        // Get neighbors
-        std::vector<Cell> neighbors = get_von_neumann_neighbors(x, y, neighborhood_radius);
-
-        // Filter to only untaken neighbors
-        std::vector<int> available_neighbors;
-        for (const Cell& neighbor : neighbors) {
-            int neighbor_idx = index(neighbor.x, neighbor.y);
-            if (!taken[neighbor_idx]) {
-                available_neighbors.push_back(neighbor_idx);
-            }
-        }
+    return pairing_engine(neighborhood_radius).pair(custom_rng);
+}
 
-        // If there are available neighbors, pick one randomly
-        if (!available_neighbors.empty()) {
-            std::uniform_int_distribution<int> dist(0, available_neighbors.size() - 1);
-            int chosen_idx = available_neighbors[dist(custom_rng)];
-
-            // Mark both as taken and add pair
-            taken[cell_idx] = true;
-            taken[chosen_idx] = true;
-            pairs.push_back({cell_idx, chosen_idx});
-        } else {
-            // No available neighbors - mark as mutation-only
-            taken[cell_idx] = true;
-            pairs.push_back({-1, cell_idx});
-        }
-    }
+std::vector<std::pair<int, int>> Grid::create_spatial_pairs(int neighborhood_radius, uint64_t seed, uint64_t epoch) {
+    return pairing_engine(neighborhood_radius).pair(seed, epoch);
+}
 
-    return pairs;
+std::vector<std::pair<int, int>> Grid::create_tiled_pairs(int neighborhood_radius, uint64_t seed, uint64_t epoch,
+                                                          ThreadPool* pool) {
+    return pairing_engine(neighborhood_radius).pair_tiled(seed, epoch, pool);
 }
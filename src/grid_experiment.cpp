@@ -0,0 +1,96 @@
+#include "grid_experiment.h"
+#include "utils.h"
+#include <iomanip>
+#include <cstdlib>
+#include <stdexcept>
+
+GridExperiment::GridExperiment(const std::string& name, const Config& config, const std::string& output_dir,
+                               ThreadPool& pool, SnapshotWriter* snapshot_writer)
+    : experiment_name(name),
+      settings(config),
+      output_dir(output_dir),
+      snapshot_writer(snapshot_writer),
+      rng(static_cast<unsigned int>(config.random_seed)),
+      simulation(config, pool, rng),
+      output(config.output_threads, config.output_queue, parse_output_backpressure(config.output_backpressure)) {
+    simulation.initialize();
+
+    // The visualization directory is made once here, pairings on first use
+    if (!output_dir.empty()) {
+        std::string command = "mkdir -p " + shell_quote(output_dir + "/visualizations");
+        if (system(command.c_str()) != 0) {
+            throw std::runtime_error("Could not create output directory: " + output_dir);
+        }
+
+        std::string filename = output_dir + "/visualizations/grid_epoch_0000.html";
+        simulation.grid().save_html(filename);
+        log_stream << "Saved initial visualization: " << filename << std::endl;
+    }
+}
+
+void GridExperiment::step(bool live_clients) {
+    int epoch = current_epoch;
+    GridEpochStats stats = simulation.run_epoch(epoch);
+
+    if (!output_dir.empty()) {
+        simulation.save_pairings(epoch, output_dir + "/pairings", snapshot_writer, output, log_stream);
+    }
+
+    // Calculate stats (only when someone will see them)
+    bool eval_epoch = (epoch % settings.eval_interval == 0);
+    double hoe = 0.0;
+    if (eval_epoch || live_clients) {
+        hoe = simulation.higher_order_entropy();
+    }
+    last_entropy = hoe;
+    last_avg_iterations = stats.avg_iterations;
+    last_finished_ratio = stats.finished_ratio;
+
+    if (eval_epoch) {
+        print_epoch_stats(log_stream, epoch, hoe, stats);
+        log_stream << std::endl;
+    }
+
+    if (!output_dir.empty()) {
+        simulation.save_visualization(epoch, output_dir + "/visualizations", output, log_stream);
+    }
+
+    current_epoch++;
+}
+
+std::string GridExperiment::to_json() const {
+    // The grid's own message, with the experiment's name as its first field
+    std::string json = simulation.grid().to_json(current_epoch, last_entropy, last_avg_iterations,
+                                                 last_finished_ratio);
+    std::string tag = "\"experiment\":\"";
+    for (char c : experiment_name) {
+        if (c == '"' || c == '\\') {
+            tag += '\\';
+        }
+        tag += c;
+    }
+    tag += "\",";
+    return json.insert(1, tag);
+}
+
+void GridExperiment::finish() {
+    if (output_dir.empty()) {
+        return;
+    }
+    std::stringstream final_filename;
+    final_filename << output_dir << "/visualizations/grid_epoch_"
+                   << std::setfill('0') << std::setw(4) << settings.epochs << ".html";
+    simulation.grid().save_html(final_filename.str());
+    log_stream << "\nSaved final visualization: " << final_filename.str() << std::endl;
+    output.flush();
+    if (output.dropped() > 0 || output.failures() > 0) {
+        log_stream << "Output: " << output.dropped() << " visualizations dropped, " << output.failures()
+                   << " files failed" << std::endl;
+    }
+}
+
+std::string GridExperiment::take_log() {
+    std::string text = log_stream.str();
+    log_stream.str("");
+    return text;
+}
@@ -0,0 +1,189 @@
+#include "grid_frame.h"
+#include "byte_order.h"
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+namespace {
+
+using namespace byte_order;
+
+constexpr size_t MAX_PALETTE = 256;
+
+uint32_t pack(const RGB& color) {
+    return (static_cast<uint32_t>(color.r) << 16) | (static_cast<uint32_t>(color.g) << 8) | color.b;
+}
+
+void put_rgb(uint8_t* out, const RGB& color) {
+    out[0] = color.r;
+    out[1] = color.g;
+    out[2] = color.b;
+}
+
+RGB get_rgb(const uint8_t* in) {
+    return RGB{in[0], in[1], in[2]};
+}
+
+void put_header(std::vector<uint8_t>& frame, GridFrameType type, const GridFrameStats& stats,
+                int width, int height, uint32_t count) {
+    uint8_t* out = frame.data();
+    std::memcpy(out, GRID_FRAME_MAGIC, 4);
+    put_u32(out + 4, static_cast<uint32_t>(type));
+    put_u32(out + 8, static_cast<uint32_t>(stats.epoch));
+    put_u32(out + 12, static_cast<uint32_t>(width));
+    put_u32(out + 16, static_cast<uint32_t>(height));
+    put_u32(out + 20, count);
+    put_f64(out + 24, stats.entropy);
+    put_f64(out + 32, stats.avg_iters);
+    put_f64(out + 40, stats.finished_ratio);
+}
+
+// Palette of at most MAX_PALETTE colours and the index of every cell, or
+// false if the grid has more colours than that
+bool build_palette(const std::vector<RGB>& colors, std::vector<RGB>& palette, std::vector<uint8_t>& indices) {
+    // Open addressing over packed colours, twice the palette size
+    constexpr size_t SLOTS = 2 * MAX_PALETTE;
+    uint32_t keys[SLOTS];
+    int16_t slots[SLOTS];
+    std::fill(slots, slots + SLOTS, static_cast<int16_t>(-1));
+
+    palette.clear();
+    indices.resize(colors.size());
+    for (size_t i = 0; i < colors.size(); i++) {
+        uint32_t key = pack(colors[i]);
+        size_t slot = (key * 2654435761u) % SLOTS;
+        while (slots[slot] >= 0 && keys[slot] != key) {
+            slot = (slot + 1) % SLOTS;
+        }
+        if (slots[slot] < 0) {
+            if (palette.size() == MAX_PALETTE) {
+                return false;
+            }
+            keys[slot] = key;
+            slots[slot] = static_cast<int16_t>(palette.size());
+            palette.push_back(colors[i]);
+        }
+        indices[i] = static_cast<uint8_t>(slots[slot]);
+    }
+    return true;
+}
+
+} // namespace
+
+void GridFrameEncoder::encode(const GridFrameStats& stats, int width, int height, const std::vector<RGB>& colors,
+                              bool with_keyframe) {
+    size_t cells = static_cast<size_t>(width) * height;
+    if (colors.size() != cells) {
+        throw std::runtime_error("Frame colors do not match the grid size");
+    }
+
+    // Cells that changed since the previous frame, if it had the same shape
+    changes.clear();
+    if (!previous.empty() && previous_width == width && previous_height == height) {
+        std::vector<uint32_t> changed;
+        for (size_t i = 0; i < cells; i++) {
+            if (pack(colors[i]) != pack(previous[i])) {
+                changed.push_back(static_cast<uint32_t>(i));
+            }
+        }
+
+        size_t delta_size = GRID_FRAME_HEADER_SIZE + changed.size() * 7;
+        if (delta_size < GRID_FRAME_HEADER_SIZE + cells * 3) {
+            changes.resize(delta_size);
+            put_header(changes, GridFrameType::Delta, stats, width, height, static_cast<uint32_t>(changed.size()));
+            uint8_t* out_indices = changes.data() + GRID_FRAME_HEADER_SIZE;
+            uint8_t* out_colors = out_indices + changed.size() * 4;
+            for (size_t i = 0; i < changed.size(); i++) {
+                put_u32(out_indices + i * 4, changed[i]);
+                put_rgb(out_colors + i * 3, colors[changed[i]]);
+            }
+        }
+    }
+
+    key.clear();
+    if (with_keyframe || changes.empty()) {
+        std::vector<RGB> palette;
+        std::vector<uint8_t> indices;
+        if (build_palette(colors, palette, indices) && palette.size() * 3 + cells < cells * 3) {
+            key.resize(GRID_FRAME_HEADER_SIZE + palette.size() * 3 + cells);
+            put_header(key, GridFrameType::Palette, stats, width, height, static_cast<uint32_t>(palette.size()));
+            uint8_t* out = key.data() + GRID_FRAME_HEADER_SIZE;
+            for (size_t i = 0; i < palette.size(); i++) {
+                put_rgb(out + i * 3, palette[i]);
+            }
+            std::memcpy(out + palette.size() * 3, indices.data(), cells);
+        } else {
+            key.resize(GRID_FRAME_HEADER_SIZE + cells * 3);
+            put_header(key, GridFrameType::Rgb, stats, width, height, static_cast<uint32_t>(cells));
+            uint8_t* out = key.data() + GRID_FRAME_HEADER_SIZE;
+            for (size_t i = 0; i < cells; i++) {
+                put_rgb(out + i * 3, colors[i]);
+            }
+        }
+    }
+
+    previous = colors;
+    previous_width = width;
+    previous_height = height;
+}
+
+void apply_grid_frame(const uint8_t* data, size_t size, GridFrameType& type, GridFrameStats& stats,
+                      int& width, int& height, std::vector<RGB>& colors) {
+    if (size < GRID_FRAME_HEADER_SIZE || std::memcmp(data, GRID_FRAME_MAGIC, 4) != 0) {
+        throw std::runtime_error("Not a grid frame");
+    }
+    type = static_cast<GridFrameType>(get_u32(data + 4));
+    stats.epoch = static_cast<int>(get_u32(data + 8));
+    int frame_width = static_cast<int>(get_u32(data + 12));
+    int frame_height = static_cast<int>(get_u32(data + 16));
+    size_t count = get_u32(data + 20);
+    stats.entropy = get_f64(data + 24);
+    stats.avg_iters = get_f64(data + 32);
+    stats.finished_ratio = get_f64(data + 40);
+
+    size_t cells = static_cast<size_t>(frame_width) * frame_height;
+    const uint8_t* payload = data + GRID_FRAME_HEADER_SIZE;
+    size_t payload_size = size - GRID_FRAME_HEADER_SIZE;
+
+    if (type == GridFrameType::Rgb) {
+        if (count != cells || payload_size != cells * 3) {
+            throw std::runtime_error("Grid frame does not match its size");
+        }
+        colors.resize(cells);
+        for (size_t i = 0; i < cells; i++) {
+            colors[i] = get_rgb(payload + i * 3);
+        }
+    } else if (type == GridFrameType::Palette) {
+        if (count == 0 || count > MAX_PALETTE || payload_size != count * 3 + cells) {
+            throw std::runtime_error("Grid frame does not match its size");
+        }
+        const uint8_t* indices = payload + count * 3;
+        colors.resize(cells);
+        for (size_t i = 0; i < cells; i++) {
+            if (indices[i] >= count) {
+                throw std::runtime_error("Grid frame palette index out of range");
+            }
+            colors[i] = get_rgb(payload + indices[i] * 3);
+        }
+    } else if (type == GridFrameType::Delta) {
+        if (frame_width != width || frame_height != height || colors.size() != cells) {
+            throw std::runtime_error("Delta frame does not fit the current grid");
+        }
+        if (payload_size != count * 7) {
+            throw std::runtime_error("Grid frame does not match its size");
+        }
+        const uint8_t* new_colors = payload + count * 4;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t index = get_u32(payload + i * 4);
+            if (index >= cells) {
+                throw std::runtime_error("Delta frame cell out of range");
+            }
+            colors[index] = get_rgb(new_colors + i * 3);
+        }
+    } else {
+        throw std::runtime_error("Unknown grid frame type");
+    }
+
+    width = frame_width;
+    height = frame_height;
+}
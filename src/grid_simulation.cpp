@@ -0,0 +1,346 @@
+#include "grid_simulation.h"
+#include "emulator.h"
+#include "utils.h"
+#include "thread_pool.h"
+#include "pairing_engine.h"
+#include "profiler.h"
+#include "snapshot.h"
+#include "output_pipeline.h"
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <cstdlib>
+#include <stdexcept>
+
+static void run_simulation_pair(
+    Span<const uint8_t> programA,
+    Span<const uint8_t> programB,
+    Span<uint8_t> nextA,
+    Span<uint8_t> nextB,
+    int program_size,
+    EmulatorBackend backend,
+    bool detect_cycles,
+    PairCache* cache,
+    EmulatorStats& result
+) {
+    // Emulate in the next-epoch slots, leaving the current programs untouched
+    std::copy(programA.begin(), programA.end(), nextA.begin());
+    std::copy(programB.begin(), programB.end(), nextB.begin());
+    if (cache != nullptr && cache->lookup(nextA.data(), nextB.data(), program_size, result)) {
+        return;
+    }
+    result = emulate_pair_in_place(nextA.data(), nextB.data(), program_size, 0, program_size,
+                                   0, 8192, backend, detect_cycles);
+    if (cache != nullptr) {
+        cache->add(programA.data(), programB.data(), nextA.data(), nextB.data(), program_size, result);
+    }
+}
+
+static MetricsOptions metrics_options_of(const Config& config) {
+    MetricsOptions options;
+    options.brotli_quality = config.brotli_quality;
+    options.brotli_window = config.brotli_window;
+    options.shards = config.hoe_shards;
+    return options;
+}
+
+GridSimulation::GridSimulation(const Config& config, ThreadPool& pool, std::mt19937& rng)
+    : settings(config),
+      pool(pool),
+      rng(rng),
+      seed(static_cast<uint64_t>(config.random_seed)),
+      soup(config.grid_width, config.grid_height, config.program_size),
+      metrics(metrics_options_of(config), &pool) {
+    // Each group's band of rows is placed on its node
+    if (settings.numa_tiles) {
+        bands = row_bands(settings.grid_width, settings.grid_height, pool.groups());
+        soup.place_bands(pool, bands);
+    }
+
+    // Identical pairs are answered from here, across epochs too
+    if (settings.pair_cache_size > 0) {
+        cache = std::make_unique<PairCache>(settings.pair_cache_size);
+    }
+}
+
+void GridSimulation::initialize() {
+    if (settings.counter_rng) {
+        auto initialize_cells = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                CounterRng cell_rng(seed, RngDomain::Initialization, 0, i);
+                soup.initialize_program(i, cell_rng);
+            }
+        };
+        if (settings.numa_tiles) {
+            pool.parallel_for_groups(bands, 0, initialize_cells);
+        } else {
+            pool.parallel_for(soup.get_total_programs(), 0, initialize_cells);
+        }
+    } else {
+        soup.initialize_random(rng);
+    }
+    reset_metrics();
+}
+
+void GridSimulation::reset_metrics() {
+    metrics.reset(soup.all_bytes().data(), soup.all_bytes().size());
+}
+
+GridEpochStats GridSimulation::run_epoch(int epoch) {
+    const Config& config = settings;
+
+    // Next-epoch programs are built alongside the current ones
+    soup.begin_epoch();
+
+    // Create spatial pairs using Von Neumann neighborhoods (r=2)
+    ScopedPhase pairing_phase(profiler, ProfilePhase::Pairing);
+    if (config.pairing == "tiled") {
+        program_pairs = soup.create_tiled_pairs(2, seed, epoch + 1, &pool);
+    } else {
+        program_pairs = config.counter_rng ? soup.create_spatial_pairs(2, seed, epoch + 1)
+                                           : soup.create_spatial_pairs(2, rng);
+    }
+    // NUMA tiles: each band's pairs stay on its group, pairs across bands go anywhere
+    std::vector<size_t> pair_groups;
+    if (config.numa_tiles) {
+        pair_groups = group_pairs_by_band(program_pairs, bands);
+    }
+    pairing_phase.stop();
+
+    auto for_pairs = [&](size_t chunk_size, const std::function<void(size_t, size_t)>& fn) {
+        if (config.numa_tiles) {
+            pool.parallel_for_groups(pair_groups, chunk_size, fn);
+        } else {
+            pool.parallel_for(program_pairs.size(), chunk_size, fn);
+        }
+    };
+
+    // Mutate one next-epoch program from its own counter-based stream
+    auto mutate_cell = [&](int idx) {
+        CounterRng cell_rng(seed, RngDomain::Mutation, epoch + 1, idx);
+        mutate_in_place(soup.next_program(idx).data(), config.program_size, config.mutation_rate, cell_rng);
+    };
+
+    // Run simulations on the worker pool
+    std::vector<EmulatorStats> results(program_pairs.size());
+    bool batched = config.emulator_backend == "batch";
+    EmulatorBackend backend = (config.emulator_backend == "predecoded") ? EmulatorBackend::Predecoded
+                                                                         : EmulatorBackend::Scalar;
+    size_t chunk_size = batched ? std::max<size_t>(4 * EMULATOR_BATCH_LANES,
+                                                   program_pairs.size() / (pool.size() * 8)) : 0;
+    // Fused mutation is timed as part of emulation
+    ScopedPhase emulation_phase(profiler, ProfilePhase::Emulation);
+    for_pairs(chunk_size, [&](size_t begin, size_t end) {
+        thread_local std::vector<EmulatorJob> jobs;
+        jobs.clear();
+
+        for (size_t i = begin; i < end; i++) {
+            int idx_a = program_pairs[i].first;
+            int idx_b = program_pairs[i].second;
+
+            // Mutation-only cases carry the program over unchanged (mutated below)
+            if (idx_a == -1) {
+                Span<const uint8_t> program = soup.program_at(idx_b);
+                std::copy(program.begin(), program.end(), soup.next_program(idx_b).begin());
+                if (config.fused_mutation) {
+                    mutate_cell(idx_b);
+                }
+                continue;
+            }
+
+            // Batched: stage the pair in its next-epoch slots, run the chunk below
+            if (batched) {
+                Span<const uint8_t> program_a = soup.program_at(idx_a);
+                Span<const uint8_t> program_b = soup.program_at(idx_b);
+                std::copy(program_a.begin(), program_a.end(), soup.next_program(idx_a).begin());
+                std::copy(program_b.begin(), program_b.end(), soup.next_program(idx_b).begin());
+                if (cache && cache->lookup(soup.next_program(idx_a).data(), soup.next_program(idx_b).data(),
+                                           config.program_size, results[i])) {
+                    continue;
+                }
+                jobs.push_back(EmulatorJob{soup.next_program(idx_a).data(), soup.next_program(idx_b).data(),
+                                           &results[i]});
+                continue;
+            }
+
+            run_simulation_pair(soup.program_at(idx_a), soup.program_at(idx_b),
+                                soup.next_program(idx_a), soup.next_program(idx_b),
+                                config.program_size, backend, config.cycle_detection, cache.get(), results[i]);
+
+            // Fused: mutate while the pair is still in this worker's cache
+            if (config.fused_mutation) {
+                mutate_cell(idx_a);
+                mutate_cell(idx_b);
+            }
+        }
+
+        if (batched) {
+            emulate_batch(jobs.data(), jobs.size(), config.program_size, 0, config.program_size, 0, 8192,
+                          config.cycle_detection);
+            if (cache) {
+                for (const EmulatorJob& job : jobs) {
+                    const std::pair<int, int>& pair = program_pairs[job.stats - results.data()];
+                    cache->add(soup.program_at(pair.first).data(), soup.program_at(pair.second).data(),
+                               job.programA, job.programB, config.program_size, *job.stats);
+                }
+            }
+            if (config.fused_mutation) {
+                for (size_t i = begin; i < end; i++) {
+                    if (program_pairs[i].first != -1) {
+                        mutate_cell(program_pairs[i].first);
+                        mutate_cell(program_pairs[i].second);
+                    }
+                }
+            }
+        }
+    });
+    emulation_phase.stop();
+
+    // Counter-based streams let mutation run on the pool as well
+    ScopedPhase mutation_phase(profiler, ProfilePhase::Mutation);
+    if (config.counter_rng && !config.fused_mutation) {
+        for_pairs(0, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                for (int idx : {program_pairs[i].first, program_pairs[i].second}) {
+                    if (idx != -1) {
+                        mutate_cell(idx);
+                    }
+                }
+            }
+        });
+    }
+
+    // Process results and update soup
+    double total_iterations = 0;
+    double total_skipped = 0;
+    double finished_runs = 0;
+    double terminated_runs = 0;
+    int executed_pairs = 0;
+
+    for (size_t i = 0; i < program_pairs.size(); i++) {
+        int idx_a = program_pairs[i].first;
+        int idx_b = program_pairs[i].second;
+
+        // Handle mutation-only cases (no neighbor available)
+        if (idx_a == -1) {
+            if (!config.counter_rng) {
+                mutate_in_place(soup.next_program(idx_b).data(), config.program_size, config.mutation_rate, rng);
+            }
+            continue;
+        }
+
+        const EmulatorStats& result = results[i];
+
+        // Programs already hold the post-emulation tape; mutate them
+        if (!config.counter_rng) {
+            mutate_in_place(soup.next_program(idx_a).data(), config.program_size, config.mutation_rate, rng);
+            mutate_in_place(soup.next_program(idx_b).data(), config.program_size, config.mutation_rate, rng);
+        }
+
+        total_iterations += result.iteration;
+        total_skipped += result.skipped;
+        finished_runs += (result.status == EmulatorStatus::Finished) ? 1.0 : 0.0;
+        terminated_runs += (result.status == EmulatorStatus::Terminated) ? 1.0 : 0.0;
+        executed_pairs++;
+    }
+    mutation_phase.stop();
+
+    profile_count(ProfileCounter::Pairs, executed_pairs);
+    profile_count(ProfileCounter::MutationOnly, program_pairs.size() - executed_pairs);
+    profile_count(ProfileCounter::Instructions, static_cast<uint64_t>(total_iterations));
+    profile_count(ProfileCounter::Skipped, static_cast<uint64_t>(total_skipped));
+
+    // Calculate averages (only for executed pairs)
+    GridEpochStats stats;
+    if (executed_pairs > 0) {
+        stats.avg_skipped = total_skipped / executed_pairs;
+        stats.avg_iterations = total_iterations / executed_pairs;
+        stats.terminated_ratio = terminated_runs / executed_pairs;
+        stats.finished_ratio = finished_runs / executed_pairs;
+    }
+
+    // Swap the new programs in
+    soup.commit_epoch();
+    ScopedPhase update_phase(profiler, ProfilePhase::Metrics);
+    metrics.update(soup.previous_bytes().data(), soup.all_bytes().data(), soup.all_bytes().size());
+    update_phase.stop();
+
+    return stats;
+}
+
+double GridSimulation::higher_order_entropy() {
+    ScopedPhase phase(profiler, ProfilePhase::Metrics);
+    return metrics.higher_order_entropy(soup.all_bytes().data(), soup.all_bytes().size());
+}
+
+void GridSimulation::save_pairings(int epoch, const std::string& pairings_dir, SnapshotWriter* snapshot_writer,
+                                   OutputPipeline& output, std::ostream& log) {
+    // Save pairing information starting at epoch 16324
+    const int PAIRING_START_EPOCH = 16324;
+    if (epoch + 1 < PAIRING_START_EPOCH) {
+        return;
+    }
+
+    ScopedPhase phase(profiler, ProfilePhase::Output);
+    std::vector<int32_t> partners = pairing_index(program_pairs, soup.get_total_programs());
+
+    std::stringstream pairing_filename;
+    pairing_filename << pairings_dir << "/pairings_epoch_"
+                     << std::setfill('0') << std::setw(4) << (epoch + 1)
+                     << (snapshot_writer ? ".bffs" : ".csv");
+
+    // Create directory on first use
+    if (!pairings_dir_made) {
+        std::string command = "mkdir -p " + shell_quote(pairings_dir);
+        if (system(command.c_str()) != 0) {
+            throw std::runtime_error("Could not create output directory: " + pairings_dir);
+        }
+        pairings_dir_made = true;
+    }
+
+    if (snapshot_writer) {
+        // Written in the background while the next epoch runs
+        snapshot_writer->submit(pairing_filename.str(), soup.to_snapshot(epoch + 1, std::move(partners)));
+    } else if (output.inline_jobs()) {
+        soup.save_pairing_csv(pairing_filename.str(), epoch + 1, partners);
+    } else {
+        auto snapshot = std::make_shared<const Snapshot>(soup.to_snapshot(epoch + 1, std::move(partners)));
+        std::string path = pairing_filename.str();
+        output.submit([snapshot, path] { Grid::save_pairing_csv(path, *snapshot); });
+    }
+    log << "\tSaved pairing data: " << pairing_filename.str() << std::endl;
+}
+
+void GridSimulation::save_visualization(int epoch, const std::string& visualizations_dir, OutputPipeline& output,
+                                        std::ostream& log) {
+    if (epoch <= 0 || epoch % settings.visualization_interval != 0) {
+        return;
+    }
+
+    ScopedPhase phase(profiler, ProfilePhase::Output);
+    std::stringstream vis_filename;
+    vis_filename << visualizations_dir << "/grid_epoch_"
+                 << std::setfill('0') << std::setw(4) << epoch << ".html";
+    std::string path = vis_filename.str();
+    int width = soup.get_width();
+    int height = soup.get_height();
+    int program_size = settings.program_size;
+    if (output.submit_frame([colors = soup.colors(), path, width, height, program_size] {
+            Grid::save_colors_html(path, width, height, program_size, colors);
+        })) {
+        log << "\tSaved visualization: " << path << std::endl;
+    } else {
+        log << "\tDropped visualization (output queue full): " << path << std::endl;
+    }
+}
+
+void print_epoch_stats(std::ostream& out, int epoch, double hoe, const GridEpochStats& stats) {
+    out << "Epoch: " << epoch << std::endl;
+    out << std::fixed << std::setprecision(3);
+    out << "\tHigher Order Entropy=" << hoe
+        << ",\tAvg Iters=" << stats.avg_iterations
+        << ",\tAvg Skips=" << stats.avg_skipped
+        << ",\tFinished Ratio=" << stats.finished_ratio
+        << ",\tTerminated Ratio=" << stats.terminated_ratio;
+}
@@ -1,18 +1,26 @@
 #include "grid_w_tracer.h"
 #include "grid.h"  // For RGB struct
 #include "utils.h"
+#include "profiler.h"
+#include "thread_pool.h"
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <cmath>
+#include <stdexcept>
 
 GridWithTracer::GridWithTracer(int width, int height, int program_size)
-    : width(width), height(height), program_size(program_size) {
-    grid_data.resize(width * height);
-    for (auto& program : grid_data) {
-        program.reserve(program_size);
-    }
+    : width(width), height(height), program_size(program_size),
+      programs(width * height, program_size), pairing(width, height) {
+}
+
+void GridWithTracer::place_bands(ThreadPool& pool, const std::vector<size_t>& bands) {
+    programs.allocate_untouched();
+    pool.parallel_for_groups(bands, 0, [&](size_t begin, size_t end) {
+        programs.touch(static_cast<int>(begin), static_cast<int>(end));
+    });
 }
 
 void GridWithTracer::initialize_random() {
@@ -26,47 +34,65 @@ void GridWithTracer::initialize_random(std::mt19937& rng) {
 
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x++) {
-            int idx = index(x, y);
-            grid_data[idx].clear();
+            Span<Token> program = programs.program(index(x, y));
 
             // Create random program with tokens
             // Each token's initial position is its index in the program
             // Epoch is 0 for initialization
             for (int i = 0; i < program_size; i++) {
                 uint8_t random_char = static_cast<uint8_t>(dis(rng));
-                Token token(0, static_cast<uint16_t>(i), random_char);
-                grid_data[idx].push_back(token);
+                program[i] = Token(0, static_cast<uint16_t>(i), random_char);
             }
         }
     }
 }
 
-std::vector<Token>& GridWithTracer::get_program(int x, int y) {
-    return grid_data[index(x, y)];
+void GridWithTracer::initialize_program(int index, CounterRng& counter_rng) {
+    Span<Token> program = programs.program(index);
+    for (int i = 0; i < program_size; i++) {
+        program[i] = Token(0, static_cast<uint16_t>(i), counter_rng.next_byte());
+    }
 }
 
-const std::vector<Token>& GridWithTracer::get_program(int x, int y) const {
-    return grid_data[index(x, y)];
+Span<Token> GridWithTracer::get_program(int x, int y) {
+    return programs.program(index(x, y));
 }
 
-void GridWithTracer::set_program(int x, int y, const std::vector<Token>& program) {
-    grid_data[index(x, y)] = program;
+Span<const Token> GridWithTracer::get_program(int x, int y) const {
+    return programs.program(index(x, y));
+}
+
+void GridWithTracer::set_program(int x, int y, Span<const Token> program) {
+    Span<Token> slot = programs.program(index(x, y));
+    std::copy(program.begin(), program.begin() + std::min(program.size(), slot.size()), slot.begin());
 }
 
 std::vector<std::vector<Token>> GridWithTracer::get_all_programs() const {
-    return grid_data;
+    std::vector<std::vector<Token>> soup;
+    soup.reserve(get_total_programs());
+    for (int i = 0; i < get_total_programs(); i++) {
+        soup.push_back(programs.program(i).to_vector());
+    }
+    return soup;
 }
 
-void GridWithTracer::set_all_programs(const std::vector<std::vector<Token>>& programs) {
-    grid_data = programs;
+void GridWithTracer::set_all_programs(const std::vector<std::vector<Token>>& soup) {
+    for (int i = 0; i < get_total_programs() && i < static_cast<int>(soup.size()); i++) {
+        set_program(i % width, i / width, soup[i]);
+    }
 }
 
 std::vector<uint8_t> GridWithTracer::get_program_bytes(int x, int y) const {
-    const auto& tokens = get_program(x, y);
-    return tokens_to_bytes(tokens);
+    Span<const Token> tokens = get_program(x, y);
+    std::vector<uint8_t> bytes;
+    bytes.reserve(tokens.size());
+    for (const Token& token : tokens) {
+        bytes.push_back(token.get_char());
+    }
+    return bytes;
 }
 
-RGB GridWithTracer::program_to_color(const std::vector<uint8_t>& program) const {
+RGB GridWithTracer::program_to_color(Span<const uint8_t> program) const {
     // Semantic color mapping based on CuBFF implementation
     // Colors programs based on instruction type frequencies
 
@@ -134,7 +160,24 @@ RGB GridWithTracer::program_to_color(const std::vector<uint8_t>& program) const
     return RGB{r, g, b};
 }
 
-void GridWithTracer::save_tokens_to_csv(const std::string& filepath, int epoch_num) const {
+std::vector<RGB> GridWithTracer::colors() const {
+    std::vector<RGB> result(get_total_programs());
+    std::vector<uint8_t> bytes(program_size);
+    for (int i = 0; i < get_total_programs(); i++) {
+        Span<const Token> tokens = program_at(i);
+        for (int j = 0; j < program_size; j++) {
+            bytes[j] = tokens[j].get_char();
+        }
+        result[i] = program_to_color(bytes);
+    }
+    return result;
+}
+
+// Token CSV of a width * height grid; token_at(index) gives the tokens in
+// flat order, program after program
+template <typename TokenAt>
+static void write_tokens_csv(const std::string& filepath, int64_t epoch_num, int width, int height,
+                             int program_size, TokenAt token_at) {
     std::ofstream file(filepath);
     if (!file.is_open()) {
         std::cerr << "Failed to open file: " << filepath << std::endl;
@@ -147,9 +190,9 @@ void GridWithTracer::save_tokens_to_csv(const std::string& filepath, int epoch_n
     // Write all tokens
     for (int y = 0; y < height; y++) {
         for (int x = 0; x < width; x++) {
-            const auto& program = get_program(x, y);
-            for (size_t i = 0; i < program.size(); i++) {
-                const Token& token = program[i];
+            size_t first = (static_cast<size_t>(y) * width + x) * program_size;
+            for (size_t i = 0; i < static_cast<size_t>(program_size); i++) {
+                const Token token = token_at(first + i);
                 file << epoch_num << ","
                      << x << ","
                      << y << ","
@@ -170,9 +213,54 @@ void GridWithTracer::save_tokens_to_csv(const std::string& filepath, int epoch_n
         }
     }
 
+    profile_count(ProfileCounter::BytesWritten, static_cast<uint64_t>(file.tellp()));
+
     file.close();
 }
 
+void GridWithTracer::save_tokens_to_csv(const std::string& filepath, int epoch_num) const {
+    const Token* tokens = programs.data();
+    write_tokens_csv(filepath, epoch_num, width, height, program_size, [tokens](size_t i) { return tokens[i]; });
+}
+
+void GridWithTracer::save_tokens_to_csv(const std::string& filepath, const Snapshot& snapshot) {
+    if (snapshot.kind != SnapshotKind::Tokens ||
+        snapshot.tokens.size() != static_cast<size_t>(snapshot.total_programs()) * snapshot.program_size) {
+        throw std::runtime_error("Snapshot holds no tokens for " + filepath);
+    }
+    const uint64_t* values = snapshot.tokens.data();
+    write_tokens_csv(filepath, snapshot.epoch, snapshot.width, snapshot.height, snapshot.program_size,
+                     [values](size_t i) { return Token(values[i]); });
+}
+
+Snapshot GridWithTracer::to_snapshot(int epoch_num) const {
+    Snapshot snapshot;
+    snapshot.kind = SnapshotKind::Tokens;
+    snapshot.epoch = epoch_num;
+    snapshot.width = width;
+    snapshot.height = height;
+    snapshot.program_size = program_size;
+
+    Span<const Token> tokens = programs.all();
+    snapshot.tokens.resize(tokens.size());
+    for (size_t i = 0; i < tokens.size(); i++) {
+        snapshot.tokens[i] = tokens[i].value;
+    }
+
+    return snapshot;
+}
+
+void GridWithTracer::load_snapshot(const Snapshot& snapshot) {
+    if (snapshot.kind != SnapshotKind::Tokens || snapshot.width != width || snapshot.height != height ||
+        snapshot.program_size != program_size || snapshot.tokens.size() != programs.size()) {
+        throw std::runtime_error("Snapshot does not match the grid size");
+    }
+    Token* tokens = programs.data();
+    for (size_t i = 0; i < snapshot.tokens.size(); i++) {
+        tokens[i] = Token(snapshot.tokens[i]);
+    }
+}
+
 std::string GridWithTracer::to_json(int epoch, double entropy, double finished_ratio) const {
     std::ostringstream json;
 
@@ -232,60 +320,15 @@ std::vector<GridWithTracer::Cell> GridWithTracer::get_von_neumann_neighbors(int
     return neighbors;
 }
 
-std::vector<std::pair<int, int>> GridWithTracer::create_spatial_pairs(int neighborhood_radius, std::mt19937& rng) {
-    int total_cells = width * height;
-    std::vector<std::pair<int, int>> pairs;
-    std::vector<bool> taken(total_cells, false);
-
-    // Create a random order to visit cells
-    std::vector<int> cell_order(total_cells);
-    for (int i = 0; i < total_cells; i++) {
-        cell_order[i] = i;
-    }
-
-    // Shuffle cells
-    std::shuffle(cell_order.begin(), cell_order.end(), rng);
-
-    // Process cells in random order
-    for (int cell_idx : cell_order) {
-        // Skip if already taken
-        if (taken[cell_idx]) {
-            continue;
-        }
-
-        // Convert flat index to x, y
-        int y = cell_idx / width;
-        int x = cell_idx % width;
-
-        // Get neighbors
-        std::vector<Cell> neighbors = get_von_neumann_neighbors(x, y, neighborhood_radius);
-
-        // Filter to only untaken neighbors
-        std::vector<int> available_neighbors;
-        for (const Cell& neighbor : neighbors) {
-            int neighbor_idx = index(neighbor.x, neighbor.y);
-            if (!taken[neighbor_idx]) {
-                available_neighbors.push_back(neighbor_idx);
-            }
-        }
-
-        // If there are available neighbors, pick one randomly
-        if (!available_neighbors.empty()) {
-            std::uniform_int_distribution<int> dist(0, available_neighbors.size() - 1);
-            int chosen_idx = available_neighbors[dist(rng)];
-
-            // Mark both as taken and add pair
-            taken[cell_idx] = true;
-            taken[chosen_idx] = true;
-            pairs.push_back({cell_idx, chosen_idx});
-        } else {
-            // No available neighbors - mark as mutation-only
-            taken[cell_idx] = true;
-            pairs.push_back({-1, cell_idx});
-        }
+PairingEngine& GridWithTracer::pairing_engine(int radius) {
+    if (pairing.get_radius() != radius) {
+        pairing = PairingEngine(width, height, radius);
     }
+    return pairing;
+}
 
-    return pairs;
+std::vector<std::pair<int, int>> GridWithTracer::create_spatial_pairs(int neighborhood_radius, std::mt19937& rng) {
+    return pairing_engine(neighborhood_radius).pair(rng);
 }
 
 std::vector<Token> GridWithTracer::mutate(const std::vector<Token>& program, double mutation_rate,
@@ -306,3 +349,52 @@ std::vector<Token> GridWithTracer::mutate(const std::vector<Token>& program, dou
 
     return mutated;
 }
+
+void GridWithTracer::mutate_in_place(Span<Token> program, double mutation_rate,
+                                     uint64_t epoch, std::mt19937& rng) {
+    std::uniform_real_distribution<> mutation_dist(0.0, 1.0);
+    std::uniform_int_distribution<> byte_dist(0, 255);
+
+    for (size_t i = 0; i < program.size(); i++) {
+        if (mutation_dist(rng) < mutation_rate) {
+            uint8_t new_char = static_cast<uint8_t>(byte_dist(rng));
+            program[i] = Token(epoch, static_cast<uint16_t>(i), new_char);
+        }
+    }
+}
+
+void GridWithTracer::mutate_in_place(Span<Token> program, double mutation_rate,
+                                     uint64_t epoch, CounterRng& counter_rng) {
+    if (mutation_rate <= 0.0) {
+        return;
+    }
+
+    uint64_t length = program.size();
+    if (mutation_rate >= 1.0) {
+        for (uint64_t i = 0; i < length; i++) {
+            program[i] = Token(epoch, static_cast<uint16_t>(i), counter_rng.next_byte());
+        }
+        return;
+    }
+
+    // Gap to the next mutated token is geometric with p = mutation_rate
+    double log_q = std::log1p(-mutation_rate);
+    uint64_t pos = counter_rng.next_geometric(log_q);
+    while (pos < length) {
+        program[pos] = Token(epoch, static_cast<uint16_t>(pos), counter_rng.next_byte());
+        uint64_t skip = counter_rng.next_geometric(log_q);
+        if (skip >= length) {
+            break;
+        }
+        pos += skip + 1;
+    }
+}
+
+std::vector<std::pair<int, int>> GridWithTracer::create_spatial_pairs(int neighborhood_radius, uint64_t seed, uint64_t epoch) {
+    return pairing_engine(neighborhood_radius).pair(seed, epoch);
+}
+
+std::vector<std::pair<int, int>> GridWithTracer::create_tiled_pairs(int neighborhood_radius, uint64_t seed,
+                                                                    uint64_t epoch, ThreadPool* pool) {
+    return pairing_engine(neighborhood_radius).pair_tiled(seed, epoch, pool);
+}
@@ -1,34 +1,49 @@
 #include "emulator.h"
+#include "pair_cache.h"
 #include "utils.h"
 #include "metrics.h"
 #include "config.h"
+#include "thread_pool.h"
+#include "program_arena.h"
+#include "metrics_engine.h"
+#include "checkpoint.h"
 
 #include <iostream>
 #include <vector>
 #include <random>
 #include <algorithm>
-#include <thread>
 #include <iomanip>
+#include <memory>
+#include <cstring>
 
 void run_simulation_pair(
-    const std::vector<uint8_t>& programA,
-    const std::vector<uint8_t>& programB,
+    Span<uint8_t> programA,
+    Span<uint8_t> programB,
     int program_size,
-    EmulatorResult& result
+    EmulatorBackend backend,
+    bool detect_cycles,
+    PairCache* cache,
+    EmulatorStats& result
 ) {
-    // Concatenate programs
-    std::vector<uint8_t> tape = programA;
-    tape.insert(tape.end(), programB.begin(), programB.end());
-
-    // Run emulation
-    result = emulate(tape, 0, program_size);
+    // Run emulation directly on the two programs
+    if (cache != nullptr) {
+        result = emulate_pair_cached(*cache, programA.data(), programB.data(), program_size, backend, detect_cycles);
+        return;
+    }
+    result = emulate_pair_in_place(programA.data(), programB.data(), program_size, 0, program_size,
+                                   0, 8192, backend, detect_cycles);
 }
 
 int main(int argc, char* argv[]) {
     // Parse command line arguments
     std::string config_file = "configs/small_config.yaml";
-    if (argc > 2 && std::string(argv[1]) == "--config") {
-        config_file = argv[2];
+    std::string resume_file;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::string(argv[i]) == "--config") {
+            config_file = argv[i + 1];
+        } else if (std::string(argv[i]) == "--resume") {
+            resume_file = argv[i + 1];
+        }
     }
 
     // Load configuration
@@ -44,10 +59,32 @@ int main(int argc, char* argv[]) {
     seed_random(config.random_seed);
     std::mt19937 rng(config.random_seed);
 
-    // Initialize soup with random programs
-    std::vector<std::vector<uint8_t>> soup;
-    for (int i = 0; i < config.soup_size; i++) {
-        soup.push_back(generate_random_program(config.program_size));
+    // Worker pool shared by initialization and every epoch
+    ThreadPool pool(ThreadPool::resolve_thread_count(config.num_threads));
+    uint64_t seed = static_cast<uint64_t>(config.random_seed);
+
+    // Initialize soup with random programs, in memory or in a mapped file
+    ProgramArena<uint8_t> soup;
+    bool streamed = !config.soup_file.empty();
+    try {
+        soup = streamed ? ProgramArena<uint8_t>(config.soup_size, config.program_size, config.soup_file)
+                        : ProgramArena<uint8_t>(config.soup_size, config.program_size);
+    } catch (const std::exception& e) {
+        std::cerr << "Error creating soup: " << e.what() << std::endl;
+        return 1;
+    }
+    if (config.counter_rng) {
+        pool.parallel_for(config.soup_size, 0, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                CounterRng cell_rng(seed, RngDomain::Initialization, 0, i);
+                generate_random_program(soup.program(i).data(), config.program_size, cell_rng);
+            }
+        });
+    } else {
+        for (int i = 0; i < config.soup_size; i++) {
+            std::vector<uint8_t> program = generate_random_program(config.program_size);
+            std::copy(program.begin(), program.end(), soup.program(i).begin());
+        }
     }
 
     std::cout << "Starting simulation with:" << std::endl;
@@ -55,82 +92,250 @@ int main(int argc, char* argv[]) {
     std::cout << "  Program size: " << config.program_size << std::endl;
     std::cout << "  Mutation rate: " << config.mutation_rate << std::endl;
     std::cout << "  Epochs: " << config.epochs << std::endl;
+    std::cout << "  Threads: " << pool.size() << std::endl;
+    if (config.counter_rng) {
+        std::cout << "  RNG: counter-based streams" << std::endl;
+    }
+    if (config.fused_mutation) {
+        std::cout << "  Mutation: fused into emulation tasks" << std::endl;
+    }
+    if (config.emulator_backend == "batch") {
+        std::cout << "  Emulator: batched, " << EMULATOR_BATCH_LANES << " pairs in lockstep" << std::endl;
+    } else if (config.emulator_backend == "predecoded") {
+        std::cout << "  Emulator: pre-decoded" << std::endl;
+    }
+    if (config.pair_cache_size > 0) {
+        std::cout << "  Pair cache: " << config.pair_cache_size << " pairs" << std::endl;
+    }
+    if (streamed) {
+        std::cout << "  Soup: mapped from " << config.soup_file << ", in shards of "
+                  << config.stream_shard_pairs << " pairs" << std::endl;
+    }
     std::cout << std::endl;
 
+    // Entropy metrics with the configured Brotli settings
+    MetricsOptions metrics_options;
+    metrics_options.brotli_quality = config.brotli_quality;
+    metrics_options.brotli_window = config.brotli_window;
+    metrics_options.shards = config.hoe_shards;
+    metrics_options.streaming = streamed;
+    MetricsEngine metrics(metrics_options, &pool);
+
+    // Carry on from a checkpoint: the soup and both engines as they were
+    int start_epoch = 0;
+    if (!resume_file.empty()) {
+        try {
+            Checkpoint checkpoint = read_checkpoint(resume_file);
+            check_checkpoint(checkpoint, "bffpp", 1, config.soup_size, 1, config.program_size);
+            if (checkpoint.rng_states.size() != 2) {
+                throw std::runtime_error("Checkpoint does not hold the random engines");
+            }
+            std::copy(checkpoint.grids[0].bytes.begin(), checkpoint.grids[0].bytes.end(), soup.data());
+            restore_rng_state(get_rng(), checkpoint.rng_states[0]);
+            restore_rng_state(rng, checkpoint.rng_states[1]);
+            start_epoch = static_cast<int>(checkpoint.epoch);
+        } catch (const std::exception& e) {
+            std::cerr << "Error resuming from " << resume_file << ": " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Resumed from " << resume_file << " at epoch " << start_epoch << std::endl << std::endl;
+    }
+
+    // Identical pairs are answered from here, across epochs too
+    std::unique_ptr<PairCache> pair_cache;
+    if (config.pair_cache_size > 0) {
+        pair_cache = std::make_unique<PairCache>(config.pair_cache_size);
+    }
+
+    // Checkpoints are copied out here and written in the background
+    std::unique_ptr<CheckpointWriter> checkpoint_writer;
+    if (config.checkpoint_interval > 0) {
+        system("mkdir -p data/checkpoints");
+        checkpoint_writer = std::make_unique<CheckpointWriter>(config.checkpoint_full_interval);
+    }
+
+    // Per-epoch buffers, allocated once and reused
+    std::vector<int> perm(config.soup_size);
+    std::vector<std::pair<uint64_t, int>> perm_keys(config.counter_rng ? config.soup_size : 0);
+    std::vector<std::pair<int, int>> program_pairs(config.soup_size / 2);
+    std::vector<EmulatorStats> results(program_pairs.size());
+
+    // A streamed soup runs an epoch in shards of stream_shard_pairs pairs:
+    // each shard's programs are copied into the staging buffer in file
+    // order, run there, and copied back. In memory, one shard runs in place.
+    size_t shard_pairs = streamed ? static_cast<size_t>(config.stream_shard_pairs) : program_pairs.size();
+    std::vector<uint8_t> staging(streamed ? 2 * shard_pairs * config.program_size : 0);
+    std::vector<std::pair<int, int>> shard_order;  // (program, staging slot) by program
+
     // Main simulation loop
-    for (int epoch = 0; epoch < config.epochs; epoch++) {
+    for (int epoch = start_epoch; epoch < config.epochs; epoch++) {
         // Create random permutation
-        std::vector<int> perm(config.soup_size);
-        for (int i = 0; i < config.soup_size; i++) {
-            perm[i] = i;
+        if (config.counter_rng) {
+            // Sort by per-program hash keys, generated on the pool
+            pool.parallel_for(perm_keys.size(), 0, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    perm_keys[i] = {CounterRng::hash(seed, RngDomain::PairingOrder, epoch + 1, i),
+                                    static_cast<int>(i)};
+                }
+            });
+            std::sort(perm_keys.begin(), perm_keys.end());
+            for (int i = 0; i < config.soup_size; i++) {
+                perm[i] = perm_keys[i].second;
+            }
+        } else {
+            for (int i = 0; i < config.soup_size; i++) {
+                perm[i] = i;
+            }
+            std::shuffle(perm.begin(), perm.end(), rng);
         }
-        std::shuffle(perm.begin(), perm.end(), rng);
 
         // Create program pairs
-        std::vector<std::pair<int, int>> program_pairs;
-        for (int i = 0; i < config.soup_size; i += 2) {
-            program_pairs.push_back({perm[i], perm[i + 1]});
+        for (size_t i = 0; i < program_pairs.size(); i++) {
+            program_pairs[i] = {perm[2 * i], perm[2 * i + 1]};
         }
 
-        // Run simulations with multithreading
-        std::vector<EmulatorResult> results(program_pairs.size());
-        std::vector<std::thread> threads;
+        // Program side (0 or 1) of pair i: its soup slot, or when streamed
+        // its slot in the staging buffer of the shard starting at shard_begin
+        size_t shard_begin = 0;
+        auto pair_program = [&](size_t i, int side) {
+            if (streamed) {
+                return Span<uint8_t>(staging.data() + (2 * (i - shard_begin) + side) * config.program_size,
+                                     config.program_size);
+            }
+            return soup.program(side == 0 ? program_pairs[i].first : program_pairs[i].second);
+        };
 
-        unsigned int num_threads = std::thread::hardware_concurrency();
-        if (num_threads == 0) num_threads = 4;
+        // Mutate one program from its own counter-based stream
+        auto mutate_program = [&](size_t i, int side) {
+            int idx = (side == 0) ? program_pairs[i].first : program_pairs[i].second;
+            CounterRng cell_rng(seed, RngDomain::Mutation, epoch + 1, idx);
+            mutate_in_place(pair_program(i, side).data(), config.program_size,
+                            config.mutation_rate, cell_rng);
+        };
 
-        for (size_t i = 0; i < program_pairs.size(); i++) {
-            int idx_a = program_pairs[i].first;
-            int idx_b = program_pairs[i].second;
+        // Copy a shard's programs between the soup and the staging buffer,
+        // in the order they lie in the file
+        auto copy_shard = [&](size_t begin, size_t end, bool to_staging) {
+            shard_order.clear();
+            for (size_t i = begin; i < end; i++) {
+                shard_order.push_back({program_pairs[i].first, static_cast<int>(2 * (i - begin))});
+                shard_order.push_back({program_pairs[i].second, static_cast<int>(2 * (i - begin) + 1)});
+            }
+            std::sort(shard_order.begin(), shard_order.end());
+            pool.parallel_for(shard_order.size(), 0, [&](size_t first, size_t last) {
+                for (size_t k = first; k < last; k++) {
+                    uint8_t* program = soup.program(shard_order[k].first).data();
+                    uint8_t* slot = staging.data() + static_cast<size_t>(shard_order[k].second) * config.program_size;
+                    if (to_staging) {
+                        std::memcpy(slot, program, config.program_size);
+                    } else {
+                        std::memcpy(program, slot, config.program_size);
+                    }
+                }
+            });
+        };
 
-            // Wait if too many threads are running
-            if (threads.size() >= num_threads) {
-                threads[0].join();
-                threads.erase(threads.begin());
+        bool batched = config.emulator_backend == "batch";
+        EmulatorBackend backend = (config.emulator_backend == "predecoded") ? EmulatorBackend::Predecoded
+                                                                             : EmulatorBackend::Scalar;
+        for (shard_begin = 0; shard_begin < program_pairs.size(); shard_begin += shard_pairs) {
+            size_t shard_end = std::min(shard_begin + shard_pairs, program_pairs.size());
+            if (streamed) {
+                copy_shard(shard_begin, shard_end, true);
             }
 
-            threads.emplace_back(
-                run_simulation_pair,
-                std::ref(soup[idx_a]),
-                std::ref(soup[idx_b]),
-                config.program_size,
-                std::ref(results[i])
-            );
-        }
+            // Run simulations on the worker pool
+            size_t chunk_size = batched ? std::max<size_t>(4 * EMULATOR_BATCH_LANES,
+                                                           (shard_end - shard_begin) / (pool.size() * 8)) : 0;
+            pool.parallel_for(shard_end - shard_begin, chunk_size, [&](size_t first, size_t last) {
+                size_t begin = shard_begin + first;
+                size_t end = shard_begin + last;
+                if (batched) {
+                    // The whole chunk goes through the lockstep emulator at once,
+                    // but for pairs the cache knows; the others keep their input
+                    thread_local std::vector<EmulatorJob> jobs;
+                    thread_local std::vector<uint8_t> inputs;
+                    jobs.clear();
+                    inputs.clear();
+                    for (size_t i = begin; i < end; i++) {
+                        uint8_t* program_a = pair_program(i, 0).data();
+                        uint8_t* program_b = pair_program(i, 1).data();
+                        if (pair_cache) {
+                            if (pair_cache->lookup(program_a, program_b, config.program_size, results[i])) {
+                                continue;
+                            }
+                            inputs.insert(inputs.end(), program_a, program_a + config.program_size);
+                            inputs.insert(inputs.end(), program_b, program_b + config.program_size);
+                        }
+                        jobs.push_back(EmulatorJob{program_a, program_b, &results[i]});
+                    }
+                    emulate_batch(jobs.data(), jobs.size(), config.program_size, 0, config.program_size, 0, 8192,
+                                  config.cycle_detection);
+                    if (pair_cache) {
+                        for (size_t j = 0; j < jobs.size(); j++) {
+                            const uint8_t* input_a = inputs.data() + 2 * j * config.program_size;
+                            pair_cache->add(input_a, input_a + config.program_size, jobs[j].programA,
+                                            jobs[j].programB, config.program_size, *jobs[j].stats);
+                        }
+                    }
+                }
+
+                for (size_t i = begin; i < end; i++) {
+                    if (!batched) {
+                        run_simulation_pair(
+                            pair_program(i, 0),
+                            pair_program(i, 1),
+                            config.program_size,
+                            backend,
+                            config.cycle_detection,
+                            pair_cache.get(),
+                            results[i]
+                        );
+                    }
 
-        // Wait for all threads to complete
-        for (auto& thread : threads) {
-            thread.join();
+                    // Fused: mutate while the pair is still in this worker's cache
+                    if (config.fused_mutation) {
+                        mutate_program(i, 0);
+                        mutate_program(i, 1);
+                    }
+                }
+            });
+
+            // Counter-based streams let mutation run on the pool as well
+            if (config.counter_rng && !config.fused_mutation) {
+                pool.parallel_for(shard_end - shard_begin, 0, [&](size_t first, size_t last) {
+                    for (size_t i = shard_begin + first; i < shard_begin + last; i++) {
+                        mutate_program(i, 0);
+                        mutate_program(i, 1);
+                    }
+                });
+            }
+
+            // Programs already hold the post-emulation tape; mutate them
+            if (!config.counter_rng) {
+                for (size_t i = shard_begin; i < shard_end; i++) {
+                    mutate_in_place(pair_program(i, 0).data(), config.program_size, config.mutation_rate);
+                    mutate_in_place(pair_program(i, 1).data(), config.program_size, config.mutation_rate);
+                }
+            }
+
+            if (streamed) {
+                copy_shard(shard_begin, shard_end, false);
+            }
         }
 
-        // Process results and update soup
+        // Process results
         double total_iterations = 0;
         double total_skipped = 0;
         double finished_runs = 0;
         double terminated_runs = 0;
 
         for (size_t i = 0; i < program_pairs.size(); i++) {
-            int idx_a = program_pairs[i].first;
-            int idx_b = program_pairs[i].second;
-            const EmulatorResult& result = results[i];
-
-            // Extract and mutate programs
-            std::vector<uint8_t> programA_new(
-                result.tape.begin(),
-                result.tape.begin() + config.program_size
-            );
-            std::vector<uint8_t> programB_new(
-                result.tape.begin() + config.program_size,
-                result.tape.end()
-            );
-
-            soup[idx_a] = mutate(programA_new, config.mutation_rate);
-            soup[idx_b] = mutate(programB_new, config.mutation_rate);
-
+            const EmulatorStats& result = results[i];
             total_iterations += result.iteration;
             total_skipped += result.skipped;
-            finished_runs += (result.state == "Finished") ? 1.0 : 0.0;
-            terminated_runs += (result.state == "Terminated") ? 1.0 : 0.0;
+            finished_runs += (result.status == EmulatorStatus::Finished) ? 1.0 : 0.0;
+            terminated_runs += (result.status == EmulatorStatus::Terminated) ? 1.0 : 0.0;
         }
 
         total_skipped /= program_pairs.size();
@@ -140,13 +345,8 @@ int main(int argc, char* argv[]) {
 
         // Evaluate and print statistics
         if (epoch % config.eval_interval == 0) {
-            // Flatten soup
-            std::vector<uint8_t> flat_soup;
-            for (const auto& program : soup) {
-                flat_soup.insert(flat_soup.end(), program.begin(), program.end());
-            }
-
-            double hoe = higher_order_entropy(flat_soup);
+            // Soup is already contiguous
+            double hoe = metrics.higher_order_entropy_of(soup.data(), soup.size());
 
             std::cout << "Epoch: " << epoch << std::endl;
             std::cout << std::fixed << std::setprecision(3);
@@ -160,10 +360,34 @@ int main(int argc, char* argv[]) {
             if (hoe > 1.0) {
                 std::cout << "The first " << config.num_print_programs << " programs:" << std::endl;
                 for (int program_idx = 0; program_idx < config.num_print_programs; program_idx++) {
-                    print_tape(soup[program_idx], -1, -1, -1, false);
+                    print_tape(soup.program(program_idx).to_vector(), -1, -1, -1, false);
                 }
             }
         }
+
+        // Save a checkpoint after every checkpoint_interval epochs
+        if (checkpoint_writer && (epoch + 1) % config.checkpoint_interval == 0) {
+            Checkpoint checkpoint;
+            checkpoint.driver = "bffpp";
+            checkpoint.epoch = epoch + 1;
+            Snapshot programs;
+            programs.epoch = epoch + 1;
+            programs.width = config.soup_size;
+            programs.height = 1;
+            programs.program_size = config.program_size;
+            programs.bytes.assign(soup.data(), soup.data() + soup.size());
+            checkpoint.grids.push_back(std::move(programs));
+            checkpoint.rng_states = {rng_state(get_rng()), rng_state(rng)};
+
+            std::string path = checkpoint_path("data/checkpoints", "bffpp", epoch + 1);
+            checkpoint_writer->submit(path, std::move(checkpoint));
+            std::cout << "\tSaved checkpoint: " << path << std::endl;
+        }
+    }
+
+    if (pair_cache) {
+        std::cout << "Pair cache: " << pair_cache->hits() << " of " << pair_cache->lookups()
+                  << " pairs answered, " << pair_cache->size() << " entries" << std::endl;
     }
 
     return 0;
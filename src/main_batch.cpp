@@ -0,0 +1,224 @@
+#include "config.h"
+#include "grid_experiment.h"
+#include "websocket_server.h"
+#include "thread_pool.h"
+#include "snapshot.h"
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+
+// Many grid experiments in one process: every config (times every seed of
+// an optional sweep) becomes a GridExperiment, and all of them share one
+// worker pool and one WebSocket server. The run goes in rounds; each round
+// advances every unfinished experiment by one epoch, the experiments
+// stepping side by side on the pool, so grids too small to keep every core
+// busy on their own fill the machine together.
+
+// Name of an experiment: the config file's stem, plus the seed in a sweep
+std::string experiment_name(const std::string& config_file, int seed, bool sweep) {
+    std::string stem = config_file.substr(config_file.find_last_of('/') + 1);
+    stem = stem.substr(0, stem.find_last_of('.'));
+    return sweep ? stem + "_seed" + std::to_string(seed) : stem;
+}
+
+// Print text with every line tagged with the experiment it came from
+void print_tagged(const std::string& name, const std::string& text) {
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::cout << "[" << name << "] " << line << "\n";
+    }
+    std::cout.flush();
+}
+
+int main(int argc, char* argv[]) {
+    // Parse command line arguments
+    std::vector<std::string> config_files;
+    std::vector<int> seeds;
+    int num_threads = 0;
+    std::string output_root = "data/batch";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--seeds" && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            std::string seed;
+            while (std::getline(list, seed, ',')) {
+                seeds.push_back(std::stoi(seed));
+            }
+        } else if (arg == "--threads" && i + 1 < argc) {
+            num_threads = std::stoi(argv[++i]);
+        } else if (arg == "--output" && i + 1 < argc) {
+            output_root = argv[++i];
+        } else {
+            config_files.push_back(arg);
+        }
+    }
+    if (config_files.empty()) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--seeds S1,S2,...] [--threads N] [--output DIR] <grid_config.yaml> [more configs...]"
+                  << std::endl;
+        return 1;
+    }
+
+    // One experiment per config and seed
+    struct Plan {
+        std::string name;
+        Config config;
+    };
+    std::vector<Plan> plans;
+    for (const std::string& config_file : config_files) {
+        Config config;
+        try {
+            config = load_config(config_file);
+        } catch (const std::exception& e) {
+            std::cerr << "Error loading config: " << e.what() << std::endl;
+            return 1;
+        }
+        if (!config.use_grid || config.grid_width <= 0 || config.grid_height <= 0) {
+            std::cerr << "Error: " << config_file << " is not a grid config" << std::endl;
+            return 1;
+        }
+
+        if (seeds.empty()) {
+            plans.push_back({experiment_name(config_file, config.random_seed, false), config});
+        }
+        for (int seed : seeds) {
+            config.random_seed = seed;
+            plans.push_back({experiment_name(config_file, seed, true), config});
+        }
+    }
+
+    // One worker pool for every experiment; split into a pinned group of
+    // threads per NUMA node if any of them asks for numa_tiles
+    unsigned int pool_threads = ThreadPool::resolve_thread_count(num_threads);
+    std::vector<std::vector<int>> cpu_groups;
+    for (const Plan& plan : plans) {
+        if (plan.config.numa_tiles && cpu_groups.empty()) {
+            cpu_groups = ThreadPool::numa_cpu_groups();
+            cpu_groups.resize(std::min<size_t>(cpu_groups.size(), pool_threads));
+        }
+    }
+    ThreadPool pool(pool_threads, cpu_groups);
+
+    // Binary snapshots of all experiments share a background writer per codec
+    std::map<std::string, std::unique_ptr<SnapshotWriter>> snapshot_writers;
+    std::vector<std::unique_ptr<GridExperiment>> experiments;
+    try {
+        for (const Plan& plan : plans) {
+            SnapshotWriter* writer = nullptr;
+            if (plan.config.snapshot_format == "binary") {
+                std::unique_ptr<SnapshotWriter>& shared = snapshot_writers[plan.config.snapshot_compression];
+                if (!shared) {
+                    shared = std::make_unique<SnapshotWriter>(parse_snapshot_codec(plan.config.snapshot_compression));
+                }
+                writer = shared.get();
+            }
+            experiments.push_back(std::make_unique<GridExperiment>(plan.name, plan.config,
+                                                                   output_root + "/" + plan.name, pool, writer));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error creating experiments: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Starting batch of " << experiments.size() << " grid experiments with:" << std::endl;
+    for (const auto& experiment : experiments) {
+        const Config& config = experiment->config();
+        std::cout << "  " << experiment->name() << ": " << config.grid_width << "x" << config.grid_height
+                  << ", seed " << config.random_seed << ", " << config.epochs << " epochs" << std::endl;
+        // Settings of bffpp_grid's driver rather than of its epochs
+        std::vector<std::string> ignored;
+        if (config.num_threads != 0) {
+            ignored.push_back("num_threads (the shared pool is sized by --threads)");
+        }
+        if (config.checkpoint_interval > 0) {
+            ignored.push_back("checkpoint_interval (no checkpoints in a batch)");
+        }
+        if (config.profile_interval > 0) {
+            ignored.push_back("profile_interval (no profiling in a batch)");
+        }
+        if (config.live_frames != "json") {
+            ignored.push_back("live_frames: " + config.live_frames + " (batch updates are JSON)");
+        }
+        for (const std::string& setting : ignored) {
+            std::cout << "    Warning: ignoring " << setting << std::endl;
+        }
+    }
+    std::cout << "  Threads: " << pool.size() << std::endl;
+    if (pool.groups() > 1) {
+        std::cout << "  NUMA groups: " << pool.groups() << std::endl;
+    }
+    std::cout << "  Output: " << output_root << "/<experiment>/" << std::endl;
+    std::cout << std::endl;
+
+    // One live server for every experiment; each JSON update names its experiment
+    WebSocketServer ws_server(8080);
+    ws_server.start();
+    std::cout << "WebSocket server started on port 8080" << std::endl;
+    std::cout << std::endl;
+
+    for (const auto& experiment : experiments) {
+        print_tagged(experiment->name(), experiment->take_log());
+    }
+
+    std::vector<GridExperiment*> running;
+    for (;;) {
+        // Check if paused
+        while (ws_server.is_paused()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        running.clear();
+        for (const auto& experiment : experiments) {
+            if (!experiment->finished()) {
+                running.push_back(experiment.get());
+            }
+        }
+        if (running.empty()) {
+            break;
+        }
+
+        // One epoch of each, side by side; their own parallel loops share the pool
+        bool live_clients = ws_server.has_clients();
+        try {
+            pool.parallel_for(running.size(), 1, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    running[i]->step(live_clients);
+                }
+            });
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+
+        // Output in a fixed order, whichever experiment finished first
+        for (GridExperiment* experiment : running) {
+            print_tagged(experiment->name(), experiment->take_log());
+            if (live_clients) {
+                ws_server.broadcast(experiment->to_json());
+            }
+        }
+    }
+
+    for (const auto& experiment : experiments) {
+        experiment->finish();
+        print_tagged(experiment->name(), experiment->take_log());
+        if (const PairCache* cache = experiment->pair_cache()) {
+            std::cout << "[" << experiment->name() << "] Pair cache: " << cache->hits() << " of "
+                      << cache->lookups() << " pairs answered, " << cache->size() << " entries" << std::endl;
+        }
+    }
+    for (auto& entry : snapshot_writers) {
+        entry.second->flush();
+    }
+    std::cout << "\nBatch complete!" << std::endl;
+
+    return 0;
+}
@@ -4,6 +4,12 @@
 #include "config.h"
 #include "grid.h"
 #include "websocket_server.h"
+#include "thread_pool.h"
+#include "metrics_engine.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "video_pipe.h"
+#include "output_pipeline.h"
 
 #include <iostream>
 #include <vector>
@@ -14,82 +20,32 @@
 #include <iomanip>
 #include <sstream>
 #include <fstream>
-
-// Check if a character is a valid BF instruction
-bool is_instruction(char ch) {
-    const std::string instructions = ",.[]{}<>+-";
-    return instructions.find(ch) != std::string::npos;
-}
-
-// Helper function to create a merged grid from left and right grids with a barrier
-Grid create_combined_grid(const Grid& left_grid, const Grid& right_grid, int barrier_width = 2) {
-    int width = left_grid.get_width();
-    int height = left_grid.get_height();
-    int program_size = left_grid.get_program_size();
-
-    // Create a grid that's wide enough for both grids plus barrier
-    Grid combined(width * 2 + barrier_width, height, program_size);
-
-    // Copy left grid
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            combined.set_program(x, y, left_grid.get_program(x, y));
-        }
-    }
-
-    // Set barrier (white/empty programs)
-    std::vector<uint8_t> barrier_program(program_size, 0);
+#include <memory>
+#include <utility>
+
+// Frames are 4 x 4 pixels per cell; the barrier is 2 yellow columns
+constexpr int FRAME_SCALE = 4;
+constexpr int BARRIER_WIDTH = 2;
+constexpr RGB BARRIER_COLOR = {255, 255, 0};
+constexpr RGB GAP_COLOR = {0, 0, 0};
+const std::string VIDEO_PATH = "data/visualizations/darwin/evolution_video.mp4";
+
+// Cell colors of a frame with two half_width-wide halves side by side and
+// barrier_width columns of fill between them. Rows of left and right are
+// stride cells apart, so both halves may come from one merged grid.
+std::vector<RGB> side_by_side_colors(const RGB* left, const RGB* right, int stride, int half_width, int height,
+                                     int barrier_width, RGB fill) {
+    int width = 2 * half_width + barrier_width;
+    std::vector<RGB> frame(static_cast<size_t>(width) * height);
     for (int y = 0; y < height; y++) {
-        for (int b = 0; b < barrier_width; b++) {
-            combined.set_program(width + b, y, barrier_program);
-        }
-    }
-
-    // Copy right grid
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            combined.set_program(width + barrier_width + x, y, right_grid.get_program(x, y));
-        }
+        RGB* row = frame.data() + static_cast<size_t>(y) * width;
+        const RGB* left_row = left + static_cast<size_t>(y) * stride;
+        const RGB* right_row = right + static_cast<size_t>(y) * stride;
+        std::copy(left_row, left_row + half_width, row);
+        std::fill(row + half_width, row + half_width + barrier_width, fill);
+        std::copy(right_row, right_row + half_width, row + half_width + barrier_width);
     }
-
-    return combined;
-}
-
-// Helper function to save combined grid with yellow barrier
-void save_combined_grid_with_barrier(const Grid& combined_grid, int barrier_start_x, int barrier_width, const std::string& filename, int scale = 4) {
-    std::ofstream file(filename);
-    if (!file.is_open()) {
-        throw std::runtime_error("Could not open file: " + filename);
-    }
-
-    int width = combined_grid.get_width();
-    int height = combined_grid.get_height();
-
-    // PPM header
-    file << "P3\n";
-    file << (width * scale) << " " << (height * scale) << "\n";
-    file << "255\n";
-
-    // Write pixel data, each cell scaled to scale x scale pixels
-    for (int y = 0; y < height; y++) {
-        for (int sy = 0; sy < scale; sy++) {
-            for (int x = 0; x < width; x++) {
-                for (int sx = 0; sx < scale; sx++) {
-                    if (x >= barrier_start_x && x < barrier_start_x + barrier_width) {
-                        file << "255 255 0 ";
-                    } else {
-                        RGB color = combined_grid.program_to_color(combined_grid.get_program(x, y));
-                        file << static_cast<int>(color.r) << " "
-                             << static_cast<int>(color.g) << " "
-                             << static_cast<int>(color.b) << " ";
-                    }
-                }
-            }
-            file << "\n";
-        }
-    }
-
-    file.close();
+    return frame;
 }
 
 struct DarwinConfig {
@@ -109,6 +65,29 @@ struct DarwinConfig {
     int eval_interval;
     int visualization_interval;
     unsigned int random_seed;
+    int num_threads;            // Worker threads shared by all grids (0 = all cores)
+
+    // Entropy metrics
+    int metrics_interval;       // Record entropy history every N epochs
+    int brotli_quality;
+    int brotli_window;
+    int hoe_shards;
+
+    // Pairing dumps
+    std::string snapshot_format;       // "csv" or "binary"
+    std::string snapshot_compression;  // "none" or "brotli"
+
+    // Checkpoints (0 = none)
+    int checkpoint_interval;
+    int checkpoint_full_interval;
+
+    // Video frames: "ppm" files, or "ffmpeg" to pipe them to the encoder
+    std::string frame_output;
+
+    // Background output writers (0 = inline), their queue and what a full queue does to frames
+    int output_threads;
+    int output_queue;
+    std::string output_backpressure;
 };
 
 // Simple YAML parser for Darwin config
@@ -119,6 +98,19 @@ DarwinConfig load_darwin_config(const std::string& filename) {
     }
 
     DarwinConfig config;
+    config.num_threads = 0;
+    config.metrics_interval = 1;
+    config.brotli_quality = 11;
+    config.brotli_window = 22;
+    config.hoe_shards = 1;
+    config.snapshot_format = "csv";
+    config.snapshot_compression = "none";
+    config.checkpoint_interval = 0;
+    config.checkpoint_full_interval = 10;
+    config.frame_output = "ppm";
+    config.output_threads = 0;
+    config.output_queue = 8;
+    config.output_backpressure = "block";
     std::string line;
 
     while (std::getline(file, line)) {
@@ -151,6 +143,45 @@ DarwinConfig load_darwin_config(const std::string& filename) {
         else if (key == "eval_interval") config.eval_interval = std::stoi(value);
         else if (key == "visualization_interval") config.visualization_interval = std::stoi(value);
         else if (key == "random_seed") config.random_seed = std::stoul(value);
+        else if (key == "num_threads") config.num_threads = std::stoi(value);
+        else if (key == "metrics_interval") config.metrics_interval = std::max(1, std::stoi(value));
+        else if (key == "brotli_quality") config.brotli_quality = std::stoi(value);
+        else if (key == "brotli_window") config.brotli_window = std::stoi(value);
+        else if (key == "hoe_shards") config.hoe_shards = std::stoi(value);
+        else if (key == "snapshot_format") config.snapshot_format = value;
+        else if (key == "snapshot_compression") config.snapshot_compression = value;
+        else if (key == "checkpoint_interval") config.checkpoint_interval = std::stoi(value);
+        else if (key == "checkpoint_full_interval") config.checkpoint_full_interval = std::stoi(value);
+        else if (key == "frame_output") config.frame_output = value;
+        else if (key == "output_threads") config.output_threads = std::stoi(value);
+        else if (key == "output_queue") config.output_queue = std::stoi(value);
+        else if (key == "output_backpressure") config.output_backpressure = value;
+    }
+
+    if (config.brotli_quality < 0 || config.brotli_quality > 11) {
+        throw std::runtime_error("brotli_quality must be between 0 and 11 in " + filename);
+    }
+    if (config.brotli_window < 10 || config.brotli_window > 24) {
+        throw std::runtime_error("brotli_window must be between 10 and 24 in " + filename);
+    }
+    if (config.hoe_shards < 1) {
+        throw std::runtime_error("hoe_shards must be >= 1 in " + filename);
+    }
+    if (config.snapshot_format != "csv" && config.snapshot_format != "binary") {
+        throw std::runtime_error("snapshot_format must be csv or binary in " + filename);
+    }
+    parse_snapshot_codec(config.snapshot_compression);
+    if (config.checkpoint_interval < 0 || config.checkpoint_full_interval < 1) {
+        throw std::runtime_error("checkpoint_interval must be >= 0 and checkpoint_full_interval >= 1 in " + filename);
+    }
+    if (config.frame_output != "ppm" && config.frame_output != "ffmpeg") {
+        throw std::runtime_error("frame_output must be ppm or ffmpeg in " + filename);
+    }
+    if (config.output_threads < 0 || config.output_queue < 1) {
+        throw std::runtime_error("output_threads must be >= 0 and output_queue >= 1 in " + filename);
+    }
+    if (config.output_backpressure != "block" && config.output_backpressure != "drop_frames") {
+        throw std::runtime_error("output_backpressure must be block or drop_frames in " + filename);
     }
 
     file.close();
@@ -158,123 +189,123 @@ DarwinConfig load_darwin_config(const std::string& filename) {
 }
 
 void run_simulation_pair(
-    const std::vector<uint8_t>& programA,
-    const std::vector<uint8_t>& programB,
+    Span<const uint8_t> programA,
+    Span<const uint8_t> programB,
+    Span<uint8_t> nextA,
+    Span<uint8_t> nextB,
     int program_size,
-    EmulatorResult& result
+    EmulatorStats& result
 ) {
-    std::vector<uint8_t> tape = programA;
-    tape.insert(tape.end(), programB.begin(), programB.end());
-    result = emulate(tape, 0, program_size);
+    // Emulate in the next-epoch slots, leaving the current programs untouched
+    std::copy(programA.begin(), programA.end(), nextA.begin());
+    std::copy(programB.begin(), programB.end(), nextB.begin());
+    result = emulate_pair_in_place(nextA.data(), nextB.data(), program_size, 0, program_size);
 }
 
+// Save one epoch's pairing data as a CSV, or as a binary snapshot through
+// the writer when one is given; path_stem is the file name without extension.
+// CSVs go through the output pipeline, from a copy unless it writes inline.
 void save_pairing_data(
-    const std::string& filepath,
+    const std::string& path_stem,
     int epoch,
     const Grid& grid,
-    const std::vector<std::pair<int, int>>& program_pairs
+    const std::vector<std::pair<int, int>>& program_pairs,
+    SnapshotWriter* snapshot_writer,
+    OutputPipeline& output
 ) {
-    std::ofstream pairing_file(filepath);
-    if (!pairing_file.is_open()) return;
+    std::vector<int32_t> partners = pairing_index(program_pairs, grid.get_total_programs());
 
-    // Build pairing map
-    std::map<int, int> pairing_map;
-    for (const auto& pair : program_pairs) {
-        int idx_a = pair.first;
-        int idx_b = pair.second;
-
-        if (idx_a == -1) {
-            pairing_map[idx_b] = -1;  // Mutation-only
-        } else {
-            pairing_map[idx_a] = idx_b;  // Paired
-            pairing_map[idx_b] = idx_a;
-        }
+    if (snapshot_writer) {
+        snapshot_writer->submit(path_stem + ".bffs", grid.to_snapshot(epoch, std::move(partners)));
+    } else if (output.inline_jobs()) {
+        grid.save_pairing_csv(path_stem + ".csv", epoch, partners);
+    } else {
+        auto snapshot = std::make_shared<const Snapshot>(grid.to_snapshot(epoch, std::move(partners)));
+        std::string path = path_stem + ".csv";
+        output.submit([snapshot, path] { Grid::save_pairing_csv(path, *snapshot); });
     }
+}
 
-    // Get all programs
-    auto soup = grid.get_all_programs();
-
-    // Write header
-    pairing_file << "epoch,position_x,position_y,program,combined_x,combined_y\n";
-
-    // Write data for each position
-    for (int y = 0; y < grid.get_height(); y++) {
-        for (int x = 0; x < grid.get_width(); x++) {
-            int idx = y * grid.get_width() + x;
-            const auto& program = soup[idx];
-
-            // Get combined position
-            int combined_idx = pairing_map[idx];
-            int combined_x = -1;
-            int combined_y = -1;
-
-            if (combined_idx >= 0) {
-                combined_y = combined_idx / grid.get_width();
-                combined_x = combined_idx % grid.get_width();
-            }
-
-            // Write row
-            pairing_file << epoch << ","
-                        << x << ","
-                        << y << ",\"";
-
-            // Write program as string (clean non-instructions)
-            for (uint8_t ch : program) {
-                char clean_ch = is_instruction(static_cast<char>(ch)) ?
-                              static_cast<char>(ch) : ' ';
-                pairing_file << clean_ch;
-            }
-
-            pairing_file << "\"," << combined_x << "," << combined_y << "\n";
-        }
+// Fill a grid with random programs, from the config's counter-based streams
+// when enabled and from the grid's own mt19937 otherwise
+void initialize_grid(Grid& grid, const Config& config, std::mt19937& rng, ThreadPool& pool) {
+    if (!config.counter_rng) {
+        grid.initialize_random(rng);
+        return;
     }
 
-    pairing_file.close();
+    uint64_t seed = static_cast<uint64_t>(config.random_seed);
+    pool.parallel_for(grid.get_total_programs(), 0, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            CounterRng cell_rng(seed, RngDomain::Initialization, 0, i);
+            grid.initialize_program(i, cell_rng);
+        }
+    });
 }
 
 std::vector<std::pair<int, int>> evolve_grid_epoch(
     Grid& grid,
     const Config& config,
-    std::vector<EmulatorResult>& results,
+    int epoch,
+    std::vector<EmulatorStats>& results,
     double& total_iterations,
     double& total_skipped,
     double& finished_runs,
     double& terminated_runs,
-    std::mt19937& rng
+    std::mt19937& rng,
+    ThreadPool& pool
 ) {
-    std::vector<std::vector<uint8_t>> soup = grid.get_all_programs();
-    std::vector<std::pair<int, int>> program_pairs = grid.create_spatial_pairs(2, rng);
+    uint64_t seed = static_cast<uint64_t>(config.random_seed);
+    std::vector<std::pair<int, int>> program_pairs = config.counter_rng ?
+        grid.create_spatial_pairs(2, seed, epoch + 1) : grid.create_spatial_pairs(2, rng);
+    grid.begin_epoch();
+
+    // Mutate one next-epoch program from its own counter-based stream
+    auto mutate_cell = [&](int idx) {
+        CounterRng cell_rng(seed, RngDomain::Mutation, epoch + 1, idx);
+        mutate_in_place(grid.next_program(idx).data(), config.program_size,
+                        config.mutation_rate, cell_rng);
+    };
 
     results.resize(program_pairs.size());
-    std::vector<std::thread> threads;
-
-    unsigned int num_threads = std::thread::hardware_concurrency();
-    if (num_threads == 0) num_threads = 4;
-
-    for (size_t i = 0; i < program_pairs.size(); i++) {
-        int idx_a = program_pairs[i].first;
-        int idx_b = program_pairs[i].second;
+    pool.parallel_for(program_pairs.size(), 0, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            int idx_a = program_pairs[i].first;
+            int idx_b = program_pairs[i].second;
+
+            // Mutation-only cells carry their program over (mutated below)
+            if (idx_a == -1) {
+                Span<const uint8_t> program = grid.program_at(idx_b);
+                std::copy(program.begin(), program.end(), grid.next_program(idx_b).begin());
+                if (config.fused_mutation) {
+                    mutate_cell(idx_b);
+                }
+                continue;
+            }
 
-        if (idx_a == -1) {
-            continue;
-        }
+            run_simulation_pair(grid.program_at(idx_a), grid.program_at(idx_b),
+                                grid.next_program(idx_a), grid.next_program(idx_b),
+                                config.program_size, results[i]);
 
-        if (threads.size() >= num_threads) {
-            threads[0].join();
-            threads.erase(threads.begin());
+            // Fused: mutate while the pair is still in this worker's cache
+            if (config.fused_mutation) {
+                mutate_cell(idx_a);
+                mutate_cell(idx_b);
+            }
         }
-
-        threads.emplace_back(
-            run_simulation_pair,
-            std::ref(soup[idx_a]),
-            std::ref(soup[idx_b]),
-            config.program_size,
-            std::ref(results[i])
-        );
-    }
-
-    for (auto& thread : threads) {
-        thread.join();
+    });
+
+    // Counter-based streams let mutation run on the pool as well
+    if (config.counter_rng && !config.fused_mutation) {
+        pool.parallel_for(program_pairs.size(), 0, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                for (int idx : {program_pairs[i].first, program_pairs[i].second}) {
+                    if (idx != -1) {
+                        mutate_cell(idx);
+                    }
+                }
+            }
+        });
     }
 
     total_iterations = 0;
@@ -288,28 +319,24 @@ std::vector<std::pair<int, int>> evolve_grid_epoch(
         int idx_b = program_pairs[i].second;
 
         if (idx_a == -1) {
-            soup[idx_b] = mutate(soup[idx_b], config.mutation_rate, rng);
+            if (!config.counter_rng) {
+                mutate_in_place(grid.next_program(idx_b).data(), config.program_size, config.mutation_rate, rng);
+            }
             continue;
         }
 
-        const EmulatorResult& result = results[i];
-
-        std::vector<uint8_t> programA_new(
-            result.tape.begin(),
-            result.tape.begin() + config.program_size
-        );
-        std::vector<uint8_t> programB_new(
-            result.tape.begin() + config.program_size,
-            result.tape.end()
-        );
+        const EmulatorStats& result = results[i];
 
-        soup[idx_a] = mutate(programA_new, config.mutation_rate, rng);
-        soup[idx_b] = mutate(programB_new, config.mutation_rate, rng);
+        // Programs already hold the post-emulation tape; mutate them
+        if (!config.counter_rng) {
+            mutate_in_place(grid.next_program(idx_a).data(), config.program_size, config.mutation_rate, rng);
+            mutate_in_place(grid.next_program(idx_b).data(), config.program_size, config.mutation_rate, rng);
+        }
 
         total_iterations += result.iteration;
         total_skipped += result.skipped;
-        finished_runs += (result.state == "Finished") ? 1.0 : 0.0;
-        terminated_runs += (result.state == "Terminated") ? 1.0 : 0.0;
+        finished_runs += (result.status == EmulatorStatus::Finished) ? 1.0 : 0.0;
+        terminated_runs += (result.status == EmulatorStatus::Terminated) ? 1.0 : 0.0;
         executed_pairs++;
     }
 
@@ -320,14 +347,19 @@ std::vector<std::pair<int, int>> evolve_grid_epoch(
         finished_runs /= executed_pairs;
     }
 
-    grid.set_all_programs(soup);
+    grid.commit_epoch();
     return program_pairs;
 }
 
 int main(int argc, char* argv[]) {
     std::string darwin_config_file = "configs/darwin_config.yaml";
-    if (argc > 2 && std::string(argv[1]) == "--config") {
-        darwin_config_file = argv[2];
+    std::string resume_file;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::string(argv[i]) == "--config") {
+            darwin_config_file = argv[i + 1];
+        } else if (std::string(argv[i]) == "--resume") {
+            resume_file = argv[i + 1];
+        }
     }
 
     // Load Darwin experiment configuration
@@ -353,8 +385,41 @@ int main(int argc, char* argv[]) {
     Grid left_grid(darwin_config.grid_width, darwin_config.grid_height, darwin_config.program_size);
     Grid right_grid(darwin_config.grid_width, darwin_config.grid_height, darwin_config.program_size);
 
-    left_grid.initialize_random(left_rng);
-    right_grid.initialize_random(right_rng);
+    // Worker pool shared by all three grids and every epoch
+    ThreadPool pool(ThreadPool::resolve_thread_count(darwin_config.num_threads));
+
+    initialize_grid(left_grid, left_config, left_rng, pool);
+    initialize_grid(right_grid, right_config, right_rng, pool);
+
+    // Carry on from a checkpoint. One written up to barrier_removal_epoch
+    // holds the left and right grids, a later one the merged grid, which is
+    // loaded once it exists; either holds all three engines.
+    int start_epoch = 0;
+    bool resume_merged = false;
+    Checkpoint resumed;
+    if (!resume_file.empty()) {
+        try {
+            resumed = read_checkpoint(resume_file);
+            start_epoch = static_cast<int>(resumed.epoch);
+            resume_merged = start_epoch > darwin_config.barrier_removal_epoch;
+            check_checkpoint(resumed, "bffpp_darwin", resume_merged ? 1 : 2,
+                             (resume_merged ? 2 : 1) * darwin_config.grid_width, darwin_config.grid_height,
+                             darwin_config.program_size);
+            if (resumed.rng_states.size() != 3 || resumed.histories.size() != 8) {
+                throw std::runtime_error("Checkpoint does not hold the random engines and entropy histories");
+            }
+            if (!resume_merged) {
+                left_grid.load_snapshot(resumed.grids[0]);
+                right_grid.load_snapshot(resumed.grids[1]);
+            }
+            restore_rng_state(left_rng, resumed.rng_states[0]);
+            restore_rng_state(right_rng, resumed.rng_states[1]);
+            restore_rng_state(merged_rng, resumed.rng_states[2]);
+        } catch (const std::exception& e) {
+            std::cerr << "Error resuming from " << resume_file << ": " << e.what() << std::endl;
+            return 1;
+        }
+    }
 
     std::cout << "=== DARWIN EXPERIMENT ===" << std::endl;
     std::cout << "Phase 1: Independent evolution (epochs 0-" << darwin_config.barrier_removal_epoch << ")" << std::endl;
@@ -366,6 +431,10 @@ int main(int argc, char* argv[]) {
               << "-" << darwin_config.final_epoch << ")" << std::endl;
     std::cout << "  Merged grid: " << (2 * darwin_config.grid_width) << "x" << darwin_config.grid_height
               << " (" << (2 * left_grid.get_total_programs()) << " programs)" << std::endl;
+    std::cout << "\nThreads: " << pool.size() << std::endl;
+    if (!resume_file.empty()) {
+        std::cout << "Resumed from: " << resume_file << " (epoch " << start_epoch << ")" << std::endl;
+    }
     std::cout << std::endl;
 
     // Start WebSocket server
@@ -382,6 +451,65 @@ int main(int argc, char* argv[]) {
     system("mkdir -p data/pairings/darwin/right");
     system("mkdir -p data/pairings/darwin/merged");
 
+    // Video frames go to PPM files, or straight to an ffmpeg encoder
+    int frame_width = 2 * darwin_config.grid_width + BARRIER_WIDTH;
+    std::unique_ptr<VideoPipe> video;
+    if (darwin_config.frame_output == "ffmpeg") {
+        if (system("ffmpeg -version > /dev/null 2>&1") == 0) {
+            int video_width = frame_width * FRAME_SCALE;
+            int video_height = darwin_config.grid_height * FRAME_SCALE;
+            video = std::make_unique<VideoPipe>(VideoPipe::ffmpeg_command(VIDEO_PATH, video_width, video_height, 10),
+                                                video_width, video_height);
+            std::cout << "Piping frames to ffmpeg for " << VIDEO_PATH << std::endl;
+        } else {
+            std::cout << "Warning: ffmpeg not found, saving PPM frames instead" << std::endl;
+        }
+    }
+
+    // PPM frames and pairing CSVs are written by background writers while the
+    // run goes on (inline with output_threads: 0)
+    OutputPipeline output(darwin_config.output_threads, darwin_config.output_queue,
+                          parse_output_backpressure(darwin_config.output_backpressure));
+
+    // One frame of cells, width wide (frame_width for the video)
+    int last_frame_epoch = -1;
+    auto save_frame = [&](int epoch, const std::vector<RGB>& cells, int width) {
+        if (epoch == last_frame_epoch) {
+            return;
+        }
+        last_frame_epoch = epoch;
+        if (video) {
+            if (video->write(Grid::render_colors(width, darwin_config.grid_height, cells, FRAME_SCALE))) {
+                return;
+            }
+            std::cout << "Warning: ffmpeg stopped taking frames, saving PPM frames instead" << std::endl;
+            video.reset();
+        }
+        std::stringstream frame_path;
+        frame_path << "data/visualizations/darwin/frames/frame_"
+                   << std::setfill('0') << std::setw(6) << epoch << ".ppm";
+        std::string path = frame_path.str();
+        int height = darwin_config.grid_height;
+        output.submit_frame([path, width, height, cells] {
+            Grid::save_colors_ppm(path, width, height, cells, FRAME_SCALE);
+        });
+    };
+
+    // Both grids with the barrier between them, from their cached colors
+    auto save_barrier_frame = [&](int epoch) {
+        save_frame(epoch,
+                   side_by_side_colors(left_grid.colors().data(), right_grid.colors().data(), darwin_config.grid_width,
+                                       darwin_config.grid_width, darwin_config.grid_height, BARRIER_WIDTH,
+                                       BARRIER_COLOR),
+                   frame_width);
+    };
+
+    // Binary pairing snapshots go through a background writer
+    std::unique_ptr<SnapshotWriter> snapshot_writer;
+    if (darwin_config.snapshot_format == "binary") {
+        snapshot_writer = std::make_unique<SnapshotWriter>(parse_snapshot_codec(darwin_config.snapshot_compression));
+    }
+
     // Hardcoded pairing save start epoch
     const int PAIRING_START_EPOCH = 0;  // Save from beginning for Darwin
 
@@ -392,62 +520,119 @@ int main(int argc, char* argv[]) {
     std::vector<int> epochs_phase1, epochs_phase2;
     std::vector<double> left_entropy_phase1, right_entropy_phase1, merged_entropy_phase1;
     std::vector<double> left_entropy_phase2, right_entropy_phase2, merged_entropy_phase2;
+    if (!resume_file.empty()) {
+        epochs_phase1.assign(resumed.histories[0].begin(), resumed.histories[0].end());
+        left_entropy_phase1 = resumed.histories[1];
+        right_entropy_phase1 = resumed.histories[2];
+        merged_entropy_phase1 = resumed.histories[3];
+        epochs_phase2.assign(resumed.histories[4].begin(), resumed.histories[4].end());
+        left_entropy_phase2 = resumed.histories[5];
+        right_entropy_phase2 = resumed.histories[6];
+        merged_entropy_phase2 = resumed.histories[7];
+    }
 
-    for (int epoch = 0; epoch < darwin_config.barrier_removal_epoch; epoch++) {
+    // Checkpoints are copied out here and written in the background
+    std::unique_ptr<CheckpointWriter> checkpoint_writer;
+    if (darwin_config.checkpoint_interval > 0) {
+        system("mkdir -p data/checkpoints/darwin");
+        checkpoint_writer = std::make_unique<CheckpointWriter>(darwin_config.checkpoint_full_interval);
+    }
+    auto save_checkpoint = [&](int epoch_num, std::vector<Snapshot> grids) {
+        Checkpoint checkpoint;
+        checkpoint.driver = "bffpp_darwin";
+        checkpoint.epoch = epoch_num;
+        checkpoint.grids = std::move(grids);
+        checkpoint.rng_states = {rng_state(left_rng), rng_state(right_rng), rng_state(merged_rng)};
+        checkpoint.histories = {
+            std::vector<double>(epochs_phase1.begin(), epochs_phase1.end()),
+            left_entropy_phase1, right_entropy_phase1, merged_entropy_phase1,
+            std::vector<double>(epochs_phase2.begin(), epochs_phase2.end()),
+            left_entropy_phase2, right_entropy_phase2, merged_entropy_phase2,
+        };
+
+        std::string path = checkpoint_path("data/checkpoints/darwin", "bffpp_darwin", epoch_num);
+        checkpoint_writer->submit(path, std::move(checkpoint));
+        std::cout << "  Saved checkpoint: " << path << std::endl;
+    };
+
+    // Entropy metrics, with a running byte histogram per grid
+    MetricsOptions metrics_options;
+    metrics_options.brotli_quality = darwin_config.brotli_quality;
+    metrics_options.brotli_window = darwin_config.brotli_window;
+    metrics_options.shards = darwin_config.hoe_shards;
+    MetricsEngine left_metrics(metrics_options, &pool);
+    MetricsEngine right_metrics(metrics_options, &pool);
+    left_metrics.reset(left_grid.all_bytes().data(), left_grid.all_bytes().size());
+    right_metrics.reset(right_grid.all_bytes().data(), right_grid.all_bytes().size());
+
+    int phase1_start = resume_merged ? darwin_config.barrier_removal_epoch : start_epoch;
+    for (int epoch = phase1_start; epoch < darwin_config.barrier_removal_epoch; epoch++) {
         // Check if paused
         while (ws_server.is_paused()) {
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
 
-        std::vector<EmulatorResult> left_results, right_results;
+        std::vector<EmulatorStats> left_results, right_results;
         double left_iters, left_skips, left_finished, left_terminated;
         double right_iters, right_skips, right_finished, right_terminated;
 
         // Evolve left grid
-        auto left_pairs = evolve_grid_epoch(left_grid, left_config, left_results,
-                         left_iters, left_skips, left_finished, left_terminated, left_rng);
+        auto left_pairs = evolve_grid_epoch(left_grid, left_config, epoch, left_results,
+                         left_iters, left_skips, left_finished, left_terminated, left_rng, pool);
 
         // Evolve right grid
-        auto right_pairs = evolve_grid_epoch(right_grid, right_config, right_results,
-                         right_iters, right_skips, right_finished, right_terminated, right_rng);
+        auto right_pairs = evolve_grid_epoch(right_grid, right_config, epoch, right_results,
+                         right_iters, right_skips, right_finished, right_terminated, right_rng, pool);
+
+        left_metrics.update(left_grid.previous_bytes().data(), left_grid.all_bytes().data(),
+                            left_grid.all_bytes().size());
+        right_metrics.update(right_grid.previous_bytes().data(), right_grid.all_bytes().data(),
+                             right_grid.all_bytes().size());
 
         // Save pairing information for both grids
         if (epoch + 1 >= PAIRING_START_EPOCH) {
             std::stringstream left_path, right_path;
             left_path << "data/pairings/darwin/left/pairings_epoch_"
-                     << std::setfill('0') << std::setw(4) << (epoch + 1) << ".csv";
+                     << std::setfill('0') << std::setw(4) << (epoch + 1);
             right_path << "data/pairings/darwin/right/pairings_epoch_"
-                      << std::setfill('0') << std::setw(4) << (epoch + 1) << ".csv";
+                      << std::setfill('0') << std::setw(4) << (epoch + 1);
 
-            save_pairing_data(left_path.str(), epoch + 1, left_grid, left_pairs);
-            save_pairing_data(right_path.str(), epoch + 1, right_grid, right_pairs);
+            save_pairing_data(left_path.str(), epoch + 1, left_grid, left_pairs, snapshot_writer.get(), output);
+            save_pairing_data(right_path.str(), epoch + 1, right_grid, right_pairs, snapshot_writer.get(), output);
         }
 
-        // Calculate combined stats
-        std::vector<uint8_t> left_flat, right_flat;
-        for (const auto& prog : left_grid.get_all_programs()) {
-            left_flat.insert(left_flat.end(), prog.begin(), prog.end());
+        // Calculate combined stats (only when recorded, printed or watched)
+        bool record_epoch = (epoch % darwin_config.metrics_interval == 0);
+        bool eval_epoch = (epoch % darwin_config.eval_interval == 0);
+        bool live_clients = ws_server.has_clients();
+        double left_hoe = 0.0, right_hoe = 0.0, merged_hoe = 0.0;
+
+        if (record_epoch || eval_epoch || live_clients) {
+            Span<const uint8_t> left_bytes = left_grid.all_bytes();
+            Span<const uint8_t> right_bytes = right_grid.all_bytes();
+
+            left_hoe = left_metrics.higher_order_entropy(left_bytes.data(), left_bytes.size());
+            right_hoe = right_metrics.higher_order_entropy(right_bytes.data(), right_bytes.size());
+
+            // Calculate conceptual merged grid entropy (combining both populations)
+            std::vector<uint8_t> conceptual_merged(left_bytes.begin(), left_bytes.end());
+            conceptual_merged.insert(conceptual_merged.end(), right_bytes.begin(), right_bytes.end());
+            ByteHistogram merged_histogram = left_metrics.histogram();
+            merged_histogram.merge(right_metrics.histogram());
+            merged_hoe = left_metrics.higher_order_entropy(merged_histogram, conceptual_merged.data(),
+                                                           conceptual_merged.size());
         }
-        for (const auto& prog : right_grid.get_all_programs()) {
-            right_flat.insert(right_flat.end(), prog.begin(), prog.end());
-        }
-
-        double left_hoe = higher_order_entropy(left_flat);
-        double right_hoe = higher_order_entropy(right_flat);
-
-        // Calculate conceptual merged grid entropy (combining both populations)
-        std::vector<uint8_t> conceptual_merged = left_flat;
-        conceptual_merged.insert(conceptual_merged.end(), right_flat.begin(), right_flat.end());
-        double merged_hoe = higher_order_entropy(conceptual_merged);
 
         // Track entropy history for Phase 1 (all three grids)
-        epochs_phase1.push_back(epoch);
-        left_entropy_phase1.push_back(left_hoe);
-        right_entropy_phase1.push_back(right_hoe);
-        merged_entropy_phase1.push_back(merged_hoe);
+        if (record_epoch) {
+            epochs_phase1.push_back(epoch);
+            left_entropy_phase1.push_back(left_hoe);
+            right_entropy_phase1.push_back(right_hoe);
+            merged_entropy_phase1.push_back(merged_hoe);
+        }
 
         // Broadcast to WebSocket (send both grids with barrier flag)
-        if (ws_server.has_clients()) {
+        if (live_clients) {
             std::ostringstream json;
             json << "{";
             json << "\"epoch\":" << epoch << ",";
@@ -462,11 +647,9 @@ int main(int argc, char* argv[]) {
             json << "\"entropy\":" << std::fixed << std::setprecision(6) << left_hoe << ",";
             json << "\"avg_iters\":" << std::fixed << std::setprecision(3) << left_iters << ",";
             json << "\"finished_ratio\":" << std::fixed << std::setprecision(6) << left_finished << ",";
-            json << "\"grid\":" << left_grid.to_json(epoch, left_hoe, left_iters, left_finished).substr(
-                left_grid.to_json(epoch, left_hoe, left_iters, left_finished).find("\"grid\":") + 7,
-                left_grid.to_json(epoch, left_hoe, left_iters, left_finished).length() -
-                left_grid.to_json(epoch, left_hoe, left_iters, left_finished).find("\"grid\":") - 8
-            );
+            std::string left_json = left_grid.to_json(epoch, left_hoe, left_iters, left_finished);
+            size_t left_cells = left_json.find("\"grid\":") + 7;
+            json << "\"grid\":" << left_json.substr(left_cells, left_json.length() - left_cells - 1);
             json << "},";
 
             // Right grid data
@@ -474,18 +657,16 @@ int main(int argc, char* argv[]) {
             json << "\"entropy\":" << std::fixed << std::setprecision(6) << right_hoe << ",";
             json << "\"avg_iters\":" << std::fixed << std::setprecision(3) << right_iters << ",";
             json << "\"finished_ratio\":" << std::fixed << std::setprecision(6) << right_finished << ",";
-            json << "\"grid\":" << right_grid.to_json(epoch, right_hoe, right_iters, right_finished).substr(
-                right_grid.to_json(epoch, right_hoe, right_iters, right_finished).find("\"grid\":") + 7,
-                right_grid.to_json(epoch, right_hoe, right_iters, right_finished).length() -
-                right_grid.to_json(epoch, right_hoe, right_iters, right_finished).find("\"grid\":") - 8
-            );
+            std::string right_json = right_grid.to_json(epoch, right_hoe, right_iters, right_finished);
+            size_t right_cells = right_json.find("\"grid\":") + 7;
+            json << "\"grid\":" << right_json.substr(right_cells, right_json.length() - right_cells - 1);
             json << "}";
 
             json << "}";
             ws_server.broadcast(json.str());
         }
 
-        if (epoch % darwin_config.eval_interval == 0) {
+        if (eval_epoch) {
             std::cout << "Epoch: " << epoch << std::endl;
             std::cout << "  LEFT:  HOE=" << std::fixed << std::setprecision(3) << left_hoe
                       << ", Avg Iters=" << left_iters
@@ -497,21 +678,21 @@ int main(int argc, char* argv[]) {
 
         // Save frame for video
         if (epoch % darwin_config.visualization_interval == 0) {
-            std::stringstream frame_path;
-            frame_path << "data/visualizations/darwin/frames/frame_"
-                      << std::setfill('0') << std::setw(6) << epoch << ".ppm";
-            Grid combined = create_combined_grid(left_grid, right_grid, 2);
-            save_combined_grid_with_barrier(combined, darwin_config.grid_width, 2, frame_path.str());
+            save_barrier_frame(epoch);
+        }
+
+        // Save a checkpoint after every checkpoint_interval epochs
+        if (checkpoint_writer && (epoch + 1) % darwin_config.checkpoint_interval == 0) {
+            std::vector<Snapshot> grids;
+            grids.push_back(left_grid.to_snapshot(epoch + 1));
+            grids.push_back(right_grid.to_snapshot(epoch + 1));
+            save_checkpoint(epoch + 1, std::move(grids));
         }
     }
 
-    // Save final frame before barrier removal
-    {
-        std::stringstream frame_path;
-        frame_path << "data/visualizations/darwin/frames/frame_"
-                  << std::setfill('0') << std::setw(6) << (darwin_config.barrier_removal_epoch - 1) << ".ppm";
-        Grid combined = create_combined_grid(left_grid, right_grid, 2);
-        save_combined_grid_with_barrier(combined, darwin_config.grid_width, 2, frame_path.str());
+    // Save final frame before barrier removal (a run resumed past it already has it)
+    if (!resume_merged) {
+        save_barrier_frame(darwin_config.barrier_removal_epoch - 1);
         std::cout << "Saved final frame before barrier removal" << std::endl;
     }
 
@@ -521,77 +702,105 @@ int main(int argc, char* argv[]) {
     Grid merged_grid(2 * darwin_config.grid_width, darwin_config.grid_height, darwin_config.program_size);
 
     // Copy left and right grids into merged grid
-    for (int y = 0; y < darwin_config.grid_height; y++) {
-        for (int x = 0; x < darwin_config.grid_width; x++) {
-            merged_grid.set_program(x, y, left_grid.get_program(x, y));
-            merged_grid.set_program(x + darwin_config.grid_width, y, right_grid.get_program(x, y));
+    if (resume_merged) {
+        merged_grid.load_snapshot(resumed.grids[0]);
+    } else {
+        for (int y = 0; y < darwin_config.grid_height; y++) {
+            for (int x = 0; x < darwin_config.grid_width; x++) {
+                merged_grid.set_program(x, y, left_grid.get_program(x, y));
+                merged_grid.set_program(x + darwin_config.grid_width, y, right_grid.get_program(x, y));
+            }
         }
     }
 
+    // The merged grid; the video keeps phase 1's frame size, with the barrier
+    // columns turned black
+    auto save_merged_frame = [&](int epoch) {
+        const std::vector<RGB>& cells = merged_grid.colors();
+        if (video) {
+            save_frame(epoch,
+                       side_by_side_colors(cells.data(), cells.data() + darwin_config.grid_width,
+                                           2 * darwin_config.grid_width, darwin_config.grid_width,
+                                           darwin_config.grid_height, BARRIER_WIDTH, GAP_COLOR),
+                       frame_width);
+        } else {
+            save_frame(epoch, cells, 2 * darwin_config.grid_width);
+        }
+    };
+
     // Save first frame after barrier removal
-    {
-        std::stringstream frame_path;
-        frame_path << "data/visualizations/darwin/frames/frame_"
-                  << std::setfill('0') << std::setw(6) << darwin_config.barrier_removal_epoch << ".ppm";
-        merged_grid.save_ppm(frame_path.str());
+    if (!resume_merged) {
+        save_merged_frame(darwin_config.barrier_removal_epoch);
         std::cout << "Saved first frame after barrier removal" << std::endl;
     }
 
     std::cout << "--- PHASE 2: POPULATIONS MIXING ---" << std::endl;
 
-    for (int epoch = darwin_config.barrier_removal_epoch; epoch < darwin_config.final_epoch; epoch++) {
+    MetricsEngine merged_metrics(metrics_options, &pool);
+    merged_metrics.reset(merged_grid.all_bytes().data(), merged_grid.all_bytes().size());
+
+    int phase2_start = resume_merged ? start_epoch : darwin_config.barrier_removal_epoch;
+    for (int epoch = phase2_start; epoch < darwin_config.final_epoch; epoch++) {
         // Check if paused
         while (ws_server.is_paused()) {
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
 
-        std::vector<EmulatorResult> results;
+        std::vector<EmulatorStats> results;
         double total_iters, total_skips, finished, terminated;
 
-        auto merged_pairs = evolve_grid_epoch(merged_grid, merged_config, results,
-                         total_iters, total_skips, finished, terminated, merged_rng);
+        auto merged_pairs = evolve_grid_epoch(merged_grid, merged_config, epoch, results,
+                         total_iters, total_skips, finished, terminated, merged_rng, pool);
+        merged_metrics.update(merged_grid.previous_bytes().data(), merged_grid.all_bytes().data(),
+                              merged_grid.all_bytes().size());
 
         // Save pairing information for merged grid
         if (epoch + 1 >= PAIRING_START_EPOCH) {
             std::stringstream merged_path;
             merged_path << "data/pairings/darwin/merged/pairings_epoch_"
-                       << std::setfill('0') << std::setw(4) << (epoch + 1) << ".csv";
+                       << std::setfill('0') << std::setw(4) << (epoch + 1);
 
-            save_pairing_data(merged_path.str(), epoch + 1, merged_grid, merged_pairs);
+            save_pairing_data(merged_path.str(), epoch + 1, merged_grid, merged_pairs, snapshot_writer.get(), output);
         }
 
-        // Calculate stats for full merged grid
-        std::vector<uint8_t> flat_soup;
-        for (const auto& prog : merged_grid.get_all_programs()) {
-            flat_soup.insert(flat_soup.end(), prog.begin(), prog.end());
+        // Calculate stats for full merged grid (only when recorded, printed or watched)
+        bool record_epoch = (epoch % darwin_config.metrics_interval == 0);
+        bool eval_epoch = (epoch % darwin_config.eval_interval == 0);
+        bool live_clients = ws_server.has_clients();
+        double merged_hoe = 0.0;
+
+        if (record_epoch || eval_epoch || live_clients) {
+            Span<const uint8_t> merged_bytes = merged_grid.all_bytes();
+            merged_hoe = merged_metrics.higher_order_entropy(merged_bytes.data(), merged_bytes.size());
         }
-        double merged_hoe = higher_order_entropy(flat_soup);
 
         // Also calculate entropy for left and right halves of merged grid
-        std::vector<uint8_t> left_half, right_half;
-        for (int y = 0; y < darwin_config.grid_height; y++) {
-            for (int x = 0; x < darwin_config.grid_width; x++) {
-                // Left half
-                const auto& prog = merged_grid.get_program(x, y);
-                left_half.insert(left_half.end(), prog.begin(), prog.end());
-            }
-            for (int x = darwin_config.grid_width; x < 2 * darwin_config.grid_width; x++) {
-                // Right half
-                const auto& prog = merged_grid.get_program(x, y);
-                right_half.insert(right_half.end(), prog.begin(), prog.end());
+        if (record_epoch) {
+            std::vector<uint8_t> left_half, right_half;
+            for (int y = 0; y < darwin_config.grid_height; y++) {
+                for (int x = 0; x < darwin_config.grid_width; x++) {
+                    // Left half
+                    const auto& prog = std::as_const(merged_grid).get_program(x, y);
+                    left_half.insert(left_half.end(), prog.begin(), prog.end());
+                }
+                for (int x = darwin_config.grid_width; x < 2 * darwin_config.grid_width; x++) {
+                    // Right half
+                    const auto& prog = std::as_const(merged_grid).get_program(x, y);
+                    right_half.insert(right_half.end(), prog.begin(), prog.end());
+                }
             }
+            double left_half_hoe = merged_metrics.higher_order_entropy_of(left_half.data(), left_half.size());
+            double right_half_hoe = merged_metrics.higher_order_entropy_of(right_half.data(), right_half.size());
+
+            // Track entropy history for Phase 2 (all three grids)
+            epochs_phase2.push_back(epoch);
+            left_entropy_phase2.push_back(left_half_hoe);
+            right_entropy_phase2.push_back(right_half_hoe);
+            merged_entropy_phase2.push_back(merged_hoe);
         }
-        double left_half_hoe = higher_order_entropy(left_half);
-        double right_half_hoe = higher_order_entropy(right_half);
-
-        // Track entropy history for Phase 2 (all three grids)
-        epochs_phase2.push_back(epoch);
-        left_entropy_phase2.push_back(left_half_hoe);
-        right_entropy_phase2.push_back(right_half_hoe);
-        merged_entropy_phase2.push_back(merged_hoe);
 
         // Broadcast merged grid
-        if (ws_server.has_clients()) {
+        if (live_clients) {
             std::ostringstream json;
             json << "{";
             json << "\"epoch\":" << epoch << ",";
@@ -603,7 +812,7 @@ int main(int argc, char* argv[]) {
             ws_server.broadcast(json.str());
         }
 
-        if (epoch % darwin_config.eval_interval == 0) {
+        if (eval_epoch) {
             std::cout << "Epoch: " << epoch << std::endl;
             std::cout << "  MERGED: HOE=" << std::fixed << std::setprecision(3) << merged_hoe
                       << ", Avg Iters=" << total_iters
@@ -612,19 +821,20 @@ int main(int argc, char* argv[]) {
 
         // Save frame for video
         if (epoch % darwin_config.visualization_interval == 0) {
-            std::stringstream frame_path;
-            frame_path << "data/visualizations/darwin/frames/frame_"
-                      << std::setfill('0') << std::setw(6) << epoch << ".ppm";
-            merged_grid.save_ppm(frame_path.str());
+            save_merged_frame(epoch);
+        }
+
+        // Save a checkpoint after every checkpoint_interval epochs
+        if (checkpoint_writer && (epoch + 1) % darwin_config.checkpoint_interval == 0) {
+            std::vector<Snapshot> grids;
+            grids.push_back(merged_grid.to_snapshot(epoch + 1));
+            save_checkpoint(epoch + 1, std::move(grids));
         }
     }
 
     // Save final frame after evolution
     {
-        std::stringstream frame_path;
-        frame_path << "data/visualizations/darwin/frames/frame_"
-                  << std::setfill('0') << std::setw(6) << (darwin_config.final_epoch - 1) << ".ppm";
-        merged_grid.save_ppm(frame_path.str());
+        save_merged_frame(darwin_config.final_epoch - 1);
         std::cout << "Saved final frame after evolution" << std::endl;
     }
 
@@ -697,24 +907,41 @@ int main(int argc, char* argv[]) {
 
     std::cout << "\nEntropy tracking complete!" << std::endl;
 
-    // Generate video from frames
-    std::cout << "\nGenerating video from frames..." << std::endl;
-
-    // Convert PPM frames to PNG using ffmpeg (ffmpeg can handle PPM directly too)
-    std::cout << "Creating video with ffmpeg..." << std::endl;
-    std::stringstream ffmpeg_cmd;
-    ffmpeg_cmd << "ffmpeg -y -framerate 10 -pattern_type glob -i 'data/visualizations/darwin/frames/frame_*.ppm' "
-               << "-c:v libx264 -pix_fmt yuv420p -crf 23 "
-               << "data/visualizations/darwin/evolution_video.mp4 2>&1 | grep -E '(frame=|error|Duration)'";
+    // Every frame and pairing file is on disk before the video is made
+    output.flush();
+    if (output.dropped() > 0 || output.failures() > 0) {
+        std::cout << "\nOutput: " << output.dropped() << " frames dropped, " << output.failures()
+                  << " files failed" << std::endl;
+    }
 
-    int result = system(ffmpeg_cmd.str().c_str());
-    if (result == 0) {
-        std::cout << "Video saved to: data/visualizations/darwin/evolution_video.mp4" << std::endl;
+    // Finish the piped video, or generate it from the frames
+    if (video) {
+        int frames = video->frames_written();
+        if (video->close()) {
+            std::cout << "\nVideo saved to: " << VIDEO_PATH << " (" << frames << " frames)" << std::endl;
+        } else {
+            std::cout << "\nWarning: ffmpeg did not finish the video cleanly" << std::endl;
+        }
     } else {
-        std::cout << "Warning: ffmpeg may not be installed or video generation failed" << std::endl;
-        std::cout << "You can manually create the video using:" << std::endl;
-        std::cout << "  ffmpeg -framerate 10 -pattern_type glob -i 'data/visualizations/darwin/frames/frame_*.ppm' "
-                  << "-c:v libx264 -pix_fmt yuv420p data/visualizations/darwin/evolution_video.mp4" << std::endl;
+        // Generate video from frames
+        std::cout << "\nGenerating video from frames..." << std::endl;
+
+        // Convert PPM frames to PNG using ffmpeg (ffmpeg can handle PPM directly too)
+        std::cout << "Creating video with ffmpeg..." << std::endl;
+        std::stringstream ffmpeg_cmd;
+        ffmpeg_cmd << "ffmpeg -y -framerate 10 -pattern_type glob -i 'data/visualizations/darwin/frames/frame_*.ppm' "
+                   << "-c:v libx264 -pix_fmt yuv420p -crf 23 "
+                   << "data/visualizations/darwin/evolution_video.mp4 2>&1 | grep -E '(frame=|error|Duration)'";
+
+        int result = system(ffmpeg_cmd.str().c_str());
+        if (result == 0) {
+            std::cout << "Video saved to: data/visualizations/darwin/evolution_video.mp4" << std::endl;
+        } else {
+            std::cout << "Warning: ffmpeg may not be installed or video generation failed" << std::endl;
+            std::cout << "You can manually create the video using:" << std::endl;
+            std::cout << "  ffmpeg -framerate 10 -pattern_type glob -i 'data/visualizations/darwin/frames/frame_*.ppm' "
+                      << "-c:v libx264 -pix_fmt yuv420p data/visualizations/darwin/evolution_video.mp4" << std::endl;
+        }
     }
 
     std::cout << "\nDarwin experiment complete!" << std::endl;
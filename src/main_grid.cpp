@@ -1,45 +1,38 @@
 #include "emulator.h"
+#include "pair_cache.h"
 #include "utils.h"
 #include "metrics.h"
 #include "config.h"
 #include "grid.h"
+#include "grid_simulation.h"
 #include "websocket_server.h"
+#include "thread_pool.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "grid_frame.h"
+#include "profiler.h"
+#include "output_pipeline.h"
 
 #include <iostream>
 #include <fstream>
 #include <vector>
-#include <map>
 #include <random>
 #include <algorithm>
 #include <thread>
 #include <iomanip>
 #include <sstream>
-
-// Check if a character is a valid BF instruction
-bool is_instruction(char ch) {
-    const std::string instructions = ",.[]{}()<>+-";
-    return instructions.find(ch) != std::string::npos;
-}
-
-void run_simulation_pair(
-    const std::vector<uint8_t>& programA,
-    const std::vector<uint8_t>& programB,
-    int program_size,
-    EmulatorResult& result
-) {
-    // Concatenate programs
-    std::vector<uint8_t> tape = programA;
-    tape.insert(tape.end(), programB.begin(), programB.end());
-
-    // Run emulation
-    result = emulate(tape, 0, program_size);
-}
+#include <memory>
 
 int main(int argc, char* argv[]) {
     // Parse command line arguments
     std::string config_file = "configs/grid_config.yaml";
-    if (argc > 2 && std::string(argv[1]) == "--config") {
-        config_file = argv[2];
+    std::string resume_file;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::string(argv[i]) == "--config") {
+            config_file = argv[i + 1];
+        } else if (std::string(argv[i]) == "--resume") {
+            resume_file = argv[i + 1];
+        }
     }
 
     // Load configuration
@@ -54,9 +47,41 @@ int main(int argc, char* argv[]) {
     // Set random seed for reproducibility
     seed_random(config.random_seed);
 
-    // Create and initialize grid
-    Grid grid(config.grid_width, config.grid_height, config.program_size);
-    grid.initialize_random();
+    // Worker pool shared by initialization and every epoch; with numa_tiles,
+    // one pinned group of threads per NUMA node
+    unsigned int num_threads = ThreadPool::resolve_thread_count(config.num_threads);
+    std::vector<std::vector<int>> cpu_groups;
+    if (config.numa_tiles) {
+        cpu_groups = ThreadPool::numa_cpu_groups();
+        cpu_groups.resize(std::min<size_t>(cpu_groups.size(), num_threads));
+    }
+    ThreadPool pool(num_threads, cpu_groups);
+
+    // Create and initialize grid; the epochs run through GridSimulation,
+    // shared with bffpp_batch, drawing from the shared engine
+    GridSimulation simulation(config, pool, get_rng());
+    Grid& grid = simulation.grid();
+    simulation.initialize();
+
+    // Carry on from a checkpoint: the grid and the shared engine as they were
+    int start_epoch = 0;
+    if (!resume_file.empty()) {
+        try {
+            Checkpoint checkpoint = read_checkpoint(resume_file);
+            check_checkpoint(checkpoint, "bffpp_grid", 1, config.grid_width, config.grid_height,
+                             config.program_size);
+            if (checkpoint.rng_states.size() != 1) {
+                throw std::runtime_error("Checkpoint does not hold the random engine");
+            }
+            grid.load_snapshot(checkpoint.grids[0]);
+            simulation.reset_metrics();
+            restore_rng_state(get_rng(), checkpoint.rng_states[0]);
+            start_epoch = static_cast<int>(checkpoint.epoch);
+        } catch (const std::exception& e) {
+            std::cerr << "Error resuming from " << resume_file << ": " << e.what() << std::endl;
+            return 1;
+        }
+    }
 
     std::cout << "Starting grid simulation with:" << std::endl;
     std::cout << "  Grid size: " << config.grid_width << "x" << config.grid_height
@@ -65,6 +90,33 @@ int main(int argc, char* argv[]) {
     std::cout << "  Mutation rate: " << config.mutation_rate << std::endl;
     std::cout << "  Epochs: " << config.epochs << std::endl;
     std::cout << "  Visualization interval: " << config.visualization_interval << std::endl;
+    std::cout << "  Threads: " << pool.size() << std::endl;
+    if (config.counter_rng) {
+        std::cout << "  RNG: counter-based streams" << std::endl;
+    }
+    if (config.fused_mutation) {
+        std::cout << "  Mutation: fused into emulation tasks" << std::endl;
+    }
+    if (config.pairing == "tiled") {
+        std::cout << "  Pairing: tiled, in parallel" << std::endl;
+    }
+    if (config.numa_tiles) {
+        std::cout << "  NUMA tiles: " << pool.groups() << " (a band of rows per pinned thread group)" << std::endl;
+    }
+    if (config.emulator_backend == "batch") {
+        std::cout << "  Emulator: batched, " << EMULATOR_BATCH_LANES << " pairs in lockstep" << std::endl;
+    } else if (config.emulator_backend == "predecoded") {
+        std::cout << "  Emulator: pre-decoded" << std::endl;
+    }
+    if (config.pair_cache_size > 0) {
+        std::cout << "  Pair cache: " << config.pair_cache_size << " pairs" << std::endl;
+    }
+    if (config.profile_interval > 0) {
+        std::cout << "  Profile: every " << config.profile_interval << " epochs" << std::endl;
+    }
+    if (!resume_file.empty()) {
+        std::cout << "  Resumed from: " << resume_file << " (epoch " << start_epoch << ")" << std::endl;
+    }
     std::cout << std::endl;
 
     // Start WebSocket server for live visualization
@@ -74,210 +126,107 @@ int main(int argc, char* argv[]) {
     std::cout << "Open data/live_visualization.html in your browser for real-time updates" << std::endl;
     std::cout << std::endl;
 
+    // Live updates as JSON, or as binary keyframes and deltas
+    GridFrameEncoder frame_encoder;
+    auto broadcast_grid = [&](int epoch_num, double hoe, double avg_iters, double finished_ratio) {
+        if (config.live_frames == "binary") {
+            GridFrameStats stats{epoch_num, hoe, avg_iters, finished_ratio};
+            frame_encoder.encode(stats, grid.get_width(), grid.get_height(), grid.colors(),
+                                 ws_server.wants_keyframe());
+            ws_server.broadcast_frame(frame_encoder.keyframe(), frame_encoder.delta());
+        } else {
+            ws_server.broadcast(grid.to_json(epoch_num, hoe, avg_iters, finished_ratio));
+        }
+    };
+
     // Create output directories
     system("mkdir -p data/visualizations");
 
-    // Save initial visualization
-    std::stringstream filename;
-    filename << "data/visualizations/grid_epoch_0000.html";
-    grid.save_html(filename.str());
-    std::cout << "Saved initial visualization: " << filename.str() << std::endl;
+    // Save initial visualization (a resumed run already has it)
+    if (start_epoch == 0) {
+        std::stringstream filename;
+        filename << "data/visualizations/grid_epoch_0000.html";
+        grid.save_html(filename.str());
+        std::cout << "Saved initial visualization: " << filename.str() << std::endl;
+    }
 
     // Send initial state via WebSocket
-    std::string json_data = grid.to_json(0, 0.0, 0.0, 0.0);
-    ws_server.broadcast(json_data);
-
-    // Main simulation loop
-    for (int epoch = 0; epoch < config.epochs; epoch++) {
-        // Check if paused
-        while (ws_server.is_paused()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        }
-
-        // Get all programs as flat vector
-        std::vector<std::vector<uint8_t>> soup = grid.get_all_programs();
-
-        // Create spatial pairs using Von Neumann neighborhoods (r=2)
-        std::vector<std::pair<int, int>> program_pairs = grid.create_spatial_pairs(2);
-
-        // Run simulations with multithreading
-        std::vector<EmulatorResult> results(program_pairs.size());
-        std::vector<std::thread> threads;
-
-        unsigned int num_threads = std::thread::hardware_concurrency();
-        if (num_threads == 0) num_threads = 4;
-
-        for (size_t i = 0; i < program_pairs.size(); i++) {
-            int idx_a = program_pairs[i].first;
-            int idx_b = program_pairs[i].second;
-
-            // Skip mutation-only cases for now (handle in result processing)
-            if (idx_a == -1) {
-                continue;
-            }
-
-            // Wait if too many threads are running
-            if (threads.size() >= num_threads) {
-                threads[0].join();
-                threads.erase(threads.begin());
-            }
-
-            threads.emplace_back(
-                run_simulation_pair,
-                std::ref(soup[idx_a]),
-                std::ref(soup[idx_b]),
-                config.program_size,
-                std::ref(results[i])
-            );
-        }
-
-        // Wait for all threads to complete
-        for (auto& thread : threads) {
-            thread.join();
-        }
+    broadcast_grid(start_epoch, 0.0, 0.0, 0.0);
 
-        // Process results and update soup
-        double total_iterations = 0;
-        double total_skipped = 0;
-        double finished_runs = 0;
-        double terminated_runs = 0;
-        int executed_pairs = 0;
-
-        for (size_t i = 0; i < program_pairs.size(); i++) {
-            int idx_a = program_pairs[i].first;
-            int idx_b = program_pairs[i].second;
-
-            // Handle mutation-only cases (no neighbor available)
-            if (idx_a == -1) {
-                // Just mutate the program without execution
-                soup[idx_b] = mutate(soup[idx_b], config.mutation_rate);
-                continue;
-            }
+    // Binary pairing snapshots go through a background writer
+    std::unique_ptr<SnapshotWriter> snapshot_writer;
+    if (config.snapshot_format == "binary") {
+        snapshot_writer = std::make_unique<SnapshotWriter>(parse_snapshot_codec(config.snapshot_compression));
+    }
 
-            const EmulatorResult& result = results[i];
+    // Pairing CSVs and visualizations are written from copies by background
+    // writers while the next epoch runs (inline with output_threads: 0)
+    OutputPipeline output(config.output_threads, config.output_queue,
+                          parse_output_backpressure(config.output_backpressure));
 
-            // Extract and mutate programs
-            std::vector<uint8_t> programA_new(
-                result.tape.begin(),
-                result.tape.begin() + config.program_size
-            );
-            std::vector<uint8_t> programB_new(
-                result.tape.begin() + config.program_size,
-                result.tape.end()
-            );
+    // Checkpoints are copied out here and written in the background
+    std::unique_ptr<CheckpointWriter> checkpoint_writer;
+    if (config.checkpoint_interval > 0) {
+        system("mkdir -p data/checkpoints");
+        checkpoint_writer = std::make_unique<CheckpointWriter>(config.checkpoint_full_interval);
+    }
 
-            soup[idx_a] = mutate(programA_new, config.mutation_rate);
-            soup[idx_b] = mutate(programB_new, config.mutation_rate);
+    // Phase times and hot-path counters, reported every profile_interval epochs
+    std::unique_ptr<EpochProfiler> profiler;
+    std::ofstream profile_csv;
+    uint64_t profiled_ws_bytes = 0;
+    if (config.profile_interval > 0) {
+        set_profiling(true);
+        profiler = std::make_unique<EpochProfiler>();
+        simulation.set_profiler(profiler.get());
+        profile_csv.open("data/profile_bffpp_grid.csv");
+        profile_csv << EpochProfile::csv_header() << "\n";
+        ws_server.set_metrics(profiler->prometheus());
+    }
+    auto report_profile = [&]() {
+        uint64_t ws_bytes = ws_server.bytes_sent();
+        profile_count(ProfileCounter::WebSocketBytes, ws_bytes - profiled_ws_bytes);
+        profiled_ws_bytes = ws_bytes;
+
+        EpochProfile interval = profiler->take_interval();
+        std::cout << "\t" << interval.stats_line() << std::endl;
+        profile_csv << interval.csv_row() << std::endl;
+        ws_server.set_metrics(profiler->prometheus());
+        ws_server.broadcast_profile(interval.to_json());
+    };
 
-            total_iterations += result.iteration;
-            total_skipped += result.skipped;
-            finished_runs += (result.state == "Finished") ? 1.0 : 0.0;
-            terminated_runs += (result.state == "Terminated") ? 1.0 : 0.0;
-            executed_pairs++;
+    // Main simulation loop
+    for (int epoch = start_epoch; epoch < config.epochs; epoch++) {
+        // Check if paused
+        while (ws_server.is_paused()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
 
-        // Calculate averages (only for executed pairs)
-        if (executed_pairs > 0) {
-            total_skipped /= executed_pairs;
-            total_iterations /= executed_pairs;
-            terminated_runs /= executed_pairs;
-            finished_runs /= executed_pairs;
+        if (profiler) {
+            profiler->begin_epoch();
         }
 
-        // Update grid with new programs
-        grid.set_all_programs(soup);
-
-        // Save pairing information starting at epoch 16324
-        const int PAIRING_START_EPOCH = 16324;
-        if (epoch + 1 >= PAIRING_START_EPOCH) {
-            // Build map: position index -> combined position index
-            std::map<int, int> pairing_map;
-            for (const auto& pair : program_pairs) {
-                int idx_a = pair.first;
-                int idx_b = pair.second;
-
-                if (idx_a == -1) {
-                    // Mutation-only: no pairing
-                    pairing_map[idx_b] = -1;
-                } else {
-                    // Paired: each points to the other
-                    pairing_map[idx_a] = idx_b;
-                    pairing_map[idx_b] = idx_a;
-                }
-            }
+        // Pairing, emulation, mutation and the pairing dump
+        GridEpochStats stats = simulation.run_epoch(epoch);
+        simulation.save_pairings(epoch, "data/pairings", snapshot_writer.get(), output, std::cout);
 
-            // Save pairing CSV
-            std::stringstream pairing_filename;
-            pairing_filename << "data/pairings/pairings_epoch_"
-                           << std::setfill('0') << std::setw(4) << (epoch + 1) << ".csv";
-
-            // Create directory if needed
-            system("mkdir -p data/pairings");
-
-            std::ofstream pairing_file(pairing_filename.str());
-            if (pairing_file.is_open()) {
-                // Write header
-                pairing_file << "epoch,position_x,position_y,program,combined_x,combined_y\n";
-
-                // Write data for each position
-                for (int y = 0; y < grid.get_height(); y++) {
-                    for (int x = 0; x < grid.get_width(); x++) {
-                        int idx = y * grid.get_width() + x;
-                        const auto& program = soup[idx];
-
-                        // Get combined position
-                        int combined_idx = pairing_map[idx];
-                        int combined_x = -1;
-                        int combined_y = -1;
-
-                        if (combined_idx >= 0) {
-                            combined_y = combined_idx / grid.get_width();
-                            combined_x = combined_idx % grid.get_width();
-                        }
-
-                        // Write row
-                        pairing_file << (epoch + 1) << ","
-                                   << x << ","
-                                   << y << ",\"";
-
-                        // Write program as string (clean non-instructions)
-                        for (uint8_t ch : program) {
-                            char clean_ch = is_instruction(static_cast<char>(ch)) ?
-                                          static_cast<char>(ch) : ' ';
-                            pairing_file << clean_ch;
-                        }
-
-                        pairing_file << "\"," << combined_x << "," << combined_y << "\n";
-                    }
-                }
-
-                pairing_file.close();
-                std::cout << "\tSaved pairing data: " << pairing_filename.str() << std::endl;
-            }
-        }
-
-        // Calculate stats
-        std::vector<uint8_t> flat_soup;
-        for (const auto& program : soup) {
-            flat_soup.insert(flat_soup.end(), program.begin(), program.end());
+        // Calculate stats (only when someone will see them)
+        bool eval_epoch = (epoch % config.eval_interval == 0);
+        bool live_clients = ws_server.has_clients();
+        double hoe = 0.0;
+        if (eval_epoch || live_clients) {
+            hoe = simulation.higher_order_entropy();
         }
-        double hoe = higher_order_entropy(flat_soup);
 
         // Broadcast live update via WebSocket
-        if (ws_server.has_clients()) {
-            std::string json_data = grid.to_json(epoch + 1, hoe, total_iterations, finished_runs);
-            ws_server.broadcast(json_data);
+        if (live_clients) {
+            ScopedPhase phase(profiler.get(), ProfilePhase::Broadcast);
+            broadcast_grid(epoch + 1, hoe, stats.avg_iterations, stats.finished_ratio);
         }
 
         // Evaluate and print statistics
-        if (epoch % config.eval_interval == 0) {
-            std::cout << "Epoch: " << epoch << std::endl;
-            std::cout << std::fixed << std::setprecision(3);
-            std::cout << "\tHigher Order Entropy=" << hoe
-                      << ",\tAvg Iters=" << total_iterations
-                      << ",\tAvg Skips=" << total_skipped
-                      << ",\tFinished Ratio=" << finished_runs
-                      << ",\tTerminated Ratio=" << terminated_runs;
+        if (eval_epoch) {
+            print_epoch_stats(std::cout, epoch, hoe, stats);
             if (ws_server.has_clients()) {
                 std::cout << ",\tWebSocket Clients=" << ws_server.get_client_count();
             }
@@ -285,12 +234,27 @@ int main(int argc, char* argv[]) {
         }
 
         // Save visualization periodically
-        if (epoch > 0 && epoch % config.visualization_interval == 0) {
-            std::stringstream vis_filename;
-            vis_filename << "data/visualizations/grid_epoch_"
-                        << std::setfill('0') << std::setw(4) << epoch << ".html";
-            grid.save_html(vis_filename.str());
-            std::cout << "\tSaved visualization: " << vis_filename.str() << std::endl;
+        simulation.save_visualization(epoch, "data/visualizations", output, std::cout);
+
+        // Save a checkpoint after every checkpoint_interval epochs
+        if (checkpoint_writer && (epoch + 1) % config.checkpoint_interval == 0) {
+            ScopedPhase phase(profiler.get(), ProfilePhase::Output);
+            Checkpoint checkpoint;
+            checkpoint.driver = "bffpp_grid";
+            checkpoint.epoch = epoch + 1;
+            checkpoint.grids.push_back(grid.to_snapshot(epoch + 1));
+            checkpoint.rng_states = {rng_state(get_rng())};
+
+            std::string path = checkpoint_path("data/checkpoints", "bffpp_grid", epoch + 1);
+            checkpoint_writer->submit(path, std::move(checkpoint));
+            std::cout << "\tSaved checkpoint: " << path << std::endl;
+        }
+
+        if (profiler) {
+            profiler->end_epoch(epoch + 1);
+            if ((epoch + 1) % config.profile_interval == 0) {
+                report_profile();
+            }
         }
     }
 
@@ -300,6 +264,15 @@ int main(int argc, char* argv[]) {
                    << std::setfill('0') << std::setw(4) << config.epochs << ".html";
     grid.save_html(final_filename.str());
     std::cout << "\nSaved final visualization: " << final_filename.str() << std::endl;
+    output.flush();
+    if (output.dropped() > 0 || output.failures() > 0) {
+        std::cout << "Output: " << output.dropped() << " visualizations dropped, " << output.failures()
+                  << " files failed" << std::endl;
+    }
+    if (const PairCache* pair_cache = simulation.pair_cache()) {
+        std::cout << "Pair cache: " << pair_cache->hits() << " of " << pair_cache->lookups()
+                  << " pairs answered, " << pair_cache->size() << " entries" << std::endl;
+    }
     std::cout << "\nSimulation complete!" << std::endl;
 
     return 0;
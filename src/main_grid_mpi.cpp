@@ -0,0 +1,165 @@
+#include "config.h"
+#include "grid.h"
+#include "strip_grid.h"
+#include "strip_exchange_mpi.h"
+#include "thread_pool.h"
+#include "metrics_engine.h"
+
+#include <mpi.h>
+#include <iostream>
+#include <vector>
+#include <iomanip>
+#include <sstream>
+#include <memory>
+
+// Grid simulation split into horizontal strips, one per MPI rank
+//
+// Runs the same epochs as bffpp_grid with counter_rng: true, for any number
+// of ranks (see strip_grid.h); each rank needs memory for its own strip
+// only. Rank 0 prints the statistics and writes the visualizations, for
+// which only the colors are gathered. There is no live WebSocket view, and
+// pairing dumps are not written.
+//
+//   mpirun -np 4 ./bffpp_grid_mpi --config configs/grid_config.yaml
+int run(const Config& config, MpiStripExchange& exchange) {
+    bool root = exchange.rank() == 0;
+
+    // The pool runs this rank's cells and compresses its strip
+    ThreadPool pool(ThreadPool::resolve_thread_count(config.num_threads));
+    uint64_t seed = static_cast<uint64_t>(config.random_seed);
+    EmulatorBackend backend = (config.emulator_backend == "predecoded") ? EmulatorBackend::Predecoded
+                                                                         : EmulatorBackend::Scalar;
+
+    StripGrid grid(config.grid_width, config.grid_height, config.program_size, seed, exchange);
+    grid.initialize();
+
+    int width = grid.get_width();
+    int height = grid.get_height();
+
+    if (root) {
+        std::cout << "Starting MPI grid simulation with:" << std::endl;
+        std::cout << "  Grid size: " << width << "x" << height
+                  << " (" << grid.get_total_programs() << " programs)" << std::endl;
+        std::cout << "  Program size: " << config.program_size << std::endl;
+        std::cout << "  Mutation rate: " << config.mutation_rate << std::endl;
+        std::cout << "  Epochs: " << config.epochs << std::endl;
+        std::cout << "  Visualization interval: " << config.visualization_interval << std::endl;
+        std::cout << "  Ranks: " << exchange.size() << " strips of about "
+                  << height / exchange.size() << " rows, " << pool.size() << " threads each" << std::endl;
+        std::cout << "  RNG: counter-based streams" << std::endl;
+        if (config.emulator_backend == "predecoded") {
+            std::cout << "  Emulator: pre-decoded" << std::endl;
+        }
+        std::cout << std::endl;
+
+        // Create output directories
+        system("mkdir -p data/visualizations");
+    }
+
+    // Save initial visualization
+    std::vector<RGB> colors = grid.gather_colors();
+    if (root) {
+        std::stringstream filename;
+        filename << "data/visualizations/grid_epoch_0000.html";
+        Grid::save_colors_html(filename.str(), width, height, config.program_size, colors);
+        std::cout << "Saved initial visualization: " << filename.str() << std::endl;
+    }
+
+    // Entropy metrics with a running byte histogram of this rank's strip
+    MetricsOptions metrics_options;
+    metrics_options.brotli_quality = config.brotli_quality;
+    metrics_options.brotli_window = config.brotli_window;
+    metrics_options.shards = config.hoe_shards;
+    MetricsEngine metrics(metrics_options, &pool);
+    metrics.reset(grid.bytes().data(), grid.bytes().size());
+
+    // Main simulation loop
+    for (int epoch = 0; epoch < config.epochs; epoch++) {
+        StripEpochStats stats = grid.run_epoch(epoch + 1, config.mutation_rate, backend, &pool);
+        metrics.update(grid.previous_bytes().data(), grid.bytes().data(), grid.bytes().size());
+
+        // Calculate averages (only for executed pairs)
+        double total_iterations = 0;
+        double total_skipped = 0;
+        double finished_runs = 0;
+        double terminated_runs = 0;
+        if (stats.executed_pairs > 0) {
+            double executed_pairs = static_cast<double>(stats.executed_pairs);
+            total_iterations = stats.iterations / executed_pairs;
+            total_skipped = stats.skipped / executed_pairs;
+            finished_runs = stats.finished / executed_pairs;
+            terminated_runs = stats.terminated / executed_pairs;
+        }
+
+        // Evaluate and print statistics
+        if (epoch % config.eval_interval == 0) {
+            double hoe = grid.higher_order_entropy(metrics);
+            if (root) {
+                std::cout << "Epoch: " << epoch << std::endl;
+                std::cout << std::fixed << std::setprecision(3);
+                std::cout << "\tHigher Order Entropy=" << hoe
+                          << ",\tAvg Iters=" << total_iterations
+                          << ",\tAvg Skips=" << total_skipped
+                          << ",\tFinished Ratio=" << finished_runs
+                          << ",\tTerminated Ratio=" << terminated_runs << std::endl;
+            }
+        }
+
+        // Save visualization periodically
+        if (epoch > 0 && epoch % config.visualization_interval == 0) {
+            colors = grid.gather_colors();
+            if (root) {
+                std::stringstream vis_filename;
+                vis_filename << "data/visualizations/grid_epoch_"
+                            << std::setfill('0') << std::setw(4) << epoch << ".html";
+                Grid::save_colors_html(vis_filename.str(), width, height, config.program_size, colors);
+                std::cout << "\tSaved visualization: " << vis_filename.str() << std::endl;
+            }
+        }
+    }
+
+    // Save final visualization
+    colors = grid.gather_colors();
+    if (root) {
+        std::stringstream final_filename;
+        final_filename << "data/visualizations/grid_epoch_"
+                       << std::setfill('0') << std::setw(4) << config.epochs << ".html";
+        Grid::save_colors_html(final_filename.str(), width, height, config.program_size, colors);
+        std::cout << "\nSaved final visualization: " << final_filename.str() << std::endl;
+        std::cout << "\nSimulation complete!" << std::endl;
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+
+    // Parse command line arguments
+    std::string config_file = "configs/grid_config.yaml";
+    if (argc > 2 && std::string(argv[1]) == "--config") {
+        config_file = argv[2];
+    }
+
+    // Every rank reads the same configuration
+    Config config;
+    try {
+        config = load_config(config_file);
+    } catch (const std::exception& e) {
+        std::cerr << "Error loading config: " << e.what() << std::endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // A failing rank cannot leave the others waiting for its margins
+    int status = 0;
+    try {
+        MpiStripExchange exchange(MPI_COMM_WORLD);
+        status = run(config, exchange);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    MPI_Finalize();
+    return status;
+}
@@ -4,8 +4,17 @@
 #include "config.h"
 #include "grid_w_tracer.h"
 #include "websocket_server.h"
+#include "thread_pool.h"
+#include "metrics_engine.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "grid_frame.h"
+#include "token_lineage.h"
+#include "profiler.h"
+#include "output_pipeline.h"
 
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <random>
 #include <algorithm>
@@ -13,26 +22,34 @@
 #include <iomanip>
 #include <sstream>
 #include <chrono>
+#include <memory>
+#include <functional>
 
 void run_simulation_pair_with_tracer(
-    const std::vector<Token>& programA,
-    const std::vector<Token>& programB,
+    Span<const Token> programA,
+    Span<const Token> programB,
     int program_size,
+    bool detect_cycles,
     EmulatorResultWithTracer& result
 ) {
     // Concatenate programs
-    std::vector<Token> tape = programA;
+    std::vector<Token> tape(programA.begin(), programA.end());
     tape.insert(tape.end(), programB.begin(), programB.end());
 
     // Run emulation with tracer
-    result = emulate_w_tracer(tape, 0, program_size);
+    result = emulate_w_tracer(std::move(tape), 0, program_size, 0, 8192, 0, detect_cycles);
 }
 
 int main(int argc, char* argv[]) {
     // Parse command line arguments
     std::string config_file = "configs/grid_config.yaml";
-    if (argc > 2 && std::string(argv[1]) == "--config") {
-        config_file = argv[2];
+    std::string resume_file;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::string(argv[i]) == "--config") {
+            config_file = argv[i + 1];
+        } else if (std::string(argv[i]) == "--resume") {
+            resume_file = argv[i + 1];
+        }
     }
 
     // Load configuration
@@ -47,9 +64,58 @@ int main(int argc, char* argv[]) {
     // Set random seed for reproducibility
     seed_random(config.random_seed);
 
-    // Create and initialize grid with tokens
+    // Worker pool shared by initialization and every epoch; with numa_tiles,
+    // one pinned group of threads per NUMA node
+    unsigned int num_threads = ThreadPool::resolve_thread_count(config.num_threads);
+    std::vector<std::vector<int>> cpu_groups;
+    if (config.numa_tiles) {
+        cpu_groups = ThreadPool::numa_cpu_groups();
+        cpu_groups.resize(std::min<size_t>(cpu_groups.size(), num_threads));
+    }
+    ThreadPool pool(num_threads, cpu_groups);
+    uint64_t seed = static_cast<uint64_t>(config.random_seed);
+
+    // Create and initialize grid with tokens; each group's band of rows is placed on its node
     GridWithTracer grid(config.grid_width, config.grid_height, config.program_size);
-    grid.initialize_random(get_rng());
+    std::vector<size_t> bands;
+    if (config.numa_tiles) {
+        bands = row_bands(config.grid_width, config.grid_height, pool.groups());
+        grid.place_bands(pool, bands);
+    }
+    if (config.counter_rng) {
+        auto initialize_cells = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                CounterRng cell_rng(seed, RngDomain::Initialization, 0, i);
+                grid.initialize_program(i, cell_rng);
+            }
+        };
+        if (config.numa_tiles) {
+            pool.parallel_for_groups(bands, 0, initialize_cells);
+        } else {
+            pool.parallel_for(grid.get_total_programs(), 0, initialize_cells);
+        }
+    } else {
+        grid.initialize_random(get_rng());
+    }
+
+    // Carry on from a checkpoint: the tokens and the shared engine as they were
+    int start_epoch = 0;
+    if (!resume_file.empty()) {
+        try {
+            Checkpoint checkpoint = read_checkpoint(resume_file);
+            check_checkpoint(checkpoint, "bffpp_grid_w_tracer", 1, config.grid_width, config.grid_height,
+                             config.program_size);
+            if (checkpoint.rng_states.size() != 1) {
+                throw std::runtime_error("Checkpoint does not hold the random engine");
+            }
+            grid.load_snapshot(checkpoint.grids[0]);
+            restore_rng_state(get_rng(), checkpoint.rng_states[0]);
+            start_epoch = static_cast<int>(checkpoint.epoch);
+        } catch (const std::exception& e) {
+            std::cerr << "Error resuming from " << resume_file << ": " << e.what() << std::endl;
+            return 1;
+        }
+    }
 
     std::cout << "Starting grid simulation with token tracking:" << std::endl;
     std::cout << "  Grid size: " << config.grid_width << "x" << config.grid_height
@@ -58,6 +124,25 @@ int main(int argc, char* argv[]) {
     std::cout << "  Mutation rate: " << config.mutation_rate << std::endl;
     std::cout << "  Epochs: " << config.epochs << std::endl;
     std::cout << "  Token snapshots will be saved to data/tokens/" << std::endl;
+    std::cout << "  Threads: " << pool.size() << std::endl;
+    if (config.counter_rng) {
+        std::cout << "  RNG: counter-based streams" << std::endl;
+    }
+    if (config.fused_mutation) {
+        std::cout << "  Mutation: fused into emulation tasks" << std::endl;
+    }
+    if (config.pairing == "tiled") {
+        std::cout << "  Pairing: tiled, in parallel" << std::endl;
+    }
+    if (config.numa_tiles) {
+        std::cout << "  NUMA tiles: " << pool.groups() << " (a band of rows per pinned thread group)" << std::endl;
+    }
+    if (config.profile_interval > 0) {
+        std::cout << "  Profile: every " << config.profile_interval << " epochs" << std::endl;
+    }
+    if (!resume_file.empty()) {
+        std::cout << "  Resumed from: " << resume_file << " (epoch " << start_epoch << ")" << std::endl;
+    }
     std::cout << std::endl;
 
     // Start WebSocket server for live visualization
@@ -67,12 +152,88 @@ int main(int argc, char* argv[]) {
     std::cout << "Open data/live_grid_w_tracer.html in your browser for real-time updates" << std::endl;
     std::cout << std::endl;
 
+    // Live updates as JSON, or as binary keyframes and deltas
+    GridFrameEncoder frame_encoder;
+    auto broadcast_grid = [&](int epoch_num, double entropy, double finished_ratio) {
+        if (config.live_frames == "binary") {
+            GridFrameStats stats{epoch_num, entropy, 0.0, finished_ratio};
+            frame_encoder.encode(stats, grid.get_width(), grid.get_height(), grid.colors(),
+                                 ws_server.wants_keyframe());
+            ws_server.broadcast_frame(frame_encoder.keyframe(), frame_encoder.delta());
+        } else {
+            ws_server.broadcast(grid.to_json(epoch_num, entropy, finished_ratio));
+        }
+    };
+
     // Create output directories
     system("mkdir -p data/tokens");
 
-    // Save initial token snapshot
-    std::cout << "Saving initial token snapshot (epoch 0)..." << std::endl;
-    grid.save_tokens_to_csv("data/tokens/tokens_epoch_0000.csv", 0);
+    // Token dumps as CSV, or as binary snapshots written in the background
+    std::unique_ptr<SnapshotWriter> snapshot_writer;
+    if (config.snapshot_format == "binary") {
+        snapshot_writer = std::make_unique<SnapshotWriter>(parse_snapshot_codec(config.snapshot_compression));
+    }
+    auto token_snapshot_path = [&](int epoch_num) {
+        std::stringstream filename;
+        filename << "data/tokens/tokens_epoch_"
+                 << std::setw(4) << std::setfill('0') << epoch_num
+                 << (snapshot_writer ? ".bffs" : ".csv");
+        return filename.str();
+    };
+    // Token CSVs are written from copies by background writers while the
+    // next epoch runs (inline with output_threads: 0)
+    OutputPipeline output(config.output_threads, config.output_queue,
+                          parse_output_backpressure(config.output_backpressure));
+    auto save_tokens = [&](const std::string& filepath, int epoch_num) {
+        if (snapshot_writer) {
+            snapshot_writer->submit(filepath, grid.to_snapshot(epoch_num));
+        } else if (output.inline_jobs()) {
+            grid.save_tokens_to_csv(filepath, epoch_num);
+        } else {
+            auto snapshot = std::make_shared<const Snapshot>(grid.to_snapshot(epoch_num));
+            output.submit([snapshot, filepath] { GridWithTracer::save_tokens_to_csv(filepath, *snapshot); });
+        }
+    };
+
+    // Save initial token snapshot (a resumed run already has it)
+    if (start_epoch == 0) {
+        std::cout << "Saving initial token snapshot (epoch 0)..." << std::endl;
+        save_tokens(token_snapshot_path(0), 0);
+    }
+
+    // Lineage statistics straight from the tokens, and the archive of every capture
+    std::unique_ptr<TokenLineage> lineage;
+    auto record_lineage = [&](int epoch_num) {
+        if (!lineage || (lineage->columns().size() > 0 && lineage->columns().epoch == epoch_num)) {
+            return;
+        }
+        lineage->capture(grid, epoch_num);
+        std::stringstream filename;
+        filename << "data/tokens/lineage_epoch_" << std::setw(4) << std::setfill('0') << epoch_num << ".csv";
+        lineage->save_csv(filename.str());
+    };
+    if (config.token_lineage) {
+        std::stringstream archive_path;
+        archive_path << "data/tokens/lineage_" << std::setw(4) << std::setfill('0') << start_epoch << ".bffl";
+        lineage = std::make_unique<TokenLineage>(grid.get_width(), grid.get_height(), config.program_size, &pool);
+        lineage->open_archive(archive_path.str());
+        record_lineage(start_epoch);
+        std::cout << "Token lineage will be saved to " << archive_path.str() << std::endl;
+    }
+
+    // Checkpoints are copied out here and written in the background
+    std::unique_ptr<CheckpointWriter> checkpoint_writer;
+    if (config.checkpoint_interval > 0) {
+        system("mkdir -p data/checkpoints");
+        checkpoint_writer = std::make_unique<CheckpointWriter>(config.checkpoint_full_interval);
+    }
+
+    // Entropy metrics with the configured Brotli settings
+    MetricsOptions metrics_options;
+    metrics_options.brotli_quality = config.brotli_quality;
+    metrics_options.brotli_window = config.brotli_window;
+    metrics_options.shards = config.hoe_shards;
+    MetricsEngine metrics(metrics_options, &pool);
 
     // Send initial state via WebSocket
     std::vector<uint8_t> initial_flat;
@@ -82,113 +243,194 @@ int main(int argc, char* argv[]) {
             initial_flat.insert(initial_flat.end(), bytes.begin(), bytes.end());
         }
     }
-    double initial_entropy = higher_order_entropy(initial_flat);
-    std::string json_data = grid.to_json(0, initial_entropy, 0.0);
-    ws_server.broadcast(json_data);
+    double initial_entropy = metrics.higher_order_entropy_of(initial_flat.data(), initial_flat.size());
+    broadcast_grid(start_epoch, initial_entropy, 0.0);
+
+    // Phase times and hot-path counters, reported every profile_interval epochs
+    std::unique_ptr<EpochProfiler> profiler;
+    std::ofstream profile_csv;
+    uint64_t profiled_ws_bytes = 0;
+    if (config.profile_interval > 0) {
+        set_profiling(true);
+        profiler = std::make_unique<EpochProfiler>();
+        profile_csv.open("data/profile_bffpp_grid_w_tracer.csv");
+        profile_csv << EpochProfile::csv_header() << "\n";
+        ws_server.set_metrics(profiler->prometheus());
+    }
+    auto report_profile = [&]() {
+        uint64_t ws_bytes = ws_server.bytes_sent();
+        profile_count(ProfileCounter::WebSocketBytes, ws_bytes - profiled_ws_bytes);
+        profiled_ws_bytes = ws_bytes;
+
+        EpochProfile interval = profiler->take_interval();
+        std::cout << "  " << interval.stats_line() << std::endl;
+        profile_csv << interval.csv_row() << std::endl;
+        ws_server.set_metrics(profiler->prometheus());
+        ws_server.broadcast_profile(interval.to_json());
+    };
 
     // Main simulation loop
     auto start_time = std::chrono::steady_clock::now();
 
-    for (int epoch = 0; epoch < config.epochs; epoch++) {
+    for (int epoch = start_epoch; epoch < config.epochs; epoch++) {
         // Check if paused
         while (ws_server.is_paused()) {
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
 
-        // Get all programs (tokens) as flat vector
-        std::vector<std::vector<Token>> soup = grid.get_all_programs();
+        if (profiler) {
+            profiler->begin_epoch();
+        }
+
+        // Next-epoch programs are built alongside the current ones
+        grid.begin_epoch();
 
         // Create spatial pairs using Von Neumann neighborhoods (r=2)
-        std::vector<std::pair<int, int>> program_pairs = grid.create_spatial_pairs(2, get_rng());
+        ScopedPhase pairing_phase(profiler.get(), ProfilePhase::Pairing);
+        std::vector<std::pair<int, int>> program_pairs;
+        if (config.pairing == "tiled") {
+            program_pairs = grid.create_tiled_pairs(2, seed, epoch + 1, &pool);
+        } else {
+            program_pairs = config.counter_rng ? grid.create_spatial_pairs(2, seed, epoch + 1)
+                                               : grid.create_spatial_pairs(2, get_rng());
+        }
+        // NUMA tiles: each band's pairs stay on its group, pairs across bands go anywhere
+        std::vector<size_t> pair_groups;
+        if (config.numa_tiles) {
+            pair_groups = group_pairs_by_band(program_pairs, bands);
+        }
+        pairing_phase.stop();
 
-        // Run simulations with multithreading
-        std::vector<EmulatorResultWithTracer> results(program_pairs.size());
-        std::vector<std::thread> threads;
+        auto for_pairs = [&](const std::function<void(size_t, size_t)>& fn) {
+            if (config.numa_tiles) {
+                pool.parallel_for_groups(pair_groups, 0, fn);
+            } else {
+                pool.parallel_for(program_pairs.size(), 0, fn);
+            }
+        };
 
-        unsigned int num_threads = std::thread::hardware_concurrency();
-        if (num_threads == 0) num_threads = 4;
+        // Mutate one next-epoch program from its own counter-based stream
+        auto mutate_cell = [&](int idx) {
+            CounterRng cell_rng(seed, RngDomain::Mutation, epoch + 1, idx);
+            grid.mutate_in_place(grid.next_program(idx), config.mutation_rate, epoch + 1, cell_rng);
+        };
 
-        for (size_t i = 0; i < program_pairs.size(); i++) {
-            int idx_a = program_pairs[i].first;
-            int idx_b = program_pairs[i].second;
-
-            // Skip mutation-only cases for now (will handle after simulation)
-            if (idx_a == -1) {
-                continue;
-            }
+        // Run simulations on the worker pool
+        std::vector<EmulatorResultWithTracer> results(program_pairs.size());
+        // Fused mutation is timed as part of emulation
+        ScopedPhase emulation_phase(profiler.get(), ProfilePhase::Emulation);
+        for_pairs([&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                int idx_a = program_pairs[i].first;
+                int idx_b = program_pairs[i].second;
+
+                // Mutation-only cases carry the program over unchanged (mutated below)
+                if (idx_a == -1) {
+                    Span<const Token> program = grid.program_at(idx_b);
+                    std::copy(program.begin(), program.end(), grid.next_program(idx_b).begin());
+                    if (config.fused_mutation) {
+                        mutate_cell(idx_b);
+                    }
+                    continue;
+                }
 
-            threads.emplace_back(
-                run_simulation_pair_with_tracer,
-                std::cref(soup[idx_a]),
-                std::cref(soup[idx_b]),
-                config.program_size,
-                std::ref(results[i])
-            );
-
-            // Limit concurrent threads
-            if (threads.size() >= num_threads) {
-                for (auto& thread : threads) {
-                    thread.join();
+                run_simulation_pair_with_tracer(grid.program_at(idx_a), grid.program_at(idx_b),
+                                                config.program_size, config.cycle_detection, results[i]);
+
+                // Split the result tape into the two next-epoch slots
+                const std::vector<Token>& tape = results[i].tape;
+                std::copy(tape.begin(), tape.begin() + config.program_size,
+                          grid.next_program(idx_a).begin());
+                std::copy(tape.begin() + config.program_size, tape.end(),
+                          grid.next_program(idx_b).begin());
+
+                // Fused: mutate in the same task and drop the tape copy, only
+                // the state is still needed on the main thread
+                if (config.fused_mutation) {
+                    mutate_cell(idx_a);
+                    mutate_cell(idx_b);
+                    std::vector<Token>().swap(results[i].tape);
                 }
-                threads.clear();
             }
-        }
-
-        // Join remaining threads
-        for (auto& thread : threads) {
-            thread.join();
-        }
+        });
+        emulation_phase.stop();
 
         // Calculate finished ratio from results
         double finished_runs = 0;
         int executed_pairs = 0;
+        uint64_t executed_steps = 0;
+        uint64_t skipped_steps = 0;
         for (size_t i = 0; i < program_pairs.size(); i++) {
             // Only count pairs that were actually executed (not mutation-only)
             if (program_pairs[i].first != -1) {
                 if (results[i].state == "Finished") {
                     finished_runs += 1.0;
                 }
+                executed_steps += results[i].iteration;
+                skipped_steps += results[i].skipped;
                 executed_pairs++;
             }
         }
         double finished_ratio = executed_pairs > 0 ? finished_runs / executed_pairs : 0.0;
+        profile_count(ProfileCounter::Pairs, executed_pairs);
+        profile_count(ProfileCounter::MutationOnly, program_pairs.size() - executed_pairs);
+        profile_count(ProfileCounter::Instructions, executed_steps);
+        profile_count(ProfileCounter::Skipped, skipped_steps);
 
         // Process results and update soup
-        for (size_t i = 0; i < program_pairs.size(); i++) {
-            int idx_a = program_pairs[i].first;
-            int idx_b = program_pairs[i].second;
-
-            if (idx_a == -1) {
-                // Mutation-only case - just mutate program B
-                soup[idx_b] = grid.mutate(soup[idx_b], config.mutation_rate, epoch + 1, get_rng());
-            } else {
-                // Normal case - extract results and mutate
-                std::vector<Token> result_a(results[i].tape.begin(),
-                                            results[i].tape.begin() + config.program_size);
-                std::vector<Token> result_b(results[i].tape.begin() + config.program_size,
-                                            results[i].tape.end());
-
-                // Apply mutations
-                soup[idx_a] = grid.mutate(result_a, config.mutation_rate, epoch + 1, get_rng());
-                soup[idx_b] = grid.mutate(result_b, config.mutation_rate, epoch + 1, get_rng());
+        ScopedPhase mutation_phase(profiler.get(), ProfilePhase::Mutation);
+        if (config.fused_mutation) {
+            // Already mutated by the workers
+        } else if (config.counter_rng) {
+            // Counter-based streams let mutation run on the pool as well
+            for_pairs([&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    for (int idx : {program_pairs[i].first, program_pairs[i].second}) {
+                        if (idx != -1) {
+                            mutate_cell(idx);
+                        }
+                    }
+                }
+            });
+        } else {
+            for (size_t i = 0; i < program_pairs.size(); i++) {
+                int idx_a = program_pairs[i].first;
+                int idx_b = program_pairs[i].second;
+
+                if (idx_a == -1) {
+                    // Mutation-only case - just mutate program B
+                    grid.mutate_in_place(grid.next_program(idx_b), config.mutation_rate, epoch + 1, get_rng());
+                } else {
+                    // Normal case - results are already in place, mutate them
+                    grid.mutate_in_place(grid.next_program(idx_a), config.mutation_rate, epoch + 1, get_rng());
+                    grid.mutate_in_place(grid.next_program(idx_b), config.mutation_rate, epoch + 1, get_rng());
+                }
             }
         }
 
-        // Update grid with all new programs at once
-        grid.set_all_programs(soup);
-
-        // Calculate entropy for progress reporting
-        std::vector<uint8_t> flat_bytes;
-        for (int y = 0; y < grid.get_height(); y++) {
-            for (int x = 0; x < grid.get_width(); x++) {
-                auto bytes = grid.get_program_bytes(x, y);
-                flat_bytes.insert(flat_bytes.end(), bytes.begin(), bytes.end());
+        mutation_phase.stop();
+
+        // Swap the new programs in
+        grid.commit_epoch();
+
+        // Calculate entropy for progress reporting (only when someone will see it)
+        bool report_epoch = ((epoch + 1) % 10 == 0 || epoch + 1 == config.epochs);
+        bool live_clients = ws_server.has_clients();
+        double entropy = 0.0;
+        if (report_epoch || live_clients) {
+            ScopedPhase phase(profiler.get(), ProfilePhase::Metrics);
+            std::vector<uint8_t> flat_bytes;
+            flat_bytes.reserve(static_cast<size_t>(grid.get_total_programs()) * config.program_size);
+            for (int i = 0; i < grid.get_total_programs(); i++) {
+                for (const Token& token : grid.program_at(i)) {
+                    flat_bytes.push_back(token.get_char());
+                }
             }
+            entropy = metrics.higher_order_entropy_of(flat_bytes.data(), flat_bytes.size());
         }
-        double entropy = higher_order_entropy(flat_bytes);
 
         // Progress reporting
-        if ((epoch + 1) % 10 == 0 || epoch + 1 == config.epochs) {
+        if (report_epoch) {
             auto current_time = std::chrono::steady_clock::now();
             auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
                 current_time - start_time).count();
@@ -201,25 +443,52 @@ int main(int argc, char* argv[]) {
 
         // Save token snapshots at visualization intervals
         if ((epoch + 1) % config.visualization_interval == 0) {
-            std::stringstream filename;
-            filename << "data/tokens/tokens_epoch_"
-                     << std::setw(4) << std::setfill('0') << (epoch + 1) << ".csv";
+            ScopedPhase phase(profiler.get(), ProfilePhase::Output);
+            std::string filename = token_snapshot_path(epoch + 1);
+            std::cout << "  Saving token snapshot: " << filename << std::endl;
+            save_tokens(filename, epoch + 1);
+            record_lineage(epoch + 1);
+        }
 
-            std::cout << "  Saving token snapshot: " << filename.str() << std::endl;
-            grid.save_tokens_to_csv(filename.str(), epoch + 1);
+        // Save a checkpoint after every checkpoint_interval epochs
+        if (checkpoint_writer && (epoch + 1) % config.checkpoint_interval == 0) {
+            ScopedPhase phase(profiler.get(), ProfilePhase::Output);
+            Checkpoint checkpoint;
+            checkpoint.driver = "bffpp_grid_w_tracer";
+            checkpoint.epoch = epoch + 1;
+            checkpoint.grids.push_back(grid.to_snapshot(epoch + 1));
+            checkpoint.rng_states = {rng_state(get_rng())};
+
+            std::string path = checkpoint_path("data/checkpoints", "bffpp_grid_w_tracer", epoch + 1);
+            checkpoint_writer->submit(path, std::move(checkpoint));
+            std::cout << "  Saved checkpoint: " << path << std::endl;
         }
 
         // Broadcast updates via WebSocket every epoch
-        std::string json_update = grid.to_json(epoch + 1, entropy, finished_ratio);
-        ws_server.broadcast(json_update);
+        if (live_clients) {
+            ScopedPhase phase(profiler.get(), ProfilePhase::Broadcast);
+            broadcast_grid(epoch + 1, entropy, finished_ratio);
+        }
+
+        if (profiler) {
+            profiler->end_epoch(epoch + 1);
+            if ((epoch + 1) % config.profile_interval == 0) {
+                report_profile();
+            }
+        }
     }
 
     // Save final token snapshot
     std::cout << "\nSaving final token snapshot..." << std::endl;
-    std::stringstream final_filename;
-    final_filename << "data/tokens/tokens_epoch_"
-                   << std::setw(4) << std::setfill('0') << config.epochs << ".csv";
-    grid.save_tokens_to_csv(final_filename.str(), config.epochs);
+    save_tokens(token_snapshot_path(config.epochs), config.epochs);
+    record_lineage(config.epochs);
+    if (snapshot_writer) {
+        snapshot_writer->flush();
+    }
+    output.flush();
+    if (output.failures() > 0) {
+        std::cout << "Output: " << output.failures() << " files failed" << std::endl;
+    }
 
     auto end_time = std::chrono::steady_clock::now();
     auto total_time = std::chrono::duration_cast<std::chrono::seconds>(
@@ -0,0 +1,73 @@
+#include "mapped_file.h"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile(const std::string& path)
+    : file_path(path), length(0), fd(-1), bytes(nullptr) {
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        throw std::runtime_error("Could not open file: " + path);
+    }
+
+    struct stat info;
+    if (::fstat(file, &info) != 0) {
+        ::close(file);
+        throw std::runtime_error("Could not stat file: " + path);
+    }
+
+    length = static_cast<size_t>(info.st_size);
+    if (length > 0) {
+        void* mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(file);
+            throw std::runtime_error("Could not map file: " + path);
+        }
+        // Read-only files are parsed front to back exactly once
+        ::madvise(mapping, length, MADV_SEQUENTIAL);
+        bytes = static_cast<uint8_t*>(mapping);
+    }
+
+    ::close(file);
+}
+
+MappedFile::MappedFile(const std::string& path, size_t size)
+    : file_path(path), length(size), fd(-1), bytes(nullptr) {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open mapped file: " + path + " (" + std::strerror(errno) + ")");
+    }
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Could not resize mapped file: " + path + " (" + std::strerror(errno) + ")");
+    }
+    if (size == 0) {
+        return;
+    }
+
+    void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("Could not map file: " + path + " (" + std::strerror(errno) + ")");
+    }
+    bytes = static_cast<uint8_t*>(mapping);
+}
+
+MappedFile::~MappedFile() {
+    if (bytes != nullptr) {
+        ::munmap(bytes, length);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+void MappedFile::flush() const {
+    if (writable() && bytes != nullptr && ::msync(bytes, length, MS_SYNC) != 0) {
+        throw std::runtime_error("Could not write back mapped file: " + file_path);
+    }
+}
@@ -4,15 +4,24 @@
 #include <algorithm>
 #include <brotli/encode.h>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BFFPP_MATCH_AVX512 1
+#include <immintrin.h>
+#endif
+
 double shannon_entropy(const std::vector<uint8_t>& byte_string) {
+    return shannon_entropy(byte_string.data(), byte_string.size());
+}
+
+double shannon_entropy(const uint8_t* data, size_t size) {
     std::array<int, 256> counts = {0};
 
-    for (uint8_t byte : byte_string) {
-        counts[byte]++;
+    for (size_t i = 0; i < size; i++) {
+        counts[data[i]]++;
     }
 
     double entropy = 0.0;
-    size_t length = byte_string.size();
+    size_t length = size;
 
     for (int i = 0; i < 256; i++) {
         if (counts[i] > 0) {
@@ -25,22 +34,27 @@ double shannon_entropy(const std::vector<uint8_t>& byte_string) {
 }
 
 double kolmogorov_complexity_estimate(const std::vector<uint8_t>& byte_string) {
+    return kolmogorov_complexity_estimate(byte_string.data(), byte_string.size(),
+                                          BROTLI_DEFAULT_QUALITY, BROTLI_DEFAULT_WINDOW);
+}
+
+double kolmogorov_complexity_estimate(const uint8_t* data, size_t size, int quality, int window) {
     /*
      * Complexity of 8.0 means that the string is incompressible and 0.0 bits can be saved per byte
      * Complexity of 0.0 means that the string is fully compressible and 8.0 bits can be saved per byte
      */
 
-    size_t input_size = byte_string.size();
+    size_t input_size = size;
     size_t max_compressed_size = BrotliEncoderMaxCompressedSize(input_size);
     std::vector<uint8_t> compressed(max_compressed_size);
 
     size_t compressed_size = max_compressed_size;
     int result = BrotliEncoderCompress(
-        BROTLI_DEFAULT_QUALITY,
-        BROTLI_DEFAULT_WINDOW,
+        quality,
+        window,
         BROTLI_DEFAULT_MODE,
         input_size,
-        byte_string.data(),
+        data,
         &compressed_size,
         compressed.data()
     );
@@ -54,17 +68,22 @@ double kolmogorov_complexity_estimate(const std::vector<uint8_t>& byte_string) {
 }
 
 double compressed_size(const std::vector<uint8_t>& byte_string) {
-    size_t input_size = byte_string.size();
+    return compressed_size(byte_string.data(), byte_string.size(),
+                           BROTLI_DEFAULT_QUALITY, BROTLI_DEFAULT_WINDOW);
+}
+
+double compressed_size(const uint8_t* data, size_t size, int quality, int window) {
+    size_t input_size = size;
     size_t max_compressed_size = BrotliEncoderMaxCompressedSize(input_size);
     std::vector<uint8_t> compressed(max_compressed_size);
 
     size_t comp_size = max_compressed_size;
     int result = BrotliEncoderCompress(
-        BROTLI_DEFAULT_QUALITY,
-        BROTLI_DEFAULT_WINDOW,
+        quality,
+        window,
         BROTLI_DEFAULT_MODE,
         input_size,
-        byte_string.data(),
+        data,
         &comp_size,
         compressed.data()
     );
@@ -77,6 +96,124 @@ double compressed_size(const std::vector<uint8_t>& byte_string) {
     return static_cast<double>(comp_size);
 }
 
+double streamed_compressed_size(const uint8_t* data, size_t size, int quality, int window, size_t chunk_size) {
+    BrotliEncoderState* encoder = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+    if (encoder == nullptr) {
+        return static_cast<double>(size);
+    }
+    BrotliEncoderSetParameter(encoder, BROTLI_PARAM_QUALITY, quality);
+    BrotliEncoderSetParameter(encoder, BROTLI_PARAM_LGWIN, window);
+    BrotliEncoderSetParameter(encoder, BROTLI_PARAM_SIZE_HINT,
+                              static_cast<uint32_t>(std::min<size_t>(size, 1u << 30)));
+
+    size_t total = 0;
+    size_t offset = 0;
+    bool ok = true;
+    while (ok) {
+        size_t available = std::min(chunk_size, size - offset);
+        const uint8_t* next_in = data + offset;
+        offset += available;
+        bool last = offset == size;
+        BrotliEncoderOperation operation = last ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS;
+
+        // Feed the chunk and drain whatever the encoder produced
+        while (true) {
+            size_t available_out = 0;
+            if (!BrotliEncoderCompressStream(encoder, operation, &available, &next_in, &available_out,
+                                             nullptr, nullptr)) {
+                ok = false;
+                break;
+            }
+            size_t produced = 0;
+            BrotliEncoderTakeOutput(encoder, &produced);
+            total += produced;
+            if (available == 0 && !BrotliEncoderHasMoreOutput(encoder) &&
+                (!last || BrotliEncoderIsFinished(encoder))) {
+                break;
+            }
+        }
+        if (last) {
+            break;
+        }
+    }
+    BrotliEncoderDestroyInstance(encoder);
+
+    // Compression failed, return input size
+    return ok ? static_cast<double>(total) : static_cast<double>(size);
+}
+
+// One 64-row block of Myers' bit-vector edit distance (Hyyro's formulation
+// for blocks): advances the vertical deltas Pv/Mv of the block by one text
+// character, given the pattern bits Eq matching it and the horizontal delta
+// hin entering the block from below, and returns the delta leaving it at
+// the row bit top
+static int advance_block(uint64_t& Pv, uint64_t& Mv, uint64_t Eq, int hin, uint64_t top) {
+    uint64_t Xv = Eq | Mv;
+    if (hin < 0) {
+        Eq |= 1;
+    }
+    uint64_t Xh = (((Eq & Pv) + Pv) ^ Pv) | Eq;
+    uint64_t Ph = Mv | ~(Xh | Pv);
+    uint64_t Mh = Pv & Xh;
+
+    int hout = (Ph & top) ? 1 : ((Mh & top) ? -1 : 0);
+    Ph <<= 1;
+    Mh <<= 1;
+    if (hin < 0) {
+        Mh |= 1;
+    } else if (hin > 0) {
+        Ph |= 1;
+    }
+    Pv = Mh | ~(Xv | Ph);
+    Mv = Ph & Xv;
+    return hout;
+}
+
+size_t edit_distance(const std::string& s1, const std::string& s2) {
+    // The shorter string is the pattern, one bit per character
+    const std::string& pattern = (s1.size() <= s2.size()) ? s1 : s2;
+    const std::string& text = (s1.size() <= s2.size()) ? s2 : s1;
+    size_t m = pattern.size();
+    if (m == 0) {
+        return text.size();
+    }
+
+    const uint64_t HIGH = 1ULL << 63;
+    uint64_t last = 1ULL << ((m - 1) % 64);
+    size_t score = m;
+
+    // 64-byte programs fit one word, so the common case needs no heap
+    if (m <= 64) {
+        std::array<uint64_t, 256> peq = {};
+        for (size_t i = 0; i < m; i++) {
+            peq[static_cast<uint8_t>(pattern[i])] |= 1ULL << i;
+        }
+        uint64_t Pv = ~0ULL;
+        uint64_t Mv = 0;
+        for (char c : text) {
+            score += advance_block(Pv, Mv, peq[static_cast<uint8_t>(c)], 1, last);
+        }
+        return score;
+    }
+
+    size_t blocks = (m + 63) / 64;
+    std::vector<uint64_t> peq(256 * blocks, 0);
+    for (size_t i = 0; i < m; i++) {
+        peq[static_cast<uint8_t>(pattern[i]) * blocks + i / 64] |= 1ULL << (i % 64);
+    }
+    std::vector<uint64_t> Pv(blocks, ~0ULL);
+    std::vector<uint64_t> Mv(blocks, 0);
+    for (char c : text) {
+        const uint64_t* eq = peq.data() + static_cast<uint8_t>(c) * blocks;
+        int h = 1;
+        for (size_t b = 0; b + 1 < blocks; b++) {
+            h = advance_block(Pv[b], Mv[b], eq[b], h, HIGH);
+        }
+        score += advance_block(Pv[blocks - 1], Mv[blocks - 1], eq[blocks - 1], h, last);
+    }
+    return score;
+}
+
 double normalized_edit_distance(const std::string& s1, const std::string& s2) {
     size_t len1 = s1.length();
     size_t len2 = s2.length();
@@ -86,39 +223,65 @@ double normalized_edit_distance(const std::string& s1, const std::string& s2) {
     if (len1 == 0) return 1.0;
     if (len2 == 0) return 1.0;
 
-    // Create DP table
-    std::vector<std::vector<size_t>> dp(len1 + 1, std::vector<size_t>(len2 + 1));
+    // Normalize by the maximum length
+    size_t max_len = std::max(len1, len2);
+    return static_cast<double>(edit_distance(s1, s2)) / static_cast<double>(max_len);
+}
 
-    // Initialize base cases
-    for (size_t i = 0; i <= len1; i++) {
-        dp[i][0] = i;
-    }
-    for (size_t j = 0; j <= len2; j++) {
-        dp[0][j] = j;
+double normalized_compression_distance(double cx, double cy, double cxy) {
+    double larger = std::max(cx, cy);
+    if (larger <= 0.0) {
+        return 0.0;
     }
+    return (cxy - std::min(cx, cy)) / larger;
+}
 
-    // Fill DP table
-    for (size_t i = 1; i <= len1; i++) {
-        for (size_t j = 1; j <= len2; j++) {
-            if (s1[i-1] == s2[j-1]) {
-                dp[i][j] = dp[i-1][j-1];
-            } else {
-                dp[i][j] = 1 + std::min({
-                    dp[i-1][j],     // deletion
-                    dp[i][j-1],     // insertion
-                    dp[i-1][j-1]    // substitution
-                });
-            }
-        }
-    }
+double normalized_compression_distance(const std::string& x, const std::string& y, int quality, int window) {
+    std::string xy = x + y;
+    return normalized_compression_distance(
+        compressed_size(reinterpret_cast<const uint8_t*>(x.data()), x.size(), quality, window),
+        compressed_size(reinterpret_cast<const uint8_t*>(y.data()), y.size(), quality, window),
+        compressed_size(reinterpret_cast<const uint8_t*>(xy.data()), xy.size(), quality, window));
+}
 
-    // Normalize by the maximum length
-    size_t edit_distance = dp[len1][len2];
-    size_t max_len = std::max(len1, len2);
+double higher_order_entropy(const std::vector<uint8_t>& byte_string) {
+    return higher_order_entropy(byte_string.data(), byte_string.size());
+}
 
-    return static_cast<double>(edit_distance) / static_cast<double>(max_len);
+double higher_order_entropy(const uint8_t* data, size_t size) {
+    return shannon_entropy(data, size) - kolmogorov_complexity_estimate(data, size);
 }
 
-double higher_order_entropy(const std::vector<uint8_t>& byte_string) {
-    return shannon_entropy(byte_string) - kolmogorov_complexity_estimate(byte_string);
+#ifdef BFFPP_MATCH_AVX512
+__attribute__((target("avx512f,avx512bw")))
+static size_t matching_bytes_avx512(const uint8_t* a, const uint8_t* b, size_t size) {
+    size_t matches = 0;
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m512i va = _mm512_loadu_si512(a + i);
+        __m512i vb = _mm512_loadu_si512(b + i);
+        matches += __builtin_popcountll(_mm512_cmpeq_epi8_mask(va, vb));
+    }
+    if (i < size) {
+        __mmask64 tail = (~0ULL) >> (64 - (size - i));
+        __m512i va = _mm512_maskz_loadu_epi8(tail, a + i);
+        __m512i vb = _mm512_maskz_loadu_epi8(tail, b + i);
+        matches += __builtin_popcountll(_mm512_mask_cmpeq_epi8_mask(tail, va, vb));
+    }
+    return matches;
+}
+#endif
+
+size_t matching_bytes(const uint8_t* a, const uint8_t* b, size_t size) {
+#ifdef BFFPP_MATCH_AVX512
+    static const bool supported = __builtin_cpu_supports("avx512bw");
+    if (supported) {
+        return matching_bytes_avx512(a, b, size);
+    }
+#endif
+    size_t matches = 0;
+    for (size_t i = 0; i < size; i++) {
+        matches += (a[i] == b[i]) ? 1 : 0;
+    }
+    return matches;
 }
@@ -0,0 +1,185 @@
+#include "metrics_engine.h"
+#include "metrics.h"
+#include "thread_pool.h"
+#include <cmath>
+#include <mutex>
+#include <algorithm>
+#include <functional>
+
+void ByteHistogram::clear() {
+    counts.fill(0);
+    total = 0;
+}
+
+void ByteHistogram::add(const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        counts[data[i]]++;
+    }
+    total += size;
+}
+
+void ByteHistogram::merge(const ByteHistogram& other) {
+    for (int i = 0; i < 256; i++) {
+        counts[i] += other.counts[i];
+    }
+    total += other.total;
+}
+
+double ByteHistogram::shannon_entropy() const {
+    // Same arithmetic as shannon_entropy() so both give identical values
+    double entropy = 0.0;
+    size_t length = static_cast<size_t>(total);
+
+    for (int i = 0; i < 256; i++) {
+        if (counts[i] > 0) {
+            double frequency = static_cast<double>(counts[i]) / length;
+            entropy += frequency * std::log2(frequency);
+        }
+    }
+
+    return -entropy;
+}
+
+MetricsEngine::MetricsEngine(const MetricsOptions& options, ThreadPool* pool)
+    : options(options), pool(pool), initialized(false) {
+    if (this->options.shards < 1) {
+        this->options.shards = 1;
+    }
+}
+
+void MetricsEngine::reset(const uint8_t* data, size_t size) {
+    running.clear();
+    running.add(data, size);
+    initialized = true;
+}
+
+void MetricsEngine::update(const uint8_t* previous, const uint8_t* current, size_t size) {
+    if (!initialized) {
+        reset(current, size);
+        return;
+    }
+
+    // Only bytes that changed touch the histogram; counts stay exact
+    auto diff_range = [previous, current](size_t begin, size_t end, ByteHistogram& delta) {
+        for (size_t i = begin; i < end; i++) {
+            if (previous[i] != current[i]) {
+                delta.counts[previous[i]]--;
+                delta.counts[current[i]]++;
+            }
+        }
+    };
+
+    if (pool == nullptr || pool->size() == 1) {
+        ByteHistogram delta;
+        diff_range(0, size, delta);
+        running.merge(delta);
+        return;
+    }
+
+    std::mutex merge_mutex;
+    pool->parallel_for(size, 0, [&](size_t begin, size_t end) {
+        ByteHistogram delta;
+        diff_range(begin, end, delta);
+
+        std::lock_guard<std::mutex> lock(merge_mutex);
+        running.merge(delta);
+    });
+}
+
+double MetricsEngine::higher_order_entropy(const uint8_t* data, size_t size) const {
+    return higher_order_entropy(running, data, size);
+}
+
+double MetricsEngine::higher_order_entropy(const ByteHistogram& histogram, const uint8_t* data, size_t size) const {
+    return histogram.shannon_entropy() - kolmogorov_complexity_estimate(data, size);
+}
+
+double MetricsEngine::higher_order_entropy_of(const uint8_t* data, size_t size) const {
+    ByteHistogram histogram;
+    histogram.add(data, size);
+    return higher_order_entropy(histogram, data, size);
+}
+
+double MetricsEngine::kolmogorov_complexity_estimate(const uint8_t* data, size_t size) const {
+    size_t shards = std::min<size_t>(options.shards, std::max<size_t>(size, 1));
+    if (shards <= 1 && (!options.streaming || size == 0)) {
+        return ::kolmogorov_complexity_estimate(data, size, options.brotli_quality, options.brotli_window);
+    }
+
+    // Compress each shard independently and add up the compressed sizes
+    size_t shard_size = (size + shards - 1) / shards;
+    shards = (size + shard_size - 1) / shard_size;
+    std::vector<double> shard_bytes(shards, 0.0);
+
+    auto compress_shards = [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; s++) {
+            size_t offset = s * shard_size;
+            size_t length = std::min(shard_size, size - offset);
+            shard_bytes[s] = options.streaming
+                ? streamed_compressed_size(data + offset, length, options.brotli_quality, options.brotli_window)
+                : compressed_size(data + offset, length, options.brotli_quality, options.brotli_window);
+        }
+    };
+
+    if (pool != nullptr) {
+        pool->parallel_for(shards, 1, compress_shards);
+    } else {
+        compress_shards(0, shards);
+    }
+
+    double total = 0.0;
+    for (double bytes : shard_bytes) {
+        total += bytes;
+    }
+
+    return (total / size) * 8.0;
+}
+
+std::vector<double> MetricsEngine::distance_matrix(const std::vector<std::string>& rows,
+                                                   const std::vector<std::string>& columns,
+                                                   ProgramDistance kind) const {
+    auto compressed = [this](const std::string& program) {
+        return compressed_size(reinterpret_cast<const uint8_t*>(program.data()), program.size(),
+                               options.brotli_quality, options.brotli_window);
+    };
+    auto run = [this](size_t count, const std::function<void(size_t, size_t)>& fn) {
+        if (pool != nullptr) {
+            pool->parallel_for(count, 0, fn);
+        } else {
+            fn(0, count);
+        }
+    };
+
+    // Sizes of the programs on their own, shared by all their pairs
+    std::vector<double> row_sizes;
+    std::vector<double> column_sizes;
+    if (kind == ProgramDistance::Compression) {
+        row_sizes.resize(rows.size());
+        column_sizes.resize(columns.size());
+        run(rows.size() + columns.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                if (i < rows.size()) {
+                    row_sizes[i] = compressed(rows[i]);
+                } else {
+                    column_sizes[i - rows.size()] = compressed(columns[i - rows.size()]);
+                }
+            }
+        });
+    }
+
+    std::vector<double> distances(rows.size() * columns.size(), 0.0);
+    run(distances.size(), [&](size_t begin, size_t end) {
+        std::string joined;
+        for (size_t k = begin; k < end; k++) {
+            size_t i = k / columns.size();
+            size_t j = k % columns.size();
+            if (kind == ProgramDistance::Edit) {
+                distances[k] = normalized_edit_distance(rows[i], columns[j]);
+            } else {
+                joined.assign(rows[i]).append(columns[j]);
+                distances[k] = normalized_compression_distance(row_sizes[i], column_sizes[j], compressed(joined));
+            }
+        }
+    });
+    return distances;
+}
@@ -0,0 +1,50 @@
+#include "output_pipeline.h"
+#include <stdexcept>
+#include <utility>
+
+OutputBackpressure parse_output_backpressure(const std::string& name) {
+    if (name == "block") {
+        return OutputBackpressure::Block;
+    }
+    if (name == "drop_frames") {
+        return OutputBackpressure::DropFrames;
+    }
+    throw std::runtime_error("Unknown output backpressure policy: " + name);
+}
+
+OutputPipeline::OutputPipeline(unsigned int threads, size_t capacity, OutputBackpressure backpressure)
+    : backpressure(backpressure), dropped_frames(0) {
+    if (threads > 0) {
+        writer = std::make_unique<BackgroundWriter>(threads, capacity, "output");
+    }
+}
+
+void OutputPipeline::submit(std::function<void()> job) {
+    if (inline_jobs()) {
+        job();
+        return;
+    }
+    writer->submit(std::move(job));
+}
+
+bool OutputPipeline::submit_frame(std::function<void()> job) {
+    if (inline_jobs()) {
+        job();
+        return true;
+    }
+    if (backpressure == OutputBackpressure::Block) {
+        writer->submit(std::move(job));
+        return true;
+    }
+    if (!writer->try_submit(std::move(job))) {
+        dropped_frames++;
+        return false;
+    }
+    return true;
+}
+
+void OutputPipeline::flush() {
+    if (writer) {
+        writer->flush();
+    }
+}
@@ -0,0 +1,140 @@
+#include "pair_cache.h"
+#include "profiler.h"
+#include "rng.h"
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+
+static_assert(PairCache::SHARDS == 64, "shard_for() takes the top 6 bits of the key");
+
+PairCache::PairCache(size_t capacity, int max_iter)
+    : shard_capacity(std::max<size_t>(1, (capacity + SHARDS - 1) / SHARDS)), max_iterations(max_iter) {}
+
+uint64_t PairCache::hash_pair(const uint8_t* programA, const uint8_t* programB, int program_size) {
+    // 8 bytes at a time through the SplitMix64 finalizer, as
+    // ReplicatorCache::hash_program(), over both programs in turn
+    uint64_t h = CounterRng::mix(static_cast<uint64_t>(program_size) + 0x9E3779B97F4A7C15ULL);
+    for (const uint8_t* program : {programA, programB}) {
+        int i = 0;
+        for (; i + 8 <= program_size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, program + i, 8);
+            h = CounterRng::mix(h ^ word);
+        }
+
+        uint64_t tail = 0;
+        for (int shift = 0; i < program_size; i++, shift += 8) {
+            tail |= static_cast<uint64_t>(program[i]) << shift;
+        }
+        h = CounterRng::mix(h ^ tail);
+    }
+    return h;
+}
+
+bool PairCache::lookup(uint8_t* programA, uint8_t* programB, int program_size, EmulatorStats& stats) {
+    uint64_t key = hash_pair(programA, programB, program_size);
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.lookups++;
+
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        return false;
+    }
+    const Entry& entry = *it->second;
+    const uint8_t* tapes = entry.tapes.data();
+    if (entry.program_size != program_size || std::memcmp(tapes, programA, program_size) != 0 ||
+        std::memcmp(tapes + program_size, programB, program_size) != 0) {
+        return false;
+    }
+
+    std::memcpy(programA, tapes + 2 * program_size, program_size);
+    std::memcpy(programB, tapes + 3 * program_size, program_size);
+    stats = entry.stats;
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    shard.hits++;
+    profile_count(ProfileCounter::PairCacheHits);
+    return true;
+}
+
+void PairCache::add(const uint8_t* inputA, const uint8_t* inputB, const uint8_t* outputA, const uint8_t* outputB,
+                    int program_size, const EmulatorStats& stats) {
+    uint64_t key = hash_pair(inputA, inputB, program_size);
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Reuse the entry of the same key, else the least recently used one
+    // when the shard is full, else a new one
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    } else if (shard.entries.size() >= shard_capacity) {
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.splice(shard.entries.begin(), shard.entries, std::prev(shard.entries.end()));
+        shard.index[key] = shard.entries.begin();
+    } else {
+        shard.entries.emplace_front();
+        shard.index[key] = shard.entries.begin();
+    }
+
+    Entry& entry = shard.entries.front();
+    entry.key = key;
+    entry.program_size = program_size;
+    entry.stats = stats;
+    entry.tapes.resize(4 * static_cast<size_t>(program_size));
+    std::memcpy(entry.tapes.data(), inputA, program_size);
+    std::memcpy(entry.tapes.data() + program_size, inputB, program_size);
+    std::memcpy(entry.tapes.data() + 2 * program_size, outputA, program_size);
+    std::memcpy(entry.tapes.data() + 3 * program_size, outputB, program_size);
+}
+
+size_t PairCache::size() const {
+    size_t total = 0;
+    for (const Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.entries.size();
+    }
+    return total;
+}
+
+uint64_t PairCache::lookups() const {
+    uint64_t total = 0;
+    for (const Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.lookups;
+    }
+    return total;
+}
+
+uint64_t PairCache::hits() const {
+    uint64_t total = 0;
+    for (const Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.hits;
+    }
+    return total;
+}
+
+EmulatorStats emulate_pair_cached(
+    PairCache& cache,
+    uint8_t* programA,
+    uint8_t* programB,
+    int program_size,
+    EmulatorBackend backend,
+    bool detect_cycles
+) {
+    EmulatorStats stats;
+    if (cache.lookup(programA, programB, program_size, stats)) {
+        return stats;
+    }
+
+    // The inputs are overwritten in place; keep them for the entry
+    thread_local std::vector<uint8_t> inputs;
+    inputs.assign(programA, programA + program_size);
+    inputs.insert(inputs.end(), programB, programB + program_size);
+
+    stats = emulate_pair_in_place(programA, programB, program_size, 0, program_size, 0, cache.max_iter(),
+                                  backend, detect_cycles);
+    cache.add(inputs.data(), inputs.data() + program_size, programA, programB, program_size, stats);
+    return stats;
+}
@@ -0,0 +1,278 @@
+#include "pairing_engine.h"
+#include "rng.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <numeric>
+#include <cstdlib>
+#include <functional>
+
+PairingEngine::PairingEngine(int width, int height, int radius)
+    : width(width), height(height), radius(radius) {
+    // Same order as Grid::get_von_neumann_neighbors(), which the random
+    // choice of a neighbour depends on
+    for (int dy = -radius; dy <= radius; dy++) {
+        for (int dx = -radius; dx <= radius; dx++) {
+            int manhattan_dist = std::abs(dx) + std::abs(dy);
+            if (manhattan_dist == 0 || manhattan_dist > radius) {
+                continue;
+            }
+            offsets.push_back(Offset{dx, dy, dy * width + dx});
+        }
+    }
+}
+
+int PairingEngine::neighbors(int cell, int* out) const {
+    int x = cell % width;
+    int y = cell / width;
+    int count = 0;
+    for (const Offset& offset : offsets) {
+        int nx = x + offset.dx;
+        int ny = y + offset.dy;
+        if (nx >= 0 && nx < width && ny >= 0 && ny < height) {
+            out[count++] = cell + offset.delta;
+        }
+    }
+    return count;
+}
+
+int PairingEngine::available_neighbors(int cell, const uint8_t* taken_cells, int* out) const {
+    int x = cell % width;
+    int y = cell / width;
+    int count = 0;
+
+    // Away from the edges every offset is in bounds
+    if (x >= radius && x < width - radius && y >= radius && y < height - radius) {
+        for (const Offset& offset : offsets) {
+            int neighbor = cell + offset.delta;
+            if (!taken_cells[neighbor]) {
+                out[count++] = neighbor;
+            }
+        }
+        return count;
+    }
+
+    for (const Offset& offset : offsets) {
+        int nx = x + offset.dx;
+        int ny = y + offset.dy;
+        if (nx >= 0 && nx < width && ny >= 0 && ny < height && !taken_cells[cell + offset.delta]) {
+            out[count++] = cell + offset.delta;
+        }
+    }
+    return count;
+}
+
+std::vector<std::pair<int, int>> PairingEngine::pair(std::mt19937& rng) {
+    int total_cells = width * height;
+    std::vector<std::pair<int, int>> pairs;
+    pairs.reserve(total_cells);
+    taken.assign(total_cells, 0);
+
+    // Create a random order to visit cells
+    cell_order.resize(total_cells);
+    std::iota(cell_order.begin(), cell_order.end(), 0);
+    std::shuffle(cell_order.begin(), cell_order.end(), rng);
+
+    std::vector<int> available(offsets.size());
+    for (int cell_idx : cell_order) {
+        if (taken[cell_idx]) {
+            continue;
+        }
+
+        int count = available_neighbors(cell_idx, taken.data(), available.data());
+        if (count > 0) {
+            std::uniform_int_distribution<int> dist(0, count - 1);
+            int chosen_idx = available[dist(rng)];
+            taken[cell_idx] = 1;
+            taken[chosen_idx] = 1;
+            pairs.push_back({cell_idx, chosen_idx});
+        } else {
+            // No available neighbors - mark as mutation-only
+            taken[cell_idx] = 1;
+            pairs.push_back({-1, cell_idx});
+        }
+    }
+
+    return pairs;
+}
+
+std::vector<std::pair<int, int>> PairingEngine::pair(uint64_t seed, uint64_t epoch) {
+    int total_cells = width * height;
+    std::vector<std::pair<int, int>> pairs;
+    pairs.reserve(total_cells);
+    taken.assign(total_cells, 0);
+
+    // Visit cells in the order of a per-cell hash key, which needs no shared
+    // generator state (ties, if any, fall back to the cell index)
+    keyed_order.resize(total_cells);
+    for (int i = 0; i < total_cells; i++) {
+        keyed_order[i] = {CounterRng::hash(seed, RngDomain::PairingOrder, epoch, i), i};
+    }
+    std::sort(keyed_order.begin(), keyed_order.end());
+
+    std::vector<int> available(offsets.size());
+    for (const auto& entry : keyed_order) {
+        int cell_idx = entry.second;
+        if (taken[cell_idx]) {
+            continue;
+        }
+
+        int count = available_neighbors(cell_idx, taken.data(), available.data());
+        if (count > 0) {
+            CounterRng choice_rng(seed, RngDomain::PairingChoice, epoch, cell_idx);
+            int chosen_idx = available[choice_rng.next_below(count)];
+            taken[cell_idx] = 1;
+            taken[chosen_idx] = 1;
+            pairs.push_back({cell_idx, chosen_idx});
+        } else {
+            taken[cell_idx] = 1;
+            pairs.push_back({-1, cell_idx});
+        }
+    }
+
+    return pairs;
+}
+
+void PairingEngine::order_tile(Tile& tile, uint64_t seed, uint64_t epoch) {
+    tile.order.clear();
+    for (int y = tile.y0; y < tile.y1; y++) {
+        for (int x = tile.x0; x < tile.x1; x++) {
+            int cell = y * width + x;
+            tile.order.push_back({CounterRng::hash(seed, RngDomain::PairingOrder, epoch, cell), cell});
+        }
+    }
+    std::sort(tile.order.begin(), tile.order.end());
+    tile.next = 0;
+    tile.pairs.clear();
+}
+
+void PairingEngine::pair_tile(Tile& tile, uint64_t last_key, uint64_t seed, uint64_t epoch) {
+    thread_local std::vector<int> available;
+    available.resize(offsets.size());
+
+    for (; tile.next < tile.order.size() && tile.order[tile.next].first <= last_key; tile.next++) {
+        int cell_idx = tile.order[tile.next].second;
+        if (taken[cell_idx]) {
+            continue;
+        }
+
+        int count = available_neighbors(cell_idx, taken.data(), available.data());
+        if (count > 0) {
+            CounterRng choice_rng(seed, RngDomain::PairingChoice, epoch, cell_idx);
+            int chosen_idx = available[choice_rng.next_below(count)];
+            taken[cell_idx] = 1;
+            taken[chosen_idx] = 1;
+            tile.pairs.push_back({cell_idx, chosen_idx});
+        } else {
+            taken[cell_idx] = 1;
+            tile.pairs.push_back({-1, cell_idx});
+        }
+    }
+}
+
+std::vector<std::pair<int, int>> PairingEngine::pair_tiled(uint64_t seed, uint64_t epoch, ThreadPool* pool) {
+    // Same-colour tiles have a whole tile between them, which has to cover
+    // both of their neighbourhood reaches
+    const int tile_size = std::max(TILE_SIZE, 2 * radius);
+    taken.assign(width * height, 0);
+
+    auto for_each = [pool](size_t count, const std::function<void(size_t, size_t)>& fn) {
+        if (pool) {
+            pool->parallel_for(count, 0, fn);
+        } else {
+            fn(0, count);
+        }
+    };
+
+    // Shift the tiling every epoch, so no seam stays in place
+    CounterRng tiling_rng(seed, RngDomain::PairingTiles, epoch, 0);
+    int origin_x = static_cast<int>(tiling_rng.next_below(tile_size));
+    int origin_y = static_cast<int>(tiling_rng.next_below(tile_size));
+    int tiles_x = (width + origin_x + tile_size - 1) / tile_size;
+    int tiles_y = (height + origin_y + tile_size - 1) / tile_size;
+
+    tiles.resize(static_cast<size_t>(tiles_x) * tiles_y);
+    for_each(tiles.size(), [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+            int tx = static_cast<int>(t) % tiles_x;
+            int ty = static_cast<int>(t) / tiles_x;
+            tiles[t].x0 = std::max(0, tx * tile_size - origin_x);
+            tiles[t].y0 = std::max(0, ty * tile_size - origin_y);
+            tiles[t].x1 = std::min(width, (tx + 1) * tile_size - origin_x);
+            tiles[t].y1 = std::min(height, (ty + 1) * tile_size - origin_y);
+            order_tile(tiles[t], seed, epoch);
+        }
+    });
+
+    std::vector<int> tiles_of_colour[4];
+    for (int t = 0; t < static_cast<int>(tiles.size()); t++) {
+        int colour = ((t / tiles_x) & 1) * 2 + ((t % tiles_x) & 1);
+        tiles_of_colour[colour].push_back(t);
+    }
+
+    // The key range is split into slices; each slice visits the colours in
+    // a fresh random order, and a tile only pairs its cells whose keys fall
+    // into the slice. More slices interleave neighbouring tiles more finely
+    // and keep the matching closer to the sequential pass.
+    for (int slice = 0; slice < KEY_SLICES; slice++) {
+        uint64_t last_key = (slice == KEY_SLICES - 1) ? ~0ULL : (~0ULL / KEY_SLICES) * (slice + 1);
+
+        int colours[4] = {0, 1, 2, 3};
+        for (int i = 3; i > 0; i--) {
+            std::swap(colours[i], colours[tiling_rng.next_below(i + 1)]);
+        }
+
+        for (int colour : colours) {
+            const std::vector<int>& same_colour = tiles_of_colour[colour];
+            for_each(same_colour.size(), [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    pair_tile(tiles[same_colour[i]], last_key, seed, epoch);
+                }
+            });
+        }
+    }
+
+    // Tiles in row-major order, independent of which thread ran them
+    std::vector<std::pair<int, int>> pairs;
+    pairs.reserve(width * height);
+    for (const Tile& tile : tiles) {
+        pairs.insert(pairs.end(), tile.pairs.begin(), tile.pairs.end());
+    }
+    return pairs;
+}
+
+std::vector<size_t> row_bands(int width, int height, int bands) {
+    std::vector<size_t> bounds;
+    for (int band = 0; band <= bands; band++) {
+        bounds.push_back(static_cast<size_t>(height * band / bands) * width);
+    }
+    return bounds;
+}
+
+std::vector<size_t> group_pairs_by_band(std::vector<std::pair<int, int>>& pairs, const std::vector<size_t>& bands) {
+    size_t num_bands = bands.size() - 1;
+    auto band_of = [&](int cell) {
+        return static_cast<size_t>(std::upper_bound(bands.begin(), bands.end(), static_cast<size_t>(cell)) -
+                                   bands.begin()) - 1;
+    };
+
+    // Counting sort: band of each pair (num_bands for straddling ones), then positions
+    std::vector<size_t> pair_band(pairs.size());
+    std::vector<size_t> bounds(num_bands + 2, 0);
+    for (size_t i = 0; i < pairs.size(); i++) {
+        size_t band = band_of(pairs[i].second);
+        if (pairs[i].first != -1 && band_of(pairs[i].first) != band) {
+            band = num_bands;
+        }
+        pair_band[i] = band;
+        bounds[band + 1]++;
+    }
+    std::partial_sum(bounds.begin(), bounds.end(), bounds.begin());
+
+    std::vector<size_t> next(bounds.begin(), bounds.end() - 1);
+    std::vector<std::pair<int, int>> grouped(pairs.size());
+    for (size_t i = 0; i < pairs.size(); i++) {
+        grouped[next[pair_band[i]]++] = pairs[i];
+    }
+    pairs.swap(grouped);
+    return bounds;
+}
@@ -0,0 +1,211 @@
+#include "profiler.h"
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+const char* const PHASE_NAMES[PROFILE_PHASES] = {
+    "pairing", "emulation", "mutation", "metrics", "output", "broadcast"
+};
+
+const char* const COUNTER_NAMES[PROFILE_COUNTERS] = {
+    "pairs", "pair_cache_hits", "mutation_only", "instructions", "skipped", "cycle_exits", "jumps",
+    "jump_distance", "bracket_rebuilds", "bracket_scan_bytes", "bytes_written", "websocket_bytes"
+};
+
+const char* const OPCODE_NAMES[PROFILE_OPCODES] = {
+    "noop", "<", ">", "{", "}", "-", "+", ".", ",", "[", "]"
+};
+
+// Opcode names that are safe in a CSV header
+const char* const OPCODE_COLUMNS[PROFILE_OPCODES] = {
+    "noop", "head0_left", "head0_right", "head1_left", "head1_right", "decrement", "increment",
+    "copy_to_head1", "copy_from_head1", "open", "close"
+};
+
+// Opcode names as JSON keys and Prometheus label values
+std::string quoted_opcode(int slot) {
+    return std::string("\"") + OPCODE_NAMES[slot] + "\"";
+}
+
+double per_second(uint64_t count, double seconds) {
+    return seconds > 0 ? static_cast<double>(count) / seconds : 0.0;
+}
+
+} // namespace
+
+const char* profile_phase_name(ProfilePhase phase) {
+    return PHASE_NAMES[static_cast<int>(phase)];
+}
+
+const char* profile_counter_name(ProfileCounter counter) {
+    return COUNTER_NAMES[static_cast<int>(counter)];
+}
+
+const char* profile_opcode_name(int slot) {
+    return OPCODE_NAMES[slot];
+}
+
+ProfileSample ProfileSample::operator-(const ProfileSample& earlier) const {
+    ProfileSample difference;
+    for (int i = 0; i < PROFILE_COUNTERS; i++) {
+        difference.counters[i] = counters[i] - earlier.counters[i];
+    }
+    for (int i = 0; i < PROFILE_OPCODES; i++) {
+        difference.opcodes[i] = opcodes[i] - earlier.opcodes[i];
+    }
+    return difference;
+}
+
+ProfileSample profile_totals() {
+    ProfileSample totals;
+    std::lock_guard<std::mutex> lock(profiler_detail::blocks_mutex);
+    for (const auto& block : profiler_detail::blocks) {
+        for (int i = 0; i < PROFILE_COUNTERS; i++) {
+            totals.counters[i] += block->counters[i].load(std::memory_order_relaxed);
+        }
+        for (int i = 0; i < PROFILE_OPCODES; i++) {
+            totals.opcodes[i] += block->opcodes[i].load(std::memory_order_relaxed);
+        }
+    }
+    return totals;
+}
+
+std::string EpochProfile::stats_line() const {
+    double epochs_in = epochs > 0 ? static_cast<double>(epochs) : 1.0;
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(1);
+    line << "Profile epoch " << epoch << " (" << epochs << " epochs): "
+         << wall_seconds * 1000.0 / epochs_in << " ms/epoch |";
+    for (int i = 0; i < PROFILE_PHASES; i++) {
+        line << " " << PHASE_NAMES[i] << " " << phase_seconds[i] * 1000.0 / epochs_in << " ms";
+    }
+    double emulation = phase_seconds[static_cast<int>(ProfilePhase::Emulation)];
+    line << std::setprecision(2)
+         << " | " << per_second(counts.get(ProfileCounter::Pairs), emulation) / 1e6 << " M pairs/s"
+         << " " << per_second(counts.get(ProfileCounter::Instructions), emulation) / 1e6 << " M instr/s"
+         << " | " << counts.get(ProfileCounter::Jumps) << " jumps, "
+         << counts.get(ProfileCounter::BracketRebuilds) << " bracket rebuilds"
+         << " | " << counts.get(ProfileCounter::BytesWritten) << " B written, "
+         << counts.get(ProfileCounter::WebSocketBytes) << " B sent";
+    return line.str();
+}
+
+std::string EpochProfile::to_json() const {
+    std::ostringstream json;
+    json << std::setprecision(9);
+    json << "{\"type\":\"profile\",\"epoch\":" << epoch << ",\"epochs\":" << epochs
+         << ",\"wall_seconds\":" << wall_seconds << ",\"phase_seconds\":{";
+    for (int i = 0; i < PROFILE_PHASES; i++) {
+        json << (i ? "," : "") << "\"" << PHASE_NAMES[i] << "\":" << phase_seconds[i];
+    }
+    json << "},\"counters\":{";
+    for (int i = 0; i < PROFILE_COUNTERS; i++) {
+        json << (i ? "," : "") << "\"" << COUNTER_NAMES[i] << "\":" << counts.counters[i];
+    }
+    json << "},\"opcodes\":{";
+    for (int i = 0; i < PROFILE_OPCODES; i++) {
+        json << (i ? "," : "") << quoted_opcode(i) << ":" << counts.opcodes[i];
+    }
+    json << "}}";
+    return json.str();
+}
+
+std::string EpochProfile::csv_header() {
+    std::ostringstream header;
+    header << "epoch,epochs,wall_seconds";
+    for (const char* name : PHASE_NAMES) {
+        header << "," << name << "_seconds";
+    }
+    for (const char* name : COUNTER_NAMES) {
+        header << "," << name;
+    }
+    for (const char* name : OPCODE_COLUMNS) {
+        header << ",op_" << name;
+    }
+    return header.str();
+}
+
+std::string EpochProfile::csv_row() const {
+    std::ostringstream row;
+    row << std::setprecision(9);
+    row << epoch << "," << epochs << "," << wall_seconds;
+    for (double seconds : phase_seconds) {
+        row << "," << seconds;
+    }
+    for (uint64_t count : counts.counters) {
+        row << "," << count;
+    }
+    for (uint64_t count : counts.opcodes) {
+        row << "," << count;
+    }
+    return row.str();
+}
+
+EpochProfiler::EpochProfiler()
+    : in_epoch(false), interval_start(profile_totals()), total_epochs(0), last_epoch(0),
+      total_wall_seconds(0.0), total_phase_seconds() {}
+
+void EpochProfiler::begin_epoch() {
+    epoch_start = std::chrono::steady_clock::now();
+    in_epoch = true;
+}
+
+void EpochProfiler::add_time(ProfilePhase phase, double seconds) {
+    interval.phase_seconds[static_cast<int>(phase)] += seconds;
+    total_phase_seconds[static_cast<int>(phase)] += seconds;
+}
+
+void EpochProfiler::end_epoch(int64_t epoch) {
+    if (!in_epoch) {
+        return;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch_start).count();
+    in_epoch = false;
+    interval.wall_seconds += seconds;
+    interval.epoch = epoch;
+    interval.epochs++;
+    total_wall_seconds += seconds;
+    total_epochs++;
+    last_epoch = epoch;
+}
+
+EpochProfile EpochProfiler::take_interval() {
+    ProfileSample now = profile_totals();
+    EpochProfile finished = interval;
+    finished.counts = now - interval_start;
+    interval = EpochProfile();
+    interval_start = now;
+    return finished;
+}
+
+std::string EpochProfiler::prometheus() const {
+    ProfileSample totals = profile_totals();
+    std::ostringstream text;
+    text << std::setprecision(9);
+
+    text << "# HELP bffpp_epoch Last epoch completed.\n# TYPE bffpp_epoch gauge\n"
+         << "bffpp_epoch " << last_epoch << "\n";
+    text << "# HELP bffpp_epochs_total Epochs profiled.\n# TYPE bffpp_epochs_total counter\n"
+         << "bffpp_epochs_total " << total_epochs << "\n";
+    text << "# HELP bffpp_epoch_seconds_total Wall time of the profiled epochs.\n"
+         << "# TYPE bffpp_epoch_seconds_total counter\n"
+         << "bffpp_epoch_seconds_total " << total_wall_seconds << "\n";
+
+    text << "# HELP bffpp_phase_seconds_total Time spent in each phase of an epoch.\n"
+         << "# TYPE bffpp_phase_seconds_total counter\n";
+    for (int i = 0; i < PROFILE_PHASES; i++) {
+        text << "bffpp_phase_seconds_total{phase=\"" << PHASE_NAMES[i] << "\"} " << total_phase_seconds[i] << "\n";
+    }
+
+    for (int i = 0; i < PROFILE_COUNTERS; i++) {
+        text << "# TYPE bffpp_" << COUNTER_NAMES[i] << "_total counter\n"
+             << "bffpp_" << COUNTER_NAMES[i] << "_total " << totals.counters[i] << "\n";
+    }
+
+    text << "# HELP bffpp_opcodes_total Emulator steps by opcode.\n# TYPE bffpp_opcodes_total counter\n";
+    for (int i = 0; i < PROFILE_OPCODES; i++) {
+        text << "bffpp_opcodes_total{opcode=" << quoted_opcode(i) << "} " << totals.opcodes[i] << "\n";
+    }
+    return text.str();
+}
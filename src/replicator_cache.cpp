@@ -0,0 +1,136 @@
+#include "replicator_cache.h"
+#include "byte_order.h"
+#include "rng.h"
+#include <fstream>
+#include <vector>
+#include <mutex>
+#include <cstring>
+#include <cstdio>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+using namespace byte_order;
+
+constexpr char CACHE_MAGIC[4] = {'B', 'F', 'R', 'C'};
+constexpr uint32_t CACHE_VERSION = 1;
+constexpr size_t CACHE_HEADER_SIZE = 24;
+constexpr size_t CACHE_ENTRY_SIZE = 9;  // 64-bit key + one result byte
+
+static_assert(ReplicatorCache::SHARDS == 64, "shard_for() takes the top 6 bits of the key");
+
+} // namespace
+
+uint64_t ReplicatorCache::hash_program(const std::string& program) {
+    // 8 bytes at a time through the SplitMix64 finalizer, seeded with the length
+    uint64_t h = CounterRng::mix(program.size() + 0x9E3779B97F4A7C15ULL);
+    size_t i = 0;
+    for (; i + 8 <= program.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, program.data() + i, 8);
+        h = CounterRng::mix(h ^ word);
+    }
+
+    uint64_t tail = 0;
+    for (size_t shift = 0; i < program.size(); i++, shift += 8) {
+        tail |= static_cast<uint64_t>(static_cast<uint8_t>(program[i])) << shift;
+    }
+    return CounterRng::mix(h ^ tail);
+}
+
+bool ReplicatorCache::lookup(const std::string& program, bool& is_replicator) const {
+    return lookup(hash_program(program), is_replicator);
+}
+
+bool ReplicatorCache::lookup(uint64_t key, bool& is_replicator) const {
+    const Shard& shard = shard_for(key);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end()) {
+        return false;
+    }
+    is_replicator = it->second;
+    return true;
+}
+
+void ReplicatorCache::add(const std::string& program, bool is_replicator) {
+    add(hash_program(program), is_replicator);
+}
+
+void ReplicatorCache::add(uint64_t key, bool is_replicator) {
+    Shard& shard = shard_for(key);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    shard.entries[key] = is_replicator;
+}
+
+size_t ReplicatorCache::size() const {
+    size_t total = 0;
+    for (const Shard& shard : shards) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        total += shard.entries.size();
+    }
+    return total;
+}
+
+size_t ReplicatorCache::load(const std::string& filepath, uint32_t tag) {
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        return 0;
+    }
+
+    std::vector<uint8_t> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (contents.size() < CACHE_HEADER_SIZE || std::memcmp(contents.data(), CACHE_MAGIC, 4) != 0) {
+        return 0;
+    }
+
+    uint64_t header = get_u64(contents.data() + 4);
+    uint32_t version = static_cast<uint32_t>(header);
+    uint32_t saved_tag = static_cast<uint32_t>(header >> 32);
+    uint64_t count = get_u64(contents.data() + 16);
+    if (version != CACHE_VERSION || saved_tag != tag ||
+        contents.size() != CACHE_HEADER_SIZE + count * CACHE_ENTRY_SIZE) {
+        return 0;
+    }
+
+    const uint8_t* entry = contents.data() + CACHE_HEADER_SIZE;
+    for (uint64_t i = 0; i < count; i++, entry += CACHE_ENTRY_SIZE) {
+        add(get_u64(entry), entry[8] != 0);
+    }
+    return static_cast<size_t>(count);
+}
+
+void ReplicatorCache::save(const std::string& filepath, uint32_t tag) const {
+    std::vector<uint8_t> contents(CACHE_HEADER_SIZE);
+    std::memcpy(contents.data(), CACHE_MAGIC, 4);
+    put_u64(contents.data() + 4, CACHE_VERSION | (static_cast<uint64_t>(tag) << 32));
+
+    uint64_t count = 0;
+    for (const Shard& shard : shards) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        for (const auto& [key, is_replicator] : shard.entries) {
+            uint8_t entry[CACHE_ENTRY_SIZE];
+            put_u64(entry, key);
+            entry[8] = is_replicator ? 1 : 0;
+            contents.insert(contents.end(), entry, entry + CACHE_ENTRY_SIZE);
+            count++;
+        }
+    }
+    put_u64(contents.data() + 16, count);
+
+    std::string temp_path = filepath + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Could not open cache file: " + temp_path);
+        }
+        file.write(reinterpret_cast<const char*>(contents.data()), contents.size());
+        if (!file) {
+            throw std::runtime_error("Failed to write cache file: " + temp_path);
+        }
+    }
+
+    if (std::rename(temp_path.c_str(), filepath.c_str()) != 0) {
+        throw std::runtime_error("Could not replace cache file: " + filepath);
+    }
+}
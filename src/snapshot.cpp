@@ -0,0 +1,247 @@
+#include "snapshot.h"
+#include "byte_order.h"
+#include "profiler.h"
+#include <brotli/encode.h>
+#include <brotli/decode.h>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <iterator>
+
+namespace {
+
+using namespace byte_order;
+
+// Snapshots are written often, so favour speed over ratio
+const int SNAPSHOT_BROTLI_QUALITY = 4;
+
+size_t padded(size_t size) {
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+void write_block(std::ofstream& file, SnapshotBlockType type, SnapshotCodec codec,
+                 const void* data, size_t size) {
+    const uint8_t* payload = static_cast<const uint8_t*>(data);
+    std::vector<uint8_t> compressed;
+
+    if (codec == SnapshotCodec::Brotli && size > 0) {
+        size_t encoded_size = BrotliEncoderMaxCompressedSize(size);
+        compressed.resize(encoded_size);
+        if (!BrotliEncoderCompress(SNAPSHOT_BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC,
+                                   size, payload, &encoded_size, compressed.data())) {
+            throw std::runtime_error("Brotli compression of a snapshot block failed");
+        }
+        compressed.resize(encoded_size);
+        payload = compressed.data();
+    } else {
+        codec = SnapshotCodec::Raw;
+    }
+
+    size_t stored_size = (codec == SnapshotCodec::Raw) ? size : compressed.size();
+
+    uint8_t block_header[SNAPSHOT_BLOCK_HEADER_SIZE] = {};
+    put_u32(block_header + 0, static_cast<uint32_t>(type));
+    put_u32(block_header + 4, static_cast<uint32_t>(codec));
+    put_u64(block_header + 8, size);
+    put_u64(block_header + 16, stored_size);
+    file.write(reinterpret_cast<const char*>(block_header), sizeof(block_header));
+
+    file.write(reinterpret_cast<const char*>(payload), stored_size);
+
+    static const char zeros[8] = {};
+    file.write(zeros, padded(stored_size) - stored_size);
+}
+
+// Copy (or decompress) a block payload into out, which has the raw size
+void read_block(const uint8_t* payload, size_t stored_size, SnapshotCodec codec,
+                uint8_t* out, size_t raw_size, const std::string& name) {
+    if (codec == SnapshotCodec::Raw) {
+        if (stored_size != raw_size) {
+            throw std::runtime_error("Corrupt snapshot block in " + name);
+        }
+        std::memcpy(out, payload, raw_size);
+        return;
+    }
+
+    if (codec != SnapshotCodec::Brotli) {
+        throw std::runtime_error("Unknown snapshot block codec in " + name);
+    }
+
+    size_t decoded_size = raw_size;
+    if (BrotliDecoderDecompress(stored_size, payload, &decoded_size, out) != BROTLI_DECODER_RESULT_SUCCESS ||
+        decoded_size != raw_size) {
+        throw std::runtime_error("Could not decompress snapshot block in " + name);
+    }
+}
+
+} // namespace
+
+std::vector<int32_t> pairing_index(const std::vector<std::pair<int, int>>& pairs, int total_programs) {
+    std::vector<int32_t> partners(total_programs, -1);
+    for (const auto& pair : pairs) {
+        if (pair.first != -1) {
+            partners[pair.first] = pair.second;
+            partners[pair.second] = pair.first;
+        }
+    }
+    return partners;
+}
+
+void write_snapshot(const std::string& filepath, const Snapshot& snapshot, SnapshotCodec codec) {
+    size_t cells = static_cast<size_t>(snapshot.total_programs()) * snapshot.program_size;
+    bool tokens = snapshot.kind == SnapshotKind::Tokens;
+
+    if ((tokens ? snapshot.tokens.size() : snapshot.bytes.size()) != cells) {
+        throw std::runtime_error("Snapshot programs do not match the grid size: " + filepath);
+    }
+    if (!snapshot.partners.empty() && snapshot.partners.size() != static_cast<size_t>(snapshot.total_programs())) {
+        throw std::runtime_error("Snapshot pairing does not match the grid size: " + filepath);
+    }
+
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open snapshot file: " + filepath);
+    }
+
+    uint32_t num_blocks = snapshot.partners.empty() ? 1 : 2;
+
+    uint8_t header[SNAPSHOT_HEADER_SIZE] = {};
+    std::memcpy(header, SNAPSHOT_MAGIC, 4);
+    put_u32(header + 4, SNAPSHOT_VERSION);
+    put_u32(header + 8, static_cast<uint32_t>(snapshot.kind));
+    put_u32(header + 12, num_blocks);
+    put_u64(header + 16, static_cast<uint64_t>(snapshot.epoch));
+    put_u32(header + 24, static_cast<uint32_t>(snapshot.width));
+    put_u32(header + 28, static_cast<uint32_t>(snapshot.height));
+    put_u32(header + 32, static_cast<uint32_t>(snapshot.program_size));
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    if (tokens) {
+        write_block(file, SnapshotBlockType::Tokens, codec, snapshot.tokens.data(), cells * sizeof(uint64_t));
+    } else {
+        write_block(file, SnapshotBlockType::Programs, codec, snapshot.bytes.data(), cells);
+    }
+
+    if (!snapshot.partners.empty()) {
+        write_block(file, SnapshotBlockType::Pairing, codec, snapshot.partners.data(),
+                    snapshot.partners.size() * sizeof(int32_t));
+    }
+
+    if (!file) {
+        throw std::runtime_error("Failed to write snapshot file: " + filepath);
+    }
+    profile_count(ProfileCounter::BytesWritten, static_cast<uint64_t>(file.tellp()));
+}
+
+Snapshot parse_snapshot(const uint8_t* data, size_t size, const std::string& name) {
+    if (!host_is_little_endian()) {
+        throw std::runtime_error("Snapshots can only be read on little-endian hosts: " + name);
+    }
+    if (size < SNAPSHOT_HEADER_SIZE || std::memcmp(data, SNAPSHOT_MAGIC, 4) != 0) {
+        throw std::runtime_error("Not a snapshot file: " + name);
+    }
+    if (get_u32(data + 4) != SNAPSHOT_VERSION) {
+        throw std::runtime_error("Unsupported snapshot version in " + name);
+    }
+
+    Snapshot snapshot;
+    snapshot.kind = static_cast<SnapshotKind>(get_u32(data + 8));
+    uint32_t num_blocks = get_u32(data + 12);
+    snapshot.epoch = static_cast<int64_t>(get_u64(data + 16));
+    snapshot.width = static_cast<int>(get_u32(data + 24));
+    snapshot.height = static_cast<int>(get_u32(data + 28));
+    snapshot.program_size = static_cast<int>(get_u32(data + 32));
+
+    if (snapshot.kind != SnapshotKind::Programs && snapshot.kind != SnapshotKind::Tokens) {
+        throw std::runtime_error("Unknown snapshot kind in " + name);
+    }
+
+    size_t cells = static_cast<size_t>(snapshot.total_programs()) * snapshot.program_size;
+    size_t offset = SNAPSHOT_HEADER_SIZE;
+
+    for (uint32_t b = 0; b < num_blocks; b++) {
+        if (offset + SNAPSHOT_BLOCK_HEADER_SIZE > size) {
+            throw std::runtime_error("Truncated snapshot file: " + name);
+        }
+
+        const uint8_t* block_header = data + offset;
+        SnapshotBlockType type = static_cast<SnapshotBlockType>(get_u32(block_header));
+        SnapshotCodec codec = static_cast<SnapshotCodec>(get_u32(block_header + 4));
+        size_t raw_size = get_u64(block_header + 8);
+        size_t stored_size = get_u64(block_header + 16);
+        offset += SNAPSHOT_BLOCK_HEADER_SIZE;
+
+        if (stored_size > size - offset) {
+            throw std::runtime_error("Truncated snapshot file: " + name);
+        }
+        const uint8_t* payload = data + offset;
+
+        if (type == SnapshotBlockType::Programs) {
+            if (raw_size != cells) {
+                throw std::runtime_error("Snapshot programs do not match the grid size in " + name);
+            }
+            snapshot.bytes.resize(cells);
+            read_block(payload, stored_size, codec, snapshot.bytes.data(), raw_size, name);
+        } else if (type == SnapshotBlockType::Tokens) {
+            if (raw_size != cells * sizeof(uint64_t)) {
+                throw std::runtime_error("Snapshot tokens do not match the grid size in " + name);
+            }
+            snapshot.tokens.resize(cells);
+            read_block(payload, stored_size, codec, reinterpret_cast<uint8_t*>(snapshot.tokens.data()),
+                       raw_size, name);
+        } else if (type == SnapshotBlockType::Pairing) {
+            if (raw_size != static_cast<size_t>(snapshot.total_programs()) * sizeof(int32_t)) {
+                throw std::runtime_error("Snapshot pairing does not match the grid size in " + name);
+            }
+            snapshot.partners.resize(snapshot.total_programs());
+            read_block(payload, stored_size, codec, reinterpret_cast<uint8_t*>(snapshot.partners.data()),
+                       raw_size, name);
+        }
+        // Unknown block types are skipped, so newer writers stay readable
+
+        offset += padded(stored_size);
+    }
+
+    bool tokens = snapshot.kind == SnapshotKind::Tokens;
+    if ((tokens ? snapshot.tokens.size() : snapshot.bytes.size()) != cells) {
+        throw std::runtime_error("Snapshot has no programs block: " + name);
+    }
+
+    return snapshot;
+}
+
+Snapshot read_snapshot(const std::string& filepath) {
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file: " + filepath);
+    }
+
+    std::vector<uint8_t> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return parse_snapshot(contents.data(), contents.size(), filepath);
+}
+
+bool is_snapshot_file(const std::string& filepath) {
+    std::ifstream file(filepath, std::ios::binary);
+    char magic[4] = {};
+    if (!file.read(magic, 4)) {
+        return false;
+    }
+    return std::memcmp(magic, SNAPSHOT_MAGIC, 4) == 0;
+}
+
+SnapshotCodec parse_snapshot_codec(const std::string& name) {
+    if (name == "raw" || name == "none") {
+        return SnapshotCodec::Raw;
+    }
+    if (name == "brotli") {
+        return SnapshotCodec::Brotli;
+    }
+    throw std::runtime_error("Unknown snapshot compression: " + name);
+}
+
+SnapshotWriter::SnapshotWriter(SnapshotCodec codec, size_t max_pending)
+    : codec(codec), writer(1, max_pending, "snapshot") {}
+
+void SnapshotWriter::submit(const std::string& filepath, Snapshot snapshot) {
+    writer.submit([this, filepath, snapshot = std::move(snapshot)] { write_snapshot(filepath, snapshot, codec); });
+}
@@ -0,0 +1,71 @@
+#include "strip_exchange_mpi.h"
+#include <stdexcept>
+#include <string>
+#include <limits>
+
+namespace {
+
+void check(int err, const char* what) {
+    if (err != MPI_SUCCESS) {
+        char message[MPI_MAX_ERROR_STRING];
+        int length = 0;
+        MPI_Error_string(err, message, &length);
+        throw std::runtime_error(std::string(what) + ": " + std::string(message, length));
+    }
+}
+
+// MPI counts are ints
+int count_of(size_t bytes) {
+    if (bytes > static_cast<size_t>(std::numeric_limits<int>::max())) {
+        throw std::runtime_error("MPI message of " + std::to_string(bytes) + " bytes is too large");
+    }
+    return static_cast<int>(bytes);
+}
+
+} // namespace
+
+MpiStripExchange::MpiStripExchange(MPI_Comm comm) : comm(comm) {
+    check(MPI_Comm_rank(comm, &comm_rank), "MPI_Comm_rank failed");
+    check(MPI_Comm_size(comm, &comm_size), "MPI_Comm_size failed");
+}
+
+void MpiStripExchange::exchange_rows(const uint8_t* to_up, uint8_t* from_up, size_t up_bytes,
+                                     const uint8_t* to_down, uint8_t* from_down, size_t down_bytes) {
+    const int UPWARD = 1;
+    const int DOWNWARD = 2;
+    int up = (up_bytes > 0) ? comm_rank - 1 : MPI_PROC_NULL;
+    int down = (down_bytes > 0) ? comm_rank + 1 : MPI_PROC_NULL;
+
+    // Upward: ours to the rank above, the one below's to us; then downward
+    check(MPI_Sendrecv(to_up, count_of(up_bytes), MPI_BYTE, up, UPWARD,
+                       from_down, count_of(down_bytes), MPI_BYTE, down, UPWARD, comm, MPI_STATUS_IGNORE),
+          "Margin exchange failed");
+    check(MPI_Sendrecv(to_down, count_of(down_bytes), MPI_BYTE, down, DOWNWARD,
+                       from_up, count_of(up_bytes), MPI_BYTE, up, DOWNWARD, comm, MPI_STATUS_IGNORE),
+          "Margin exchange failed");
+}
+
+void MpiStripExchange::sum(int64_t* values, int count) {
+    check(MPI_Allreduce(MPI_IN_PLACE, values, count, MPI_INT64_T, MPI_SUM, comm), "Reduction failed");
+}
+
+void MpiStripExchange::sum(double* values, int count) {
+    check(MPI_Allreduce(MPI_IN_PLACE, values, count, MPI_DOUBLE, MPI_SUM, comm), "Reduction failed");
+}
+
+void MpiStripExchange::gather(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    int count = count_of(size);
+    std::vector<int> counts(comm_rank == 0 ? comm_size : 0);
+    check(MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, comm), "Gather failed");
+
+    std::vector<int> offsets(counts.size());
+    size_t total = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        offsets[i] = count_of(total);
+        total += counts[i];
+    }
+    out.resize(total);
+
+    check(MPI_Gatherv(data, count, MPI_BYTE, out.data(), counts.data(), offsets.data(), MPI_BYTE, 0, comm),
+          "Gather failed");
+}
@@ -0,0 +1,355 @@
+#include "strip_grid.h"
+#include "gpu_epoch.h"
+#include "metrics_engine.h"
+#include "thread_pool.h"
+#include "utils.h"
+#include "rng.h"
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <mutex>
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+constexpr int RADIUS = gpu_epoch::PAIRING_RADIUS;
+
+// Rows of pairing state that a ready check can read beyond the strip
+constexpr int PAIRING_MARGIN = 2 * RADIUS;
+
+void for_each(ThreadPool* pool, size_t count, const std::function<void(size_t, size_t)>& fn) {
+    if (pool) {
+        pool->parallel_for(count, 0, fn);
+    } else {
+        fn(0, count);
+    }
+}
+
+} // namespace
+
+static_assert(sizeof(RGB) == 3, "gather_colors() copies packed bytes straight into RGB values");
+
+StripGrid::StripGrid(int width, int height, int program_size, uint64_t seed, StripExchange& exchange)
+    : width(width), height(height), program_size(program_size), seed(seed), exchange(exchange) {
+    int strips = exchange.size();
+    int rank = exchange.rank();
+    first_row = static_cast<int>(static_cast<int64_t>(height) * rank / strips);
+    last_row = static_cast<int>(static_cast<int64_t>(height) * (rank + 1) / strips);
+
+    // Every strip is as high as the thinnest one, give or take a row
+    if (strips > 1 && height / strips < PAIRING_MARGIN) {
+        throw std::runtime_error("Grid height " + std::to_string(height) + " is too small for " +
+                                 std::to_string(strips) + " strips of at least " +
+                                 std::to_string(PAIRING_MARGIN) + " rows");
+    }
+
+    size_t pairing_cells = static_cast<size_t>(pairing_margin_above() + (last_row - first_row) +
+                                               pairing_margin_below()) * width;
+    pairing_first_cell = (first_row - pairing_margin_above()) * width;
+    keys.resize(pairing_cells);
+    partner.resize(pairing_cells);
+
+    size_t program_cells = static_cast<size_t>(program_margin_above() + (last_row - first_row) +
+                                               program_margin_below()) * width;
+    program_first_cell = (first_row - program_margin_above()) * width;
+    programs[0].resize(program_cells * program_size);
+    programs[1].resize(program_cells * program_size);
+}
+
+int StripGrid::pairing_margin_above() const {
+    return exchange.rank() > 0 ? PAIRING_MARGIN : 0;
+}
+
+int StripGrid::pairing_margin_below() const {
+    return exchange.rank() < exchange.size() - 1 ? PAIRING_MARGIN : 0;
+}
+
+int StripGrid::program_margin_above() const {
+    return exchange.rank() > 0 ? RADIUS : 0;
+}
+
+int StripGrid::program_margin_below() const {
+    return exchange.rank() < exchange.size() - 1 ? RADIUS : 0;
+}
+
+void StripGrid::initialize() {
+    uint8_t* soup = programs[current].data();
+    for (int cell = first_row * width; cell < last_row * width; cell++) {
+        CounterRng cell_rng(seed, RngDomain::Initialization, 0, cell);
+        generate_random_program(soup + static_cast<size_t>(cell - program_first_cell) * program_size,
+                                program_size, cell_rng);
+    }
+}
+
+Span<const uint8_t> StripGrid::bytes() const {
+    size_t offset = static_cast<size_t>(first_row * width - program_first_cell) * program_size;
+    return Span<const uint8_t>(programs[current].data() + offset,
+                               static_cast<size_t>(last_row - first_row) * width * program_size);
+}
+
+Span<const uint8_t> StripGrid::previous_bytes() const {
+    size_t offset = static_cast<size_t>(first_row * width - program_first_cell) * program_size;
+    return Span<const uint8_t>(programs[1 - current].data() + offset,
+                               static_cast<size_t>(last_row - first_row) * width * program_size);
+}
+
+void StripGrid::refresh_partners() {
+    // Own rows next to each boundary into the neighbour's margin
+    size_t bytes = static_cast<size_t>(PAIRING_MARGIN) * width * sizeof(int32_t);
+    uint8_t* window = reinterpret_cast<uint8_t*>(partner.data());
+    size_t own_begin = static_cast<size_t>(pairing_margin_above()) * width * sizeof(int32_t);
+    size_t own_end = static_cast<size_t>(pairing_margin_above() + last_row - first_row) * width * sizeof(int32_t);
+
+    bool above = pairing_margin_above() > 0;
+    bool below = pairing_margin_below() > 0;
+    exchange.exchange_rows(above ? window + own_begin : nullptr, above ? window : nullptr, above ? bytes : 0,
+                           below ? window + own_end - bytes : nullptr, below ? window + own_end : nullptr,
+                           below ? bytes : 0);
+}
+
+void StripGrid::merge_partners() {
+    // Only the radius rows of a margin next to the boundary can have been
+    // taken from here
+    size_t count = static_cast<size_t>(RADIUS) * width;
+    size_t bytes = count * sizeof(int32_t);
+    size_t above = static_cast<size_t>(pairing_margin_above()) * width;
+    size_t own_end = above + static_cast<size_t>(last_row - first_row) * width;
+
+    receive_up.resize(bytes);
+    receive_down.resize(bytes);
+    const uint8_t* window = reinterpret_cast<const uint8_t*>(partner.data());
+    exchange.exchange_rows(above ? window + (above - count) * sizeof(int32_t) : nullptr, receive_up.data(),
+                           above ? bytes : 0,
+                           pairing_margin_below() ? window + own_end * sizeof(int32_t) : nullptr,
+                           receive_down.data(), pairing_margin_below() ? bytes : 0);
+
+    // Ready cells of both strips were far apart, so a cell is never taken
+    // on both sides
+    auto take = [&](const std::vector<uint8_t>& received, size_t first) {
+        for (size_t i = 0; i < count; i++) {
+            int32_t value;
+            std::memcpy(&value, received.data() + i * sizeof(int32_t), sizeof(int32_t));
+            if (partner[first + i] == gpu_epoch::UNRESOLVED && value != gpu_epoch::UNRESOLVED) {
+                partner[first + i] = value;
+            }
+        }
+    };
+    if (pairing_margin_above()) {
+        take(receive_up, above);
+    }
+    if (pairing_margin_below()) {
+        take(receive_down, own_end - count);
+    }
+}
+
+void StripGrid::refresh_programs() {
+    size_t bytes = static_cast<size_t>(RADIUS) * width * program_size;
+    uint8_t* window = programs[current].data();
+    size_t own_begin = static_cast<size_t>(program_margin_above()) * width * program_size;
+    size_t own_end = static_cast<size_t>(program_margin_above() + last_row - first_row) * width * program_size;
+
+    bool above = program_margin_above() > 0;
+    bool below = program_margin_below() > 0;
+    exchange.exchange_rows(above ? window + own_begin : nullptr, above ? window : nullptr, above ? bytes : 0,
+                           below ? window + own_end - bytes : nullptr, below ? window + own_end : nullptr,
+                           below ? bytes : 0);
+}
+
+void StripGrid::merge_programs() {
+    size_t count = static_cast<size_t>(RADIUS) * width;
+    size_t bytes = count * program_size;
+    uint8_t* window = programs[1 - current].data();
+    size_t above = static_cast<size_t>(program_margin_above()) * width;
+    size_t own_end = above + static_cast<size_t>(last_row - first_row) * width;
+
+    receive_up.resize(bytes);
+    receive_down.resize(bytes);
+    exchange.exchange_rows(window, receive_up.data(), program_margin_above() ? bytes : 0,
+                           window + own_end * program_size, receive_down.data(),
+                           program_margin_below() ? bytes : 0);
+
+    // Keep the programs of the cells whose pair ran on the other side
+    auto take = [&](const std::vector<uint8_t>& received, size_t first) {
+        for (size_t i = 0; i < count; i++) {
+            int cell = program_first_cell + static_cast<int>(first + i);
+            int other = partner[cell - pairing_first_cell];
+            if (other >= 0 && !own_cell(other) &&
+                gpu_epoch::visited_before(keys.data(), other - pairing_first_cell, cell - pairing_first_cell)) {
+                std::memcpy(window + (first + i) * program_size, received.data() + i * program_size, program_size);
+            }
+        }
+    };
+    if (program_margin_above()) {
+        take(receive_up, above);
+    }
+    if (program_margin_below()) {
+        take(receive_down, own_end - count);
+    }
+}
+
+void StripGrid::pair(uint64_t epoch, ThreadPool* pool) {
+    for (size_t i = 0; i < keys.size(); i++) {
+        int cell = pairing_first_cell + static_cast<int>(i);
+        keys[i] = CounterRng::hash(seed, RngDomain::PairingOrder, epoch, cell);
+    }
+    std::fill(partner.begin(), partner.end(), gpu_epoch::UNRESOLVED);
+
+    unresolved.clear();
+    for (int cell = first_row * width; cell < last_row * width; cell++) {
+        unresolved.push_back(cell);
+    }
+
+    // The earliest unresolved cell of the grid is always ready, so this
+    // terminates; every strip runs the same number of rounds
+    last_rounds = 0;
+    while (true) {
+        refresh_partners();
+        unresolved.erase(std::remove_if(unresolved.begin(), unresolved.end(), [this](int cell) {
+            return partner[cell - pairing_first_cell] != gpu_epoch::UNRESOLVED;
+        }), unresolved.end());
+
+        int64_t remaining = static_cast<int64_t>(unresolved.size());
+        exchange.sum(&remaining, 1);
+        if (remaining == 0) {
+            break;
+        }
+
+        ready.assign(unresolved.size(), 0);
+        for_each(pool, unresolved.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                ready[i] = gpu_epoch::pairing_ready(unresolved[i], partner.data(), keys.data(), width, height,
+                                                    pairing_first_cell) ? 1 : 0;
+            }
+        });
+
+        // Ready cells are far enough apart that their writes never overlap
+        for_each(pool, unresolved.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                if (ready[i]) {
+                    gpu_epoch::pairing_resolve(unresolved[i], partner.data(), width, height, seed, epoch,
+                                               pairing_first_cell);
+                }
+            }
+        });
+
+        merge_partners();
+        last_rounds++;
+    }
+}
+
+StripEpochStats StripGrid::run_epoch(uint64_t epoch, double mutation_rate, EmulatorBackend backend,
+                                     ThreadPool* pool) {
+    pair(epoch, pool);
+    refresh_programs();
+
+    const uint8_t* current_window = programs[current].data();
+    uint8_t* next_window = programs[1 - current].data();
+    auto current_program = [&](int cell) {
+        return current_window + static_cast<size_t>(cell - program_first_cell) * program_size;
+    };
+    auto next_program = [&](int cell) {
+        return next_window + static_cast<size_t>(cell - program_first_cell) * program_size;
+    };
+    auto mutate_cell = [&](int cell) {
+        CounterRng cell_rng(seed, RngDomain::Mutation, epoch, cell);
+        mutate_in_place(next_program(cell), program_size, mutation_rate, cell_rng);
+    };
+
+    StripEpochStats stats;
+    std::mutex stats_mutex;
+    int own_first = first_row * width;
+    for_each(pool, static_cast<size_t>(last_row - first_row) * width, [&](size_t begin, size_t end) {
+        StripEpochStats local;
+        for (size_t i = begin; i < end; i++) {
+            int cell = own_first + static_cast<int>(i);
+            int other = partner[cell - pairing_first_cell];
+
+            if (other == gpu_epoch::SOLO) {
+                // Mutation-only: carried over, then mutated
+                std::memcpy(next_program(cell), current_program(cell), program_size);
+                mutate_cell(cell);
+                continue;
+            }
+            if (!gpu_epoch::visited_before(keys.data(), cell - pairing_first_cell, other - pairing_first_cell)) {
+                // The second cell of a pair is written by the first
+                continue;
+            }
+
+            // First cell of a pair: runs the pair for both, across a
+            // boundary too
+            uint8_t* next_a = next_program(cell);
+            uint8_t* next_b = next_program(other);
+            std::memcpy(next_a, current_program(cell), program_size);
+            std::memcpy(next_b, current_program(other), program_size);
+            EmulatorStats result = emulate_pair_in_place(next_a, next_b, program_size, 0, program_size,
+                                                         0, gpu_epoch::MAX_ITER, backend);
+            mutate_cell(cell);
+            mutate_cell(other);
+
+            local.executed_pairs++;
+            local.iterations += result.iteration;
+            local.skipped += result.skipped;
+            local.finished += (result.status == EmulatorStatus::Finished) ? 1 : 0;
+            local.terminated += (result.status == EmulatorStatus::Terminated) ? 1 : 0;
+        }
+
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stats.executed_pairs += local.executed_pairs;
+        stats.iterations += local.iterations;
+        stats.skipped += local.skipped;
+        stats.finished += local.finished;
+        stats.terminated += local.terminated;
+    });
+
+    merge_programs();
+    current = 1 - current;
+
+    int64_t totals[5] = {stats.executed_pairs, stats.iterations, stats.skipped, stats.finished, stats.terminated};
+    exchange.sum(totals, 5);
+    stats.executed_pairs = totals[0];
+    stats.iterations = totals[1];
+    stats.skipped = totals[2];
+    stats.finished = totals[3];
+    stats.terminated = totals[4];
+    return stats;
+}
+
+double StripGrid::higher_order_entropy(const MetricsEngine& metrics) {
+    Span<const uint8_t> own = bytes();
+    if (exchange.size() == 1) {
+        return metrics.higher_order_entropy(own.data(), own.size());
+    }
+
+    // Histograms add up exactly; compressed sizes are summed per strip
+    ByteHistogram histogram = metrics.histogram();
+    int64_t counts[257];
+    std::copy(histogram.counts.begin(), histogram.counts.end(), counts);
+    counts[256] = histogram.total;
+    exchange.sum(counts, 257);
+    std::copy(counts, counts + 256, histogram.counts.begin());
+    histogram.total = counts[256];
+
+    double compressed = metrics.kolmogorov_complexity_estimate(own.data(), own.size()) * own.size() / 8.0;
+    exchange.sum(&compressed, 1);
+
+    return histogram.shannon_entropy() - (compressed / histogram.total) * 8.0;
+}
+
+std::vector<RGB> StripGrid::gather_colors() {
+    int own_cells = (last_row - first_row) * width;
+    std::vector<uint8_t> rgb(static_cast<size_t>(own_cells) * 3);
+    Span<const uint8_t> own = bytes();
+    for (int i = 0; i < own_cells; i++) {
+        gpu_epoch::program_color(own.data() + static_cast<size_t>(i) * program_size, program_size, &rgb[3 * i]);
+    }
+
+    std::vector<uint8_t> all;
+    exchange.gather(rgb.data(), rgb.size(), all);
+
+    std::vector<RGB> colors(all.size() / 3);
+    if (!all.empty()) {
+        std::memcpy(colors.data(), all.data(), all.size());
+    }
+    return colors;
+}
@@ -0,0 +1,273 @@
+#include "checkpoint.h"
+#include "grid.h"
+#include "grid_w_tracer.h"
+#include "utils.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+std::string temp_path(const std::string& name) {
+    return (fs::temp_directory_path() / name).string();
+}
+
+bool same_grids(const std::vector<Snapshot>& a, const std::vector<Snapshot>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t g = 0; g < a.size(); g++) {
+        if (a[g].kind != b[g].kind || a[g].width != b[g].width || a[g].height != b[g].height ||
+            a[g].program_size != b[g].program_size || a[g].bytes != b[g].bytes || a[g].tokens != b[g].tokens) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool same_checkpoint(const Checkpoint& a, const Checkpoint& b) {
+    return a.driver == b.driver && a.epoch == b.epoch && same_grids(a.grids, b.grids) &&
+           a.rng_states == b.rng_states && a.histories == b.histories;
+}
+
+// The base_epoch field of a checkpoint's header (-1 for a full one)
+int64_t base_epoch_of(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char header[32] = {};
+    file.read(header, sizeof(header));
+    int64_t base_epoch;
+    std::memcpy(&base_epoch, header + 24, sizeof(base_epoch));
+    return base_epoch;
+}
+
+Checkpoint make_checkpoint(Grid& grid, GridWithTracer& tracer, std::mt19937& rng, int epoch) {
+    Checkpoint checkpoint;
+    checkpoint.driver = "test_checkpoint";
+    checkpoint.epoch = epoch;
+    checkpoint.grids.push_back(grid.to_snapshot(epoch));
+    checkpoint.grids.push_back(tracer.to_snapshot(epoch));
+    checkpoint.rng_states = {rng_state(rng)};
+    checkpoint.histories = {{0.0, 10.0, 20.0}, {1.5, 2.25, -0.125}, {}};
+    return checkpoint;
+}
+
+bool check_round_trip() {
+    std::mt19937 rng(7);
+    Grid grid(30, 20, 64);
+    grid.initialize_random(rng);
+    GridWithTracer tracer(12, 8, 32);
+    tracer.initialize_random(rng);
+
+    Checkpoint checkpoint = make_checkpoint(grid, tracer, rng, 40);
+    std::string path = temp_path("bffpp_test_checkpoint_full.bffc");
+    write_checkpoint(path, checkpoint);
+    Checkpoint loaded = read_checkpoint(path);
+
+    bool ok = same_checkpoint(loaded, checkpoint);
+    if (!ok) {
+        std::cout << "FAIL: full checkpoint did not round-trip" << std::endl;
+    }
+
+    // The grids and the engine carry on from where they were saved
+    Grid restored_grid(30, 20, 64);
+    GridWithTracer restored_tracer(12, 8, 32);
+    std::mt19937 restored_rng;
+    restored_grid.load_snapshot(loaded.grids[0]);
+    restored_tracer.load_snapshot(loaded.grids[1]);
+    restore_rng_state(restored_rng, loaded.rng_states[0]);
+
+    std::vector<std::pair<int, int>> expected = grid.create_spatial_pairs(2, rng);
+    std::vector<std::pair<int, int>> pairs = restored_grid.create_spatial_pairs(2, restored_rng);
+    if (pairs != expected || rng() != restored_rng() ||
+        !same_grids({restored_grid.to_snapshot(40)}, {grid.to_snapshot(40)}) ||
+        !same_grids({restored_tracer.to_snapshot(40)}, {tracer.to_snapshot(40)})) {
+        std::cout << "FAIL: restored state does not carry on like the original" << std::endl;
+        ok = false;
+    }
+
+    if (ok) {
+        std::cout << "PASS: full checkpoint round-trips and resumes the same sequence ("
+                  << fs::file_size(path) << " bytes)" << std::endl;
+    }
+    fs::remove(path);
+    return ok;
+}
+
+bool check_incremental() {
+    std::mt19937 rng(9);
+    Grid grid(30, 20, 64);
+    grid.initialize_random(rng);
+    GridWithTracer tracer(12, 8, 32);
+    tracer.initialize_random(rng);
+
+    Checkpoint base = make_checkpoint(grid, tracer, rng, 10);
+    std::string base_path = temp_path("bffpp_test_checkpoint_base.bffc");
+    write_checkpoint(base_path, base);
+
+    // A few programs of each grid change
+    for (int i = 0; i < grid.get_total_programs(); i += 37) {
+        mutate_in_place(grid.program_at(i).data(), 64, 0.2, rng);
+    }
+    for (int i = 0; i < tracer.get_total_programs(); i += 11) {
+        tracer.mutate_in_place(tracer.program_at(i), 0.2, 20, rng);
+    }
+    Checkpoint checkpoint = make_checkpoint(grid, tracer, rng, 20);
+    checkpoint.histories[2] = {3.0};
+
+    std::string path = temp_path("bffpp_test_checkpoint_delta.bffc");
+    write_checkpoint(path, checkpoint, &base, base_path);
+    size_t base_size = fs::file_size(base_path);
+    size_t size = fs::file_size(path);
+    bool ok = same_checkpoint(read_checkpoint(path), checkpoint);
+    if (!ok) {
+        std::cout << "FAIL: incremental checkpoint did not round-trip" << std::endl;
+    }
+    if (size * 4 >= base_size || base_epoch_of(path) != 10) {
+        std::cout << "FAIL: incremental checkpoint is not much smaller than its base" << std::endl;
+        ok = false;
+    }
+
+    // Without its base it cannot be read
+    fs::remove(base_path);
+    bool threw = false;
+    try {
+        read_checkpoint(path);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    if (!threw) {
+        std::cout << "FAIL: incremental checkpoint was read without its base" << std::endl;
+        ok = false;
+    }
+
+    if (ok) {
+        std::cout << "PASS: incremental checkpoint round-trips (" << size << " bytes against a base of "
+                  << base_size << ")" << std::endl;
+    }
+    fs::remove(path);
+    return ok;
+}
+
+bool check_writer() {
+    std::mt19937 rng(11);
+    Grid grid(16, 12, 32);
+    grid.initialize_random(rng);
+    GridWithTracer tracer(8, 6, 16);
+    tracer.initialize_random(rng);
+
+    // Full every third checkpoint, and when the grids change shape
+    std::vector<std::string> paths;
+    std::vector<Checkpoint> expected;
+    {
+        CheckpointWriter writer(3);
+        for (int epoch = 1; epoch <= 7; epoch++) {
+            mutate_in_place(grid.program_at(epoch).data(), 32, 0.5, rng);
+            Checkpoint checkpoint = make_checkpoint(grid, tracer, rng, epoch);
+            if (epoch == 6) {
+                checkpoint.grids.pop_back();
+            }
+            paths.push_back(checkpoint_path(fs::temp_directory_path().string(), "test_checkpoint", epoch));
+            expected.push_back(checkpoint);
+            writer.submit(paths.back(), std::move(checkpoint));
+        }
+        writer.flush();
+        if (writer.failures() != 0) {
+            std::cout << "FAIL: checkpoint writer reported failures" << std::endl;
+            return false;
+        }
+    }
+
+    const int64_t expected_bases[] = {-1, 1, 1, -1, 4, -1, -1};
+    bool ok = true;
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (base_epoch_of(paths[i]) != expected_bases[i] || !same_checkpoint(read_checkpoint(paths[i]), expected[i])) {
+            std::cout << "FAIL: checkpoint " << paths[i] << " is not the expected one" << std::endl;
+            ok = false;
+        }
+    }
+
+    // A full checkpoint that fails to write makes the next one full again
+    {
+        CheckpointWriter writer(3);
+        writer.submit("/nonexistent/test_checkpoint.bffc", make_checkpoint(grid, tracer, rng, 8));
+        paths.push_back(checkpoint_path(fs::temp_directory_path().string(), "test_checkpoint", 9));
+        Checkpoint checkpoint = make_checkpoint(grid, tracer, rng, 9);
+        writer.submit(paths.back(), checkpoint);
+        writer.flush();
+        if (writer.failures() != 1 || base_epoch_of(paths.back()) != -1 ||
+            !same_checkpoint(read_checkpoint(paths.back()), checkpoint)) {
+            std::cout << "FAIL: checkpoint after a failed full one is not full" << std::endl;
+            ok = false;
+        }
+    }
+
+    if (ok) {
+        std::cout << "PASS: writer alternates full and incremental checkpoints" << std::endl;
+    }
+    for (const std::string& path : paths) {
+        fs::remove(path);
+    }
+    return ok;
+}
+
+bool check_rejects_mismatches() {
+    std::mt19937 rng(13);
+    Grid grid(10, 10, 16);
+    grid.initialize_random(rng);
+    GridWithTracer tracer(10, 10, 16);
+    tracer.initialize_random(rng);
+    Checkpoint checkpoint = make_checkpoint(grid, tracer, rng, 5);
+
+    auto throws = [](auto&& call) {
+        try {
+            call();
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+
+    bool ok = !throws([&] { check_checkpoint(checkpoint, "test_checkpoint", 2, 10, 10, 16); });
+    ok = throws([&] { check_checkpoint(checkpoint, "bffpp_grid", 2, 10, 10, 16); }) && ok;
+    ok = throws([&] { check_checkpoint(checkpoint, "test_checkpoint", 1, 10, 10, 16); }) && ok;
+    ok = throws([&] { check_checkpoint(checkpoint, "test_checkpoint", 2, 10, 10, 32); }) && ok;
+
+    Grid other(12, 10, 16);
+    ok = throws([&] { other.load_snapshot(checkpoint.grids[0]); }) && ok;
+    ok = throws([&] { tracer.load_snapshot(checkpoint.grids[0]); }) && ok;
+
+    std::mt19937 engine;
+    ok = throws([&] { restore_rng_state(engine, "not an engine"); }) && ok;
+
+    // Truncated files are refused
+    std::string path = temp_path("bffpp_test_checkpoint_truncated.bffc");
+    write_checkpoint(path, checkpoint);
+    fs::resize_file(path, fs::file_size(path) / 2);
+    ok = throws([&] { read_checkpoint(path); }) && ok;
+    fs::remove(path);
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": mismatched and truncated checkpoints are rejected" << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing checkpoints..." << std::endl;
+
+    bool ok = check_round_trip();
+    ok = check_incremental() && ok;
+    ok = check_writer() && ok;
+    ok = check_rejects_mismatches() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Checkpoints restore every run state!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Checkpoint checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
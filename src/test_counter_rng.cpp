@@ -0,0 +1,253 @@
+#include "rng.h"
+#include "grid.h"
+#include "grid_w_tracer.h"
+#include "emulator.h"
+#include "utils.h"
+#include "thread_pool.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+// Run a few counter-RNG grid epochs the way main_grid does and return the soup;
+// fused mutates inside the emulation task, otherwise in a separate pass
+std::vector<uint8_t> run_grid(unsigned int num_threads, uint64_t seed, int epochs, bool fused = true) {
+    const int width = 24;
+    const int height = 16;
+    const int program_size = 64;
+    const double mutation_rate = 0.01;
+
+    ThreadPool pool(num_threads);
+    Grid grid(width, height, program_size);
+
+    pool.parallel_for(grid.get_total_programs(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            CounterRng cell_rng(seed, RngDomain::Initialization, 0, i);
+            grid.initialize_program(i, cell_rng);
+        }
+    });
+
+    for (int epoch = 0; epoch < epochs; epoch++) {
+        grid.begin_epoch();
+        std::vector<std::pair<int, int>> pairs = grid.create_spatial_pairs(2, seed, epoch + 1);
+
+        auto mutate_cell = [&](int idx) {
+            CounterRng cell_rng(seed, RngDomain::Mutation, epoch + 1, idx);
+            mutate_in_place(grid.next_program(idx).data(), program_size, mutation_rate, cell_rng);
+        };
+
+        pool.parallel_for(pairs.size(), 3, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                int idx_a = pairs[i].first;
+                int idx_b = pairs[i].second;
+
+                Span<const uint8_t> program_b = grid.program_at(idx_b);
+                std::copy(program_b.begin(), program_b.end(), grid.next_program(idx_b).begin());
+                if (idx_a != -1) {
+                    Span<const uint8_t> program_a = grid.program_at(idx_a);
+                    std::copy(program_a.begin(), program_a.end(), grid.next_program(idx_a).begin());
+                    emulate_pair_in_place(grid.next_program(idx_a).data(), grid.next_program(idx_b).data(),
+                                          program_size, 0, program_size);
+                }
+
+                if (fused) {
+                    for (int idx : {idx_a, idx_b}) {
+                        if (idx != -1) {
+                            mutate_cell(idx);
+                        }
+                    }
+                }
+            }
+        });
+
+        if (!fused) {
+            pool.parallel_for(grid.get_total_programs(), 5, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    mutate_cell(i);
+                }
+            });
+        }
+
+        grid.commit_epoch();
+    }
+
+    return grid.all_bytes().to_vector();
+}
+
+// Same for the tracer grid, without emulation (token lineage only changes by mutation)
+std::vector<uint64_t> run_tracer_grid(unsigned int num_threads, uint64_t seed, int epochs) {
+    ThreadPool pool(num_threads);
+    GridWithTracer grid(10, 10, 32);
+
+    pool.parallel_for(grid.get_total_programs(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            CounterRng cell_rng(seed, RngDomain::Initialization, 0, i);
+            grid.initialize_program(i, cell_rng);
+        }
+    });
+
+    for (int epoch = 0; epoch < epochs; epoch++) {
+        pool.parallel_for(grid.get_total_programs(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                CounterRng cell_rng(seed, RngDomain::Mutation, epoch + 1, i);
+                grid.mutate_in_place(grid.program_at(i), 0.05, epoch + 1, cell_rng);
+            }
+        });
+    }
+
+    std::vector<uint64_t> values;
+    for (int i = 0; i < grid.get_total_programs(); i++) {
+        for (const Token& token : grid.program_at(i)) {
+            values.push_back(token.value);
+        }
+    }
+    return values;
+}
+
+bool check_streams() {
+    bool ok = true;
+
+    CounterRng a(7, RngDomain::Mutation, 3, 11);
+    CounterRng b(7, RngDomain::Mutation, 3, 11);
+    CounterRng c(7, RngDomain::Mutation, 3, 12);
+    CounterRng d(7, RngDomain::Initialization, 3, 11);
+
+    int same_ab = 0, same_ac = 0, same_ad = 0;
+    for (int i = 0; i < 1000; i++) {
+        uint64_t va = a(), vb = b(), vc = c(), vd = d();
+        same_ab += (va == vb);
+        same_ac += (va == vc);
+        same_ad += (va == vd);
+    }
+
+    if (same_ab != 1000) {
+        std::cout << "FAIL: identical keys gave different streams" << std::endl;
+        ok = false;
+    }
+    if (same_ac != 0 || same_ad != 0) {
+        std::cout << "FAIL: different keys gave overlapping streams" << std::endl;
+        ok = false;
+    }
+
+    // next_below stays in range and hits every value
+    CounterRng r(1, RngDomain::PairingChoice, 0, 0);
+    std::vector<int> counts(12, 0);
+    for (int i = 0; i < 12000; i++) {
+        uint32_t v = r.next_below(12);
+        if (v >= 12) {
+            std::cout << "FAIL: next_below out of range" << std::endl;
+            return false;
+        }
+        counts[v]++;
+    }
+    for (int count : counts) {
+        if (count < 800 || count > 1200) {
+            std::cout << "FAIL: next_below badly skewed (" << count << " of 12000)" << std::endl;
+            ok = false;
+        }
+    }
+
+    if (ok) {
+        std::cout << "PASS: counter streams are deterministic and independent" << std::endl;
+    }
+    return ok;
+}
+
+bool check_geometric_mutation() {
+    // Mutated fraction should match the per-byte rate (a redraw of the same
+    // byte is invisible, hence the 255/256 factor)
+    const int num_programs = 20000;
+    const int program_size = 64;
+    const double rate = 0.01;
+
+    long changed = 0;
+    for (int p = 0; p < num_programs; p++) {
+        std::vector<uint8_t> program(program_size, 0);
+        CounterRng cell_rng(99, RngDomain::Mutation, 1, p);
+        mutate_in_place(program.data(), program_size, rate, cell_rng);
+        for (uint8_t byte : program) {
+            changed += (byte != 0);
+        }
+    }
+
+    double expected = rate * (255.0 / 256.0) * num_programs * program_size;
+    double ratio = changed / expected;
+    bool ok = ratio > 0.95 && ratio < 1.05;
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": geometric skip mutation changed " << changed
+              << " bytes, expected ~" << static_cast<long>(expected) << std::endl;
+    return ok;
+}
+
+bool check_pairing() {
+    Grid grid(13, 9, 8);
+    std::vector<std::pair<int, int>> pairs = grid.create_spatial_pairs(2, 5, 1);
+    std::vector<std::pair<int, int>> again = grid.create_spatial_pairs(2, 5, 1);
+
+    std::vector<int> seen(grid.get_total_programs(), 0);
+    for (const auto& pair : pairs) {
+        if (pair.first != -1) {
+            seen[pair.first]++;
+        }
+        seen[pair.second]++;
+    }
+
+    bool ok = pairs == again;
+    for (int count : seen) {
+        if (count != 1) {
+            ok = false;
+        }
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": counter pairing covers every cell once, reproducibly" << std::endl;
+    return ok;
+}
+
+bool check_thread_invariance() {
+    bool ok = true;
+
+    std::vector<uint8_t> reference = run_grid(1, 42, 8);
+    std::vector<uint64_t> tracer_reference = run_tracer_grid(1, 42, 8);
+
+    for (unsigned int threads : {2u, 3u, 4u, 8u}) {
+        if (run_grid(threads, 42, 8) != reference) {
+            std::cout << "FAIL: grid soup differs with " << threads << " threads" << std::endl;
+            ok = false;
+        }
+        if (run_tracer_grid(threads, 42, 8) != tracer_reference) {
+            std::cout << "FAIL: tracer soup differs with " << threads << " threads" << std::endl;
+            ok = false;
+        }
+    }
+
+    if (run_grid(4, 42, 8, false) != reference) {
+        std::cout << "FAIL: fused and separate mutation passes differ" << std::endl;
+        ok = false;
+    }
+
+    if (run_grid(1, 43, 8) == reference) {
+        std::cout << "FAIL: seed has no effect" << std::endl;
+        ok = false;
+    }
+
+    if (ok) {
+        std::cout << "PASS: soups are identical for 1, 2, 3, 4 and 8 threads, fused or not" << std::endl;
+    }
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing counter-based RNG streams..." << std::endl;
+
+    bool ok = check_streams();
+    ok = check_geometric_mutation() && ok;
+    ok = check_pairing() && ok;
+    ok = check_thread_invariance() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Counter-based RNG is reproducible across thread counts!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Counter-based RNG checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
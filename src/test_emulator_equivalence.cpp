@@ -3,8 +3,530 @@
 #include "utils.h"
 #include <iostream>
 #include <iomanip>
+#include <random>
 
-int main() {
+// Reference emulator: the original linear-scan bracket matching, kept here so
+// the indexed emulators can be checked against it byte for byte
+EmulatorResult emulate_reference(
+    std::vector<uint8_t> tape,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos,
+    int max_iter
+) {
+    int tape_size = tape.size();
+    int iteration = 0;
+    int skipped = 0;
+    std::string state = "Terminated";
+
+    while (iteration < max_iter) {
+        uint8_t instr = tape[pc_pos];
+
+        if (instr == '<') {
+            head0_pos = (head0_pos - 1 + tape_size) % tape_size;
+        } else if (instr == '>') {
+            head0_pos = (head0_pos + 1) % tape_size;
+        } else if (instr == '{') {
+            head1_pos = (head1_pos - 1 + tape_size) % tape_size;
+        } else if (instr == '}') {
+            head1_pos = (head1_pos + 1) % tape_size;
+        } else if (instr == '-') {
+            tape[head0_pos] = tape[head0_pos] - 1;
+        } else if (instr == '+') {
+            tape[head0_pos] = tape[head0_pos] + 1;
+        } else if (instr == '.') {
+            tape[head1_pos] = tape[head0_pos];
+        } else if (instr == ',') {
+            tape[head0_pos] = tape[head1_pos];
+        } else if (instr == '[') {
+            if (tape[head0_pos] == '0') {
+                int diff = 1;
+                for (int i = pc_pos + 1; i < tape_size; i++) {
+                    if (tape[i] == '[') diff++;
+                    else if (tape[i] == ']') diff--;
+                    if (diff == 0) {
+                        pc_pos = i;
+                        break;
+                    }
+                }
+                if (diff != 0) {
+                    state = "Error, Unmatched [";
+                    break;
+                }
+            }
+        } else if (instr == ']') {
+            if (tape[head0_pos] != '0') {
+                int diff = 1;
+                for (int i = pc_pos - 1; i >= 0; i--) {
+                    if (tape[i] == ']') diff++;
+                    else if (tape[i] == '[') diff--;
+                    if (diff == 0) {
+                        pc_pos = i;
+                        break;
+                    }
+                }
+                if (diff != 0) {
+                    state = "Error, Unmatched ]";
+                    break;
+                }
+            }
+        } else {
+            skipped++;
+        }
+
+        iteration++;
+        pc_pos = pc_pos + 1;
+        if (pc_pos >= tape_size) {
+            state = "Finished";
+            break;
+        }
+    }
+
+    return EmulatorResult{tape, state, iteration, skipped};
+}
+
+// Reference tracer emulator with the original linear-scan bracket matching
+EmulatorResultWithTracer emulate_w_tracer_reference(
+    std::vector<Token> tape,
+    int head0_pos,
+    int head1_pos,
+    int pc_pos,
+    int max_iter
+) {
+    const std::string instructions = "<>{}-+.,[]";
+    int tape_size = static_cast<int>(tape.size());
+    int iteration = 0;
+    int skipped = 0;
+    std::string state = "Running";
+
+    while (iteration < max_iter) {
+        iteration++;
+        char instruction = static_cast<char>(tape[pc_pos].get_char());
+
+        if (instructions.find(instruction) == std::string::npos) {
+            skipped++;
+        } else if (instruction == '<') {
+            head0_pos = (head0_pos - 1 + tape_size) % tape_size;
+        } else if (instruction == '>') {
+            head0_pos = (head0_pos + 1) % tape_size;
+        } else if (instruction == '{') {
+            head1_pos = (head1_pos - 1 + tape_size) % tape_size;
+        } else if (instruction == '}') {
+            head1_pos = (head1_pos + 1) % tape_size;
+        } else if (instruction == '+') {
+            tape[head0_pos].set_char(tape[head0_pos].get_char() + 1);
+        } else if (instruction == '-') {
+            tape[head0_pos].set_char(tape[head0_pos].get_char() - 1);
+        } else if (instruction == '.') {
+            tape[head1_pos] = tape[head0_pos];
+        } else if (instruction == ',') {
+            tape[head0_pos] = tape[head1_pos];
+        } else if (instruction == '[') {
+            if (tape[head0_pos].get_char() == '0') {
+                int depth = 1;
+                for (int i = pc_pos + 1; i < tape_size; i++) {
+                    char c = static_cast<char>(tape[i].get_char());
+                    if (c == '[') depth++;
+                    else if (c == ']') depth--;
+                    if (depth == 0) {
+                        pc_pos = i;
+                        break;
+                    }
+                }
+                if (depth != 0) {
+                    return EmulatorResultWithTracer{
+                        tape, head0_pos, head1_pos, pc_pos, iteration, skipped, "Error, Unmatched ["
+                    };
+                }
+            }
+        } else if (instruction == ']') {
+            if (tape[head0_pos].get_char() != '0') {
+                int depth = 1;
+                for (int i = pc_pos - 1; i >= 0; i--) {
+                    char c = static_cast<char>(tape[i].get_char());
+                    if (c == ']') depth++;
+                    else if (c == '[') depth--;
+                    if (depth == 0) {
+                        pc_pos = i;
+                        break;
+                    }
+                }
+                if (depth != 0) {
+                    return EmulatorResultWithTracer{
+                        tape, head0_pos, head1_pos, pc_pos, iteration, skipped, "Error, Unmatched ]"
+                    };
+                }
+            }
+        }
+
+        pc_pos = pc_pos + 1;
+        if (pc_pos >= tape_size) {
+            state = "Finished";
+            break;
+        }
+    }
+
+    if (iteration >= max_iter && state == "Running") {
+        state = "Terminated";
+    }
+
+    return EmulatorResultWithTracer{
+        tape, head0_pos, head1_pos, pc_pos, iteration, skipped, state
+    };
+}
+
+// Random tape drawn mostly from the instruction set, so that loops, bracket
+// rewrites and unmatched brackets all show up often
+std::vector<uint8_t> random_instruction_tape(int size, std::mt19937& rng) {
+    const std::string alphabet = "<>{}-+.,[]0ZZ\\";
+    std::uniform_int_distribution<int> pick(0, alphabet.size() - 1);
+    std::uniform_int_distribution<int> any_byte(0, 255);
+    std::uniform_int_distribution<int> coin(0, 3);
+
+    std::vector<uint8_t> tape(size);
+    for (int i = 0; i < size; i++) {
+        tape[i] = coin(rng) == 0 ? static_cast<uint8_t>(any_byte(rng))
+                                 : static_cast<uint8_t>(alphabet[pick(rng)]);
+    }
+    return tape;
+}
+
+// Compare indexed emulators against the linear-scan reference on many tapes
+bool check_random_tapes(int num_tapes) {
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> size_dist(4, 128);
+
+    int mismatches = 0;
+    for (int t = 0; t < num_tapes; t++) {
+        int tape_size = size_dist(rng);
+        std::vector<uint8_t> tape = random_instruction_tape(tape_size, rng);
+        std::uniform_int_distribution<int> pos_dist(0, tape_size - 1);
+        int head0 = pos_dist(rng);
+        int head1 = pos_dist(rng);
+        int max_iter = (t % 2 == 0) ? 8192 : 1024;
+
+        EmulatorResult expected = emulate_reference(tape, head0, head1, 0, max_iter);
+        EmulatorResult actual = emulate(tape, head0, head1, 0, max_iter);
+
+        bool match = expected.tape == actual.tape &&
+                     expected.state == actual.state &&
+                     expected.iteration == actual.iteration &&
+                     expected.skipped == actual.skipped;
+
+        // Pre-decoded backend on its own copy of the tape
+        std::vector<uint8_t> predecoded_tape = tape;
+        EmulatorStats predecoded = emulate_predecoded_in_place(
+            predecoded_tape.data(), tape_size, head0, head1, 0, max_iter
+        );
+        match = match && predecoded_tape == expected.tape &&
+                emulator_status_name(predecoded.status) == expected.state &&
+                predecoded.iteration == expected.iteration &&
+                predecoded.skipped == expected.skipped;
+
+        // Zero-allocation entry point on two separately stored halves
+        if (tape_size % 2 == 0) {
+            int half = tape_size / 2;
+            std::vector<uint8_t> program_a(tape.begin(), tape.begin() + half);
+            std::vector<uint8_t> program_b(tape.begin() + half, tape.end());
+            EmulatorStats stats = emulate_pair_in_place(
+                program_a.data(), program_b.data(), half, head0, head1, 0, max_iter
+            );
+            program_a.insert(program_a.end(), program_b.begin(), program_b.end());
+            match = match && program_a == expected.tape &&
+                    emulator_status_name(stats.status) == expected.state &&
+                    stats.iteration == expected.iteration &&
+                    stats.skipped == expected.skipped;
+        }
+
+        std::vector<Token> tokens = initialize_tokens_with_epoch(tape, t);
+        EmulatorResultWithTracer expected_tr = emulate_w_tracer_reference(tokens, head0, head1, 0, max_iter);
+        EmulatorResultWithTracer actual_tr = emulate_w_tracer(tokens, head0, head1, 0, max_iter);
+
+        bool match_tr = expected_tr.state == actual_tr.state &&
+                        expected_tr.iteration == actual_tr.iteration &&
+                        expected_tr.skipped == actual_tr.skipped &&
+                        expected_tr.head0_pos == actual_tr.head0_pos &&
+                        expected_tr.head1_pos == actual_tr.head1_pos &&
+                        expected_tr.pc_pos == actual_tr.pc_pos &&
+                        expected_tr.tape.size() == actual_tr.tape.size();
+        for (size_t i = 0; match_tr && i < expected_tr.tape.size(); i++) {
+            match_tr = expected_tr.tape[i].value == actual_tr.tape[i].value;
+        }
+
+        if (!match || !match_tr) {
+            if (mismatches < 5) {
+                std::cout << "  Mismatch on tape " << t << " (size " << tape_size
+                          << ", " << (match ? "tracer" : "emulator") << "): expected "
+                          << expected.state << " / " << expected.iteration
+                          << ", got " << actual.state << " / " << actual.iteration << std::endl;
+            }
+            mismatches++;
+        }
+    }
+
+    std::cout << "Random tapes checked: " << num_tapes
+              << ", mismatches: " << mismatches << std::endl;
+    return mismatches == 0;
+}
+
+// Tape made of runs of one character, so that the pre-decoded backend folds
+// long runs and self-modifying writes land inside them
+std::vector<uint8_t> random_run_tape(int size, std::mt19937& rng) {
+    const std::string alphabet = "<>{}-+.,[]0Z";
+    std::uniform_int_distribution<int> pick(0, alphabet.size() - 1);
+    std::uniform_int_distribution<int> run_length(1, 12);
+
+    std::vector<uint8_t> tape;
+    while (static_cast<int>(tape.size()) < size) {
+        tape.insert(tape.end(), run_length(rng), static_cast<uint8_t>(alphabet[pick(rng)]));
+    }
+    tape.resize(size);
+    return tape;
+}
+
+// Pre-decoded backend against the reference on run-heavy tapes, with
+// small iteration budgets so that runs get cut off part way
+bool check_predecoded_runs(int num_tapes) {
+    std::mt19937 rng(4321);
+    std::uniform_int_distribution<int> size_dist(4, 128);
+    const int budgets[] = {1, 7, 100, 8192};
+
+    int mismatches = 0;
+    for (int t = 0; t < num_tapes; t++) {
+        int tape_size = size_dist(rng);
+        std::vector<uint8_t> tape = random_run_tape(tape_size, rng);
+        std::uniform_int_distribution<int> pos_dist(0, tape_size - 1);
+        int head0 = pos_dist(rng);
+        int head1 = pos_dist(rng);
+        int max_iter = budgets[t % 4];
+
+        EmulatorResult expected = emulate_reference(tape, head0, head1, 0, max_iter);
+
+        // Through the pair entry point when the tape splits evenly
+        EmulatorStats stats;
+        std::vector<uint8_t> actual = tape;
+        if (tape_size % 2 == 0) {
+            int half = tape_size / 2;
+            std::vector<uint8_t> program_b(actual.begin() + half, actual.end());
+            actual.resize(half);
+            stats = emulate_pair_in_place(actual.data(), program_b.data(), half, head0, head1, 0, max_iter,
+                                          EmulatorBackend::Predecoded);
+            actual.insert(actual.end(), program_b.begin(), program_b.end());
+        } else {
+            stats = emulate_predecoded_in_place(actual.data(), tape_size, head0, head1, 0, max_iter);
+        }
+
+        if (actual != expected.tape || emulator_status_name(stats.status) != expected.state ||
+            stats.iteration != expected.iteration || stats.skipped != expected.skipped) {
+            if (mismatches < 5) {
+                std::cout << "  Pre-decoded mismatch on run tape " << t << " (size " << tape_size
+                          << "): expected " << expected.state << " / " << expected.iteration
+                          << ", got " << emulator_status_name(stats.status) << " / " << stats.iteration
+                          << std::endl;
+            }
+            mismatches++;
+        }
+    }
+
+    std::cout << "Run-heavy tapes checked: " << num_tapes << ", mismatches: " << mismatches << std::endl;
+    return mismatches == 0;
+}
+
+EmulatorStats run_fixed_size(std::vector<uint8_t>& tape, int head0, int head1, int max_iter) {
+    switch (tape.size()) {
+        case 32: return emulate_fixed_in_place<32>(tape.data(), head0, head1, 0, max_iter);
+        case 64: return emulate_fixed_in_place<64>(tape.data(), head0, head1, 0, max_iter);
+        case 128: return emulate_fixed_in_place<128>(tape.data(), head0, head1, 0, max_iter);
+        default: return emulate_fixed_in_place<256>(tape.data(), head0, head1, 0, max_iter);
+    }
+}
+
+// Size-specialised emulators on every instantiated tape size, directly and
+// through the pair entry point that dispatches to them
+bool check_fixed_sizes(int tapes_per_size) {
+    std::mt19937 rng(777);
+    const int sizes[] = {32, 64, 128, 256};
+
+    int mismatches = 0;
+    for (int tape_size : sizes) {
+        std::uniform_int_distribution<int> pos_dist(0, tape_size - 1);
+        for (int t = 0; t < tapes_per_size; t++) {
+            std::vector<uint8_t> tape = (t % 2 == 0) ? random_instruction_tape(tape_size, rng)
+                                                     : random_run_tape(tape_size, rng);
+            int head0 = (t % 3 == 0) ? 0 : pos_dist(rng);
+            int head1 = (t % 3 == 0) ? tape_size / 2 : pos_dist(rng);
+            int max_iter = (t % 4 == 0) ? 300 : 8192;
+
+            EmulatorResult expected = emulate_reference(tape, head0, head1, 0, max_iter);
+
+            std::vector<uint8_t> direct = tape;
+            EmulatorStats direct_stats = run_fixed_size(direct, head0, head1, max_iter);
+
+            int half = tape_size / 2;
+            std::vector<uint8_t> program_a(tape.begin(), tape.begin() + half);
+            std::vector<uint8_t> program_b(tape.begin() + half, tape.end());
+            EmulatorStats pair_stats = emulate_pair_in_place(
+                program_a.data(), program_b.data(), half, head0, head1, 0, max_iter
+            );
+            program_a.insert(program_a.end(), program_b.begin(), program_b.end());
+
+            bool match = true;
+            for (const auto& [actual, stats] : {std::make_pair(&direct, direct_stats),
+                                                std::make_pair(&program_a, pair_stats)}) {
+                match = match && *actual == expected.tape &&
+                        emulator_status_name(stats.status) == expected.state &&
+                        stats.iteration == expected.iteration && stats.skipped == expected.skipped;
+            }
+
+            if (!match) {
+                if (mismatches < 5) {
+                    std::cout << "  Fixed-size mismatch on a " << tape_size << "-byte tape, case " << t
+                              << ": expected " << expected.state << " / " << expected.iteration
+                              << ", got " << emulator_status_name(direct_stats.status) << " / "
+                              << direct_stats.iteration << std::endl;
+                }
+                mismatches++;
+            }
+        }
+    }
+
+    std::cout << "Fixed-size tapes checked: " << 4 * tapes_per_size << ", mismatches: " << mismatches << std::endl;
+    return mismatches == 0;
+}
+
+// Batches of pairs through the lockstep emulator, including batches smaller
+// than the lane count and half sizes that are not a multiple of anything
+bool check_batches() {
+    std::mt19937 rng(99);
+    const int batch_sizes[] = {0, 1, 5, EMULATOR_BATCH_LANES, 37, 2000};
+    const int program_sizes[] = {3, 17, 64};
+
+    int mismatches = 0;
+    int pairs = 0;
+    for (int program_size : program_sizes) {
+        for (int batch_size : batch_sizes) {
+            int tape_size = 2 * program_size;
+            std::uniform_int_distribution<int> pos_dist(0, tape_size - 1);
+            int head0 = (batch_size % 2 == 0) ? 0 : pos_dist(rng);
+            int head1 = (batch_size % 2 == 0) ? program_size : pos_dist(rng);
+            int max_iter = (batch_size == 37) ? 100 : 8192;
+
+            std::vector<std::vector<uint8_t>> tapes;
+            std::vector<std::vector<uint8_t>> programs_a(batch_size), programs_b(batch_size);
+            std::vector<EmulatorStats> stats(batch_size);
+            std::vector<EmulatorJob> jobs(batch_size);
+            for (int i = 0; i < batch_size; i++) {
+                tapes.push_back(random_instruction_tape(tape_size, rng));
+                programs_a[i].assign(tapes[i].begin(), tapes[i].begin() + program_size);
+                programs_b[i].assign(tapes[i].begin() + program_size, tapes[i].end());
+                jobs[i] = EmulatorJob{programs_a[i].data(), programs_b[i].data(), &stats[i]};
+            }
+
+            // Odd batches with cycle detection in the scalar steps
+            emulate_batch(jobs.data(), jobs.size(), program_size, head0, head1, 0, max_iter, batch_size % 2 == 1);
+
+            for (int i = 0; i < batch_size; i++) {
+                EmulatorResult expected = emulate_reference(tapes[i], head0, head1, 0, max_iter);
+                std::vector<uint8_t> actual = programs_a[i];
+                actual.insert(actual.end(), programs_b[i].begin(), programs_b[i].end());
+
+                if (actual != expected.tape || emulator_status_name(stats[i].status) != expected.state ||
+                    stats[i].iteration != expected.iteration || stats[i].skipped != expected.skipped) {
+                    if (mismatches < 5) {
+                        std::cout << "  Batch mismatch (program size " << program_size << ", pair " << i
+                                  << "): expected " << expected.state << " / " << expected.iteration
+                                  << ", got " << emulator_status_name(stats[i].status) << " / "
+                                  << stats[i].iteration << std::endl;
+                    }
+                    mismatches++;
+                }
+                pairs++;
+            }
+        }
+    }
+
+    std::cout << "Batched pairs checked: " << pairs << ", mismatches: " << mismatches << std::endl;
+    return mismatches == 0;
+}
+
+// Random tape with loops that write nothing dropped in, such as "[]" or
+// "[>]", which spin until max_iter unless their head reaches a '0'
+std::vector<uint8_t> random_loop_tape(int size, std::mt19937& rng) {
+    const std::string loops[] = {"[]", "[<>]", "[{}]", "[Z]", "[>]", "[<{]", "[[]]", "[}]ZZ[<]"};
+    std::vector<uint8_t> tape = random_instruction_tape(size, rng);
+    std::uniform_int_distribution<int> pick(0, 7);
+    for (int k = 0; k < 3; k++) {
+        const std::string& loop = loops[pick(rng)];
+        std::uniform_int_distribution<int> pos_dist(0, size - static_cast<int>(loop.size()));
+        std::copy(loop.begin(), loop.end(), tape.begin() + pos_dist(rng));
+    }
+    return tape;
+}
+
+// Every emulator with cycle detection on against the reference, on tapes
+// that often end in a loop, with budgets that cut loops off part way
+bool check_cycle_detection(int num_tapes) {
+    std::mt19937 rng(2468);
+    std::uniform_int_distribution<int> size_dist(8, 128);
+    const int budgets[] = {5, 333, 1000, 8192};
+
+    int mismatches = 0;
+    for (int t = 0; t < num_tapes; t++) {
+        int tape_size = (t % 3 == 0) ? 64 : size_dist(rng);
+        std::vector<uint8_t> tape = (t % 4 == 3) ? random_instruction_tape(tape_size, rng)
+                                                 : random_loop_tape(tape_size, rng);
+        std::uniform_int_distribution<int> pos_dist(0, tape_size - 1);
+        int head0 = pos_dist(rng);
+        int head1 = pos_dist(rng);
+        int max_iter = budgets[t % 4];
+
+        EmulatorResult expected = emulate_reference(tape, head0, head1, 0, max_iter);
+        auto same = [&](const std::vector<uint8_t>& actual, const EmulatorStats& stats) {
+            return actual == expected.tape && emulator_status_name(stats.status) == expected.state &&
+                   stats.iteration == expected.iteration && stats.skipped == expected.skipped;
+        };
+
+        EmulatorResult generic = emulate(tape, head0, head1, 0, max_iter, 0, true);
+        bool match = generic.tape == expected.tape && generic.state == expected.state &&
+                     generic.iteration == expected.iteration && generic.skipped == expected.skipped;
+
+        std::vector<uint8_t> predecoded = tape;
+        EmulatorStats predecoded_stats =
+            emulate_predecoded_in_place(predecoded.data(), tape_size, head0, head1, 0, max_iter, true);
+        match = match && same(predecoded, predecoded_stats);
+
+        if (tape_size == 64) {
+            std::vector<uint8_t> fixed = tape;
+            match = match && same(fixed, emulate_fixed_in_place<64>(fixed.data(), head0, head1, 0, max_iter, true));
+        }
+
+        std::vector<Token> tokens = initialize_tokens_with_epoch(tape, t);
+        EmulatorResultWithTracer expected_tr = emulate_w_tracer_reference(tokens, head0, head1, 0, max_iter);
+        EmulatorResultWithTracer actual_tr = emulate_w_tracer(tokens, head0, head1, 0, max_iter, 0, true);
+        match = match && expected_tr.state == actual_tr.state && expected_tr.iteration == actual_tr.iteration &&
+                expected_tr.skipped == actual_tr.skipped && expected_tr.head0_pos == actual_tr.head0_pos &&
+                expected_tr.head1_pos == actual_tr.head1_pos && expected_tr.pc_pos == actual_tr.pc_pos;
+        for (size_t i = 0; match && i < expected_tr.tape.size(); i++) {
+            match = expected_tr.tape[i].value == actual_tr.tape[i].value;
+        }
+
+        if (!match) {
+            if (mismatches < 5) {
+                std::cout << "  Cycle detection mismatch on tape " << t << " (size " << tape_size
+                          << "): expected " << expected.state << " / " << expected.iteration
+                          << ", got " << generic.state << " / " << generic.iteration << std::endl;
+            }
+            mismatches++;
+        }
+    }
+
+    std::cout << "Tapes checked with cycle detection: " << num_tapes << ", mismatches: " << mismatches
+              << std::endl;
+    return mismatches == 0;
+}
+
+// Original fixed test case: emulate() and emulate_w_tracer() must agree
+bool check_fixed_case() {
     // Create test programs
     std::string prog1_str = "[[{.>]-]                ]-]>.{[[";
     std::vector<uint8_t> prog1(prog1_str.begin(), prog1_str.end());
@@ -77,5 +599,24 @@ int main() {
         std::cout << std::endl;
     }
 
-    return tapes_match ? 0 : 1;
+    return tapes_match;
+}
+
+int main() {
+    bool fixed_ok = check_fixed_case();
+
+    std::cout << "\nTesting indexed emulators against linear-scan reference..." << std::endl;
+    bool random_ok = check_random_tapes(20000);
+    random_ok = check_predecoded_runs(20000) && random_ok;
+    random_ok = check_fixed_sizes(2500) && random_ok;
+    random_ok = check_batches() && random_ok;
+    random_ok = check_cycle_detection(20000) && random_ok;
+
+    if (random_ok) {
+        std::cout << "SUCCESS: Indexed emulators are bit-identical to the reference!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Indexed emulators diverge from the reference!" << std::endl;
+    }
+
+    return (fixed_ok && random_ok) ? 0 : 1;
 }
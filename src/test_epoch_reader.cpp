@@ -0,0 +1,276 @@
+#include "epoch_reader.h"
+#include "snapshot.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <random>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+std::string temp_path(const std::string& name) {
+    return (fs::temp_directory_path() / name).string();
+}
+
+void write_file(const std::string& path, const std::string& contents) {
+    std::ofstream file(path, std::ios::binary);
+    file << contents;
+}
+
+// getline-based pairing parser the analysis tools used before
+struct ReferenceCell {
+    std::string program;
+    int combined_x;
+    int combined_y;
+};
+
+std::map<std::pair<int, int>, ReferenceCell> reference_pairing(const std::string& path) {
+    std::map<std::pair<int, int>, ReferenceCell> cells;
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+
+    while (std::getline(file, line)) {
+        std::vector<std::string> fields;
+        std::string field;
+        bool in_quotes = false;
+        for (char c : line) {
+            if (c == '"') {
+                in_quotes = !in_quotes;
+            } else if (c == ',' && !in_quotes) {
+                fields.push_back(field);
+                field.clear();
+            } else {
+                field += c;
+            }
+        }
+        fields.push_back(field);
+        if (fields.size() < 6) continue;
+
+        ReferenceCell cell{fields[3], std::stoi(fields[4]), std::stoi(fields[5])};
+        cells[{std::stoi(fields[1]), std::stoi(fields[2])}] = cell;
+    }
+    return cells;
+}
+
+// getline-based token parser the analysis tools used before
+std::map<std::pair<int, int>, std::vector<uint8_t>> reference_tokens(const std::string& path) {
+    std::map<std::pair<int, int>, std::vector<uint8_t>> programs;
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+
+    while (std::getline(file, line)) {
+        std::stringstream ss(line);
+        std::string field;
+        std::vector<std::string> fields;
+        while (std::getline(ss, field, ',')) {
+            if (!field.empty() && field.front() == '"') {
+                field = field.substr(1, field.size() - 2);
+            }
+            fields.push_back(field);
+        }
+        if (fields.size() < 7) continue;
+
+        auto key = std::make_pair(std::stoi(fields[1]), std::stoi(fields[2]));
+        int pos = std::stoi(fields[3]);
+        if (programs[key].size() <= static_cast<size_t>(pos)) {
+            programs[key].resize(pos + 1);
+        }
+        programs[key][pos] = static_cast<uint8_t>(std::stoi(fields[6]));
+    }
+    return programs;
+}
+
+bool check_pairing_csv() {
+    // Commas inside the quoted program, a short line, a duplicate cell,
+    // a missing cell, CRLF endings and no newline at the very end
+    std::string csv =
+        "epoch,position_x,position_y,program,combined_x,combined_y\n"
+        "7,0,0,\"[<,>]+\",1,0\n"
+        "7,1,0,\"  ..  \",0,0\n"
+        "7,2,0,\"{}{}\",-1,-1\r\n"
+        "7,0,1,broken\n"
+        "7,1,1,\"-+-+-+\",2,1\n"
+        "7,2,1,\"+\"\"+\",1,1\n"
+        "7,1,0,\"..,,..\",0,0\n"
+        "7,2,2,\"<>\",-1,-1";
+    std::string path = temp_path("bffpp_test_pairing.csv");
+    write_file(path, csv);
+
+    EpochGrid grid = read_pairing_epoch(path);
+    auto reference = reference_pairing(path);
+
+    bool ok = grid.epoch == 7 && grid.width == 3 && grid.height == 3;
+    int found = 0;
+    for (int y = 0; y < grid.height; y++) {
+        for (int x = 0; x < grid.width; x++) {
+            auto it = reference.find({x, y});
+            if ((it != reference.end()) != grid.has(x, y)) {
+                ok = false;
+                continue;
+            }
+            if (it == reference.end()) continue;
+            found++;
+
+            int partner = grid.partners[y * grid.width + x];
+            int combined_x = partner >= 0 ? partner % grid.width : -1;
+            int combined_y = partner >= 0 ? partner / grid.width : -1;
+            if (grid.program_string(x, y) != it->second.program ||
+                combined_x != it->second.combined_x || combined_y != it->second.combined_y) {
+                std::cout << "FAIL: cell (" << x << ", " << y << ") differs from the line parser" << std::endl;
+                ok = false;
+            }
+        }
+    }
+    ok = ok && found == static_cast<int>(reference.size());
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": pairing CSV matches the line parser on " << found << " cells" << std::endl;
+    fs::remove(path);
+    return ok;
+}
+
+bool check_token_csv() {
+    std::mt19937 rng(4);
+    std::uniform_int_distribution<> byte_dist(0, 255);
+
+    // A 5x4 grid of 6-token programs, written like save_tokens_to_csv
+    // but with cell (3, 2) left out and rows in shuffled program order
+    std::ostringstream csv;
+    csv << "epoch_snapshot,grid_x,grid_y,pos_in_program,token_epoch,token_orig_pos,char,char_ascii\n";
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 5; x++) {
+            if (x == 3 && y == 2) continue;
+            for (int i = 5; i >= 0; i--) {
+                int c = byte_dist(rng);
+                csv << 12 << "," << x << "," << y << "," << i << "," << 3 << "," << i << "," << c << ",";
+                if (c >= 32 && c <= 126) {
+                    csv << "\"" << static_cast<char>(c) << "\"";
+                } else {
+                    csv << "\"\"";
+                }
+                csv << "\n";
+            }
+        }
+    }
+    std::string path = temp_path("bffpp_test_tokens.csv");
+    write_file(path, csv.str());
+
+    EpochGrid grid = read_token_epoch(path);
+    auto reference = reference_tokens(path);
+
+    bool ok = grid.epoch == 12 && grid.width == 5 && grid.height == 4 && !grid.has(3, 2);
+    for (const auto& [key, program] : reference) {
+        if (!grid.has(key.first, key.second) || grid.program(key.first, key.second).to_vector() != program) {
+            ok = false;
+        }
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": token CSV matches the line parser" << std::endl;
+    fs::remove(path);
+    return ok;
+}
+
+bool check_snapshots() {
+    std::mt19937 rng(8);
+    std::uniform_int_distribution<> byte_dist(0, 255);
+
+    Snapshot pairing;
+    pairing.kind = SnapshotKind::Programs;
+    pairing.epoch = 40;
+    pairing.width = 6;
+    pairing.height = 5;
+    pairing.program_size = 16;
+    for (int i = 0; i < 6 * 5 * 16; i++) pairing.bytes.push_back(static_cast<uint8_t>(byte_dist(rng)));
+    for (int i = 0; i < 30; i++) pairing.partners.push_back(i ^ 1);
+    pairing.partners[29] = -1;
+
+    Snapshot tokens = pairing;
+    tokens.kind = SnapshotKind::Tokens;
+    tokens.bytes.clear();
+    tokens.partners.clear();
+    for (int i = 0; i < 6 * 5 * 16; i++) {
+        tokens.tokens.push_back((static_cast<uint64_t>(i) << 24) | static_cast<uint64_t>(byte_dist(rng)));
+    }
+
+    std::string pairing_path = temp_path("bffpp_test_reader_pairing.bffs");
+    std::string token_path = temp_path("bffpp_test_reader_tokens.bffs");
+    write_snapshot(pairing_path, pairing, SnapshotCodec::Brotli);
+    write_snapshot(token_path, tokens, SnapshotCodec::Raw);
+
+    EpochGrid a = read_pairing_epoch(pairing_path);
+    EpochGrid b = read_token_epoch(token_path);
+
+    bool ok = a.epoch == 40 && a.width == 6 && a.height == 5 && a.programs == pairing.bytes &&
+              a.partners == pairing.partners && b.epoch == 40 && b.has(5, 4);
+    for (size_t i = 0; ok && i < tokens.tokens.size(); i++) {
+        ok = b.programs[i] == static_cast<uint8_t>(tokens.tokens[i] & 0xFF);
+    }
+
+    // A token snapshot is not a pairing dump
+    try {
+        read_pairing_epoch(token_path);
+        ok = false;
+    } catch (const std::runtime_error&) {
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": snapshots load into the same flat grids" << std::endl;
+    fs::remove(pairing_path);
+    fs::remove(token_path);
+    return ok;
+}
+
+bool check_prefetcher() {
+    std::vector<std::string> paths;
+    for (int epoch = 0; epoch < 6; epoch++) {
+        std::ostringstream csv;
+        csv << "epoch,position_x,position_y,program,combined_x,combined_y\n"
+            << epoch << ",0,0,\"+\",-1,-1\n";
+        paths.push_back(temp_path("bffpp_test_prefetch_" + std::to_string(epoch) + ".csv"));
+        write_file(paths.back(), csv.str());
+    }
+    fs::remove(paths[4]);
+
+    EpochPrefetcher prefetcher(read_pairing_epoch);
+    bool ok = true;
+
+    // In order, one ahead
+    for (int epoch = 0; epoch < 3; epoch++) {
+        ok = ok && prefetcher.read(paths[epoch], paths[epoch + 1]).epoch == epoch;
+    }
+    // Skipping the prefetched file falls back to a direct read
+    ok = ok && prefetcher.read(paths[5], paths[4]).epoch == 5;
+
+    // The missing file fails when it is read, not when it is prefetched
+    try {
+        prefetcher.read(paths[4]);
+        ok = false;
+    } catch (const std::runtime_error&) {
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": prefetcher returns every epoch and reports read errors in place" << std::endl;
+    for (const std::string& path : paths) {
+        fs::remove(path);
+    }
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing memory-mapped epoch readers..." << std::endl;
+
+    bool ok = check_pairing_csv();
+    ok = check_token_csv() && ok;
+    ok = check_snapshots() && ok;
+    ok = check_prefetcher() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Epoch readers agree with the line-by-line parsers!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Epoch reader checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
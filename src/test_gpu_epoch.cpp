@@ -0,0 +1,168 @@
+#include "gpu_epoch.h"
+#include "emulator.h"
+#include "utils.h"
+#include "grid.h"
+#include "rng.h"
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+bool check_stream() {
+    bool ok = true;
+    for (uint64_t cell = 0; cell < 2000 && ok; cell++) {
+        CounterRng expected(42, RngDomain::Mutation, 7, cell);
+        gpu_epoch::Stream stream(42, RngDomain::Mutation, 7, cell);
+        ok = ok && stream.next_u64() == expected.next_u64();
+        ok = ok && stream.next_byte() == expected.next_byte();
+        ok = ok && stream.next_below(12) == expected.next_below(12);
+        ok = ok && stream.next_geometric(std::log1p(-0.01)) == expected.next_geometric(std::log1p(-0.01));
+        ok = ok && gpu_epoch::Stream::hash(42, RngDomain::PairingOrder, 7, cell) ==
+                   CounterRng::hash(42, RngDomain::PairingOrder, 7, cell);
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": device streams match CounterRng" << std::endl;
+    return ok;
+}
+
+// Run the pairing rounds on the host, the way the kernels do
+int pair_in_rounds(int width, int height, uint64_t seed, uint64_t epoch, std::vector<int32_t>& partner,
+                   std::vector<uint64_t>& keys) {
+    int total_cells = width * height;
+    keys.resize(total_cells);
+    partner.assign(total_cells, gpu_epoch::UNRESOLVED);
+    for (int i = 0; i < total_cells; i++) {
+        keys[i] = gpu_epoch::Stream::hash(seed, RngDomain::PairingOrder, epoch, i);
+    }
+
+    std::vector<char> ready(total_cells);
+    int rounds = 0;
+    while (std::count(partner.begin(), partner.end(), gpu_epoch::UNRESOLVED) > 0) {
+        for (int i = 0; i < total_cells; i++) {
+            ready[i] = gpu_epoch::pairing_ready(i, partner.data(), keys.data(), width, height);
+        }
+        for (int i = 0; i < total_cells; i++) {
+            if (ready[i]) {
+                gpu_epoch::pairing_resolve(i, partner.data(), width, height, seed, epoch);
+            }
+        }
+        rounds++;
+    }
+    return rounds;
+}
+
+bool check_pairing() {
+    const int sizes[][2] = {{40, 30}, {120, 90}, {7, 5}, {1, 9}, {2, 2}};
+    bool ok = true;
+    int max_rounds = 0;
+
+    for (const auto& size : sizes) {
+        int width = size[0];
+        int height = size[1];
+        for (uint64_t epoch = 1; epoch <= 3; epoch++) {
+            Grid grid(width, height, 8);
+            std::vector<std::pair<int, int>> pairs = grid.create_spatial_pairs(gpu_epoch::PAIRING_RADIUS, 99, epoch);
+
+            std::vector<int32_t> partner;
+            std::vector<uint64_t> keys;
+            max_rounds = std::max(max_rounds, pair_in_rounds(width, height, 99, epoch, partner, keys));
+
+            for (const auto& [a, b] : pairs) {
+                if (a == -1) {
+                    ok = ok && partner[b] == gpu_epoch::SOLO;
+                } else {
+                    ok = ok && partner[a] == b && partner[b] == a && gpu_epoch::visited_before(keys.data(), a, b);
+                }
+            }
+        }
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": pairing rounds reproduce create_spatial_pairs ("
+              << max_rounds << " rounds at most)" << std::endl;
+    return ok;
+}
+
+bool check_emulation() {
+    const std::string alphabet = "<>{}-+.,[]0 ";
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+
+    bool ok = true;
+    for (int trial = 0; trial < 20000 && ok; trial++) {
+        std::vector<uint8_t> tape(128);
+        for (uint8_t& byte : tape) {
+            byte = static_cast<uint8_t>(alphabet[pick(rng)]);
+        }
+
+        std::vector<uint8_t> expected_tape = tape;
+        EmulatorStats expected = emulate_in_place(expected_tape.data(), 128, 0, 64, 0, gpu_epoch::MAX_ITER);
+        EmulatorStats result = gpu_epoch::emulate_tape(tape.data(), 128, 0, 64, 0, gpu_epoch::MAX_ITER);
+
+        ok = tape == expected_tape && result.status == expected.status &&
+             result.iteration == expected.iteration && result.skipped == expected.skipped;
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": emulate_tape matches emulate_in_place" << std::endl;
+    return ok;
+}
+
+bool check_mutation() {
+    bool ok = true;
+    for (double rate : {0.0, 0.0005, 0.05, 0.5, 1.0}) {
+        double log_q = (rate > 0.0 && rate < 1.0) ? std::log1p(-rate) : 0.0;
+        for (uint64_t cell = 0; cell < 500; cell++) {
+            std::vector<uint8_t> expected(64, ' ');
+            std::vector<uint8_t> program(64, ' ');
+            CounterRng cell_rng(3, RngDomain::Mutation, 11, cell);
+            mutate_in_place(expected.data(), 64, rate, cell_rng);
+            gpu_epoch::mutate_program(program.data(), 64, rate, log_q, 3, 11, cell);
+            ok = ok && program == expected;
+        }
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": mutate_program matches mutate_in_place" << std::endl;
+    return ok;
+}
+
+bool check_colors() {
+    std::mt19937 rng(8);
+    Grid grid(1, 1, 64);
+
+    bool ok = true;
+    for (int trial = 0; trial < 20000; trial++) {
+        // Vary the mix so every ratio shows up
+        std::vector<uint8_t> program(64);
+        int instruction_share = trial % 65;
+        for (int i = 0; i < 64; i++) {
+            program[i] = (i < instruction_share) ? static_cast<uint8_t>("<>{}-+.,[]"[rng() % 10])
+                                                 : static_cast<uint8_t>(rng() % 256);
+        }
+
+        RGB expected = grid.program_to_color(program);
+        uint8_t rgb[3];
+        gpu_epoch::program_color(program.data(), 64, rgb);
+        ok = ok && rgb[0] == expected.r && rgb[1] == expected.g && rgb[2] == expected.b;
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": program_color matches Grid::program_to_color" << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing GPU epoch steps on the host..." << std::endl;
+
+    bool ok = check_stream();
+    ok = check_pairing() && ok;
+    ok = check_emulation() && ok;
+    ok = check_mutation() && ok;
+    ok = check_colors() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: GPU epoch steps match the CPU implementation!" << std::endl;
+    } else {
+        std::cout << "FAILURE: GPU epoch steps differ from the CPU implementation!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+#include "grid.h"
+#include "video_pipe.h"
+#include "utils.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <cstring>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// Colors computed from scratch, as program_to_color gives them
+std::vector<RGB> fresh_colors(const Grid& grid) {
+    std::vector<RGB> colors;
+    for (int i = 0; i < grid.get_total_programs(); i++) {
+        colors.push_back(grid.program_to_color(grid.program_at(i)));
+    }
+    return colors;
+}
+
+bool same_colors(const std::vector<RGB>& a, const std::vector<RGB>& b) {
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(RGB)) == 0;
+}
+
+bool check_color_cache() {
+    std::mt19937 rng(31);
+    Grid grid(24, 16, 32);
+    grid.initialize_random(rng);
+    bool ok = same_colors(grid.colors(), fresh_colors(grid));
+
+    // Epochs: most programs copied over, some rewritten or mutated
+    for (int epoch = 0; epoch < 5 && ok; epoch++) {
+        grid.begin_epoch();
+        for (int i = 0; i < grid.get_total_programs(); i++) {
+            Span<const uint8_t> program = grid.program_at(i);
+            std::copy(program.begin(), program.end(), grid.next_program(i).begin());
+            if ((i + epoch) % 7 == 0) {
+                mutate_in_place(grid.next_program(i).data(), 32, 0.3, rng);
+            }
+            if ((i + epoch) % 29 == 0) {
+                std::fill(grid.next_program(i).begin(), grid.next_program(i).end(), static_cast<uint8_t>("[+<"[epoch % 3]));
+            }
+        }
+        grid.commit_epoch();
+        ok = same_colors(grid.colors(), fresh_colors(grid));
+    }
+    if (!ok) {
+        std::cout << "FAIL: cached colors differ after an epoch" << std::endl;
+        return false;
+    }
+
+    // Writes outside an epoch, through every way in
+    std::fill(grid.program_at(3).begin(), grid.program_at(3).end(), static_cast<uint8_t>('['));
+    std::fill(grid.get_program(5, 2).begin(), grid.get_program(5, 2).end(), static_cast<uint8_t>('{'));
+    std::vector<uint8_t> adds(32, '+');
+    grid.set_program(1, 1, adds);
+    ok = same_colors(grid.colors(), fresh_colors(grid));
+
+    Grid other(24, 16, 32);
+    other.initialize_random(rng);
+    grid.load_snapshot(other.to_snapshot(0));
+    ok = ok && same_colors(grid.colors(), fresh_colors(grid)) && same_colors(grid.colors(), other.colors());
+
+    // Several epochs between two looks at the colors
+    for (int epoch = 0; epoch < 3; epoch++) {
+        grid.begin_epoch();
+        for (int i = 0; i < grid.get_total_programs(); i++) {
+            Span<const uint8_t> program = grid.program_at(i);
+            std::copy(program.begin(), program.end(), grid.next_program(i).begin());
+            if (i % 11 == epoch) {
+                mutate_in_place(grid.next_program(i).data(), 32, 0.5, rng);
+            }
+        }
+        grid.commit_epoch();
+    }
+    ok = ok && same_colors(grid.colors(), fresh_colors(grid));
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": cached colors follow epochs, writes and snapshots" << std::endl;
+    return ok;
+}
+
+bool check_ppm() {
+    std::mt19937 rng(32);
+    Grid grid(5, 3, 16);
+    grid.initialize_random(rng);
+    std::string path = (fs::temp_directory_path() / "bffpp_test_grid_colors.ppm").string();
+    grid.save_ppm(path, 2);
+
+    std::ifstream file(path, std::ios::binary);
+    std::string magic;
+    int width = 0, height = 0, max_value = 0;
+    file >> magic >> width >> height >> max_value;
+    file.get();
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 3);
+    file.read(reinterpret_cast<char*>(pixels.data()), pixels.size());
+    bool ok = magic == "P6" && width == 10 && height == 6 && max_value == 255 && file.gcount() == 180 &&
+              file.peek() == EOF;
+
+    // Every pixel is its cell's color
+    const std::vector<RGB>& colors = grid.colors();
+    for (int y = 0; y < height && ok; y++) {
+        for (int x = 0; x < width; x++) {
+            const RGB& color = colors[(y / 2) * 5 + x / 2];
+            const uint8_t* pixel = pixels.data() + (static_cast<size_t>(y) * width + x) * 3;
+            ok = ok && pixel[0] == color.r && pixel[1] == color.g && pixel[2] == color.b;
+        }
+    }
+    ok = ok && Grid::render_colors(5, 3, colors, 2) == pixels;
+    fs::remove(path);
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": binary PPM frames" << std::endl;
+    return ok;
+}
+
+bool check_video_pipe() {
+    // Any command reading frames on stdin will do; cat keeps them for us
+    std::string path = (fs::temp_directory_path() / "bffpp_test_grid_colors.rgb").string();
+    std::vector<RGB> colors(4 * 2, RGB{10, 20, 30});
+    colors[5] = RGB{1, 2, 3};
+    std::vector<uint8_t> frame = Grid::render_colors(4, 2, colors, 3);
+
+    bool ok;
+    {
+        VideoPipe pipe("cat > '" + path + "'", 12, 6);
+        ok = pipe.write(frame) && pipe.write(frame) && pipe.frames_written() == 2;
+
+        bool threw = false;
+        try {
+            pipe.write(std::vector<uint8_t>(10));
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        ok = ok && threw && pipe.close();
+    }
+    ok = ok && fs::file_size(path) == 2 * frame.size();
+    fs::remove(path);
+
+    // An encoder that exits at once stops taking frames instead of killing us
+    VideoPipe gone("exit 3", 12, 6);
+    std::vector<uint8_t> big(12 * 6 * 3);
+    bool refused = false;
+    for (int i = 0; i < 20000 && !refused; i++) {
+        refused = !gone.write(big);
+    }
+    ok = ok && refused && !gone.close();
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": frames piped to an encoder process" << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing grid colors and frames..." << std::endl;
+
+    bool ok = check_color_cache();
+    ok = check_ppm() && ok;
+    ok = check_video_pipe() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Grid colors and frames match!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Grid color checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+#include "grid_experiment.h"
+#include "thread_pool.h"
+#include <iostream>
+#include <vector>
+#include <memory>
+
+Config small_config(int seed, bool counter_rng) {
+    Config config;
+    config.random_seed = seed;
+    config.program_size = 64;
+    config.epochs = 12;
+    config.mutation_rate = 0.00024;
+    config.eval_interval = 4;
+    config.grid_width = 24;
+    config.grid_height = 16;
+    config.use_grid = true;
+    config.visualization_interval = 100;
+    config.num_threads = 0;
+    config.counter_rng = counter_rng;
+    config.fused_mutation = false;
+    config.emulator_backend = "scalar";
+    config.cycle_detection = false;
+    config.pair_cache_size = 0;
+    config.pairing = "sequential";
+    config.numa_tiles = false;
+    config.brotli_quality = 11;
+    config.brotli_window = 22;
+    config.hoe_shards = 1;
+    config.output_threads = 0;
+    config.output_queue = 8;
+    config.output_backpressure = "block";
+    return config;
+}
+
+// Final programs and log of an experiment run on its own
+std::pair<std::vector<uint8_t>, std::string> run_alone(const Config& config) {
+    ThreadPool pool(1);
+    GridExperiment experiment("alone", config, "", pool);
+    std::string log;
+    while (!experiment.finished()) {
+        experiment.step();
+        log += experiment.take_log();
+    }
+    Span<const uint8_t> bytes = experiment.grid().all_bytes();
+    return {std::vector<uint8_t>(bytes.begin(), bytes.end()), log};
+}
+
+bool check_interleaved() {
+    std::vector<Config> configs = {small_config(1, false), small_config(2, false), small_config(3, true),
+                                   small_config(4, true)};
+    configs[1].epochs = 7;
+    configs[2].emulator_backend = "batch";
+    configs[3].numa_tiles = true;
+
+    // All of them stepping side by side on one pool, as bffpp_batch does
+    ThreadPool pool(4);
+    std::vector<std::unique_ptr<GridExperiment>> experiments;
+    std::vector<std::string> logs(configs.size());
+    for (const Config& config : configs) {
+        experiments.push_back(std::make_unique<GridExperiment>("shared", config, "", pool));
+    }
+    for (bool running = true; running;) {
+        running = false;
+        pool.parallel_for(experiments.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                if (!experiments[i]->finished()) {
+                    experiments[i]->step();
+                }
+            }
+        });
+        for (size_t i = 0; i < experiments.size(); i++) {
+            logs[i] += experiments[i]->take_log();
+            running = running || !experiments[i]->finished();
+        }
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < configs.size(); i++) {
+        auto expected = run_alone(configs[i]);
+        Span<const uint8_t> bytes = experiments[i]->grid().all_bytes();
+        bool same = std::vector<uint8_t>(bytes.begin(), bytes.end()) == expected.first &&
+                    logs[i] == expected.second && experiments[i]->epoch() == configs[i].epochs;
+        if (!same) {
+            std::cout << "FAIL: experiment " << i << " differs from its run on its own" << std::endl;
+        }
+        ok = ok && same;
+    }
+
+    // Different seeds must still give different soups
+    ok = ok && run_alone(configs[0]).first != run_alone(small_config(2, false)).first;
+
+    // NUMA tiles are honoured and, as in bffpp_grid, change nothing
+    ok = ok && run_alone(configs[3]) == run_alone(small_config(4, true));
+
+    if (ok) {
+        std::cout << "PASS: " << configs.size() << " interleaved experiments match their runs on their own"
+                  << std::endl;
+    }
+    return ok;
+}
+
+bool check_live_update() {
+    ThreadPool pool(2);
+    GridExperiment experiment("sweep \"a\"", small_config(5, true), "", pool);
+    experiment.step(true);
+
+    std::string json = experiment.to_json();
+    bool ok = json.rfind("{\"experiment\":\"sweep \\\"a\\\"\",\"epoch\":1,", 0) == 0 && experiment.entropy() != 0.0;
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": live updates name their experiment" << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing grid experiments..." << std::endl;
+
+    bool ok = check_interleaved();
+    ok = check_live_update() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Grid experiments step independently on a shared pool!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Grid experiment checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+#include "grid_frame.h"
+#include "grid.h"
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <stdexcept>
+
+bool same_colors(const std::vector<RGB>& a, const std::vector<RGB>& b) {
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(RGB)) == 0;
+}
+
+GridFrameType frame_type(const std::vector<uint8_t>& frame) {
+    uint32_t type;
+    std::memcpy(&type, frame.data() + 4, sizeof(type));
+    return static_cast<GridFrameType>(type);
+}
+
+// A client applying whatever it is sent, starting from nothing
+struct Viewer {
+    std::vector<RGB> colors;
+    int width = 0;
+    int height = 0;
+    GridFrameStats stats;
+
+    void apply(const std::vector<uint8_t>& frame) {
+        GridFrameType type;
+        apply_grid_frame(frame.data(), frame.size(), type, stats, width, height, colors);
+    }
+};
+
+bool check_grid_frames() {
+    // Real program colors: few distinct ones, so keyframes use a palette
+    std::mt19937 rng(21);
+    Grid grid(40, 30, 64);
+    grid.initialize_random(rng);
+
+    GridFrameEncoder encoder;
+    Viewer viewer;
+    GridFrameStats stats{3, 1.25, 17.5, 0.5};
+    encoder.encode(stats, 40, 30, grid.colors(), false);
+    bool ok = encoder.delta().empty() && !encoder.keyframe().empty() &&
+              frame_type(encoder.keyframe()) == GridFrameType::Palette;
+    viewer.apply(encoder.keyframe());
+    ok = ok && same_colors(viewer.colors, grid.colors()) && viewer.width == 40 && viewer.height == 30 &&
+         viewer.stats.epoch == 3 && viewer.stats.entropy == 1.25 && viewer.stats.avg_iters == 17.5;
+
+    // A few programs change; the delta carries only those cells
+    size_t keyframe_size = encoder.keyframe().size();
+    for (int i = 0; i < grid.get_total_programs(); i += 97) {
+        Span<uint8_t> program = grid.program_at(i);
+        std::fill(program.begin(), program.end(), static_cast<uint8_t>('['));
+    }
+    stats.epoch = 4;
+    encoder.encode(stats, 40, 30, grid.colors(), false);
+    ok = ok && encoder.keyframe().empty() && frame_type(encoder.delta()) == GridFrameType::Delta &&
+         encoder.delta().size() < keyframe_size / 4;
+    viewer.apply(encoder.delta());
+    ok = ok && same_colors(viewer.colors, grid.colors()) && viewer.stats.epoch == 4;
+
+    // A late viewer asks for a keyframe; both stay in step afterwards
+    Viewer late;
+    encoder.encode(stats, 40, 30, grid.colors(), true);
+    ok = ok && !encoder.keyframe().empty() && !encoder.delta().empty();
+    viewer.apply(encoder.delta());
+    late.apply(encoder.keyframe());
+    ok = ok && same_colors(viewer.colors, late.colors);
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": palette keyframes and deltas rebuild the grid ("
+              << keyframe_size << " bytes against " << grid.to_json(3, 1.25, 17.5, 0.5).size()
+              << " of JSON)" << std::endl;
+    return ok;
+}
+
+bool check_rgb_frames() {
+    // More than 256 colors: raw RGB keyframes, and no delta when most cells change
+    std::mt19937 rng(22);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<RGB> colors(50 * 20);
+    for (RGB& color : colors) {
+        color = RGB{static_cast<uint8_t>(byte(rng)), static_cast<uint8_t>(byte(rng)), static_cast<uint8_t>(byte(rng))};
+    }
+
+    GridFrameEncoder encoder;
+    Viewer viewer;
+    encoder.encode(GridFrameStats{}, 50, 20, colors, false);
+    bool ok = frame_type(encoder.keyframe()) == GridFrameType::Rgb &&
+              encoder.keyframe().size() == GRID_FRAME_HEADER_SIZE + colors.size() * 3;
+    viewer.apply(encoder.keyframe());
+
+    for (RGB& color : colors) {
+        color.g ^= 0x55;
+    }
+    encoder.encode(GridFrameStats{}, 50, 20, colors, false);
+    ok = ok && encoder.delta().empty() && frame_type(encoder.keyframe()) == GridFrameType::Rgb;
+    viewer.apply(encoder.keyframe());
+    ok = ok && same_colors(viewer.colors, colors);
+
+    // A new shape always starts with a keyframe
+    colors.resize(10 * 10);
+    encoder.encode(GridFrameStats{}, 10, 10, colors, false);
+    ok = ok && encoder.delta().empty() && !encoder.keyframe().empty();
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": many-colored grids fall back to RGB keyframes" << std::endl;
+    return ok;
+}
+
+bool check_rejects_bad_frames() {
+    std::vector<RGB> colors(4 * 4, RGB{1, 2, 3});
+    GridFrameEncoder encoder;
+    encoder.encode(GridFrameStats{}, 4, 4, colors, false);
+    std::vector<uint8_t> keyframe = encoder.keyframe();
+    colors[5] = RGB{9, 9, 9};
+    encoder.encode(GridFrameStats{}, 4, 4, colors, false);
+    std::vector<uint8_t> delta = encoder.delta();
+
+    auto throws = [](const std::vector<uint8_t>& frame, Viewer& viewer) {
+        try {
+            viewer.apply(frame);
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+
+    Viewer fresh;
+    bool ok = throws(delta, fresh);  // A delta needs the keyframe first
+    std::vector<uint8_t> truncated(keyframe.begin(), keyframe.end() - 1);
+    ok = throws(truncated, fresh) && ok;
+    std::vector<uint8_t> bad_magic = keyframe;
+    bad_magic[0] = 'X';
+    ok = throws(bad_magic, fresh) && ok;
+
+    bool encoder_threw = false;
+    try {
+        encoder.encode(GridFrameStats{}, 5, 4, colors, false);
+    } catch (const std::runtime_error&) {
+        encoder_threw = true;
+    }
+    ok = ok && encoder_threw;
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": malformed and out-of-order frames are rejected" << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing binary grid frames..." << std::endl;
+
+    bool ok = check_grid_frames();
+    ok = check_rgb_frames() && ok;
+    ok = check_rejects_bad_frames() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Grid frames round-trip!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Grid frame checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,273 @@
+#include "metrics_engine.h"
+#include "metrics.h"
+#include "thread_pool.h"
+#include "program_arena.h"
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+// Random soup with some structure, so compression has something to find
+std::vector<uint8_t> make_soup(size_t size, std::mt19937& rng) {
+    std::uniform_int_distribution<> byte_dist(0, 255);
+    std::vector<uint8_t> soup(size);
+    for (size_t i = 0; i < size; i++) {
+        soup[i] = (i % 64 < 16) ? static_cast<uint8_t>("[<>]+-.,"[i % 8]) : static_cast<uint8_t>(byte_dist(rng));
+    }
+    return soup;
+}
+
+bool check_running_histogram() {
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<> byte_dist(0, 255);
+    std::vector<uint8_t> soup = make_soup(64 * 1024, rng);
+
+    ThreadPool pool(4);
+    MetricsEngine engine(MetricsOptions(), &pool);
+    engine.reset(soup.data(), soup.size());
+
+    bool ok = true;
+    for (int epoch = 0; epoch < 50; epoch++) {
+        std::vector<uint8_t> previous = soup;
+
+        // Touch a few hundred bytes, like emulation plus 1/4096 mutation
+        std::uniform_int_distribution<size_t> pos_dist(0, soup.size() - 1);
+        for (int k = 0; k < 300; k++) {
+            soup[pos_dist(rng)] = static_cast<uint8_t>(byte_dist(rng));
+        }
+
+        engine.update(previous.data(), soup.data(), soup.size());
+
+        if (engine.shannon_entropy() != shannon_entropy(soup)) {
+            std::cout << "FAIL: running histogram drifted at epoch " << epoch << std::endl;
+            ok = false;
+            break;
+        }
+    }
+
+    if (ok) {
+        double a = engine.higher_order_entropy(soup.data(), soup.size());
+        double b = higher_order_entropy(soup);
+        if (a != b) {
+            std::cout << "FAIL: default engine HOE " << a << " != higher_order_entropy " << b << std::endl;
+            ok = false;
+        }
+    }
+
+    if (ok) {
+        std::cout << "PASS: running histogram matches a full recount, HOE is identical" << std::endl;
+    }
+    return ok;
+}
+
+bool check_sharded_estimate() {
+    std::mt19937 rng(11);
+    std::vector<uint8_t> soup = make_soup(256 * 1024, rng);
+
+    MetricsOptions options;
+    options.brotli_quality = 5;
+    options.shards = 8;
+
+    ThreadPool pool(4);
+    MetricsEngine parallel(options, &pool);
+    MetricsEngine serial(options, nullptr);
+
+    double k_parallel = parallel.kolmogorov_complexity_estimate(soup.data(), soup.size());
+    double k_serial = serial.kolmogorov_complexity_estimate(soup.data(), soup.size());
+    double k_full = kolmogorov_complexity_estimate(soup);
+
+    bool ok = true;
+    if (k_parallel != k_serial) {
+        std::cout << "FAIL: sharded estimate depends on the pool" << std::endl;
+        ok = false;
+    }
+
+    // Sharding and a lower quality cost a little accuracy, not a lot
+    if (std::abs(k_parallel - k_full) > 0.5) {
+        std::cout << "FAIL: sharded estimate " << k_parallel << " too far from " << k_full << std::endl;
+        ok = false;
+    }
+
+    // Odd sizes and more shards than bytes must not break
+    double tiny = parallel.kolmogorov_complexity_estimate(soup.data(), 5);
+    if (!(tiny > 0.0)) {
+        std::cout << "FAIL: tiny input gave " << tiny << std::endl;
+        ok = false;
+    }
+
+    if (ok) {
+        std::cout << "PASS: sharded estimate " << k_parallel << " vs full " << k_full << std::endl;
+    }
+    return ok;
+}
+
+bool check_streamed_estimate() {
+    std::mt19937 rng(13);
+    std::vector<uint8_t> soup = make_soup(256 * 1024, rng);
+
+    // The streaming encoder gives the one-shot size at any chunk size
+    bool ok = true;
+    for (size_t chunk : {size_t(1) << 20, size_t(1) << 15, size_t(4099)}) {
+        for (int quality : {5, 11}) {
+            double streamed = streamed_compressed_size(soup.data(), soup.size(), quality, 22, chunk);
+            double one_shot = compressed_size(soup.data(), soup.size(), quality, 22);
+            if (streamed != one_shot) {
+                std::cout << "FAIL: streamed size " << streamed << " != " << one_shot << " (quality " << quality
+                          << ", chunks of " << chunk << ")" << std::endl;
+                ok = false;
+            }
+        }
+    }
+
+    // A streaming engine over a mapped soup, sharded or not
+    std::string path = "test_metrics_engine_soup.bin";
+    {
+        ProgramArena<uint8_t> mapped(static_cast<int>(soup.size() / 64), 64, path);
+        std::copy(soup.begin(), soup.end(), mapped.data());
+
+        ThreadPool pool(4);
+        for (int shards : {1, 8}) {
+            MetricsOptions options;
+            options.brotli_quality = 5;
+            options.shards = shards;
+            MetricsEngine in_memory(options, &pool);
+            options.streaming = true;
+            MetricsEngine streaming(options, &pool);
+
+            double k_memory = in_memory.kolmogorov_complexity_estimate(soup.data(), soup.size());
+            double k_streamed = streaming.kolmogorov_complexity_estimate(mapped.data(), mapped.size());
+            if (k_memory != k_streamed) {
+                std::cout << "FAIL: streaming engine " << k_streamed << " != " << k_memory << " with "
+                          << shards << " shards" << std::endl;
+                ok = false;
+            }
+        }
+    }
+    std::remove(path.c_str());
+
+    if (ok) {
+        std::cout << "PASS: streamed compression gives the one-shot sizes, also over a mapped soup" << std::endl;
+    }
+    return ok;
+}
+
+bool check_matching_bytes() {
+    std::mt19937 rng(17);
+    std::uniform_int_distribution<> byte_dist(0, 3);
+
+    // Every length around the 64-byte vectors, at every offset into them
+    bool ok = true;
+    std::vector<uint8_t> a(300), b(300);
+    for (size_t i = 0; i < a.size(); i++) {
+        a[i] = static_cast<uint8_t>(byte_dist(rng));
+        b[i] = static_cast<uint8_t>(byte_dist(rng));
+    }
+    for (size_t offset = 0; offset < 3 && ok; offset++) {
+        for (size_t size = 0; size + offset <= a.size(); size++) {
+            size_t expected = 0;
+            for (size_t i = 0; i < size; i++) {
+                expected += (a[offset + i] == b[offset + i]) ? 1 : 0;
+            }
+            if (matching_bytes(a.data() + offset, b.data() + offset, size) != expected) {
+                std::cout << "FAIL: matching_bytes wrong for " << size << " bytes at offset " << offset
+                          << std::endl;
+                ok = false;
+                break;
+            }
+        }
+    }
+    ok = ok && matching_bytes(a.data(), a.data(), a.size()) == a.size();
+
+    if (ok) {
+        std::cout << "PASS: matching_bytes agrees with a byte loop" << std::endl;
+    }
+    return ok;
+}
+
+// Levenshtein distance from the full dynamic programming table
+size_t reference_edit_distance(const std::string& a, const std::string& b) {
+    std::vector<std::vector<size_t>> dp(a.size() + 1, std::vector<size_t>(b.size() + 1));
+    for (size_t i = 0; i <= a.size(); i++) dp[i][0] = i;
+    for (size_t j = 0; j <= b.size(); j++) dp[0][j] = j;
+    for (size_t i = 1; i <= a.size(); i++) {
+        for (size_t j = 1; j <= b.size(); j++) {
+            size_t substitution = dp[i - 1][j - 1] + (a[i - 1] == b[j - 1] ? 0 : 1);
+            dp[i][j] = std::min({dp[i - 1][j] + 1, dp[i][j - 1] + 1, substitution});
+        }
+    }
+    return dp[a.size()][b.size()];
+}
+
+bool check_edit_distance() {
+    std::mt19937 rng(19);
+    std::uniform_int_distribution<size_t> length_dist(0, 200);
+    std::uniform_int_distribution<int> char_dist(0, 3);
+
+    // Few distinct characters, so that strings share long runs; lengths on
+    // both sides of the 64-character word
+    std::vector<std::string> programs;
+    bool ok = true;
+    for (int k = 0; k < 300 && ok; k++) {
+        std::string a(k < 100 ? 64 : length_dist(rng), ' ');
+        std::string b(k < 100 ? 64 : length_dist(rng), ' ');
+        for (char& c : a) c = "[]+-"[char_dist(rng)];
+        for (char& c : b) c = "[]+-"[char_dist(rng)];
+        if (k % 10 == 0 && !a.empty()) {
+            b = a;
+            b[a.size() / 2] = '.';
+        }
+        if (edit_distance(a, b) != reference_edit_distance(a, b)) {
+            std::cout << "FAIL: edit distance of lengths " << a.size() << " and " << b.size() << " is "
+                      << edit_distance(a, b) << ", not " << reference_edit_distance(a, b) << std::endl;
+            ok = false;
+        }
+        if (k < 20) {
+            programs.push_back(a);
+        }
+    }
+
+    // The matrix with and without the pool, against the pairwise calls
+    ThreadPool pool(4);
+    MetricsEngine parallel(MetricsOptions(), &pool);
+    MetricsEngine serial(MetricsOptions(), nullptr);
+    std::vector<double> edit = parallel.distance_matrix(programs, programs);
+    std::vector<double> ncd = parallel.distance_matrix(programs, programs, ProgramDistance::Compression);
+    ok = ok && edit == serial.distance_matrix(programs, programs) &&
+         ncd == serial.distance_matrix(programs, programs, ProgramDistance::Compression);
+    for (size_t i = 0; i < programs.size() && ok; i++) {
+        for (size_t j = 0; j < programs.size(); j++) {
+            size_t k = i * programs.size() + j;
+            if (edit[k] != normalized_edit_distance(programs[i], programs[j]) ||
+                ncd[k] != normalized_compression_distance(programs[i], programs[j])) {
+                std::cout << "FAIL: distance matrix differs at (" << i << ", " << j << ")" << std::endl;
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    if (ok) {
+        std::cout << "PASS: bit-vector edit distance matches the DP table, distance matrices match" << std::endl;
+    }
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing metrics engine..." << std::endl;
+
+    bool ok = check_running_histogram();
+    ok = check_sharded_estimate() && ok;
+    ok = check_streamed_estimate() && ok;
+    ok = check_matching_bytes() && ok;
+    ok = check_edit_distance() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Metrics engine agrees with the reference metrics!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Metrics engine checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
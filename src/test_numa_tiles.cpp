@@ -0,0 +1,152 @@
+#include "thread_pool.h"
+#include "pairing_engine.h"
+#include "grid.h"
+#include "rng.h"
+#include <iostream>
+#include <vector>
+#include <set>
+#include <thread>
+#include <algorithm>
+
+// Two groups pinned to the same CPU: enough to see which thread ran what
+std::vector<std::vector<int>> two_groups() {
+    int cpu = ThreadPool::numa_cpu_groups()[0][0];
+    return {{cpu}, {cpu}};
+}
+
+bool check_grouped_loop() {
+    ThreadPool pool(4, two_groups());
+    std::vector<size_t> bounds = {0, 3000, 5000, 5400};
+
+    std::vector<std::thread::id> runner(bounds.back());
+    std::vector<int> runs(bounds.back(), 0);
+    pool.parallel_for_groups(bounds, 7, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            runner[i] = std::this_thread::get_id();
+            runs[i]++;
+            // Give every thread the chance to take part
+            volatile double x = 0.0;
+            for (int k = 0; k < 2000; k++) {
+                x = x + k;
+            }
+        }
+    });
+
+    bool once = std::all_of(runs.begin(), runs.end(), [](int count) { return count == 1; });
+    std::set<std::thread::id> group0(runner.begin(), runner.begin() + bounds[1]);
+    std::set<std::thread::id> group1(runner.begin() + bounds[1], runner.begin() + bounds[2]);
+    bool apart = std::none_of(group0.begin(), group0.end(), [&](std::thread::id id) { return group1.count(id); });
+    bool ok = pool.groups() == 2 && once && apart && group0.size() <= 2 && group1.size() <= 2;
+
+    // Nested loops from inside a group still finish
+    std::vector<int> nested(400, 0);
+    pool.parallel_for_groups({0, 10, 20}, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            pool.parallel_for_groups({0, 8, 16, 20}, 2, [&](size_t b, size_t e) {
+                for (size_t j = b; j < e; j++) {
+                    nested[20 * i + j]++;
+                }
+            });
+        }
+    });
+    ok = ok && std::all_of(nested.begin(), nested.end(), [](int count) { return count == 1; });
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": grouped loops keep each group's indices on its threads ("
+              << group0.size() << " + " << group1.size() << " threads)" << std::endl;
+    return ok;
+}
+
+bool check_bands() {
+    const int width = 30;
+    const int height = 20;
+    std::vector<size_t> bands = row_bands(width, height, 3);
+    bool ok = bands == std::vector<size_t>{0, 180, 390, 600};
+
+    PairingEngine engine(width, height, 2);
+    std::vector<std::pair<int, int>> pairs = engine.pair(21, 5);
+    std::vector<std::pair<int, int>> grouped = pairs;
+    std::vector<size_t> bounds = group_pairs_by_band(grouped, bands);
+    ok = ok && bounds.size() == 5 && bounds.front() == 0 && bounds.back() == pairs.size();
+
+    auto band_of = [&](int cell) {
+        return static_cast<size_t>(std::upper_bound(bands.begin(), bands.end(), static_cast<size_t>(cell)) -
+                                   bands.begin()) - 1;
+    };
+    for (size_t range = 0; ok && range + 1 < bounds.size(); range++) {
+        for (size_t i = bounds[range]; i < bounds[range + 1]; i++) {
+            auto [a, b] = grouped[i];
+            bool inside = (a == -1 || band_of(a) == band_of(b));
+            ok = ok && (range < 3 ? inside && band_of(b) == range : !inside);
+        }
+    }
+
+    // Nothing lost, and the order within a band is kept
+    std::vector<std::pair<int, int>> crossing;
+    for (const auto& pair : pairs) {
+        if (pair.first != -1 && band_of(pair.first) != band_of(pair.second)) {
+            crossing.push_back(pair);
+        }
+    }
+    ok = ok && std::equal(crossing.begin(), crossing.end(), grouped.begin() + bounds[3]);
+    std::sort(pairs.begin(), pairs.end());
+    std::sort(grouped.begin(), grouped.end());
+    ok = ok && pairs == grouped;
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": pairs are grouped by band (" << crossing.size()
+              << " of them across bands)" << std::endl;
+    return ok;
+}
+
+bool check_placed_grid() {
+    // A placed grid starts from the same programs as an ordinary one
+    const uint64_t seed = 9;
+    ThreadPool pool(4, two_groups());
+    Grid plain(30, 20, 64);
+    Grid placed(30, 20, 64);
+    std::vector<size_t> bands = row_bands(30, 20, pool.groups());
+    placed.place_bands(pool, bands);
+
+    auto initialize = [&](Grid& grid) {
+        return [&, seed](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                CounterRng cell_rng(seed, RngDomain::Initialization, 0, i);
+                grid.initialize_program(i, cell_rng);
+            }
+        };
+    };
+    pool.parallel_for(plain.get_total_programs(), 0, initialize(plain));
+    pool.parallel_for_groups(bands, 0, initialize(placed));
+
+    Span<const uint8_t> a = plain.all_bytes();
+    Span<const uint8_t> b = placed.all_bytes();
+    bool ok = a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+
+    // And keeps working through epochs
+    placed.begin_epoch();
+    for (int i = 0; i < placed.get_total_programs(); i++) {
+        Span<const uint8_t> program = placed.program_at(i);
+        std::copy(program.begin(), program.end(), placed.next_program(i).begin());
+    }
+    placed.commit_epoch();
+    Span<const uint8_t> c = placed.all_bytes();
+    ok = ok && std::equal(a.begin(), a.end(), c.begin());
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": placed grid holds the same programs" << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing NUMA tiles..." << std::endl;
+
+    bool ok = check_grouped_loop();
+    ok = check_bands() && ok;
+    ok = check_placed_grid() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: NUMA tiles schedule and place each band on its group!" << std::endl;
+    } else {
+        std::cout << "FAILURE: NUMA tile checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+#include "output_pipeline.h"
+#include "snapshot.h"
+#include "grid.h"
+#include "grid_w_tracer.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <filesystem>
+#include <thread>
+#include <chrono>
+
+namespace fs = std::filesystem;
+
+std::string temp_path(const std::string& name) {
+    return (fs::temp_directory_path() / name).string();
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+// Holds the background writers until opened
+struct Gate {
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool open = false;
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return open; });
+    }
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            open = true;
+        }
+        changed.notify_all();
+    }
+};
+
+bool check_inline() {
+    // Without writers, a job has run by the time submit() returns
+    OutputPipeline output;
+    int runs = 0;
+    output.submit([&] { runs++; });
+    bool ok = output.inline_jobs() && runs == 1 && output.submit_frame([&] { runs++; }) && runs == 2;
+
+    bool thrown = false;
+    try {
+        output.submit([] { throw std::runtime_error("disk full"); });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    ok = ok && thrown;
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": inline pipeline writes in submit()" << std::endl;
+    return ok;
+}
+
+bool check_background() {
+    OutputPipeline output(3, 4);
+    std::atomic<int> runs(0);
+    for (int i = 0; i < 100; i++) {
+        output.submit([&] { runs++; });
+    }
+    output.submit([] { throw std::runtime_error("disk full"); });
+    output.flush();
+
+    bool ok = !output.inline_jobs() && runs == 100 && output.failures() == 1 && output.dropped() == 0;
+    std::cout << (ok ? "PASS" : "FAIL") << ": background writers run every job (" << runs << ")" << std::endl;
+    return ok;
+}
+
+bool check_backpressure() {
+    // One writer held up and a full queue: frames are dropped, data waits
+    Gate gate;
+    OutputPipeline output(1, 2, OutputBackpressure::DropFrames);
+    std::atomic<int> runs(0);
+    std::atomic<bool> started(false);
+    output.submit([&] { started = true; gate.wait(); runs++; });
+    while (!started) {
+        std::this_thread::yield();
+    }
+    bool queued = output.submit_frame([&] { runs++; }) && output.submit_frame([&] { runs++; });
+    bool dropped = !output.submit_frame([&] { runs++; });
+
+    std::atomic<bool> data_queued(false);
+    std::thread producer([&] {
+        output.submit([&] { runs++; });
+        data_queued = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    bool waited = !data_queued;
+
+    gate.release();
+    producer.join();
+    output.flush();
+
+    bool ok = queued && dropped && waited && data_queued && output.dropped() == 1 && runs == 4;
+
+    // Blocking frames wait instead
+    Gate block_gate;
+    OutputPipeline blocking(1, 1, OutputBackpressure::Block);
+    blocking.submit([&] { block_gate.wait(); });
+    std::atomic<int> frames(0);
+    std::thread frame_producer([&] {
+        for (int i = 0; i < 3; i++) {
+            blocking.submit_frame([&] { frames++; });
+        }
+    });
+    block_gate.release();
+    frame_producer.join();
+    blocking.flush();
+    ok = ok && frames == 3 && blocking.dropped() == 0;
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": full queue drops frames or blocks as configured" << std::endl;
+    return ok;
+}
+
+bool check_snapshot_writers() {
+    // The files written from copies match those written from the grids
+    std::mt19937 rng(5);
+    Grid grid(30, 20, 64);
+    grid.initialize_random(rng);
+    std::vector<int32_t> partners = pairing_index(grid.create_spatial_pairs(2, rng), grid.get_total_programs());
+
+    std::string direct = temp_path("bffpp_test_pairing_direct.csv");
+    std::string copied = temp_path("bffpp_test_pairing_copied.csv");
+    grid.save_pairing_csv(direct, 12, partners);
+    OutputPipeline output(2, 4);
+    auto snapshot = std::make_shared<const Snapshot>(grid.to_snapshot(12, partners));
+    output.submit([snapshot, copied] { Grid::save_pairing_csv(copied, *snapshot); });
+
+    GridWithTracer tracer(12, 10, 32);
+    tracer.initialize_random(rng);
+    std::string tokens_direct = temp_path("bffpp_test_tokens_direct.csv");
+    std::string tokens_copied = temp_path("bffpp_test_tokens_copied.csv");
+    tracer.save_tokens_to_csv(tokens_direct, 7);
+    auto tokens = std::make_shared<const Snapshot>(tracer.to_snapshot(7));
+    output.submit([tokens, tokens_copied] { GridWithTracer::save_tokens_to_csv(tokens_copied, *tokens); });
+    output.flush();
+
+    bool ok = !read_file(direct).empty() && read_file(direct) == read_file(copied) &&
+              !read_file(tokens_direct).empty() && read_file(tokens_direct) == read_file(tokens_copied);
+    for (const std::string& path : {direct, copied, tokens_direct, tokens_copied}) {
+        fs::remove(path);
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": CSVs from snapshots match the grids' own" << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing output pipeline..." << std::endl;
+
+    bool ok = check_inline();
+    ok = check_background() && ok;
+    ok = check_backpressure() && ok;
+    ok = check_snapshot_writers() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Output pipeline writes, blocks and drops as configured!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Output pipeline checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
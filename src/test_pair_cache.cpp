@@ -0,0 +1,145 @@
+#include "pair_cache.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+
+const int PROGRAM_SIZE = 64;
+
+// Pairs drawn mostly from the instruction set, as two programs back to back
+std::vector<std::vector<uint8_t>> make_pairs(size_t count, uint32_t seed) {
+    const std::string alphabet = "<>{}-+.,[]0Z";
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+
+    std::vector<std::vector<uint8_t>> pairs(count, std::vector<uint8_t>(2 * PROGRAM_SIZE));
+    for (std::vector<uint8_t>& pair : pairs) {
+        for (uint8_t& byte : pair) {
+            byte = static_cast<uint8_t>(alphabet[pick(rng)]);
+        }
+    }
+    return pairs;
+}
+
+bool same_stats(const EmulatorStats& a, const EmulatorStats& b) {
+    return a.status == b.status && a.iteration == b.iteration && a.skipped == b.skipped;
+}
+
+// Tape and stats of a pair run without the cache
+std::pair<std::vector<uint8_t>, EmulatorStats> run_directly(std::vector<uint8_t> pair, int max_iter = 8192) {
+    EmulatorStats stats = emulate_pair_in_place(pair.data(), pair.data() + PROGRAM_SIZE, PROGRAM_SIZE, 0,
+                                                PROGRAM_SIZE, 0, max_iter);
+    return {pair, stats};
+}
+
+bool check_results() {
+    std::vector<std::vector<uint8_t>> pairs = make_pairs(500, 1);
+    PairCache cache(10000, 1000);
+
+    // Every pair twice: a miss that runs it, then a hit
+    bool ok = true;
+    for (int round = 0; round < 2; round++) {
+        for (const std::vector<uint8_t>& pair : pairs) {
+            auto expected = run_directly(pair, 1000);
+            std::vector<uint8_t> tape = pair;
+            EmulatorStats stats = emulate_pair_cached(cache, tape.data(), tape.data() + PROGRAM_SIZE, PROGRAM_SIZE,
+                                                      round == 0 ? EmulatorBackend::Scalar
+                                                                 : EmulatorBackend::Predecoded);
+            ok = ok && tape == expected.first && same_stats(stats, expected.second);
+        }
+    }
+    ok = ok && cache.lookups() == 1000 && cache.hits() == 500 && cache.size() == 500;
+
+    // A pair that differs in one byte is a different pair
+    std::vector<uint8_t> changed = pairs[0];
+    changed[PROGRAM_SIZE + 5] = (changed[PROGRAM_SIZE + 5] == '+') ? '-' : '+';
+    EmulatorStats stats;
+    ok = ok && !cache.lookup(changed.data(), changed.data() + PROGRAM_SIZE, PROGRAM_SIZE, stats) &&
+         PairCache::hash_pair(pairs[0].data(), pairs[0].data() + PROGRAM_SIZE, PROGRAM_SIZE) !=
+             PairCache::hash_pair(changed.data(), changed.data() + PROGRAM_SIZE, PROGRAM_SIZE);
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": cached pairs give the tapes and stats of a direct run" << std::endl;
+    return ok;
+}
+
+bool check_eviction() {
+    std::vector<std::vector<uint8_t>> pairs = make_pairs(3000, 2);
+    PairCache cache(2 * PairCache::SHARDS);
+
+    // The first pair is looked up after every add, so it is never the least
+    // recently used entry of its shard
+    std::vector<uint8_t> kept = pairs[0];
+    emulate_pair_cached(cache, kept.data(), kept.data() + PROGRAM_SIZE, PROGRAM_SIZE);
+    bool ok = true;
+    for (size_t i = 1; i < pairs.size(); i++) {
+        std::vector<uint8_t> tape = pairs[i];
+        emulate_pair_cached(cache, tape.data(), tape.data() + PROGRAM_SIZE, PROGRAM_SIZE);
+
+        std::vector<uint8_t> probe = pairs[0];
+        EmulatorStats stats;
+        ok = ok && cache.lookup(probe.data(), probe.data() + PROGRAM_SIZE, PROGRAM_SIZE, stats) && probe == kept;
+    }
+    ok = ok && cache.size() == cache.capacity() && cache.capacity() == 2 * PairCache::SHARDS;
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": a full cache evicts the least recently used pairs, keeping "
+              << cache.size() << " entries" << std::endl;
+    return ok;
+}
+
+bool check_concurrent() {
+    // Few distinct pairs, so that threads keep hitting each other's entries
+    std::vector<std::vector<uint8_t>> pairs = make_pairs(200, 3);
+    std::vector<std::pair<std::vector<uint8_t>, EmulatorStats>> expected;
+    for (const std::vector<uint8_t>& pair : pairs) {
+        expected.push_back(run_directly(pair));
+    }
+
+    PairCache cache(1000);
+    const int num_threads = 8;
+    std::vector<int> wrong(num_threads, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 rng(t);
+            for (int k = 0; k < 2000; k++) {
+                size_t i = rng() % pairs.size();
+                std::vector<uint8_t> tape = pairs[i];
+                EmulatorStats stats = emulate_pair_cached(cache, tape.data(), tape.data() + PROGRAM_SIZE,
+                                                          PROGRAM_SIZE);
+                if (tape != expected[i].first || !same_stats(stats, expected[i].second)) {
+                    wrong[t]++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    bool ok = cache.size() == pairs.size() && cache.lookups() == num_threads * 2000 &&
+              cache.hits() >= cache.lookups() - num_threads * pairs.size();
+    for (int count : wrong) {
+        ok = ok && count == 0;
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": " << num_threads << " threads shared the cache, " << cache.hits()
+              << " of " << cache.lookups() << " lookups hit" << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing pair cache..." << std::endl;
+
+    bool ok = check_results();
+    ok = check_eviction() && ok;
+    ok = check_concurrent() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Pair cache answers identical pairs exactly!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Pair cache checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+#include "pairing_engine.h"
+#include "grid.h"
+#include "rng.h"
+#include "thread_pool.h"
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+
+// The pairing pass as Grid implemented it before PairingEngine, with a
+// neighbour vector per cell; either order_rng or (seed, epoch) is used
+std::vector<std::pair<int, int>> reference_pairs(const Grid& grid, int radius, std::mt19937* order_rng,
+                                                 uint64_t seed, uint64_t epoch) {
+    int width = grid.get_width();
+    int total_cells = grid.get_total_programs();
+    std::vector<std::pair<int, int>> pairs;
+    std::vector<bool> taken(total_cells, false);
+
+    std::vector<int> cell_order(total_cells);
+    if (order_rng) {
+        for (int i = 0; i < total_cells; i++) {
+            cell_order[i] = i;
+        }
+        std::shuffle(cell_order.begin(), cell_order.end(), *order_rng);
+    } else {
+        std::vector<std::pair<uint64_t, int>> keyed_order(total_cells);
+        for (int i = 0; i < total_cells; i++) {
+            keyed_order[i] = {CounterRng::hash(seed, RngDomain::PairingOrder, epoch, i), i};
+        }
+        std::sort(keyed_order.begin(), keyed_order.end());
+        for (int i = 0; i < total_cells; i++) {
+            cell_order[i] = keyed_order[i].second;
+        }
+    }
+
+    for (int cell_idx : cell_order) {
+        if (taken[cell_idx]) {
+            continue;
+        }
+
+        std::vector<int> available;
+        for (const Grid::Cell& neighbor : grid.get_von_neumann_neighbors(cell_idx % width, cell_idx / width, radius)) {
+            int neighbor_idx = neighbor.y * width + neighbor.x;
+            if (!taken[neighbor_idx]) {
+                available.push_back(neighbor_idx);
+            }
+        }
+
+        if (available.empty()) {
+            taken[cell_idx] = true;
+            pairs.push_back({-1, cell_idx});
+            continue;
+        }
+
+        int chosen_idx;
+        if (order_rng) {
+            std::uniform_int_distribution<int> dist(0, available.size() - 1);
+            chosen_idx = available[dist(*order_rng)];
+        } else {
+            CounterRng choice_rng(seed, RngDomain::PairingChoice, epoch, cell_idx);
+            chosen_idx = available[choice_rng.next_below(available.size())];
+        }
+        taken[cell_idx] = true;
+        taken[chosen_idx] = true;
+        pairs.push_back({cell_idx, chosen_idx});
+    }
+
+    return pairs;
+}
+
+// Every cell exactly once, partners in bounds and within the radius
+bool valid_matching(const std::vector<std::pair<int, int>>& pairs, int width, int height, int radius) {
+    std::vector<int> seen(width * height, 0);
+    for (const auto& [a, b] : pairs) {
+        if (b < 0 || b >= width * height) {
+            return false;
+        }
+        seen[b]++;
+        if (a == -1) {
+            continue;
+        }
+        if (a < 0 || a >= width * height || a == b) {
+            return false;
+        }
+        seen[a]++;
+        int distance = std::abs(a % width - b % width) + std::abs(a / width - b / width);
+        if (distance > radius) {
+            return false;
+        }
+    }
+    return std::all_of(seen.begin(), seen.end(), [](int count) { return count == 1; });
+}
+
+bool check_sequential() {
+    const int sizes[][2] = {{40, 30}, {17, 9}, {1, 12}, {3, 3}, {64, 64}};
+    bool ok = true;
+    for (const auto& size : sizes) {
+        for (int radius : {1, 2, 3}) {
+            Grid grid(size[0], size[1], 8);
+            PairingEngine engine(size[0], size[1], radius);
+
+            std::mt19937 rng_a(77);
+            std::mt19937 rng_b(77);
+            for (int epoch = 1; epoch <= 3; epoch++) {
+                ok = ok && engine.pair(rng_a) == reference_pairs(grid, radius, &rng_b, 0, 0);
+                ok = ok && engine.pair(123, epoch) == reference_pairs(grid, radius, nullptr, 123, epoch);
+            }
+        }
+    }
+
+    // Grid's own entry points go through the engine
+    Grid grid(40, 30, 8);
+    std::mt19937 rng_a(5);
+    std::mt19937 rng_b(5);
+    ok = ok && grid.create_spatial_pairs(2, rng_a) == reference_pairs(grid, 2, &rng_b, 0, 0);
+    ok = ok && grid.create_spatial_pairs(1, 9, 4) == reference_pairs(grid, 1, nullptr, 9, 4);
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": sequential pairing matches the original pass" << std::endl;
+    return ok;
+}
+
+bool check_neighbors() {
+    Grid grid(11, 7, 8);
+    PairingEngine engine(11, 7, 2);
+    std::vector<int> out(engine.max_neighbors());
+
+    bool ok = true;
+    for (int cell = 0; cell < grid.get_total_programs(); cell++) {
+        std::vector<int> expected;
+        for (const Grid::Cell& neighbor : grid.get_von_neumann_neighbors(cell % 11, cell / 11, 2)) {
+            expected.push_back(neighbor.y * 11 + neighbor.x);
+        }
+        int count = engine.neighbors(cell, out.data());
+        ok = ok && std::vector<int>(out.begin(), out.begin() + count) == expected;
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": offset table gives the Von Neumann neighbourhoods" << std::endl;
+    return ok;
+}
+
+bool check_tiled() {
+    const int sizes[][2] = {{120, 90}, {33, 17}, {1, 40}, {5, 5}, {16, 16}};
+    ThreadPool pool(4);
+    bool ok = true;
+
+    for (const auto& size : sizes) {
+        PairingEngine serial(size[0], size[1], 2);
+        PairingEngine parallel(size[0], size[1], 2);
+        for (uint64_t epoch = 1; epoch <= 5; epoch++) {
+            std::vector<std::pair<int, int>> pairs = serial.pair_tiled(31, epoch);
+            ok = ok && valid_matching(pairs, size[0], size[1], 2);
+            ok = ok && parallel.pair_tiled(31, epoch, &pool) == pairs;
+        }
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": tiled pairing is a valid matching, the same for any thread count"
+              << std::endl;
+    return ok;
+}
+
+bool check_tiled_statistics() {
+    // Share of mutation-only cells and of pairs at each distance, over many
+    // epochs: the tiled matcher should look like the sequential one
+    const int width = 120;
+    const int height = 90;
+    PairingEngine engine(width, height, 2);
+
+    auto histogram = [&](const std::vector<std::pair<int, int>>& pairs, std::vector<double>& counts) {
+        for (const auto& [a, b] : pairs) {
+            int bucket = 0;
+            if (a != -1) {
+                bucket = std::abs(a % width - b % width) + std::abs(a / width - b / width);
+            }
+            counts[bucket] += 1.0;
+        }
+    };
+
+    std::vector<double> sequential(3, 0.0);
+    std::vector<double> tiled(3, 0.0);
+    for (uint64_t epoch = 1; epoch <= 40; epoch++) {
+        histogram(engine.pair(17, epoch), sequential);
+        histogram(engine.pair_tiled(17, epoch), tiled);
+    }
+
+    bool ok = true;
+    for (int bucket = 0; bucket < 3; bucket++) {
+        double relative = std::abs(tiled[bucket] - sequential[bucket]) / sequential[bucket];
+        ok = ok && relative < 0.02;
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": tiled pairing has the sequential statistics (mutation-only "
+              << sequential[0] / 40 << " vs " << tiled[0] / 40 << " cells per epoch)" << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing pairing engine..." << std::endl;
+
+    bool ok = check_sequential();
+    ok = check_neighbors() && ok;
+    ok = check_tiled() && ok;
+    ok = check_tiled_statistics() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Pairing engine matches the original pairing!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Pairing engine checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
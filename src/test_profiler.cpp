@@ -0,0 +1,284 @@
+#include "profiler.h"
+#include "emulator.h"
+#include "emulator_w_tracer.h"
+#include "thread_pool.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include <algorithm>
+
+// Counters moved by one call
+template <typename Fn>
+ProfileSample counted(Fn fn) {
+    ProfileSample before = profile_totals();
+    fn();
+    return profile_totals() - before;
+}
+
+bool same_counts(const ProfileSample& a, const ProfileSample& b, bool with_rebuilds = true) {
+    for (int i = 0; i < PROFILE_COUNTERS; i++) {
+        bool rebuild_counter = i == static_cast<int>(ProfileCounter::BracketRebuilds) ||
+                               i == static_cast<int>(ProfileCounter::BracketScanBytes);
+        if (a.counters[i] != b.counters[i] && (with_rebuilds || !rebuild_counter)) return false;
+    }
+    for (int i = 0; i < PROFILE_OPCODES; i++) {
+        if (a.opcodes[i] != b.opcodes[i]) return false;
+    }
+    return true;
+}
+
+uint64_t opcode_total(const ProfileSample& sample) {
+    uint64_t total = 0;
+    for (uint64_t count : sample.opcodes) {
+        total += count;
+    }
+    return total;
+}
+
+// Tapes with half of their bytes instructions
+std::vector<uint8_t> random_tape(std::mt19937& rng, int size) {
+    const std::string ops = "<>{}-+.,[]";
+    std::vector<uint8_t> tape(size);
+    for (uint8_t& byte : tape) {
+        byte = rng() % 2 ? static_cast<uint8_t>(ops[rng() % ops.size()]) : static_cast<uint8_t>(rng() % 32);
+    }
+    return tape;
+}
+
+bool check_hand_counted() {
+    // "++[-]" with head 0 on a '0' (the emulators' zero): two increments,
+    // then the loop runs the decrement twice, jumping back from ']' to '['
+    // once; 27 no-ops follow. The first bracket builds the bracket table.
+    std::vector<uint8_t> tape(32, 0);
+    tape[16] = '0';
+    tape[0] = '+';
+    tape[1] = '+';
+    tape[2] = '[';
+    tape[3] = '-';
+    tape[4] = ']';
+
+    EmulatorStats stats;
+    ProfileSample counts = counted([&] { stats = emulate_in_place(tape.data(), 32, 16, 20); });
+
+    bool ok = stats.status == EmulatorStatus::Finished && tape[16] == '0';
+    ok = ok && counts.opcodes[0] == 27 && counts.opcodes[profile_opcode_slot('+')] == 2 &&
+         counts.opcodes[profile_opcode_slot('-')] == 2 && counts.opcodes[profile_opcode_slot('[')] == 1 &&
+         counts.opcodes[profile_opcode_slot(']')] == 2;
+    ok = ok && opcode_total(counts) == static_cast<uint64_t>(stats.iteration) &&
+         counts.opcodes[0] == static_cast<uint64_t>(stats.skipped);
+    ok = ok && counts.get(ProfileCounter::Jumps) == 1 && counts.get(ProfileCounter::JumpDistance) == 2 &&
+         counts.get(ProfileCounter::BracketRebuilds) == 1 && counts.get(ProfileCounter::BracketScanBytes) == 32;
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": opcode and jump counts of a hand-counted program" << std::endl;
+    return ok;
+}
+
+bool check_backends_agree() {
+    std::mt19937 rng(7);
+    bool ok = true;
+    bool jumped = false;
+    bool rebuilt = false;
+    for (int trial = 0; trial < 300 && ok; trial++) {
+        std::vector<uint8_t> tape = random_tape(rng, 64);
+        int head0 = rng() % 64;
+        int head1 = rng() % 64;
+
+        std::vector<uint8_t> generic = tape;
+        EmulatorStats stats;
+        ProfileSample expected = counted([&] { stats = emulate_in_place(generic.data(), 64, head0, head1); });
+
+        std::vector<uint8_t> fixed = tape;
+        ProfileSample fixed_counts = counted([&] { emulate_fixed_in_place<64>(fixed.data(), head0, head1, 0, 8192); });
+
+        std::vector<uint8_t> predecoded = tape;
+        ProfileSample predecoded_counts =
+            counted([&] { emulate_predecoded_in_place(predecoded.data(), 64, head0, head1); });
+
+        ProfileSample tracer_counts = counted([&] { emulate_w_tracer(initialize_tokens(tape), head0, head1); });
+
+        // Folded runs of '+' and '-' write once, so the pre-decoded backend
+        // may find its bracket table stale less often
+        ok = same_counts(expected, fixed_counts) && same_counts(expected, predecoded_counts, false) &&
+             same_counts(expected, tracer_counts);
+        // A run that stops on an unmatched bracket dispatched one step more
+        bool unmatched = stats.status == EmulatorStatus::UnmatchedOpen || stats.status == EmulatorStatus::UnmatchedClose;
+        ok = ok && opcode_total(expected) == static_cast<uint64_t>(stats.iteration) + (unmatched ? 1 : 0) &&
+             expected.opcodes[0] == static_cast<uint64_t>(stats.skipped);
+        jumped = jumped || expected.get(ProfileCounter::Jumps) > 0;
+        rebuilt = rebuilt || expected.get(ProfileCounter::BracketRebuilds) > 0;
+    }
+    ok = ok && jumped && rebuilt;
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": scalar, fixed-size, pre-decoded and tracer emulators count alike"
+              << std::endl;
+    return ok;
+}
+
+bool check_cycle_exits() {
+    // "Z[<>]" on a non-zero cell spins until max_iter; with cycle detection
+    // the skipped repeats are counted as if they had run
+    std::mt19937 rng(10);
+    bool ok = true;
+    uint64_t exits = 0;
+    for (int trial = 0; trial < 200 && ok; trial++) {
+        std::vector<uint8_t> tape = random_tape(rng, 64);
+        if (trial % 2 == 0) {
+            const std::string loop = "Z[<>]";
+            std::copy(loop.begin(), loop.end(), tape.begin() + rng() % 40);
+        }
+        int head0 = rng() % 64;
+        int head1 = rng() % 64;
+
+        std::vector<uint8_t> plain = tape;
+        ProfileSample expected = counted([&] { emulate_in_place(plain.data(), 64, head0, head1); });
+        std::vector<uint8_t> generic = tape;
+        ProfileSample generic_counts =
+            counted([&] { emulate_in_place(generic.data(), 64, head0, head1, 0, 8192, 0, true); });
+        std::vector<uint8_t> fixed = tape;
+        ProfileSample fixed_counts =
+            counted([&] { emulate_fixed_in_place<64>(fixed.data(), head0, head1, 0, 8192, true); });
+        std::vector<uint8_t> predecoded = tape;
+        ProfileSample predecoded_counts =
+            counted([&] { emulate_predecoded_in_place(predecoded.data(), 64, head0, head1, 0, 8192, true); });
+        ProfileSample tracer_counts =
+            counted([&] { emulate_w_tracer(initialize_tokens(tape), head0, head1, 0, 8192, 0, true); });
+
+        // Everything but the bracket tables and the exits themselves
+        exits += generic_counts.get(ProfileCounter::CycleExits);
+        ok = generic_counts.get(ProfileCounter::CycleExits) == fixed_counts.get(ProfileCounter::CycleExits) &&
+             generic_counts.get(ProfileCounter::CycleExits) == tracer_counts.get(ProfileCounter::CycleExits);
+        for (ProfileSample* counts : {&generic_counts, &fixed_counts, &predecoded_counts, &tracer_counts}) {
+            counts->counters[static_cast<int>(ProfileCounter::CycleExits)] = 0;
+            ok = ok && same_counts(expected, *counts, false);
+        }
+    }
+    ok = ok && exits > 0;
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": skipped loop repeats count as if they had run" << std::endl;
+    return ok;
+}
+
+bool check_disabled() {
+    set_profiling(false);
+    std::mt19937 rng(8);
+    std::vector<uint8_t> tape = random_tape(rng, 64);
+    ProfileSample counts = counted([&] {
+        emulate_in_place(tape.data(), 64);
+        profile_count(ProfileCounter::BytesWritten, 100);
+    });
+    set_profiling(true);
+
+    bool ok = same_counts(counts, ProfileSample());
+    std::cout << (ok ? "PASS" : "FAIL") << ": nothing is counted while profiling is off" << std::endl;
+    return ok;
+}
+
+bool check_threads() {
+    std::mt19937 rng(9);
+    std::vector<std::vector<uint8_t>> tapes;
+    for (int i = 0; i < 200; i++) {
+        tapes.push_back(random_tape(rng, 128));
+    }
+
+    std::vector<std::vector<uint8_t>> serial_tapes = tapes;
+    ProfileSample serial = counted([&] {
+        for (auto& tape : serial_tapes) {
+            emulate_in_place(tape.data(), 128);
+            profile_count(ProfileCounter::Pairs);
+        }
+    });
+
+    ThreadPool pool(4);
+    ProfileSample parallel = counted([&] {
+        pool.parallel_for(tapes.size(), 8, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                emulate_in_place(tapes[i].data(), 128);
+                profile_count(ProfileCounter::Pairs);
+            }
+        });
+    });
+
+    // A thread that has exited still counts
+    ProfileSample joined = counted([] {
+        std::thread worker([] { profile_count(ProfileCounter::Skipped, 5); });
+        worker.join();
+    });
+
+    bool ok = same_counts(serial, parallel) && parallel.get(ProfileCounter::Pairs) == tapes.size() &&
+              joined.get(ProfileCounter::Skipped) == 5;
+    std::cout << (ok ? "PASS" : "FAIL") << ": counters of every pool thread add up" << std::endl;
+    return ok;
+}
+
+bool check_reports() {
+    EpochProfiler profiler;
+    for (int epoch = 1; epoch <= 3; epoch++) {
+        profiler.begin_epoch();
+        {
+            ScopedPhase phase(&profiler, ProfilePhase::Emulation);
+            profile_count(ProfileCounter::Pairs, 10);
+            profile_count(ProfileCounter::Instructions, 1000);
+        }
+        ScopedPhase off(nullptr, ProfilePhase::Output);
+        off.stop();
+        profiler.add_time(ProfilePhase::Output, 0.25);
+        profiler.end_epoch(epoch);
+    }
+    EpochProfile first = profiler.take_interval();
+
+    profiler.begin_epoch();
+    profile_count(ProfileCounter::BytesWritten, 64);
+    profiler.end_epoch(4);
+    EpochProfile second = profiler.take_interval();
+
+    bool ok = first.epoch == 3 && first.epochs == 3 && first.counts.get(ProfileCounter::Pairs) == 30 &&
+              first.counts.get(ProfileCounter::Instructions) == 3000 &&
+              first.phase_seconds[static_cast<int>(ProfilePhase::Output)] == 0.75 &&
+              first.phase_seconds[static_cast<int>(ProfilePhase::Emulation)] > 0.0 &&
+              first.phase_seconds[static_cast<int>(ProfilePhase::Pairing)] == 0.0;
+    ok = ok && second.epoch == 4 && second.epochs == 1 && second.counts.get(ProfileCounter::Pairs) == 0 &&
+         second.counts.get(ProfileCounter::BytesWritten) == 64;
+
+    // Every CSV row has a value for every header column
+    auto columns = [](const std::string& line) {
+        return std::count(line.begin(), line.end(), ',') + 1;
+    };
+    ok = ok && columns(EpochProfile::csv_header()) == columns(first.csv_row());
+    ok = ok && first.csv_row().compare(0, 4, "3,3,") == 0;
+
+    std::string json = first.to_json();
+    ok = ok && json.compare(0, 17, "{\"type\":\"profile\"") == 0 && json.find("\"pairs\":30") != std::string::npos &&
+         json.find("\"[\":") != std::string::npos && json.back() == '}';
+
+    std::string text = profiler.prometheus();
+    ok = ok && text.find("bffpp_epoch 4\n") != std::string::npos &&
+         text.find("bffpp_epochs_total 4\n") != std::string::npos &&
+         text.find("bffpp_phase_seconds_total{phase=\"output\"} 0.75\n") != std::string::npos &&
+         text.find("bffpp_opcodes_total{opcode=\"+\"}") != std::string::npos &&
+         first.stats_line().compare(0, 26, "Profile epoch 3 (3 epochs)") == 0;
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": intervals, stats line, CSV, JSON and Prometheus text" << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing profiler..." << std::endl;
+    set_profiling(true);
+
+    bool ok = check_hand_counted();
+    ok = check_backends_agree() && ok;
+    ok = check_cycle_exits() && ok;
+    ok = check_disabled() && ok;
+    ok = check_threads() && ok;
+    ok = check_reports() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Profiler counts match the emulators!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Profiler checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+#include "replicator_cache.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include <set>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+std::vector<std::string> make_programs(size_t count, uint32_t seed) {
+    const std::string alphabet = ",.[]{}<>+- ";
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+
+    std::vector<std::string> programs(count);
+    for (std::string& program : programs) {
+        program.resize(64);
+        for (char& c : program) {
+            c = alphabet[pick(rng)];
+        }
+    }
+    return programs;
+}
+
+// Replication verdict the tests store, a pure function of the program
+bool verdict(const std::string& program) {
+    return (program[0] == '[') != (program[63] == ']');
+}
+
+bool check_hash() {
+    std::vector<std::string> programs = make_programs(20000, 1);
+    std::set<std::string> unique(programs.begin(), programs.end());
+    std::set<uint64_t> hashes;
+    for (const std::string& program : unique) {
+        hashes.insert(ReplicatorCache::hash_program(program));
+    }
+
+    // One changed character, or another length, gives another key
+    std::string a = programs[0];
+    std::string b = a;
+    b[37] = (b[37] == '+') ? '-' : '+';
+    bool ok = hashes.size() == unique.size() &&
+              ReplicatorCache::hash_program(a) != ReplicatorCache::hash_program(b) &&
+              ReplicatorCache::hash_program(a) != ReplicatorCache::hash_program(a + " ");
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": " << hashes.size() << " distinct programs gave distinct keys" << std::endl;
+    return ok;
+}
+
+bool check_concurrent() {
+    std::vector<std::string> programs = make_programs(40000, 2);
+    ReplicatorCache cache;
+
+    // Each thread adds its own slice and looks up everything added so far
+    const int num_threads = 8;
+    std::vector<int> wrong(num_threads, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = t; i < programs.size(); i += num_threads) {
+                cache.add(programs[i], verdict(programs[i]));
+                bool cached;
+                if (!cache.lookup(programs[i], cached) || cached != verdict(programs[i])) {
+                    wrong[t]++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    bool ok = true;
+    for (int count : wrong) {
+        ok = ok && count == 0;
+    }
+
+    std::set<std::string> unique(programs.begin(), programs.end());
+    ok = ok && cache.size() == unique.size();
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": " << num_threads << " threads filled the cache with "
+              << cache.size() << " consistent entries" << std::endl;
+    return ok;
+}
+
+bool check_persistence() {
+    std::string path = (fs::temp_directory_path() / "bffpp_test_replicator_cache.bin").string();
+    std::vector<std::string> programs = make_programs(5000, 3);
+
+    ReplicatorCache cache;
+    for (const std::string& program : programs) {
+        cache.add(program, verdict(program));
+    }
+    cache.save(path, 1024);
+
+    ReplicatorCache loaded;
+    size_t count = loaded.load(path, 1024);
+
+    bool ok = count == cache.size() && loaded.size() == cache.size();
+    for (const std::string& program : programs) {
+        bool cached;
+        ok = ok && loaded.lookup(program, cached) && cached == verdict(program);
+    }
+
+    // Results from another emulation budget are not reused
+    ReplicatorCache other_budget;
+    ok = ok && other_budget.load(path, 2048) == 0 && other_budget.size() == 0;
+
+    // Neither is a damaged file
+    fs::resize_file(path, fs::file_size(path) - 3);
+    ReplicatorCache damaged;
+    ok = ok && damaged.load(path, 1024) == 0;
+
+    // A missing file is just an empty cache
+    fs::remove(path);
+    ReplicatorCache missing;
+    ok = ok && missing.load(path, 1024) == 0;
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": cache survives a save/load round trip and rejects stale files" << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing replicator cache..." << std::endl;
+
+    bool ok = check_hash();
+    ok = check_concurrent() && ok;
+    ok = check_persistence() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Replicator cache is consistent and persistent!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Replicator cache checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
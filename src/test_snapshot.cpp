@@ -0,0 +1,187 @@
+#include "snapshot.h"
+#include "grid.h"
+#include "grid_w_tracer.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+std::string temp_path(const std::string& name) {
+    return (fs::temp_directory_path() / name).string();
+}
+
+bool same_snapshot(const Snapshot& a, const Snapshot& b) {
+    return a.kind == b.kind && a.epoch == b.epoch && a.width == b.width && a.height == b.height &&
+           a.program_size == b.program_size && a.bytes == b.bytes && a.tokens == b.tokens &&
+           a.partners == b.partners;
+}
+
+bool check_pairing_round_trip() {
+    std::mt19937 rng(3);
+    Grid grid(30, 20, 64);
+    grid.initialize_random(rng);
+    std::vector<std::pair<int, int>> pairs = grid.create_spatial_pairs(2, rng);
+    std::vector<int32_t> partners = pairing_index(pairs, grid.get_total_programs());
+
+    bool ok = true;
+    for (const auto& pair : pairs) {
+        bool expected = pair.first == -1 ? partners[pair.second] == -1
+                                         : partners[pair.first] == pair.second && partners[pair.second] == pair.first;
+        if (!expected) {
+            std::cout << "FAIL: pairing index disagrees with the pairs" << std::endl;
+            ok = false;
+            break;
+        }
+    }
+
+    Snapshot snapshot = grid.to_snapshot(17, partners);
+    std::string raw_path = temp_path("bffpp_test_pairing_raw.bffs");
+    std::string brotli_path = temp_path("bffpp_test_pairing_brotli.bffs");
+    write_snapshot(raw_path, snapshot, SnapshotCodec::Raw);
+    write_snapshot(brotli_path, snapshot, SnapshotCodec::Brotli);
+
+    for (const std::string& path : {raw_path, brotli_path}) {
+        if (!is_snapshot_file(path) || !same_snapshot(read_snapshot(path), snapshot)) {
+            std::cout << "FAIL: pairing snapshot did not round-trip: " << path << std::endl;
+            ok = false;
+        }
+    }
+
+    if (fs::file_size(brotli_path) >= fs::file_size(raw_path)) {
+        std::cout << "FAIL: compressed snapshot is not smaller" << std::endl;
+        ok = false;
+    }
+
+    if (ok) {
+        std::cout << "PASS: pairing snapshot round-trips raw (" << fs::file_size(raw_path)
+                  << " bytes) and compressed (" << fs::file_size(brotli_path) << " bytes)" << std::endl;
+    }
+    fs::remove(raw_path);
+    fs::remove(brotli_path);
+    return ok;
+}
+
+bool check_token_round_trip() {
+    std::mt19937 rng(5);
+    GridWithTracer grid(12, 8, 32);
+    grid.initialize_random(rng);
+    for (int epoch = 1; epoch <= 5; epoch++) {
+        for (int i = 0; i < grid.get_total_programs(); i++) {
+            grid.mutate_in_place(grid.program_at(i), 0.05, epoch, rng);
+        }
+    }
+
+    Snapshot snapshot = grid.to_snapshot(5);
+    std::string path = temp_path("bffpp_test_tokens.bffs");
+    write_snapshot(path, snapshot, SnapshotCodec::Brotli);
+    Snapshot loaded = read_snapshot(path);
+
+    bool ok = same_snapshot(loaded, snapshot) && loaded.kind == SnapshotKind::Tokens;
+    for (int i = 0; ok && i < grid.get_total_programs(); i++) {
+        Span<const Token> program = grid.program_at(i);
+        for (int j = 0; j < grid.get_program_size(); j++) {
+            if (loaded.tokens[static_cast<size_t>(i) * grid.get_program_size() + j] != program[j].value) {
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": token snapshot round-trips every packed token" << std::endl;
+    fs::remove(path);
+    return ok;
+}
+
+bool check_async_writer() {
+    std::mt19937 rng(9);
+    Grid grid(10, 10, 16);
+    std::vector<Snapshot> expected;
+    std::vector<std::string> paths;
+
+    bool ok = true;
+    {
+        SnapshotWriter writer(SnapshotCodec::Brotli, 2);
+        for (int epoch = 0; epoch < 12; epoch++) {
+            grid.initialize_random(rng);
+            std::vector<int32_t> partners = pairing_index(grid.create_spatial_pairs(2, rng), grid.get_total_programs());
+            expected.push_back(grid.to_snapshot(epoch, partners));
+            paths.push_back(temp_path("bffpp_test_async_" + std::to_string(epoch) + ".bffs"));
+            writer.submit(paths.back(), expected.back());
+        }
+
+        // A failing write is reported, not fatal
+        writer.submit(temp_path("bffpp_no_such_dir/epoch.bffs"), expected.front());
+        writer.flush();
+
+        if (writer.failures() != 1) {
+            std::cout << "FAIL: writer reported " << writer.failures() << " failures, expected 1" << std::endl;
+            ok = false;
+        }
+    }
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (!same_snapshot(read_snapshot(paths[i]), expected[i])) {
+            std::cout << "FAIL: async snapshot " << i << " differs" << std::endl;
+            ok = false;
+        }
+        fs::remove(paths[i]);
+    }
+
+    if (ok) {
+        std::cout << "PASS: async writer saves every queued snapshot in order" << std::endl;
+    }
+    return ok;
+}
+
+bool check_rejects_bad_files() {
+    std::mt19937 rng(1);
+    Grid grid(4, 4, 8);
+    grid.initialize_random(rng);
+
+    std::string path = temp_path("bffpp_test_truncated.bffs");
+    write_snapshot(path, grid.to_snapshot(0), SnapshotCodec::Raw);
+    fs::resize_file(path, fs::file_size(path) - 20);
+
+    bool ok = true;
+    try {
+        read_snapshot(path);
+        std::cout << "FAIL: truncated snapshot was accepted" << std::endl;
+        ok = false;
+    } catch (const std::runtime_error&) {
+    }
+
+    std::string csv_path = temp_path("bffpp_test_not_snapshot.csv");
+    std::ofstream(csv_path) << "epoch,position_x,position_y,program,combined_x,combined_y\n";
+    if (is_snapshot_file(csv_path)) {
+        std::cout << "FAIL: CSV mistaken for a snapshot" << std::endl;
+        ok = false;
+    }
+
+    if (ok) {
+        std::cout << "PASS: truncated snapshots and CSV files are told apart" << std::endl;
+    }
+    fs::remove(path);
+    fs::remove(csv_path);
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing binary snapshots..." << std::endl;
+
+    bool ok = check_pairing_round_trip();
+    ok = check_token_round_trip() && ok;
+    ok = check_async_writer() && ok;
+    ok = check_rejects_bad_files() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Snapshots round-trip in every format!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Snapshot checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
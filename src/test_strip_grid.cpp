@@ -0,0 +1,291 @@
+#include "strip_grid.h"
+#include "grid.h"
+#include "emulator.h"
+#include "utils.h"
+#include "rng.h"
+#include "metrics_engine.h"
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+
+// Strips on threads of one process, passing buffers through shared slots
+class ThreadExchange : public StripExchange {
+public:
+    struct Hub {
+        explicit Hub(int strips) : strips(strips), up(strips), down(strips), values(strips), blobs(strips) {}
+
+        // Every strip waits until all of them got here
+        void barrier() {
+            std::unique_lock<std::mutex> lock(mutex);
+            int generation = this->generation;
+            if (++waiting == strips) {
+                waiting = 0;
+                this->generation++;
+                cv.notify_all();
+            } else {
+                cv.wait(lock, [&] { return this->generation != generation; });
+            }
+        }
+
+        int strips;
+        std::vector<std::vector<uint8_t>> up, down;  // What each strip sent each way
+        std::vector<std::vector<double>> values;
+        std::vector<std::vector<uint8_t>> blobs;
+        std::mutex mutex;
+        std::condition_variable cv;
+        int waiting = 0;
+        int generation = 0;
+    };
+
+    ThreadExchange(Hub& hub, int rank) : hub(hub), strip(rank) {}
+
+    int rank() const override { return strip; }
+    int size() const override { return hub.strips; }
+
+    void exchange_rows(const uint8_t* to_up, uint8_t* from_up, size_t up_bytes,
+                       const uint8_t* to_down, uint8_t* from_down, size_t down_bytes) override {
+        hub.up[strip].assign(to_up, to_up + up_bytes);
+        hub.down[strip].assign(to_down, to_down + down_bytes);
+        hub.barrier();
+        if (up_bytes > 0) {
+            std::memcpy(from_up, hub.down[strip - 1].data(), up_bytes);
+        }
+        if (down_bytes > 0) {
+            std::memcpy(from_down, hub.up[strip + 1].data(), down_bytes);
+        }
+        hub.barrier();
+    }
+
+    void sum(int64_t* values, int count) override {
+        // Small counts, exact in a double
+        std::vector<double> converted(values, values + count);
+        sum(converted.data(), count);
+        for (int i = 0; i < count; i++) {
+            values[i] = static_cast<int64_t>(converted[i]);
+        }
+    }
+
+    void sum(double* values, int count) override {
+        hub.values[strip].assign(values, values + count);
+        hub.barrier();
+        for (int i = 0; i < count; i++) {
+            values[i] = 0.0;
+            for (int s = 0; s < hub.strips; s++) {
+                values[i] += hub.values[s][i];
+            }
+        }
+        hub.barrier();
+    }
+
+    void gather(const uint8_t* data, size_t size, std::vector<uint8_t>& out) override {
+        hub.blobs[strip].assign(data, data + size);
+        hub.barrier();
+        out.clear();
+        if (strip == 0) {
+            for (const std::vector<uint8_t>& blob : hub.blobs) {
+                out.insert(out.end(), blob.begin(), blob.end());
+            }
+        }
+        hub.barrier();
+    }
+
+private:
+    Hub& hub;
+    int strip;
+};
+
+struct Outcome {
+    std::vector<uint8_t> soup;
+    std::vector<RGB> colors;
+    std::vector<StripEpochStats> stats;
+    double hoe = 0.0;
+};
+
+// bffpp_grid with counter_rng: true, in one process
+Outcome reference_run(int width, int height, int program_size, uint64_t seed, double mutation_rate, int epochs) {
+    Grid grid(width, height, program_size);
+    for (int i = 0; i < grid.get_total_programs(); i++) {
+        CounterRng cell_rng(seed, RngDomain::Initialization, 0, i);
+        grid.initialize_program(i, cell_rng);
+    }
+
+    Outcome outcome;
+    for (int epoch = 1; epoch <= epochs; epoch++) {
+        grid.begin_epoch();
+        StripEpochStats stats;
+        for (const auto& [idx_a, idx_b] : grid.create_spatial_pairs(2, seed, epoch)) {
+            std::vector<int> mutated = {idx_b};
+            Span<const uint8_t> program_b = grid.program_at(idx_b);
+            std::copy(program_b.begin(), program_b.end(), grid.next_program(idx_b).begin());
+            if (idx_a != -1) {
+                Span<const uint8_t> program_a = grid.program_at(idx_a);
+                std::copy(program_a.begin(), program_a.end(), grid.next_program(idx_a).begin());
+                EmulatorStats result = emulate_pair_in_place(grid.next_program(idx_a).data(),
+                                                             grid.next_program(idx_b).data(), program_size,
+                                                             0, program_size, 0, 8192);
+                stats.executed_pairs++;
+                stats.iterations += result.iteration;
+                stats.skipped += result.skipped;
+                stats.finished += (result.status == EmulatorStatus::Finished) ? 1 : 0;
+                stats.terminated += (result.status == EmulatorStatus::Terminated) ? 1 : 0;
+                mutated.push_back(idx_a);
+            }
+            for (int idx : mutated) {
+                CounterRng cell_rng(seed, RngDomain::Mutation, epoch, idx);
+                mutate_in_place(grid.next_program(idx).data(), program_size, mutation_rate, cell_rng);
+            }
+        }
+        grid.commit_epoch();
+        outcome.stats.push_back(stats);
+    }
+
+    outcome.soup.assign(grid.all_bytes().begin(), grid.all_bytes().end());
+    outcome.colors = grid.colors();
+    MetricsEngine metrics;
+    outcome.hoe = metrics.higher_order_entropy_of(outcome.soup.data(), outcome.soup.size());
+    return outcome;
+}
+
+// The same run split into strips, one thread per strip
+Outcome strip_run(int strips, int width, int height, int program_size, uint64_t seed, double mutation_rate,
+                  int epochs, EmulatorBackend backend) {
+    ThreadExchange::Hub hub(strips);
+    Outcome outcome;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto run = [&](int rank) {
+        try {
+            ThreadExchange exchange(hub, rank);
+            StripGrid grid(width, height, program_size, seed, exchange);
+            grid.initialize();
+
+            MetricsEngine metrics;
+            metrics.reset(grid.bytes().data(), grid.bytes().size());
+            for (int epoch = 1; epoch <= epochs; epoch++) {
+                StripEpochStats stats = grid.run_epoch(epoch, mutation_rate, backend);
+                metrics.update(grid.previous_bytes().data(), grid.bytes().data(), grid.bytes().size());
+                if (rank == 0) {
+                    outcome.stats.push_back(stats);
+                }
+            }
+
+            double hoe = grid.higher_order_entropy(metrics);
+            std::vector<RGB> colors = grid.gather_colors();
+            std::vector<uint8_t> soup;
+            exchange.gather(grid.bytes().data(), grid.bytes().size(), soup);
+            if (rank == 0) {
+                outcome.hoe = hoe;
+                outcome.colors = colors;
+                outcome.soup = soup;
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int rank = 0; rank < strips; rank++) {
+        threads.emplace_back(run, rank);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return outcome;
+}
+
+bool same_stats(const std::vector<StripEpochStats>& a, const std::vector<StripEpochStats>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].executed_pairs != b[i].executed_pairs || a[i].iterations != b[i].iterations ||
+            a[i].skipped != b[i].skipped || a[i].finished != b[i].finished || a[i].terminated != b[i].terminated) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool same_colors(const std::vector<RGB>& a, const std::vector<RGB>& b) {
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(RGB)) == 0;
+}
+
+bool check_strips() {
+    const int sizes[][2] = {{24, 20}, {9, 13}, {40, 12}};
+    bool ok = true;
+
+    for (const auto& size : sizes) {
+        Outcome expected = reference_run(size[0], size[1], 16, 11, 0.01, 30);
+        for (int strips = 1; strips <= 3; strips++) {
+            Outcome outcome = strip_run(strips, size[0], size[1], 16, 11, 0.01, 30, EmulatorBackend::Scalar);
+            ok = ok && outcome.soup == expected.soup;
+            ok = ok && same_stats(outcome.stats, expected.stats);
+            ok = ok && same_colors(outcome.colors, expected.colors);
+        }
+    }
+
+    // Another backend, same bytes
+    Outcome expected = reference_run(24, 20, 32, 4, 0.02, 10);
+    Outcome outcome = strip_run(2, 24, 20, 32, 4, 0.02, 10, EmulatorBackend::Predecoded);
+    ok = ok && outcome.soup == expected.soup && same_stats(outcome.stats, expected.stats);
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": 1 to 3 strips evolve the grid exactly as one process" << std::endl;
+    return ok;
+}
+
+bool check_entropy() {
+    // One strip gives the single-process value; more strips shard the
+    // Kolmogorov part at the strip boundaries
+    Outcome expected = reference_run(24, 20, 16, 11, 0.01, 5);
+    Outcome single = strip_run(1, 24, 20, 16, 11, 0.01, 5, EmulatorBackend::Scalar);
+
+    MetricsOptions sharded_options;
+    sharded_options.shards = 2;
+    MetricsEngine sharded(sharded_options);
+    double expected_sharded = sharded.higher_order_entropy_of(expected.soup.data(), expected.soup.size());
+    Outcome split = strip_run(2, 24, 20, 16, 11, 0.01, 5, EmulatorBackend::Scalar);
+
+    bool ok = single.hoe == expected.hoe && std::abs(split.hoe - expected_sharded) < 1e-9;
+    std::cout << (ok ? "PASS" : "FAIL") << ": entropy reduced over strips (" << expected.hoe << ", "
+              << split.hoe << " with 2 strips)" << std::endl;
+    return ok;
+}
+
+bool check_too_thin() {
+    bool threw = false;
+    try {
+        strip_run(3, 10, 11, 16, 11, 0.01, 1, EmulatorBackend::Scalar);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+
+    std::cout << (threw ? "PASS" : "FAIL") << ": strips thinner than the pairing reach are rejected" << std::endl;
+    return threw;
+}
+
+int main() {
+    std::cout << "Testing strip grid..." << std::endl;
+
+    bool ok = check_strips();
+    ok = check_entropy() && ok;
+    ok = check_too_thin() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Strip grid matches the single-process grid!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Strip grid checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+#include "token_lineage.h"
+#include "grid_w_tracer.h"
+#include "thread_pool.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+bool same_columns(const TokenColumns& a, const TokenColumns& b) {
+    return a.epoch == b.epoch && a.chars == b.chars && a.epochs == b.epochs && a.positions == b.positions;
+}
+
+bool close_to(double a, double b) {
+    return std::fabs(a - b) < 1e-9;
+}
+
+// A few tracer epochs: tokens copied between cells, then mutated
+void advance(GridWithTracer& grid, int epoch, std::mt19937& rng) {
+    grid.begin_epoch();
+    int cells = grid.get_total_programs();
+    for (int i = 0; i < cells; i++) {
+        Span<const Token> source = grid.program_at(i % 5 == 0 ? (i + 1) % cells : i);
+        std::copy(source.begin(), source.end(), grid.next_program(i).begin());
+        grid.mutate_in_place(grid.next_program(i), 0.05, epoch, rng);
+    }
+    grid.commit_epoch();
+}
+
+// Statistics of one cell the slow way, from the packed tokens
+CellLineage reference_stats(const GridWithTracer& grid, int cell, int64_t epoch,
+                            const std::map<uint64_t, uint32_t>& copies, const std::vector<Token>& before) {
+    Span<const Token> program = grid.program_at(cell);
+    int size = grid.get_program_size();
+    std::map<uint64_t, int> counts;
+    std::vector<double> ages;
+    CellLineage s;
+    for (int i = 0; i < size; i++) {
+        const Token& token = program[i];
+        counts[token.value]++;
+        ages.push_back(static_cast<double>(epoch - static_cast<int64_t>(token.get_epoch())));
+        s.primordial_fraction += token.get_epoch() == 0 ? 1.0 / size : 0.0;
+        s.mean_copies += static_cast<double>(copies.at(token.value)) / size;
+        s.max_copies = std::max(s.max_copies, copies.at(token.value));
+        if (!before.empty() && before[static_cast<size_t>(cell) * size + i].value != token.value) {
+            s.churn += 1.0 / size;
+        }
+    }
+    if (before.empty()) {
+        s.churn = 1.0;
+    }
+    std::sort(ages.begin(), ages.end());
+    for (double age : ages) {
+        s.mean_age += age / size;
+    }
+    s.median_age = size % 2 == 1 ? ages[size / 2] : (ages[size / 2 - 1] + ages[size / 2]) / 2.0;
+    s.max_age = static_cast<uint32_t>(ages.back());
+    s.distinct_origins = static_cast<uint32_t>(counts.size());
+    for (const auto& entry : counts) {
+        double p = static_cast<double>(entry.second) / size;
+        s.origin_entropy -= p * std::log2(p);
+    }
+    return s;
+}
+
+bool same_stats(const CellLineage& a, const CellLineage& b) {
+    return close_to(a.mean_age, b.mean_age) && close_to(a.median_age, b.median_age) && a.max_age == b.max_age &&
+           close_to(a.primordial_fraction, b.primordial_fraction) && a.distinct_origins == b.distinct_origins &&
+           close_to(a.origin_entropy, b.origin_entropy) && close_to(a.mean_copies, b.mean_copies) &&
+           a.max_copies == b.max_copies && close_to(a.churn, b.churn);
+}
+
+bool check_columns() {
+    std::mt19937 rng(41);
+    std::vector<Token> tokens;
+    for (int i = 0; i < 40000; i++) {
+        tokens.push_back(Token(rng() % 100000, static_cast<uint16_t>(rng()), static_cast<uint8_t>(rng())));
+    }
+
+    ThreadPool pool(3);
+    TokenColumns serial = TokenColumns::from_tokens(Span<const Token>(tokens.data(), tokens.size()), 9);
+    TokenColumns parallel = TokenColumns::from_tokens(Span<const Token>(tokens.data(), tokens.size()), 9, &pool);
+    bool ok = same_columns(serial, parallel) && serial.size() == tokens.size();
+    for (size_t i = 0; i < tokens.size() && ok; i++) {
+        ok = serial.token(i) == tokens[i].value;
+    }
+
+    // Epochs past the 32-bit plane are refused rather than wrapped
+    tokens[7] = Token(1ULL << 33, 1, 1);
+    bool threw = false;
+    try {
+        TokenColumns::from_tokens(Span<const Token>(tokens.data(), tokens.size()), 9, &pool);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    ok = ok && threw;
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": tokens split into planes and packed again" << std::endl;
+    return ok;
+}
+
+bool check_stats() {
+    std::mt19937 rng(42);
+    GridWithTracer grid(32, 16, 64);
+    grid.initialize_random(rng);
+    ThreadPool pool(3);
+    TokenLineage serial(32, 16, 64);
+    TokenLineage parallel(32, 16, 64, &pool);
+
+    bool ok = true;
+    std::vector<Token> before;
+    for (int epoch = 0; epoch <= 6 && ok; epoch += 2) {
+        if (epoch > 0) {
+            advance(grid, epoch - 1, rng);
+            advance(grid, epoch, rng);
+        }
+        serial.capture(grid, epoch);
+        parallel.capture(grid, epoch);
+
+        std::map<uint64_t, uint32_t> copies;
+        for (const Token& token : grid.tokens()) {
+            copies[token.value]++;
+        }
+        size_t changed = 0;
+        for (size_t i = 0; i < grid.tokens().size(); i++) {
+            changed += before.empty() || before[i].value != grid.tokens()[i].value;
+        }
+
+        ok = serial.changed_tokens() == changed && parallel.changed_tokens() == changed;
+        for (int cell = 0; cell < grid.get_total_programs() && ok; cell++) {
+            CellLineage expected = reference_stats(grid, cell, epoch, copies, before);
+            ok = same_stats(serial.cells()[cell], expected) && same_stats(parallel.cells()[cell], expected);
+        }
+        before.assign(grid.tokens().begin(), grid.tokens().end());
+    }
+
+    // The copied cells share tokens, and mutation has made new ones
+    const std::vector<CellLineage>& cells = parallel.cells();
+    bool copied = std::any_of(cells.begin(), cells.end(), [](const CellLineage& s) { return s.max_copies > 1; });
+    bool aged = std::any_of(cells.begin(), cells.end(), [](const CellLineage& s) { return s.mean_age > 0.0; });
+    ok = ok && copied && aged;
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": per-cell ages, origins, copies and churn" << std::endl;
+    return ok;
+}
+
+bool check_archive() {
+    std::mt19937 rng(43);
+    GridWithTracer grid(12, 10, 32);
+    grid.initialize_random(rng);
+    std::string path = (fs::temp_directory_path() / "bffpp_test_token_lineage.bffl").string();
+
+    TokenLineage lineage(12, 10, 32);
+    lineage.capture(grid, 0);
+    lineage.open_archive(path);
+    std::vector<TokenColumns> captured = {lineage.columns()};
+    for (int epoch = 1; epoch <= 5; epoch++) {
+        advance(grid, epoch, rng);
+        lineage.capture(grid, epoch);
+        captured.push_back(lineage.columns());
+    }
+    lineage.capture(grid, 6);
+    captured.push_back(lineage.columns());
+
+    size_t full_size = 24 + 24 + grid.tokens().size() * 7;
+    bool ok = fs::file_size(path) < full_size * captured.size() && lineage.changed_tokens() == 0;
+
+    LineageArchiveReader reader(path);
+    ok = ok && reader.get_width() == 12 && reader.get_height() == 10 && reader.get_program_size() == 32;
+    TokenColumns columns;
+    size_t records = 0;
+    while (ok && reader.next(columns)) {
+        ok = records < captured.size() && same_columns(columns, captured[records]);
+        records++;
+    }
+    ok = ok && records == captured.size();
+    fs::remove(path);
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": lineage archive of deltas reads back every capture" << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing token lineage..." << std::endl;
+
+    bool ok = check_columns();
+    ok = check_stats() && ok;
+    ok = check_archive() && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: Token lineage matches the tokens!" << std::endl;
+    } else {
+        std::cout << "FAILURE: Token lineage checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
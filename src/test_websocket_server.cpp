@@ -0,0 +1,410 @@
+#include "websocket_server.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <zlib.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <poll.h>
+
+constexpr int TEST_PORT = 18571;
+
+// A minimal client speaking raw WebSocket frames
+struct TestClient {
+    int sock = -1;
+    std::vector<uint8_t> input;
+    std::string response;
+
+    ~TestClient() {
+        if (sock >= 0) {
+            close(sock);
+        }
+    }
+
+    bool connect_to(const std::string& extensions, const std::string& key = "dGhlIHNhbXBsZSBub25jZQ==",
+                    int receive_buffer = 0) {
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (receive_buffer > 0) {
+            setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+        }
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(TEST_PORT);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(sock, (struct sockaddr*)&address, sizeof(address)) < 0) {
+            return false;
+        }
+        std::string request = "GET / HTTP/1.1\r\nHost: localhost\r\nupgrade: websocket\r\nConnection: Upgrade\r\n"
+                              "Sec-WebSocket-Key: " + key + "\r\nSec-WebSocket-Version: 13\r\n";
+        if (!extensions.empty()) {
+            request += "Sec-WebSocket-Extensions: " + extensions + "\r\n";
+        }
+        request += "\r\n";
+        send(sock, request.data(), request.size(), 0);
+
+        while (response.find("\r\n\r\n") == std::string::npos) {
+            if (!receive(2000)) {
+                return false;
+            }
+            response.assign(input.begin(), input.end());
+        }
+        size_t end = response.find("\r\n\r\n") + 4;
+        input.erase(input.begin(), input.begin() + end);
+        response.resize(end);
+        return response.compare(0, 12, "HTTP/1.1 101") == 0;
+    }
+
+    bool receive(int timeout_ms) {
+        struct pollfd entry = {sock, POLLIN, 0};
+        if (poll(&entry, 1, timeout_ms) <= 0) {
+            return false;
+        }
+        uint8_t buffer[65536];
+        ssize_t bytes = recv(sock, buffer, sizeof(buffer), 0);
+        if (bytes <= 0) {
+            return false;
+        }
+        input.insert(input.end(), buffer, buffer + bytes);
+        return true;
+    }
+
+    // Next server frame; false on timeout
+    bool read_frame(uint8_t& opcode, bool& compressed, std::vector<uint8_t>& payload, int timeout_ms = 2000) {
+        while (true) {
+            if (input.size() >= 2) {
+                uint64_t length = input[1] & 0x7F;
+                size_t header = 2;
+                if (length == 126 && input.size() >= 4) {
+                    length = (input[2] << 8) | input[3];
+                    header = 4;
+                } else if (length == 127 && input.size() >= 10) {
+                    length = 0;
+                    for (int i = 0; i < 8; i++) {
+                        length = (length << 8) | input[2 + i];
+                    }
+                    header = 10;
+                }
+                if (length < 126 || header > 2) {
+                    if (input.size() >= header + length) {
+                        opcode = input[0] & 0x0F;
+                        compressed = (input[0] & 0x40) != 0;
+                        payload.assign(input.begin() + header, input.begin() + header + length);
+                        input.erase(input.begin(), input.begin() + header + length);
+                        return true;
+                    }
+                }
+            }
+            if (!receive(timeout_ms)) {
+                return false;
+            }
+        }
+    }
+
+    void send_frame(uint8_t opcode, const std::vector<uint8_t>& payload, bool fin = true, bool compressed = false) {
+        std::vector<uint8_t> frame;
+        frame.push_back((fin ? 0x80 : 0x00) | (compressed ? 0x40 : 0x00) | opcode);
+        if (payload.size() < 126) {
+            frame.push_back(0x80 | static_cast<uint8_t>(payload.size()));
+        } else {
+            frame.push_back(0x80 | 126);
+            frame.push_back(static_cast<uint8_t>(payload.size() >> 8));
+            frame.push_back(static_cast<uint8_t>(payload.size()));
+        }
+        const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+        frame.insert(frame.end(), mask, mask + 4);
+        for (size_t i = 0; i < payload.size(); i++) {
+            frame.push_back(payload[i] ^ mask[i % 4]);
+        }
+        send(sock, frame.data(), frame.size(), 0);
+    }
+};
+
+std::vector<uint8_t> bytes_of(const std::string& text) {
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+std::vector<uint8_t> raw_deflate(const std::vector<uint8_t>& input) {
+    z_stream stream = {};
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    std::vector<uint8_t> output(deflateBound(&stream, input.size()) + 16);
+    stream.next_in = const_cast<Bytef*>(input.data());
+    stream.avail_in = input.size();
+    stream.next_out = output.data();
+    stream.avail_out = output.size();
+    deflate(&stream, Z_SYNC_FLUSH);
+    output.resize(output.size() - stream.avail_out - 4);
+    deflateEnd(&stream);
+    return output;
+}
+
+std::vector<uint8_t> raw_inflate(std::vector<uint8_t> input) {
+    const uint8_t tail[4] = {0x00, 0x00, 0xff, 0xff};
+    input.insert(input.end(), tail, tail + 4);
+    z_stream stream = {};
+    inflateInit2(&stream, -MAX_WBITS);
+    std::vector<uint8_t> output(1 << 20);
+    stream.next_in = input.data();
+    stream.avail_in = input.size();
+    stream.next_out = output.data();
+    stream.avail_out = output.size();
+    inflate(&stream, Z_SYNC_FLUSH);
+    output.resize(output.size() - stream.avail_out);
+    inflateEnd(&stream);
+    return output;
+}
+
+template <typename Condition>
+bool wait_until(Condition condition, int timeout_ms = 2000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+bool check_handshake_and_frames(WebSocketServer& server) {
+    TestClient client;
+    bool ok = client.connect_to("");
+    // The accept key of RFC 6455's example handshake
+    ok = ok && client.response.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") != std::string::npos &&
+         client.response.find("permessage-deflate") == std::string::npos;
+    ok = ok && wait_until([&] { return server.get_client_count() == 1; });
+
+    uint8_t opcode = 0;
+    bool compressed = false;
+    std::vector<uint8_t> payload;
+    server.broadcast("hello");
+    ok = ok && client.read_frame(opcode, compressed, payload) && opcode == 0x1 && payload == bytes_of("hello");
+
+    // A new client gets the keyframe, then deltas
+    server.broadcast_frame({1, 2, 3}, {4});
+    ok = ok && client.read_frame(opcode, compressed, payload) && opcode == 0x2 &&
+         payload == std::vector<uint8_t>{1, 2, 3};
+    server.broadcast_frame({5, 6, 7}, {8});
+    ok = ok && client.read_frame(opcode, compressed, payload) && payload == std::vector<uint8_t>{8};
+    ok = ok && !server.wants_keyframe();
+
+    // A ping is answered with the same payload
+    client.send_frame(0x9, bytes_of("abc"));
+    ok = ok && client.read_frame(opcode, compressed, payload) && opcode == 0xA && payload == bytes_of("abc");
+
+    // Close is answered, and the client is gone
+    client.send_frame(0x8, {0x03, 0xE8});
+    ok = ok && client.read_frame(opcode, compressed, payload) && opcode == 0x8;
+    ok = ok && wait_until([&] { return server.get_client_count() == 0; });
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": handshake, text and binary frames, ping and close" << std::endl;
+    return ok;
+}
+
+bool check_deflate(WebSocketServer& server) {
+    TestClient plain, deflating;
+    bool ok = plain.connect_to("") &&
+              deflating.connect_to("permessage-deflate; client_max_window_bits", "x3JJHMbDL1EzLkh9GBhXDw==");
+    ok = ok && deflating.response.find("Sec-WebSocket-Extensions: permessage-deflate") != std::string::npos;
+    ok = ok && wait_until([&] { return server.get_client_count() == 2; });
+
+    // A grid-sized JSON message is compressed once for the client that asked
+    std::string message = "{\"epoch\":1,\"grid\":[";
+    for (int i = 0; i < 2000; i++) {
+        message += "[" + std::to_string(i % 7) + ",128,255],";
+    }
+    message += "[0,0,0]]}";
+
+    uint8_t opcode = 0;
+    bool compressed = false;
+    std::vector<uint8_t> payload;
+    server.broadcast(message);
+    ok = ok && plain.read_frame(opcode, compressed, payload) && !compressed && payload == bytes_of(message);
+    ok = ok && deflating.read_frame(opcode, compressed, payload) && compressed && opcode == 0x1;
+    size_t compressed_size = payload.size();
+    ok = ok && compressed_size * 4 < message.size() && raw_inflate(payload) == bytes_of(message);
+
+    // Short messages go out as they are
+    server.broadcast("hi");
+    ok = ok && deflating.read_frame(opcode, compressed, payload) && !compressed && payload == bytes_of("hi");
+    ok = ok && plain.read_frame(opcode, compressed, payload) && payload == bytes_of("hi");
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": permessage-deflate (" << compressed_size << " bytes for "
+              << message.size() << ")" << std::endl;
+    return ok;
+}
+
+bool check_commands(WebSocketServer& server) {
+    std::atomic<int> received(0);
+    server.set_command_callback([&](const std::string& command) {
+        if (command == "pause" || command == "play") {
+            received++;
+        }
+    });
+
+    TestClient client;
+    bool ok = client.connect_to("permessage-deflate");
+    ok = ok && wait_until([&] { return server.get_client_count() == 1; });
+
+    client.send_frame(0x1, bytes_of("pause"));
+    ok = ok && wait_until([&] { return server.is_paused(); });
+
+    // Compressed by the client
+    client.send_frame(0x1, raw_deflate(bytes_of("play")), true, true);
+    ok = ok && wait_until([&] { return !server.is_paused(); });
+
+    // Fragmented, with a ping in between
+    client.send_frame(0x1, bytes_of("pa"), false);
+    client.send_frame(0x9, bytes_of("x"));
+    client.send_frame(0x0, bytes_of("use"));
+    ok = ok && wait_until([&] { return server.is_paused(); }) && wait_until([&] { return received == 3; });
+
+    server.set_command_callback(nullptr);
+    client.send_frame(0x1, bytes_of("play"));
+    ok = ok && wait_until([&] { return !server.is_paused(); });
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": pause and play commands, compressed and fragmented" << std::endl;
+    return ok;
+}
+
+// A plain HTTP request on the server's port; the whole reply, read until the server closes
+std::string http_get(const std::string& path) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(TEST_PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    std::string reply;
+    if (connect(sock, (struct sockaddr*)&address, sizeof(address)) == 0) {
+        std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        send(sock, request.data(), request.size(), 0);
+        char buffer[4096];
+        struct pollfd entry = {sock, POLLIN, 0};
+        while (poll(&entry, 1, 2000) > 0) {
+            ssize_t bytes = recv(sock, buffer, sizeof(buffer), 0);
+            if (bytes <= 0) {
+                break;
+            }
+            reply.append(buffer, bytes);
+        }
+    }
+    close(sock);
+    return reply;
+}
+
+bool check_profile_and_metrics(WebSocketServer& server) {
+    std::string metrics = "# TYPE bffpp_epoch gauge\nbffpp_epoch 42\n";
+    server.set_metrics(metrics);
+    std::string reply = http_get("/metrics");
+    bool ok = reply.compare(0, 15, "HTTP/1.1 200 OK") == 0 &&
+              reply.find("Content-Type: text/plain; version=0.0.4") != std::string::npos &&
+              reply.size() > metrics.size() && reply.compare(reply.size() - metrics.size(), metrics.size(), metrics) == 0;
+    ok = ok && http_get("/other").compare(0, 12, "HTTP/1.1 404") == 0;
+
+    std::atomic<int> subscribed(0);
+    server.set_command_callback([&](const std::string& command) {
+        if (command == "profile") {
+            subscribed++;
+        }
+    });
+
+    TestClient viewer, profiler;
+    ok = ok && viewer.connect_to("") && profiler.connect_to("", "x3JJHMbDL1EzLkh9GBhXDw==");
+    ok = ok && wait_until([&] { return server.get_client_count() == 2; });
+    profiler.send_frame(0x1, bytes_of("profile"));
+    ok = ok && wait_until([&] { return subscribed == 1; });
+    server.set_command_callback(nullptr);
+
+    // Profile messages go to subscribers only; broadcasts to everyone
+    uint64_t sent_before = server.bytes_sent();
+    uint8_t opcode = 0;
+    bool compressed = false;
+    std::vector<uint8_t> payload;
+    server.broadcast_profile("{\"type\":\"profile\"}");
+    server.broadcast("grid");
+    ok = ok && profiler.read_frame(opcode, compressed, payload) && payload == bytes_of("{\"type\":\"profile\"}");
+    ok = ok && profiler.read_frame(opcode, compressed, payload) && payload == bytes_of("grid");
+    ok = ok && viewer.read_frame(opcode, compressed, payload) && payload == bytes_of("grid");
+    ok = ok && wait_until([&] { return server.bytes_sent() >= sent_before + 3 * 2 + 18 + 2 * 4; });
+
+    viewer.send_frame(0x8, {});
+    profiler.send_frame(0x8, {});
+    ok = ok && wait_until([&] { return server.get_client_count() == 0; });
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": GET /metrics, the profile channel and bytes sent" << std::endl;
+    return ok;
+}
+
+bool check_slow_client(WebSocketServer& server) {
+    // One client never reads; another reads everything
+    TestClient stalled, reader;
+    bool ok = stalled.connect_to("", "dGhlIHNhbXBsZSBub25jZQ==", 4096) && reader.connect_to("");
+    ok = ok && wait_until([&] { return server.get_client_count() == 2; });
+
+    std::atomic<bool> done(false);
+    std::atomic<int> big_frames(0);
+    std::thread reading([&] {
+        uint8_t opcode;
+        bool compressed;
+        std::vector<uint8_t> payload;
+        while (reader.read_frame(opcode, compressed, payload, 5000)) {
+            if (payload == bytes_of("done")) {
+                done = true;
+                return;
+            }
+            big_frames++;
+        }
+    });
+
+    std::string message(256 * 1024, 'x');
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 200; i++) {
+        message[0] = static_cast<char>('a' + i % 26);
+        server.broadcast(message);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Repeat until the reader's queue has room for it
+    ok = ok && wait_until([&] {
+        server.broadcast("done");
+        return done.load();
+    }, 5000);
+    reading.join();
+    ok = ok && seconds < 2.0 && big_frames > 0 && server.get_client_count() == 2;
+
+    // Stopping does not wait for the stalled client for long
+    start = std::chrono::steady_clock::now();
+    server.stop();
+    double stop_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ok = ok && stop_seconds < 2.0 && !server.has_clients();
+
+    std::cout << (ok ? "PASS" : "FAIL") << ": a stalled client does not hold up broadcasts (200 x 256 KB in "
+              << seconds << " s, " << big_frames << " delivered to the reader)" << std::endl;
+    return ok;
+}
+
+int main() {
+    std::cout << "Testing the WebSocket server..." << std::endl;
+
+    WebSocketServer server(TEST_PORT);
+    server.start();
+
+    bool ok = check_handshake_and_frames(server);
+    ok = check_deflate(server) && ok;
+    ok = check_commands(server) && ok;
+    ok = check_profile_and_metrics(server) && ok;
+    ok = check_slow_client(server) && ok;
+
+    if (ok) {
+        std::cout << "SUCCESS: WebSocket server checks passed!" << std::endl;
+    } else {
+        std::cout << "FAILURE: WebSocket server checks failed!" << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
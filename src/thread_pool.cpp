@@ -0,0 +1,418 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#include <dirent.h>
+#endif
+
+// Queue owned by the current thread: workers own queue 1..N-1, every thread
+// outside the pool (normally the driver's main thread) shares queue 0
+static thread_local const ThreadPool* current_pool = nullptr;
+static thread_local unsigned int current_queue = 0;
+
+unsigned int ThreadPool::resolve_thread_count(int requested) {
+    if (requested > 0) {
+        return static_cast<unsigned int>(requested);
+    }
+
+    unsigned int hw = std::thread::hardware_concurrency();
+    return hw == 0 ? 4 : hw;
+}
+
+#ifdef __linux__
+// CPU numbers in a sysfs list such as "0-3,8-11"
+static std::vector<int> parse_cpu_list(const std::string& text) {
+    std::vector<int> cpus;
+    std::stringstream list(text);
+    std::string range;
+    while (std::getline(list, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first = std::atoi(range.c_str());
+        int last = (dash == std::string::npos) ? first : std::atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+std::vector<std::vector<int>> ThreadPool::numa_cpu_groups() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        for (unsigned int cpu = 0; cpu < resolve_thread_count(0) && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &allowed);
+        }
+    }
+
+    // Nodes in number order, each with the CPUs we may use
+    std::vector<std::pair<int, std::vector<int>>> nodes;
+    if (DIR* dir = opendir("/sys/devices/system/node")) {
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+                name.find_first_not_of("0123456789", 4) != std::string::npos) {
+                continue;
+            }
+            std::ifstream file("/sys/devices/system/node/" + name + "/cpulist");
+            std::string text;
+            std::getline(file, text);
+
+            std::vector<int> cpus;
+            for (int cpu : parse_cpu_list(text)) {
+                if (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                    cpus.push_back(cpu);
+                }
+            }
+            if (!cpus.empty()) {
+                nodes.push_back({std::atoi(name.c_str() + 4), cpus});
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(nodes.begin(), nodes.end());
+
+    std::vector<std::vector<int>> groups;
+    for (auto& node : nodes) {
+        groups.push_back(std::move(node.second));
+    }
+    if (groups.empty()) {
+        groups.emplace_back();
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                groups.back().push_back(cpu);
+            }
+        }
+    }
+    return groups;
+}
+#else
+// Without sysfs or affinity calls: one group of every CPU
+std::vector<std::vector<int>> ThreadPool::numa_cpu_groups() {
+    std::vector<std::vector<int>> groups(1);
+    for (unsigned int cpu = 0; cpu < resolve_thread_count(0); cpu++) {
+        groups[0].push_back(static_cast<int>(cpu));
+    }
+    return groups;
+}
+#endif
+
+ThreadPool::ThreadPool(unsigned int num_threads)
+    : num_threads(resolve_thread_count(static_cast<int>(num_threads))),
+      thread_group(this->num_threads, 0),
+      group_first{0, this->num_threads},
+      queued_tasks(0),
+      stopping(false) {
+    group_queued.push_back(std::make_unique<std::atomic<size_t>>(0));
+    start_workers();
+}
+
+// Restrict a thread to the given CPUs; only Linux lets us, elsewhere threads stay unpinned
+static void pin_thread(pthread_t thread, const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    if (pthread_setaffinity_np(thread, sizeof(set), &set) != 0) {
+        throw std::runtime_error("Could not pin a worker thread to CPU " + std::to_string(cpus.front()));
+    }
+#else
+    (void)thread;
+    (void)cpus;
+#endif
+}
+
+ThreadPool::ThreadPool(unsigned int num_threads, const std::vector<std::vector<int>>& cpu_groups)
+    : num_threads(resolve_thread_count(static_cast<int>(num_threads))),
+      queued_tasks(0),
+      stopping(false) {
+    size_t num_groups = std::max<size_t>(1, cpu_groups.size());
+    if (num_groups > this->num_threads) {
+        throw std::runtime_error("A pinned thread pool needs at most " + std::to_string(this->num_threads) +
+                                 " thread groups");
+    }
+    for (const std::vector<int>& cpus : cpu_groups) {
+        if (cpus.empty()) {
+            throw std::runtime_error("A pinned thread pool group has no CPUs");
+        }
+    }
+
+    // Consecutive threads per group, the caller first
+    for (unsigned int t = 0; t < this->num_threads; t++) {
+        unsigned int group = static_cast<unsigned int>(t * num_groups / this->num_threads);
+        if (group_first.size() == group) {
+            group_first.push_back(t);
+            group_queued.push_back(std::make_unique<std::atomic<size_t>>(0));
+        }
+        thread_group.push_back(group);
+    }
+    group_first.push_back(this->num_threads);
+
+    if (cpu_groups.empty()) {
+        start_workers();
+        return;
+    }
+    pin_thread(pthread_self(), cpu_groups[0]);
+    start_workers();
+    try {
+        for (unsigned int t = 1; t < this->num_threads; t++) {
+            const std::vector<int>& cpus = cpu_groups[thread_group[t]];
+            pin_thread(workers[t - 1].native_handle(), {cpus[(t - group_first[thread_group[t]]) % cpus.size()]});
+        }
+    } catch (...) {
+        stop_workers();
+        throw;
+    }
+}
+
+void ThreadPool::start_workers() {
+    for (unsigned int i = 0; i < num_threads; i++) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    for (unsigned int i = 1; i < num_threads; i++) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    stop_workers();
+}
+
+void ThreadPool::stop_workers() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake_cv.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallel_for(
+    size_t count,
+    size_t chunk_size,
+    const std::function<void(size_t, size_t)>& fn
+) {
+    if (count == 0) {
+        return;
+    }
+
+    if (chunk_size == 0) {
+        chunk_size = std::max<size_t>(1, count / (static_cast<size_t>(num_threads) * 8));
+    }
+
+    size_t num_chunks = (count + chunk_size - 1) / chunk_size;
+
+    // Single thread or single chunk: no point going through the queues
+    if (num_threads == 1 || num_chunks == 1) {
+        fn(0, count);
+        return;
+    }
+
+    Job job;
+    job.fn = &fn;
+    job.remaining = num_chunks;
+
+    unsigned int home = (current_pool == this) ? current_queue : 0;
+
+    // Deal chunks out round-robin, starting with the caller's own queue
+    for (size_t c = 0; c < num_chunks; c++) {
+        size_t begin = c * chunk_size;
+        size_t end = std::min(count, begin + chunk_size);
+        push_task((home + c) % num_threads, Task{&job, begin, end, -1});
+    }
+
+    run_job(job, home);
+}
+
+void ThreadPool::parallel_for_groups(
+    const std::vector<size_t>& bounds,
+    size_t chunk_size,
+    const std::function<void(size_t, size_t)>& fn
+) {
+    unsigned int num_groups = groups();
+    if (bounds.size() != num_groups + 1 && bounds.size() != num_groups + 2) {
+        throw std::runtime_error("parallel_for_groups needs " + std::to_string(num_groups + 1) + " or " +
+                                 std::to_string(num_groups + 2) + " bounds");
+    }
+    size_t count = bounds.back();
+    if (count == 0) {
+        return;
+    }
+    if (num_threads == 1) {
+        fn(0, count);
+        return;
+    }
+
+    unsigned int home = (current_pool == this) ? current_queue : 0;
+
+    // Chunks of each range, dealt round-robin over the threads allowed to
+    // run them, starting with the caller's queue if it is one of those
+    std::vector<std::pair<unsigned int, Task>> tasks;
+    Job job;
+    job.fn = &fn;
+    for (size_t r = 0; r + 1 < bounds.size(); r++) {
+        bool anywhere = (r == num_groups);
+        unsigned int first = anywhere ? 0 : group_first[r];
+        unsigned int threads = anywhere ? num_threads : group_first[r + 1] - first;
+        unsigned int start = (home >= first && home < first + threads) ? home - first : 0;
+        size_t range_chunk = chunk_size;
+        if (range_chunk == 0) {
+            range_chunk = std::max<size_t>(1, (bounds[r + 1] - bounds[r]) / (static_cast<size_t>(threads) * 8));
+        }
+
+        size_t c = 0;
+        for (size_t begin = bounds[r]; begin < bounds[r + 1]; begin += range_chunk, c++) {
+            size_t end = std::min(bounds[r + 1], begin + range_chunk);
+            unsigned int queue = first + static_cast<unsigned int>((start + c) % threads);
+            tasks.push_back({queue, Task{&job, begin, end, anywhere ? -1 : static_cast<int>(r)}});
+        }
+    }
+
+    job.remaining = tasks.size();
+    for (const auto& task : tasks) {
+        push_task(task.first, task.second);
+    }
+
+    run_job(job, home);
+}
+
+void ThreadPool::push_task(unsigned int queue_index, const Task& task) {
+    WorkQueue& queue = *queues[queue_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(task);
+    if (task.group < 0) {
+        queued_tasks++;
+    } else {
+        (*group_queued[task.group])++;
+    }
+}
+
+void ThreadPool::run_job(Job& job, unsigned int home) {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+    }
+    wake_cv.notify_all();
+
+    // Help out until every chunk of this job is done
+    for (;;) {
+        Task task;
+        if (try_pop_task(home, task)) {
+            run_task(task);
+            continue;
+        }
+
+        // Nothing left to take: the remaining chunks are running elsewhere
+        std::unique_lock<std::mutex> lock(job.done_mutex);
+        job.done_cv.wait(lock, [&job] { return job.remaining == 0; });
+        break;
+    }
+
+    if (job.error) {
+        std::rethrow_exception(job.error);
+    }
+}
+
+void ThreadPool::worker_loop(unsigned int queue_index) {
+    current_pool = this;
+    current_queue = queue_index;
+
+    while (true) {
+        Task task;
+        if (try_pop_task(queue_index, task)) {
+            run_task(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake_cv.wait(lock, [this, queue_index] { return stopping || runnable_tasks(queue_index); });
+        if (stopping && !runnable_tasks(queue_index)) {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::try_pop_task(unsigned int queue_index, Task& task) {
+    // Own queue first, oldest chunk first; it only holds tasks this thread may run
+    {
+        WorkQueue& own = *queues[queue_index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            if (task.group < 0) {
+                queued_tasks--;
+            } else {
+                (*group_queued[task.group])--;
+            }
+            return true;
+        }
+    }
+
+    // Then steal the newest chunk from someone else; from another group,
+    // only chunks that may run anywhere
+    unsigned int group = thread_group[queue_index];
+    for (unsigned int offset = 1; offset < num_threads; offset++) {
+        unsigned int victim_index = (queue_index + offset) % num_threads;
+        bool same_group = thread_group[victim_index] == group;
+        if (!same_group && queued_tasks == 0) {
+            continue;
+        }
+
+        WorkQueue& victim = *queues[victim_index];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        for (auto it = victim.tasks.rbegin(); it != victim.tasks.rend(); ++it) {
+            if (same_group || it->group < 0) {
+                task = *it;
+                victim.tasks.erase(std::next(it).base());
+                if (task.group < 0) {
+                    queued_tasks--;
+                } else {
+                    (*group_queued[task.group])--;
+                }
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool ThreadPool::runnable_tasks(unsigned int queue_index) const {
+    return queued_tasks > 0 || *group_queued[thread_group[queue_index]] > 0;
+}
+
+void ThreadPool::run_task(const Task& task) {
+    Job* job = task.job;
+
+    try {
+        (*job->fn)(task.begin, task.end);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(job->error_mutex);
+        if (!job->error) {
+            job->error = std::current_exception();
+        }
+    }
+
+    // Decrement under the job's mutex so the waiting caller cannot return
+    // (and destroy the job) while we are still touching it
+    std::lock_guard<std::mutex> lock(job->done_mutex);
+    if (--job->remaining == 0) {
+        job->done_cv.notify_all();
+    }
+}
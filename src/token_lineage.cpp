@@ -0,0 +1,391 @@
+#include "token_lineage.h"
+#include "byte_order.h"
+#include "grid_w_tracer.h"
+#include "thread_pool.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+using namespace byte_order;
+
+constexpr char LINEAGE_MAGIC[4] = {'B', 'F', 'F', 'L'};
+constexpr uint32_t LINEAGE_VERSION = 1;
+constexpr size_t LINEAGE_HEADER_SIZE = 24;
+constexpr size_t LINEAGE_RECORD_HEADER_SIZE = 24;
+
+// Below this many tokens a plane is split on the calling thread
+constexpr size_t MIN_PARALLEL_TOKENS = 1 << 14;
+
+// fn(begin, end) over [0, count), on the pool when there is enough work
+void for_ranges(ThreadPool* pool, size_t count, const std::function<void(size_t, size_t)>& fn) {
+    if (pool && pool->size() > 1 && count >= MIN_PARALLEL_TOKENS) {
+        pool->parallel_for(count, 0, fn);
+    } else if (count > 0) {
+        fn(0, count);
+    }
+}
+
+// Sort in pool-sized parts, then merge the parts pairwise
+void parallel_sort(std::vector<uint64_t>& values, ThreadPool* pool) {
+    size_t parts = (pool && values.size() >= MIN_PARALLEL_TOKENS) ? pool->size() : 1;
+    if (parts <= 1) {
+        std::sort(values.begin(), values.end());
+        return;
+    }
+
+    std::vector<size_t> bounds(parts + 1);
+    for (size_t p = 0; p <= parts; p++) {
+        bounds[p] = values.size() * p / parts;
+    }
+    pool->parallel_for(parts, 1, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++) {
+            std::sort(values.begin() + bounds[p], values.begin() + bounds[p + 1]);
+        }
+    });
+    for (size_t width = 1; width < parts; width *= 2) {
+        size_t merges = (parts + 2 * width - 1) / (2 * width);
+        pool->parallel_for(merges, 1, [&](size_t begin, size_t end) {
+            for (size_t m = begin; m < end; m++) {
+                size_t first = 2 * width * m;
+                size_t middle = std::min(first + width, parts);
+                size_t last = std::min(first + 2 * width, parts);
+                if (middle < last) {
+                    std::inplace_merge(values.begin() + bounds[first], values.begin() + bounds[middle],
+                                       values.begin() + bounds[last]);
+                }
+            }
+        });
+    }
+}
+
+template <typename T>
+void write_plane(std::ofstream& file, const std::vector<T>& plane) {
+    file.write(reinterpret_cast<const char*>(plane.data()), plane.size() * sizeof(T));
+}
+
+template <typename T>
+void read_plane(std::ifstream& file, std::vector<T>& plane, size_t count, const std::string& filepath) {
+    plane.resize(count);
+    file.read(reinterpret_cast<char*>(plane.data()), count * sizeof(T));
+    if (static_cast<size_t>(file.gcount()) != count * sizeof(T)) {
+        throw std::runtime_error("Truncated lineage archive: " + filepath);
+    }
+}
+
+} // namespace
+
+void TokenColumns::resize(size_t count) {
+    chars.resize(count);
+    epochs.resize(count);
+    positions.resize(count);
+}
+
+TokenColumns TokenColumns::from_tokens(Span<const Token> tokens, int64_t epoch, ThreadPool* pool) {
+    TokenColumns columns;
+    columns.epoch = epoch;
+    columns.resize(tokens.size());
+    for_ranges(pool, tokens.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const Token& token = tokens[i];
+            if (token.get_epoch() > std::numeric_limits<uint32_t>::max()) {
+                throw std::runtime_error("Token epoch does not fit the lineage epoch plane");
+            }
+            columns.chars[i] = token.get_char();
+            columns.epochs[i] = static_cast<uint32_t>(token.get_epoch());
+            columns.positions[i] = token.get_position();
+        }
+    });
+    return columns;
+}
+
+LineageArchiveWriter::LineageArchiveWriter(const std::string& filepath, int width, int height, int program_size)
+    : filepath(filepath), cells(static_cast<size_t>(width) * height * program_size), records(0) {
+    if (!host_is_little_endian()) {
+        throw std::runtime_error("Lineage archives can only be written on little-endian hosts: " + filepath);
+    }
+    file.open(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open lineage archive: " + filepath);
+    }
+
+    uint8_t header[LINEAGE_HEADER_SIZE] = {};
+    std::memcpy(header, LINEAGE_MAGIC, 4);
+    put_u32(header + 4, LINEAGE_VERSION);
+    put_u32(header + 8, static_cast<uint32_t>(width));
+    put_u32(header + 12, static_cast<uint32_t>(height));
+    put_u32(header + 16, static_cast<uint32_t>(program_size));
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+}
+
+void LineageArchiveWriter::append(const TokenColumns& columns, const TokenColumns* previous) {
+    if (columns.size() != cells || (previous && previous->size() != cells)) {
+        throw std::runtime_error("Lineage capture does not match the archive's grid: " + filepath);
+    }
+
+    bool full = (previous == nullptr);
+    std::vector<uint8_t> bitmap;
+    TokenColumns patch;
+    if (!full) {
+        bitmap.assign((cells + 7) / 8, 0);
+        for (size_t i = 0; i < cells; i++) {
+            if (columns.chars[i] != previous->chars[i] || columns.epochs[i] != previous->epochs[i] ||
+                columns.positions[i] != previous->positions[i]) {
+                bitmap[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+                patch.chars.push_back(columns.chars[i]);
+                patch.epochs.push_back(columns.epochs[i]);
+                patch.positions.push_back(columns.positions[i]);
+            }
+        }
+    }
+    const TokenColumns& planes = full ? columns : patch;
+
+    uint8_t header[LINEAGE_RECORD_HEADER_SIZE] = {};
+    put_u64(header + 0, static_cast<uint64_t>(columns.epoch));
+    put_u32(header + 8, full ? 1 : 0);
+    put_u64(header + 16, planes.size());
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    write_plane(file, bitmap);
+    write_plane(file, planes.chars);
+    write_plane(file, planes.epochs);
+    write_plane(file, planes.positions);
+    file.flush();
+
+    if (!file) {
+        throw std::runtime_error("Failed to write lineage archive: " + filepath);
+    }
+    records++;
+}
+
+LineageArchiveReader::LineageArchiveReader(const std::string& filepath)
+    : filepath(filepath), width(0), height(0), program_size(0), started(false) {
+    if (!host_is_little_endian()) {
+        throw std::runtime_error("Lineage archives can only be read on little-endian hosts: " + filepath);
+    }
+    file.open(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open lineage archive: " + filepath);
+    }
+
+    uint8_t header[LINEAGE_HEADER_SIZE];
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (file.gcount() != static_cast<std::streamsize>(sizeof(header)) ||
+        std::memcmp(header, LINEAGE_MAGIC, 4) != 0) {
+        throw std::runtime_error("Not a lineage archive: " + filepath);
+    }
+    if (get_u32(header + 4) != LINEAGE_VERSION) {
+        throw std::runtime_error("Unsupported lineage archive version: " + filepath);
+    }
+    width = static_cast<int>(get_u32(header + 8));
+    height = static_cast<int>(get_u32(header + 12));
+    program_size = static_cast<int>(get_u32(header + 16));
+}
+
+bool LineageArchiveReader::next(TokenColumns& columns) {
+    uint8_t header[LINEAGE_RECORD_HEADER_SIZE];
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (file.gcount() == 0) {
+        return false;
+    }
+    if (file.gcount() != static_cast<std::streamsize>(sizeof(header))) {
+        throw std::runtime_error("Truncated lineage archive: " + filepath);
+    }
+
+    size_t cells = static_cast<size_t>(width) * height * program_size;
+    bool full = get_u32(header + 8) != 0;
+    size_t count = get_u64(header + 16);
+    if (count > cells || (full && count != cells) || (!full && !started)) {
+        throw std::runtime_error("Corrupt lineage archive: " + filepath);
+    }
+
+    if (full) {
+        read_plane(file, columns.chars, cells, filepath);
+        read_plane(file, columns.epochs, cells, filepath);
+        read_plane(file, columns.positions, cells, filepath);
+    } else {
+        if (columns.size() != cells) {
+            throw std::runtime_error("Lineage delta needs the previous record: " + filepath);
+        }
+        std::vector<uint8_t> bitmap;
+        TokenColumns patch;
+        read_plane(file, bitmap, (cells + 7) / 8, filepath);
+        read_plane(file, patch.chars, count, filepath);
+        read_plane(file, patch.epochs, count, filepath);
+        read_plane(file, patch.positions, count, filepath);
+
+        size_t next = 0;
+        for (size_t i = 0; i < cells; i++) {
+            if (bitmap[i / 8] & (1u << (i % 8))) {
+                if (next == count) {
+                    throw std::runtime_error("Corrupt lineage archive: " + filepath);
+                }
+                columns.chars[i] = patch.chars[next];
+                columns.epochs[i] = patch.epochs[next];
+                columns.positions[i] = patch.positions[next];
+                next++;
+            }
+        }
+        if (next != count) {
+            throw std::runtime_error("Corrupt lineage archive: " + filepath);
+        }
+    }
+    columns.epoch = static_cast<int64_t>(get_u64(header + 0));
+    started = true;
+    return true;
+}
+
+TokenLineage::TokenLineage(int width, int height, int program_size, ThreadPool* pool)
+    : width(width), height(height), program_size(program_size), pool(pool), has_previous(false), changed(0) {}
+
+void TokenLineage::capture(const GridWithTracer& grid, int64_t epoch) {
+    capture(grid.tokens(), epoch);
+}
+
+void TokenLineage::capture(Span<const Token> tokens, int64_t epoch) {
+    size_t cells = static_cast<size_t>(width) * height * program_size;
+    if (tokens.size() != cells) {
+        throw std::runtime_error("Token lineage capture does not match the grid size");
+    }
+
+    bool first = current.size() == 0;
+    if (!first) {
+        std::swap(previous, current);
+        has_previous = true;
+    }
+    current = TokenColumns::from_tokens(tokens, epoch, pool);
+
+    // Which tokens changed since the previous capture
+    changed_flags.assign(cells, 1);
+    if (has_previous) {
+        for_ranges(pool, cells, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                changed_flags[i] = (current.chars[i] != previous.chars[i] || current.epochs[i] != previous.epochs[i] ||
+                                    current.positions[i] != previous.positions[i]) ? 1 : 0;
+            }
+        });
+    }
+    changed = static_cast<size_t>(std::count(changed_flags.begin(), changed_flags.end(), 1));
+
+    if (archive) {
+        archive->append(current, has_previous ? &previous : nullptr);
+    }
+    compute_stats();
+}
+
+void TokenLineage::open_archive(const std::string& filepath) {
+    archive = std::make_unique<LineageArchiveWriter>(filepath, width, height, program_size);
+    if (current.size() > 0) {
+        archive->append(current, nullptr);
+    }
+}
+
+void TokenLineage::compute_stats() {
+    size_t cells = current.size();
+    int total_programs = width * height;
+
+    // Copies of every token value across the grid
+    std::vector<uint64_t> sorted(cells);
+    for_ranges(pool, cells, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            sorted[i] = current.token(i);
+        }
+    });
+    parallel_sort(sorted, pool);
+    std::vector<uint64_t> unique_tokens;
+    std::vector<uint32_t> copies;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        if (i == 0 || sorted[i] != sorted[i - 1]) {
+            unique_tokens.push_back(sorted[i]);
+            copies.push_back(0);
+        }
+        copies.back()++;
+    }
+
+    stats.assign(total_programs, CellLineage{});
+    auto cell_stats = [&](size_t begin, size_t end) {
+        std::vector<uint64_t> values(program_size);
+        for (size_t cell = begin; cell < end; cell++) {
+            size_t base = cell * program_size;
+            size_t changed_here = 0;
+            for (int i = 0; i < program_size; i++) {
+                values[i] = current.token(base + i);
+                changed_here += changed_flags[base + i];
+            }
+
+            // Sorted by value is sorted by the epoch the token was made in
+            std::sort(values.begin(), values.end());
+            auto age = [&](uint64_t value) {
+                uint64_t made = value >> 24;
+                return made >= static_cast<uint64_t>(current.epoch) ? 0.0
+                                                                    : static_cast<double>(current.epoch - made);
+            };
+
+            CellLineage& out = stats[cell];
+            double age_sum = 0.0;
+            size_t primordial = 0;
+            double copies_sum = 0.0;
+            for (int i = 0; i < program_size;) {
+                int run = 1;
+                while (i + run < program_size && values[i + run] == values[i]) {
+                    run++;
+                }
+                uint32_t grid_copies =
+                    copies[std::lower_bound(unique_tokens.begin(), unique_tokens.end(), values[i]) -
+                           unique_tokens.begin()];
+                double p = static_cast<double>(run) / program_size;
+
+                out.distinct_origins++;
+                out.origin_entropy -= p * std::log2(p);
+                out.max_copies = std::max(out.max_copies, grid_copies);
+                copies_sum += static_cast<double>(grid_copies) * run;
+                age_sum += age(values[i]) * run;
+                if ((values[i] >> 24) == 0) {
+                    primordial += run;
+                }
+                i += run;
+            }
+
+            // Ages run from the oldest token down
+            int middle = program_size / 2;
+            out.median_age = (program_size % 2 == 1) ? age(values[middle])
+                                                     : (age(values[middle - 1]) + age(values[middle])) / 2.0;
+            out.max_age = static_cast<uint32_t>(age(values[0]));
+            out.mean_age = age_sum / program_size;
+            out.primordial_fraction = static_cast<double>(primordial) / program_size;
+            out.mean_copies = copies_sum / program_size;
+            out.churn = static_cast<double>(changed_here) / program_size;
+        }
+    };
+    if (pool && program_size > 0) {
+        pool->parallel_for(total_programs, 0, cell_stats);
+    } else if (program_size > 0) {
+        cell_stats(0, total_programs);
+    }
+}
+
+void TokenLineage::save_csv(const std::string& filepath) const {
+    std::ofstream file(filepath);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open lineage file: " + filepath);
+    }
+
+    file << "epoch,grid_x,grid_y,mean_age,median_age,max_age,primordial_fraction,distinct_origins,"
+            "origin_entropy,mean_copies,max_copies,churn\n";
+    for (size_t cell = 0; cell < stats.size(); cell++) {
+        const CellLineage& s = stats[cell];
+        file << current.epoch << "," << cell % width << "," << cell / width << ","
+             << s.mean_age << "," << s.median_age << "," << s.max_age << ","
+             << s.primordial_fraction << "," << s.distinct_origins << ","
+             << s.origin_entropy << "," << s.mean_copies << "," << s.max_copies << ","
+             << s.churn << "\n";
+    }
+
+    if (!file) {
+        throw std::runtime_error("Failed to write lineage file: " + filepath);
+    }
+    profile_count(ProfileCounter::BytesWritten, static_cast<uint64_t>(file.tellp()));
+}
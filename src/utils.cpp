@@ -1,4 +1,5 @@
 #include "utils.h"
+#include <cmath>
 #include <iostream>
 #include <random>
 #include <cctype>
@@ -135,3 +136,73 @@ std::vector<uint8_t> mutate(
 
     return tape;
 }
+
+void mutate_in_place(uint8_t* program, int length, double mutation_rate) {
+    if (mutation_rate == 0.0) {
+        return;
+    }
+
+    mutate_in_place(program, length, mutation_rate, get_rng());
+}
+
+void mutate_in_place(
+    uint8_t* program,
+    int length,
+    double mutation_rate,
+    std::mt19937& custom_rng
+) {
+    if (mutation_rate == 0.0) {
+        return;
+    }
+
+    std::uniform_real_distribution<> dis(0.0, 1.0);
+    std::uniform_int_distribution<> byte_dis(0, 255);
+
+    for (int i = 0; i < length; i++) {
+        if (dis(custom_rng) < mutation_rate) {
+            program[i] = static_cast<uint8_t>(byte_dis(custom_rng));
+        }
+    }
+}
+
+void generate_random_program(uint8_t* program, int length, CounterRng& counter_rng) {
+    for (int i = 0; i < length; i++) {
+        program[i] = counter_rng.next_byte();
+    }
+}
+
+void mutate_in_place(
+    uint8_t* program,
+    int length,
+    double mutation_rate,
+    CounterRng& counter_rng
+) {
+    if (mutation_rate <= 0.0) {
+        return;
+    }
+
+    if (mutation_rate >= 1.0) {
+        generate_random_program(program, length, counter_rng);
+        return;
+    }
+
+    // Gap to the next mutated byte is geometric with p = mutation_rate
+    double log_q = std::log1p(-mutation_rate);
+    uint64_t pos = counter_rng.next_geometric(log_q);
+    while (pos < static_cast<uint64_t>(length)) {
+        program[pos] = counter_rng.next_byte();
+        uint64_t skip = counter_rng.next_geometric(log_q);
+        if (skip >= static_cast<uint64_t>(length)) {
+            break;
+        }
+        pos += skip + 1;
+    }
+}
+
+std::string shell_quote(const std::string& text) {
+    std::string quoted = "'";
+    for (char ch : text) {
+        quoted += (ch == '\'') ? std::string("'\\''") : std::string(1, ch);
+    }
+    return quoted + "'";
+}
@@ -0,0 +1,72 @@
+#include "video_pipe.h"
+#include "profiler.h"
+#include "utils.h"
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+    #define popen _popen
+    #define pclose _pclose
+#else
+    #include <csignal>
+    #include <sys/wait.h>
+#endif
+
+VideoPipe::VideoPipe(const std::string& command, int width, int height)
+    : pipe(nullptr), width(width), height(height), frames(0), failed(false) {
+    if (width <= 0 || height <= 0) {
+        throw std::runtime_error("Video frames must have a positive size");
+    }
+#ifndef _WIN32
+    // An encoder that exits early must not take the simulation with it
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+#ifdef _WIN32
+    pipe = popen(command.c_str(), "wb");
+#else
+    pipe = popen(command.c_str(), "w");
+#endif
+    if (!pipe) {
+        throw std::runtime_error("Could not start video encoder: " + command);
+    }
+}
+
+VideoPipe::~VideoPipe() {
+    close();
+}
+
+bool VideoPipe::write(const std::vector<uint8_t>& pixels) {
+    if (!pipe || failed) {
+        return false;
+    }
+    if (pixels.size() != static_cast<size_t>(width) * height * 3) {
+        throw std::runtime_error("Video frame does not match the video size");
+    }
+    if (std::fwrite(pixels.data(), 1, pixels.size(), pipe) != pixels.size()) {
+        failed = true;
+        return false;
+    }
+    profile_count(ProfileCounter::BytesWritten, pixels.size());
+    frames++;
+    return true;
+}
+
+bool VideoPipe::close() {
+    if (!pipe) {
+        return false;
+    }
+    int status = pclose(pipe);
+    pipe = nullptr;
+#ifdef _WIN32
+    return !failed && status == 0;
+#else
+    return !failed && status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
+
+std::string VideoPipe::ffmpeg_command(const std::string& output, int width, int height, int fps) {
+    std::ostringstream command;
+    command << "ffmpeg -loglevel error -y -f rawvideo -pix_fmt rgb24 -s " << width << "x" << height
+            << " -framerate " << fps << " -i - -c:v libx264 -pix_fmt yuv420p -crf 23 " << shell_quote(output);
+    return command.str();
+}
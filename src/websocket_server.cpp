@@ -2,7 +2,11 @@
 #include <iostream>
 #include <sstream>
 #include <cstring>
+#include <cerrno>
+#include <chrono>
 #include <algorithm>
+#include <cctype>
+#include <zlib.h>
 
 // Platform-specific includes
 #ifdef _WIN32
@@ -10,12 +14,23 @@
     #include <ws2tcpip.h>
     #pragma comment(lib, "ws2_32.lib")
     #define close closesocket
+    #define poll WSAPoll
 #else
     #include <sys/socket.h>
     #include <netinet/in.h>
     #include <unistd.h>
     #include <fcntl.h>
     #include <arpa/inet.h>
+    #if defined(__linux__)
+        #include <sys/epoll.h>
+    #elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+        #include <sys/event.h>
+    #else
+        #include <poll.h>
+    #endif
+#endif
+#ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL 0
 #endif
 
 // SHA1 and Base64 for WebSocket handshake
@@ -43,76 +58,263 @@ static std::string base64_encode(const unsigned char* input, int length) {
     return result;
 }
 
-WebSocketServer::WebSocketServer(int port)
-    : port(port), server_socket(-1), running(false), paused(false) {
+namespace {
+
+constexpr size_t MAX_HANDSHAKE = 8192;
+// Messages shorter than this are not worth compressing
+constexpr size_t MIN_DEFLATE_SIZE = 128;
+// The tail every Z_SYNC_FLUSH leaves, dropped from permessage-deflate messages
+constexpr uint8_t DEFLATE_TAIL[4] = {0x00, 0x00, 0xff, 0xff};
+
+void set_nonblocking(int sock) {
+#ifdef _WIN32
+    u_long mode = 1;
+    ioctlsocket(sock, FIONBIO, &mode);
+#else
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
 }
 
-WebSocketServer::~WebSocketServer() {
-    stop();
+// Where MSG_NOSIGNAL is missing (macOS, BSD), writes to a peer that has
+// gone raise SIGPIPE unless the socket itself is told not to
+void set_nosigpipe(int sock) {
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+    (void)sock;
+#endif
 }
 
-void WebSocketServer::start() {
-    if (running) return;
+bool would_block() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
 
-    running = true;
-    server_thread_handle = std::thread(&WebSocketServer::server_thread, this);
+std::string lowercase(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+    return text;
 }
 
-void WebSocketServer::stop() {
-    if (!running) return;
+// Value of an HTTP header (name matched case-insensitively), or "" if absent
+std::string header_value(const std::string& request, const std::string& name) {
+    std::string wanted = lowercase(name) + ":";
+    std::istringstream lines(request);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (lowercase(line.substr(0, wanted.size())) == wanted) {
+            size_t start = line.find_first_not_of(" \t", wanted.size());
+            return start == std::string::npos ? "" : line.substr(start);
+        }
+    }
+    return "";
+}
 
-    running = false;
+} // namespace
 
-    // Close all client sockets
-    {
-        std::lock_guard<std::mutex> lock(clients_mutex);
-        for (int sock : client_sockets) {
-            close(sock);
+// Readiness of the listening socket, the wake pipe and every client
+struct WebSocketServer::Poller {
+    struct Event {
+        int fd;
+        bool readable;
+        bool writable;
+        bool error;
+    };
+
+#if defined(__linux__)
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    ~Poller() { close(epoll_fd); }
+
+    void add(int fd) {
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    void set_writing(int fd, bool writing) {
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        if (writing) {
+            event.events |= EPOLLOUT;
         }
-        client_sockets.clear();
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
     }
 
-    // Close server socket
-    if (server_socket >= 0) {
-        close(server_socket);
-        server_socket = -1;
+    void remove(int fd) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
     }
 
-    // Wait for server thread to finish
-    if (server_thread_handle.joinable()) {
-        server_thread_handle.join();
+    std::vector<Event> wait(int timeout_ms) {
+        struct epoll_event ready[64];
+        int count = epoll_wait(epoll_fd, ready, 64, timeout_ms);
+        std::vector<Event> events;
+        for (int i = 0; i < count; i++) {
+            events.push_back({ready[i].data.fd, (ready[i].events & EPOLLIN) != 0, (ready[i].events & EPOLLOUT) != 0,
+                              (ready[i].events & (EPOLLERR | EPOLLHUP)) != 0});
+        }
+        return events;
     }
-}
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    int kqueue_fd = kqueue();
 
-void WebSocketServer::broadcast(const std::string& message) {
-    std::vector<uint8_t> frame = create_websocket_frame(message);
+    ~Poller() { close(kqueue_fd); }
 
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    auto it = client_sockets.begin();
-    while (it != client_sockets.end()) {
-        int sock = *it;
-        ssize_t sent = send(sock, frame.data(), frame.size(), 0);
-        if (sent <= 0) {
-            // Client disconnected
-            close(sock);
-            it = client_sockets.erase(it);
-        } else {
-            ++it;
+    void add(int fd) {
+        struct kevent change;
+        EV_SET(&change, fd, EVFILT_READ, EV_ADD, 0, 0, nullptr);
+        kevent(kqueue_fd, &change, 1, nullptr, 0, nullptr);
+    }
+
+    void set_writing(int fd, bool writing) {
+        struct kevent change;
+        EV_SET(&change, fd, EVFILT_WRITE, writing ? EV_ADD | EV_ENABLE : EV_DELETE, 0, 0, nullptr);
+        kevent(kqueue_fd, &change, 1, nullptr, 0, nullptr);
+    }
+
+    void remove(int) {
+        // Closing the socket removes its filters
+    }
+
+    std::vector<Event> wait(int timeout_ms) {
+        struct kevent ready[64];
+        struct timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+        int count = kevent(kqueue_fd, nullptr, 0, ready, 64, timeout_ms < 0 ? nullptr : &timeout);
+        std::vector<Event> events;
+        for (int i = 0; i < count; i++) {
+            events.push_back({static_cast<int>(ready[i].ident), ready[i].filter == EVFILT_READ,
+                              ready[i].filter == EVFILT_WRITE, (ready[i].flags & EV_ERROR) != 0});
         }
+        return events;
     }
-}
+#else
+    std::vector<struct pollfd> fds;
 
-bool WebSocketServer::has_clients() const {
-    std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(clients_mutex));
-    return !client_sockets.empty();
+    void add(int fd) {
+        fds.push_back({fd, POLLIN, 0});
+    }
+
+    void set_writing(int fd, bool writing) {
+        for (struct pollfd& entry : fds) {
+            if (entry.fd == fd) {
+                entry.events = POLLIN | (writing ? POLLOUT : 0);
+            }
+        }
+    }
+
+    void remove(int fd) {
+        fds.erase(std::remove_if(fds.begin(), fds.end(), [fd](const struct pollfd& entry) { return entry.fd == fd; }),
+                  fds.end());
+    }
+
+    std::vector<Event> wait(int timeout_ms) {
+        std::vector<Event> events;
+        if (poll(fds.data(), fds.size(), timeout_ms) > 0) {
+            for (const struct pollfd& entry : fds) {
+                if (entry.revents != 0) {
+                    events.push_back({static_cast<int>(entry.fd), (entry.revents & POLLIN) != 0,
+                                      (entry.revents & POLLOUT) != 0,
+                                      (entry.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0});
+                }
+            }
+        }
+        return events;
+    }
+#endif
+};
+
+// Raw deflate for permessage-deflate, reset for every message
+struct WebSocketServer::Codec {
+    z_stream deflater = {};
+    z_stream inflater = {};
+
+    Codec() {
+        deflateInit2(&deflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+        inflateInit2(&inflater, -MAX_WBITS);
+    }
+
+    ~Codec() {
+        deflateEnd(&deflater);
+        inflateEnd(&inflater);
+    }
+
+    // The compressed payload of a message, without its deflate tail
+    bool compress(const std::vector<uint8_t>& input, std::vector<uint8_t>& output) {
+        deflateReset(&deflater);
+        output.resize(deflateBound(&deflater, input.size()) + 16);
+        deflater.next_in = const_cast<Bytef*>(input.data());
+        deflater.avail_in = static_cast<uInt>(input.size());
+        size_t used = 0;
+        while (true) {
+            deflater.next_out = output.data() + used;
+            deflater.avail_out = static_cast<uInt>(output.size() - used);
+            int result = deflate(&deflater, Z_SYNC_FLUSH);
+            if (result != Z_OK && result != Z_BUF_ERROR) {
+                return false;
+            }
+            used = output.size() - deflater.avail_out;
+            if (deflater.avail_out != 0) {
+                break;
+            }
+            output.resize(output.size() * 2);
+        }
+        if (used < sizeof(DEFLATE_TAIL) || std::memcmp(output.data() + used - 4, DEFLATE_TAIL, 4) != 0) {
+            return false;
+        }
+        output.resize(used - sizeof(DEFLATE_TAIL));
+        return true;
+    }
+
+    // Decompress a client message; false if it is corrupt or over limit bytes
+    bool decompress(const std::vector<uint8_t>& input, std::vector<uint8_t>& output, size_t limit) {
+        inflateReset(&inflater);
+        std::vector<uint8_t> data(input);
+        data.insert(data.end(), DEFLATE_TAIL, DEFLATE_TAIL + sizeof(DEFLATE_TAIL));
+        inflater.next_in = data.data();
+        inflater.avail_in = static_cast<uInt>(data.size());
+        output.clear();
+        uint8_t chunk[4096];
+        while (true) {
+            inflater.next_out = chunk;
+            inflater.avail_out = sizeof(chunk);
+            int result = inflate(&inflater, Z_SYNC_FLUSH);
+            if (result != Z_OK && result != Z_BUF_ERROR && result != Z_STREAM_END) {
+                return false;
+            }
+            output.insert(output.end(), chunk, chunk + (sizeof(chunk) - inflater.avail_out));
+            if (output.size() > limit) {
+                return false;
+            }
+            if (result == Z_STREAM_END || (inflater.avail_in == 0 && inflater.avail_out != 0)) {
+                return true;
+            }
+            if (result == Z_BUF_ERROR && inflater.avail_out != 0) {
+                return false;
+            }
+        }
+    }
+};
+
+WebSocketServer::WebSocketServer(int port)
+    : port(port), server_socket(-1), wake_read(-1), wake_write(-1), running(false), paused(false),
+      wake_pending(false), total_bytes_sent(0) {
 }
 
-int WebSocketServer::get_client_count() const {
-    std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(clients_mutex));
-    return client_sockets.size();
+WebSocketServer::~WebSocketServer() {
+    stop();
 }
 
-void WebSocketServer::server_thread() {
+void WebSocketServer::start() {
+    if (running) return;
+
     // Create socket
     server_socket = socket(AF_INET, SOCK_STREAM, 0);
     if (server_socket < 0) {
@@ -122,18 +324,12 @@ void WebSocketServer::server_thread() {
 
     // Set socket options
     int opt = 1;
-    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-    // Set non-blocking mode
-#ifdef _WIN32
-    u_long mode = 1;
-    ioctlsocket(server_socket, FIONBIO, &mode);
-#else
-    fcntl(server_socket, F_SETFL, O_NONBLOCK);
-#endif
+    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&opt), sizeof(opt));
+    set_nonblocking(server_socket);
 
     // Bind socket
     struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port);
@@ -141,118 +337,594 @@ void WebSocketServer::server_thread() {
     if (bind(server_socket, (struct sockaddr*)&address, sizeof(address)) < 0) {
         std::cerr << "Failed to bind to port " << port << std::endl;
         close(server_socket);
+        server_socket = -1;
         return;
     }
 
     // Listen
-    if (listen(server_socket, 5) < 0) {
+    if (listen(server_socket, 64) < 0) {
         std::cerr << "Failed to listen on socket" << std::endl;
         close(server_socket);
+        server_socket = -1;
         return;
     }
 
+    poller = std::make_unique<Poller>();
+    codec = std::make_unique<Codec>();
+    poller->add(server_socket);
+
+    // Broadcasts wake the loop through a pipe (Windows falls back to a short
+    // poll timeout); a socket pair where SO_NOSIGPIPE exists, since a pipe
+    // cannot be kept from raising SIGPIPE
+#ifndef _WIN32
+    int pipe_fds[2];
+#ifdef SO_NOSIGPIPE
+    int made = socketpair(AF_UNIX, SOCK_STREAM, 0, pipe_fds);
+#else
+    int made = pipe(pipe_fds);
+#endif
+    if (made == 0) {
+        wake_read = pipe_fds[0];
+        wake_write = pipe_fds[1];
+        set_nonblocking(wake_read);
+        set_nonblocking(wake_write);
+        set_nosigpipe(wake_write);
+        poller->add(wake_read);
+    }
+#endif
+
     std::cout << "WebSocket server listening on port " << port << std::endl;
 
-    // Accept connections
-    while (running) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        int client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &client_len);
+    running = true;
+    loop_thread_handle = std::thread(&WebSocketServer::event_loop, this);
+}
 
-        if (client_socket >= 0) {
-            std::thread(&WebSocketServer::handle_client, this, client_socket).detach();
-        } else {
-            // No connection pending, sleep briefly
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+void WebSocketServer::stop() {
+    if (!running) return;
+
+    running = false;
+    wake();
+    if (loop_thread_handle.joinable()) {
+        loop_thread_handle.join();
+    }
+}
+
+void WebSocketServer::wake() {
+#ifndef _WIN32
+    if (wake_write >= 0 && !wake_pending.exchange(true)) {
+        char byte = 1;
+        ssize_t written = write(wake_write, &byte, 1);
+        (void)written;
+    }
+#endif
+}
+
+WebSocketServer::MessagePtr WebSocketServer::make_message(const uint8_t* payload, size_t size, uint8_t opcode,
+                                                          bool compressible) {
+    MessagePtr message = std::make_shared<Message>();
+    message->payload.assign(payload, payload + size);
+    message->opcode = opcode;
+    message->compressible = compressible && size >= MIN_DEFLATE_SIZE;
+    return message;
+}
+
+void WebSocketServer::broadcast(const std::string& message) {
+    // Opcode 1: text frame
+    MessagePtr text = make_message(reinterpret_cast<const uint8_t*>(message.data()), message.size(), 0x1, true);
+
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        if (clients.empty()) {
+            return;
+        }
+        for (auto& [sock, client] : clients) {
+            enqueue(client, text);
         }
     }
+    wake();
 }
 
-void WebSocketServer::handle_client(int client_socket) {
-    // Read HTTP request
-    char buffer[4096];
-    ssize_t bytes_read = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
+void WebSocketServer::broadcast_frame(const std::vector<uint8_t>& keyframe, const std::vector<uint8_t>& delta) {
+    // Opcode 2: binary frame
+    MessagePtr key, changes;
+    if (!keyframe.empty()) {
+        key = make_message(keyframe.data(), keyframe.size(), 0x2, true);
+    }
+    if (!delta.empty()) {
+        changes = make_message(delta.data(), delta.size(), 0x2, true);
+    }
 
-    if (bytes_read <= 0) {
-        close(client_socket);
-        return;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        for (auto& [sock, client] : clients) {
+            if (client.needs_keyframe || !changes) {
+                // A client without a keyframe waits for the next one
+                if (key && enqueue(client, key)) {
+                    client.needs_keyframe = false;
+                } else {
+                    client.needs_keyframe = true;
+                }
+            } else if (!enqueue(client, changes)) {
+                // A dropped delta breaks the chain until the next keyframe
+                client.needs_keyframe = true;
+            }
+        }
     }
+    wake();
+}
 
-    buffer[bytes_read] = '\0';
-    std::string request(buffer);
+void WebSocketServer::broadcast_profile(const std::string& message) {
+    MessagePtr text = make_message(reinterpret_cast<const uint8_t*>(message.data()), message.size(), 0x1, true);
 
-    // Check if it's a WebSocket upgrade request
-    if (request.find("Upgrade: websocket") != std::string::npos) {
-        // Extract Sec-WebSocket-Key
-        size_t key_pos = request.find("Sec-WebSocket-Key: ");
-        if (key_pos != std::string::npos) {
-            key_pos += 19;
-            size_t key_end = request.find("\r\n", key_pos);
-            std::string key = request.substr(key_pos, key_end - key_pos);
-
-            // Send handshake response
-            std::string response = create_handshake_response(key);
-            send(client_socket, response.c_str(), response.length(), 0);
-
-            // Add to client list
-            {
-                std::lock_guard<std::mutex> lock(clients_mutex);
-                client_sockets.push_back(client_socket);
-                std::cout << "WebSocket client connected (" << client_sockets.size() << " total)" << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        for (auto& [sock, client] : clients) {
+            if (client.profile) {
+                enqueue(client, text);
             }
+        }
+    }
+    wake();
+}
 
-            // Keep reading messages from client
-            while (running) {
-                std::vector<uint8_t> frame_buffer(4096);
-                ssize_t bytes = recv(client_socket, frame_buffer.data(), frame_buffer.size(), 0);
+void WebSocketServer::set_metrics(const std::string& text) {
+    std::lock_guard<std::mutex> lock(metrics_mutex);
+    metrics = text;
+}
 
-                if (bytes <= 0) {
-                    // Client disconnected
-                    break;
-                }
+uint64_t WebSocketServer::bytes_sent() const {
+    return total_bytes_sent.load(std::memory_order_relaxed);
+}
 
-                frame_buffer.resize(bytes);
-                std::string message = parse_websocket_frame(frame_buffer);
-
-                if (!message.empty()) {
-                    // Handle command
-                    if (message == "pause") {
-                        paused = true;
-                        std::cout << "Simulation paused by client" << std::endl;
-                    } else if (message == "play") {
-                        paused = false;
-                        std::cout << "Simulation resumed by client" << std::endl;
-                    }
+bool WebSocketServer::wants_keyframe() const {
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    for (const auto& [sock, client] : clients) {
+        if (client.needs_keyframe) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WebSocketServer::enqueue(Client& client, const MessagePtr& message) {
+    if (client.closing || client.queue.size() >= MAX_QUEUED_FRAMES) {
+        return false;
+    }
+    client.queue.push_back(message);
+    return true;
+}
+
+bool WebSocketServer::has_clients() const {
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    return !clients.empty();
+}
+
+int WebSocketServer::get_client_count() const {
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    return clients.size();
+}
+
+void WebSocketServer::event_loop() {
+    std::vector<std::string> commands;
+    std::chrono::steady_clock::time_point deadline;
+    bool stopping = false;
+
+    while (true) {
+        int timeout_ms = (stopping || wake_read < 0) ? 50 : -1;
+        std::vector<Poller::Event> events = poller->wait(timeout_ms);
+
+        commands.clear();
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex);
+
+            if (!running && !stopping) {
+                // Give the last messages a moment to reach their clients
+                stopping = true;
+                deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+            }
 
-                    // Invoke callback if set
-                    {
-                        std::lock_guard<std::mutex> lock(callback_mutex);
-                        if (command_callback) {
-                            command_callback(message);
-                        }
+            std::vector<int> dropped;
+            std::vector<int> writable;
+            for (const Poller::Event& event : events) {
+                if (event.fd == server_socket) {
+                    if (!stopping) {
+                        accept_clients();
                     }
+                } else if (event.fd == wake_read) {
+#ifndef _WIN32
+                    char drain[64];
+                    while (read(wake_read, drain, sizeof(drain)) > 0) {
+                    }
+#endif
+                    wake_pending = false;
+                } else if (handshakes.count(event.fd)) {
+                    if (read_handshake(event.fd, handshakes[event.fd])) {
+                        handshakes.erase(event.fd);
+                    }
+                } else if (clients.count(event.fd)) {
+                    Client& client = clients[event.fd];
+                    if (event.readable && !read_client(client, event.fd, commands)) {
+                        dropped.push_back(event.fd);
+                    } else if (event.error && !event.readable) {
+                        dropped.push_back(event.fd);
+                    } else if (event.writable) {
+                        writable.push_back(event.fd);
+                    }
+                }
+            }
+
+            // Write every queue that has something and a socket that may take it
+            for (auto& [sock, client] : clients) {
+                if (std::find(dropped.begin(), dropped.end(), sock) != dropped.end()) {
+                    continue;
+                }
+                bool may_write = !client.writing ||
+                                 std::find(writable.begin(), writable.end(), sock) != writable.end();
+                if (!client.queue.empty() && may_write && !write_client(client, sock)) {
+                    dropped.push_back(sock);
+                    continue;
+                }
+                if (client.queue.empty() && client.closing) {
+                    dropped.push_back(sock);
+                    continue;
+                }
+                bool want_write = !client.queue.empty();
+                if (want_write != client.writing) {
+                    poller->set_writing(sock, want_write);
+                    client.writing = want_write;
                 }
             }
 
-            // Remove client from list
-            {
-                std::lock_guard<std::mutex> lock(clients_mutex);
-                auto it = std::find(client_sockets.begin(), client_sockets.end(), client_socket);
-                if (it != client_sockets.end()) {
-                    client_sockets.erase(it);
-                    std::cout << "WebSocket client disconnected (" << client_sockets.size() << " remaining)" << std::endl;
+            for (int sock : dropped) {
+                if (clients.erase(sock) > 0) {
+                    close_socket(sock);
+                    std::cout << "WebSocket client disconnected (" << clients.size() << " remaining)" << std::endl;
                 }
             }
-            close(client_socket);
+
+            if (stopping) {
+                bool drained = std::all_of(clients.begin(), clients.end(),
+                                           [](const auto& entry) { return entry.second.queue.empty(); });
+                if (drained || std::chrono::steady_clock::now() >= deadline) {
+                    break;
+                }
+            }
+        }
+
+        // Commands run outside the lock, so the callback may broadcast
+        if (!commands.empty()) {
+            std::lock_guard<std::mutex> lock(callback_mutex);
+            if (command_callback) {
+                for (const std::string& command : commands) {
+                    command_callback(command);
+                }
+            }
+        }
+    }
+
+    // Close all client sockets
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        for (const auto& [sock, client] : clients) {
+            close_socket(sock);
+        }
+        clients.clear();
+    }
+    for (const auto& [sock, request] : handshakes) {
+        close_socket(sock);
+    }
+    handshakes.clear();
+
+    // Close server socket and the wake pipe
+    close_socket(server_socket);
+    server_socket = -1;
+#ifndef _WIN32
+    if (wake_read >= 0) {
+        close_socket(wake_read);
+        close(wake_write);
+        wake_read = wake_write = -1;
+    }
+#endif
+    wake_pending = false;
+}
+
+void WebSocketServer::close_socket(int sock) {
+    poller->remove(sock);
+    close(sock);
+}
+
+void WebSocketServer::accept_clients() {
+    while (true) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &client_len);
+        if (client_socket < 0) {
+            return;
+        }
+        set_nonblocking(client_socket);
+        set_nosigpipe(client_socket);
+        handshakes[client_socket] = std::string();
+        poller->add(client_socket);
+    }
+}
+
+bool WebSocketServer::read_handshake(int sock, std::string& request) {
+    char buffer[4096];
+    while (true) {
+        ssize_t bytes_read = recv(sock, buffer, sizeof(buffer), 0);
+        if (bytes_read > 0) {
+            request.append(buffer, bytes_read);
+            if (request.size() > MAX_HANDSHAKE) {
+                break;
+            }
+        } else if (bytes_read < 0 && would_block()) {
+            break;
+        } else {
+            close_socket(sock);
+            return true;
+        }
+    }
+
+    size_t end = request.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        if (request.size() <= MAX_HANDSHAKE) {
+            return false;
+        }
+        close_socket(sock);
+        return true;
+    }
+
+    // Check if it's a WebSocket upgrade request
+    std::string upgrade = lowercase(header_value(request, "Upgrade"));
+    std::string key = header_value(request, "Sec-WebSocket-Key");
+    if (upgrade.find("websocket") == std::string::npos || key.empty()) {
+        // Not a WebSocket connection: an HTTP request, answered and closed
+        serve_http(sock, request);
+        close_socket(sock);
+        return true;
+    }
+
+    // Take permessage-deflate unless the client limits our window, which
+    // would keep its messages from being shared with other clients
+    std::string extensions = lowercase(header_value(request, "Sec-WebSocket-Extensions"));
+    bool deflate = extensions.find("permessage-deflate") != std::string::npos &&
+                   extensions.find("server_max_window_bits") == std::string::npos;
+
+    // The response goes out ahead of any frame
+    Client client;
+    client.deflate = deflate;
+    std::string response = create_handshake_response(key, deflate);
+    MessagePtr handshake = std::make_shared<Message>();
+    handshake->plain.assign(response.begin(), response.end());
+    client.queue.push_back(handshake);
+
+    // Bytes after the request are the first frames
+    client.input.assign(request.begin() + end + 4, request.end());
+
+    clients[sock] = std::move(client);
+    std::cout << "WebSocket client connected (" << clients.size() << " total)" << std::endl;
+    return true;
+}
+
+void WebSocketServer::serve_http(int sock, const std::string& request) {
+    std::string body;
+    std::string status = "200 OK";
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 13, "GET /metrics?") == 0) {
+        std::lock_guard<std::mutex> lock(metrics_mutex);
+        body = metrics;
+    } else {
+        status = "404 Not Found";
+        body = "Not found\n";
+    }
+
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\n";
+    response << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+    response << "Content-Length: " << body.size() << "\r\n";
+    response << "Connection: close\r\n";
+    response << "\r\n";
+    response << body;
+
+    // A fresh socket's send buffer takes a metrics page whole, so there is
+    // no queue here: what the socket does not take is dropped
+    std::string text = response.str();
+    size_t sent = 0;
+    while (sent < text.size()) {
+        ssize_t bytes = send(sock, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (bytes <= 0) {
+            break;
+        }
+        sent += static_cast<size_t>(bytes);
+    }
+    total_bytes_sent.fetch_add(sent, std::memory_order_relaxed);
+}
+
+bool WebSocketServer::read_client(Client& client, int sock, std::vector<std::string>& commands) {
+    uint8_t buffer[4096];
+    while (true) {
+        ssize_t bytes = recv(sock, reinterpret_cast<char*>(buffer), sizeof(buffer), 0);
+        if (bytes > 0) {
+            client.input.insert(client.input.end(), buffer, buffer + bytes);
+            if (client.input.size() > 2 * MAX_CLIENT_MESSAGE) {
+                return false;
+            }
+        } else if (bytes < 0 && would_block()) {
+            break;
+        } else {
+            // Client disconnected
+            return false;
+        }
+    }
+
+    // Parse every complete frame
+    std::vector<uint8_t>& input = client.input;
+    size_t pos = 0;
+    while (input.size() - pos >= 2) {
+        const uint8_t* frame = input.data() + pos;
+        size_t available = input.size() - pos;
+        bool fin = (frame[0] & 0x80) != 0;
+        bool compressed = (frame[0] & 0x40) != 0;
+        uint8_t opcode = frame[0] & 0x0F;
+        bool masked = (frame[1] & 0x80) != 0;
+        uint64_t payload_len = frame[1] & 0x7F;
+        size_t header = 2;
+
+        // Extended payload length
+        if (payload_len == 126) {
+            if (available < 4) break;
+            payload_len = (frame[2] << 8) | frame[3];
+            header = 4;
+        } else if (payload_len == 127) {
+            if (available < 10) break;
+            payload_len = 0;
+            for (int i = 0; i < 8; i++) {
+                payload_len = (payload_len << 8) | frame[2 + i];
+            }
+            header = 10;
+        }
+        if (payload_len > MAX_CLIENT_MESSAGE) {
+            return false;
+        }
+
+        // Masking key (if masked)
+        uint8_t mask[4] = {0};
+        if (masked) {
+            if (available < header + 4) break;
+            std::memcpy(mask, frame + header, 4);
+            header += 4;
+        }
+        if (available < header + payload_len) break;
+
+        // Decode payload
+        std::vector<uint8_t> payload(frame + header, frame + header + payload_len);
+        if (masked) {
+            for (size_t i = 0; i < payload.size(); i++) {
+                payload[i] ^= mask[i % 4];
+            }
+        }
+        pos += header + payload_len;
+
+        if (opcode >= 0x8) {
+            // Control frames may arrive between the fragments of a message
+            handle_message(client, opcode, payload, false, commands);
+        } else if (opcode != 0x0 && !client.in_message) {
+            if (fin) {
+                handle_message(client, opcode, payload, compressed && client.deflate, commands);
+            } else {
+                client.message = std::move(payload);
+                client.message_compressed = compressed && client.deflate;
+                client.in_message = true;
+            }
+        } else if (opcode == 0x0 && client.in_message) {
+            client.message.insert(client.message.end(), payload.begin(), payload.end());
+            if (client.message.size() > MAX_CLIENT_MESSAGE) {
+                return false;
+            }
+            if (fin) {
+                client.in_message = false;
+                handle_message(client, 0x1, client.message, client.message_compressed, commands);
+                client.message.clear();
+            }
+        } else {
+            // A continuation without a start or a start inside a message
+            return false;
+        }
+    }
+    input.erase(input.begin(), input.begin() + pos);
+    return true;
+}
+
+void WebSocketServer::handle_message(Client& client, uint8_t opcode, std::vector<uint8_t>& payload, bool compressed,
+                                     std::vector<std::string>& commands) {
+    if (opcode == 0x8) {
+        // Close: answer with a close frame, then drop the client
+        if (!client.closing) {
+            client.queue.push_back(make_message(payload.data(), std::min<size_t>(payload.size(), 2), 0x8, false));
+            client.closing = true;
+        }
+        return;
+    }
+    if (opcode == 0x9) {
+        // Ping: pong with the same payload
+        if (!client.closing) {
+            client.queue.push_back(make_message(payload.data(), payload.size(), 0xA, false));
+        }
+        return;
+    }
+    if (opcode != 0x1 || client.closing) {
+        // Pongs and binary messages carry no commands
+        return;
+    }
+
+    std::vector<uint8_t> text;
+    if (compressed) {
+        if (!codec->decompress(payload, text, MAX_CLIENT_MESSAGE)) {
+            client.closing = true;
             return;
         }
+    } else {
+        text.swap(payload);
+    }
+    std::string message(text.begin(), text.end());
+    if (message.empty()) {
+        return;
     }
 
-    // Not a WebSocket connection, close it
-    close(client_socket);
+    // Handle command
+    if (message == "pause") {
+        paused = true;
+        std::cout << "Simulation paused by client" << std::endl;
+    } else if (message == "play") {
+        paused = false;
+        std::cout << "Simulation resumed by client" << std::endl;
+    } else if (message == "profile") {
+        client.profile = true;
+    }
+    commands.push_back(message);
 }
 
-std::string WebSocketServer::create_handshake_response(const std::string& key) {
+bool WebSocketServer::write_client(Client& client, int sock) {
+    while (!client.queue.empty()) {
+        const std::vector<uint8_t>& frame = wire_frame(*client.queue.front(), client.deflate);
+        ssize_t sent = send(sock, reinterpret_cast<const char*>(frame.data()) + client.sent,
+                            frame.size() - client.sent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            client.sent += static_cast<size_t>(sent);
+            total_bytes_sent.fetch_add(static_cast<uint64_t>(sent), std::memory_order_relaxed);
+            if (client.sent == frame.size()) {
+                client.queue.pop_front();
+                client.sent = 0;
+            }
+        } else if (sent < 0 && would_block()) {
+            return true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+const std::vector<uint8_t>& WebSocketServer::wire_frame(Message& message, bool deflate) {
+    if (deflate && message.compressible) {
+        if (!message.deflate_tried) {
+            message.deflate_tried = true;
+            std::vector<uint8_t> compressed;
+            if (codec->compress(message.payload, compressed) && compressed.size() < message.payload.size()) {
+                message.deflated =
+                    create_websocket_frame(compressed.data(), compressed.size(), message.opcode, true);
+            }
+        }
+        if (!message.deflated.empty()) {
+            return message.deflated;
+        }
+    }
+    if (message.plain.empty()) {
+        message.plain = create_websocket_frame(message.payload.data(), message.payload.size(), message.opcode, false);
+    }
+    return message.plain;
+}
+
+std::string WebSocketServer::create_handshake_response(const std::string& key, bool deflate) {
     const std::string magic = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
     std::string accept_key = key + magic;
 
@@ -269,19 +941,25 @@ std::string WebSocketServer::create_handshake_response(const std::string& key) {
     response << "Upgrade: websocket\r\n";
     response << "Connection: Upgrade\r\n";
     response << "Sec-WebSocket-Accept: " << accept << "\r\n";
+    if (deflate) {
+        response << "Sec-WebSocket-Extensions: permessage-deflate; server_no_context_takeover; "
+                    "client_no_context_takeover\r\n";
+    }
     response << "\r\n";
 
     return response.str();
 }
 
-std::vector<uint8_t> WebSocketServer::create_websocket_frame(const std::string& message) {
+std::vector<uint8_t> WebSocketServer::create_websocket_frame(const uint8_t* payload, size_t size, uint8_t opcode,
+                                                             bool compressed) {
     std::vector<uint8_t> frame;
+    frame.reserve(size + 10);
 
-    // Opcode: 1 (text frame), FIN: 1
-    frame.push_back(0x81);
+    // FIN: 1, RSV1 for a compressed message, then the opcode
+    frame.push_back(0x80 | (compressed ? 0x40 : 0x00) | opcode);
 
     // Payload length
-    size_t len = message.length();
+    size_t len = size;
     if (len <= 125) {
         frame.push_back(static_cast<uint8_t>(len));
     } else if (len <= 65535) {
@@ -296,7 +974,7 @@ std::vector<uint8_t> WebSocketServer::create_websocket_frame(const std::string&
     }
 
     // Payload data
-    frame.insert(frame.end(), message.begin(), message.end());
+    frame.insert(frame.end(), payload, payload + size);
 
     return frame;
 }
@@ -309,48 +987,3 @@ void WebSocketServer::set_command_callback(std::function<void(const std::string&
 bool WebSocketServer::is_paused() const {
     return paused;
 }
-
-std::string WebSocketServer::parse_websocket_frame(const std::vector<uint8_t>& frame) {
-    if (frame.size() < 2) return "";
-
-    // Check if message is masked (from client)
-    bool masked = (frame[1] & 0x80) != 0;
-    uint64_t payload_len = frame[1] & 0x7F;
-    size_t pos = 2;
-
-    // Extended payload length
-    if (payload_len == 126) {
-        if (frame.size() < 4) return "";
-        payload_len = (frame[2] << 8) | frame[3];
-        pos = 4;
-    } else if (payload_len == 127) {
-        if (frame.size() < 10) return "";
-        payload_len = 0;
-        for (int i = 0; i < 8; i++) {
-            payload_len = (payload_len << 8) | frame[2 + i];
-        }
-        pos = 10;
-    }
-
-    // Masking key (if masked)
-    uint8_t mask[4] = {0};
-    if (masked) {
-        if (frame.size() < pos + 4) return "";
-        for (int i = 0; i < 4; i++) {
-            mask[i] = frame[pos + i];
-        }
-        pos += 4;
-    }
-
-    // Decode payload
-    std::string message;
-    for (size_t i = 0; i < payload_len && (pos + i) < frame.size(); i++) {
-        if (masked) {
-            message += static_cast<char>(frame[pos + i] ^ mask[i % 4]);
-        } else {
-            message += static_cast<char>(frame[pos + i]);
-        }
-    }
-
-    return message;
-}